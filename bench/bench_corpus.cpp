@@ -0,0 +1,332 @@
+// End-to-end benchmark of the verifier over a corpus of ELF files.
+//
+// Every section of every file is verified with each domain, in a child process of its own, so that a crash or a
+// timeout only loses that section and the peak resident set size is the section's own. Each run is repeated after
+// a few untimed warmup runs; one CSV row per section and domain reports the verdict, the minimum and median analysis
+// time and the peak RSS. Given a baseline in the same format, rows whose median time grew beyond a threshold, or
+// whose verdict changed, are flagged, and the exit code is 1 if there is any. With --perf-counters, the row also
+// reports the median hardware events of the fixpoint (cycles, instructions, LLC misses and branch misses), as
+// perf_event_open counts them on the analyzing thread.
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "CLI11.hpp"
+
+#include "asm_files.hpp"
+#include "asm_unmarshal.hpp"
+#include "config.hpp"
+#include "crab/cfg.hpp"
+#include "crab/perf_counters.hpp"
+#include "crab/stats.hpp"
+#include "crab_verifier.hpp"
+#include "linux_verifier.hpp"
+
+namespace fs = std::filesystem;
+using std::string;
+using std::vector;
+
+// What a child process wrote, how it ended, and the peak resident set size it reached.
+struct child_result_t {
+    string output;
+    int status;
+    long peak_kb;
+};
+
+/** Run f in a child process killed after timeout seconds (none if 0), collecting what it writes to its stream. */
+static child_result_t run_in_child(unsigned timeout, const std::function<void(std::ostream&)>& f) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw std::runtime_error("pipe failed");
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        alarm(timeout);
+        std::ostringstream out;
+        int code = 0;
+        try {
+            f(out);
+        } catch (const std::exception& e) {
+            out.str("");
+            out << "error: " << e.what();
+            code = 1;
+        }
+        const string s = out.str();
+        for (size_t done = 0; done < s.size();) {
+            ssize_t n = write(fds[1], s.data() + done, s.size() - done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        _exit(code);
+    }
+    close(fds[1]);
+    child_result_t res{{}, 0, 0};
+    char buf[4096];
+    for (ssize_t n; (n = read(fds[0], buf, sizeof(buf))) > 0;)
+        res.output.append(buf, n);
+    close(fds[0]);
+    rusage ru{};
+    wait4(pid, &res.status, 0, &ru);
+    res.peak_kb = ru.ru_maxrss;
+    return res;
+}
+
+// The ELF files among paths and, recursively, in the directories among them, in a stable order.
+static vector<string> find_elf_files(const vector<string>& paths) {
+    vector<string> files;
+    for (const string& path : paths) {
+        if (!fs::is_directory(path)) {
+            files.push_back(path);
+            continue;
+        }
+        for (const auto& entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".o")
+                files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static MapFd* map_creator(const string& domain) { return domain == "linux" ? create_map_linux : create_map_crab; }
+
+// Verify raw_prog with domain, returning whether it passed and the CPU time of the analysis.
+static std::tuple<bool, double> verify(const raw_program& raw_prog, const string& domain) {
+    auto prog_or_error = unmarshal(raw_prog);
+    if (std::holds_alternative<string>(prog_or_error))
+        return {false, 0};
+    if (domain == "linux") {
+        const auto [res, seconds, wall_seconds] = bpf_verify_program(raw_prog.info.program_type, raw_prog.prog);
+        return {res, seconds};
+    }
+    cfg_t det_cfg = instruction_seq_to_cfg(std::get<InstructionSeq>(prog_or_error));
+    explicate_assertions(det_cfg, raw_prog.info);
+    cfg_t cfg = to_nondet(det_cfg);
+    if (global_options.simplify)
+        cfg.simplify();
+    if (global_options.fold_constants)
+        fold_constants(cfg);
+    if (global_options.slice)
+        slice_to_assertions(cfg);
+    global_options.relations = domain == "intervals"    ? relations_t::none
+                               : domain == "equalities" ? relations_t::equalities
+                                                        : relations_t::differences;
+    const auto [res, seconds, wall_seconds] = abs_validate(cfg, raw_prog.info);
+    return {res, seconds};
+}
+
+struct measurement_t {
+    bool passed;
+    double min_sec;
+    double median_sec;
+};
+
+static double median(vector<double> v) {
+    std::sort(v.begin(), v.end());
+    const size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// The time of the runs that follow warmup untimed ones, written as "passed,min,median", followed with perf_counters by
+// the median count of each hardware event of the fixpoint, empty for an event that could not be counted.
+static void measure_section(std::ostream& out, const string& file, const string& section, const string& domain,
+                            unsigned warmup, unsigned repeat, bool perf_counters) {
+    vector<raw_program> raw_progs = read_elf(file, section, map_creator(domain));
+    if (raw_progs.size() != 1)
+        throw std::runtime_error("section not found");
+    bool passed = false;
+    vector<double> times;
+    vector<double> events[crab::hw_events];
+    for (unsigned i = 0; i < warmup + repeat; i++) {
+        crab::CrabStats::reset();
+        const auto [res, seconds] = verify(raw_progs.front(), domain);
+        passed = res;
+        if (i < warmup)
+            continue;
+        times.push_back(seconds);
+        const crab::hw_counts_t counts = crab::CrabStats::hardware_events();
+        for (size_t e = 0; e < crab::hw_events; e++) {
+            if (counts[e])
+                events[e].push_back((double)*counts[e]);
+        }
+    }
+    out << passed << "," << *std::min_element(times.begin(), times.end()) << "," << median(times);
+    if (!perf_counters)
+        return;
+    for (const vector<double>& counts : events) {
+        out << ",";
+        if (counts.size() == times.size())
+            out << std::llround(median(counts));
+    }
+}
+
+// The baseline rows, keyed by file, section and domain.
+using baseline_t = std::map<std::tuple<string, string, string>, measurement_t>;
+
+static vector<string> split_csv_line(const string& line) {
+    vector<string> fields;
+    std::istringstream in(line);
+    for (string field; std::getline(in, field, ',');)
+        fields.push_back(field);
+    return fields;
+}
+
+static baseline_t read_baseline(const string& path) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot read baseline " + path);
+    string line;
+    std::getline(in, line);
+    const vector<string> header = split_csv_line(line);
+    auto column = [&](const string& name) {
+        auto it = std::find(header.begin(), header.end(), name);
+        if (it == header.end())
+            throw std::runtime_error("baseline " + path + " has no column " + name);
+        return it - header.begin();
+    };
+    const auto file = column("file"), section = column("section"), domain = column("domain"),
+               passed = column("passed"), min_sec = column("min_sec"), median_sec = column("median_sec");
+    baseline_t baseline;
+    while (std::getline(in, line)) {
+        const vector<string> fields = split_csv_line(line);
+        if (fields.size() != header.size() || fields[median_sec].empty())
+            continue;
+        baseline[{fields[file], fields[section], fields[domain]}] = {fields[passed] == "1", std::stod(fields[min_sec]),
+                                                                    std::stod(fields[median_sec])};
+    }
+    return baseline;
+}
+
+int main(int argc, char** argv) {
+    CLI::App app{"Benchmark the verifier over a corpus of ELF files"};
+
+    vector<string> paths;
+    app.add_option("paths", paths, "ELF files, or directories to search for them")->required()->type_name("PATH ...");
+    vector<string> domains{"zoneCrab"};
+    app.add_option("-d,--domain", domains, "Domains to benchmark (default: zoneCrab)")
+        ->check(CLI::IsMember({"zoneCrab", "intervals", "equalities", "linux"}))
+        ->type_name("DOMAIN ...");
+    unsigned repeat = 5;
+    app.add_option("-r,--repeat", repeat, "Timed runs per section (default: 5)")->type_name("N");
+    unsigned warmup = 1;
+    app.add_option("-w,--warmup", warmup, "Untimed runs per section before the timed ones (default: 1)")
+        ->type_name("N");
+    unsigned timeout = 600;
+    app.add_option("--timeout", timeout, "Give up on a section after SEC seconds (default: 600, 0 for none)")
+        ->type_name("SEC");
+    string baseline_path;
+    app.add_option("--baseline", baseline_path, "Compare against the results stored in FILE by a previous run")
+        ->type_name("FILE");
+    double threshold = 10;
+    app.add_option("--threshold", threshold, "Flag median times more than PCT percent above the baseline (default: 10)")
+        ->type_name("PCT");
+    double min_delta = 0.001;
+    app.add_option("--min-delta", min_delta, "Ignore differences below SEC seconds (default: 0.001)")->type_name("SEC");
+    bool perf_counters = false;
+    app.add_flag("--perf-counters", perf_counters,
+                 "Add the median cycles, instructions, LLC misses and branch misses of the fixpoint, from the "
+                 "hardware counters (Linux; empty for the linux domain)");
+
+    CLI11_PARSE(app, argc, argv);
+    if (repeat == 0) {
+        std::cerr << "--repeat must be at least 1\n";
+        return 64;
+    }
+    const baseline_t baseline = baseline_path.empty() ? baseline_t{} : read_baseline(baseline_path);
+    if (perf_counters)
+        crab::CrabStats::count_hardware_events(crab::CrabStats::id("phase.fixpoint"));
+
+    std::cout << "file,section,domain,passed,min_sec,median_sec,peak_kb";
+    if (perf_counters) {
+        for (size_t e = 0; e < crab::hw_events; e++)
+            std::cout << "," << crab::perf_counters_t::name((crab::hw_event_t)e);
+    }
+    if (!baseline_path.empty())
+        std::cout << ",baseline_median_sec,status";
+    std::cout << std::endl;
+
+    int flagged = 0;
+    for (const string& file : find_elf_files(paths)) {
+        for (const string& domain : domains) {
+            const child_result_t listing = run_in_child(timeout, [&](std::ostream& out) {
+                for (const raw_program& raw_prog : read_elf(file, string(), map_creator(domain)))
+                    out << raw_prog.section << "\n";
+            });
+            std::istringstream sections(listing.output);
+            for (string section; std::getline(sections, section);) {
+                const child_result_t run = run_in_child(
+                    timeout, [&](std::ostream& out) {
+                        measure_section(out, file, section, domain, warmup, repeat, perf_counters);
+                    });
+
+                std::cout << file << "," << section << "," << domain << ",";
+                std::optional<measurement_t> m;
+                if (WIFEXITED(run.status) && WEXITSTATUS(run.status) == 0) {
+                    vector<string> fields = split_csv_line(run.output);
+                    m = measurement_t{fields.at(0) == "1", std::stod(fields.at(1)), std::stod(fields.at(2))};
+                    std::cout << m->passed << "," << m->min_sec << "," << m->median_sec << "," << run.peak_kb;
+                    // The split drops the trailing empty counts.
+                    fields.resize(perf_counters ? 3 + crab::hw_events : 3);
+                    for (size_t e = 3; e < fields.size(); e++)
+                        std::cout << "," << fields[e];
+                } else {
+                    // Empty measurements, so that the row is not mistaken for a result.
+                    std::cout << ",,,";
+                    if (perf_counters)
+                        std::cout << string(crab::hw_events, ',');
+                }
+                if (baseline_path.empty()) {
+                    std::cout << std::endl;
+                    continue;
+                }
+
+                string status;
+                auto base = baseline.find({file, section, domain});
+                if (!m) {
+                    status = WIFSIGNALED(run.status) && WTERMSIG(run.status) == SIGALRM ? "timeout" : "error";
+                } else if (base == baseline.end()) {
+                    status = "new";
+                } else if (m->passed != base->second.passed) {
+                    status = "changed";
+                } else if (m->median_sec - base->second.median_sec > min_delta &&
+                           m->median_sec > base->second.median_sec * (1 + threshold / 100)) {
+                    status = "regression";
+                } else if (base->second.median_sec - m->median_sec > min_delta &&
+                           m->median_sec < base->second.median_sec * (1 - threshold / 100)) {
+                    status = "improved";
+                } else {
+                    status = "ok";
+                }
+                if (status == "regression" || status == "changed" ||
+                    (base != baseline.end() && (status == "timeout" || status == "error")))
+                    flagged++;
+                std::cout << ",";
+                if (base != baseline.end())
+                    std::cout << base->second.median_sec;
+                std::cout << "," << status << std::endl;
+            }
+        }
+    }
+    if (flagged)
+        std::cerr << flagged << " sections regressed\n";
+    return flagged ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+// Micro-benchmarks of the zone domain.
+//
+// Each SplitDBM operation is timed on synthetic zones of controlled size and density, and the corresponding
+// ebpf_domain_t operations are replayed on the states reached when analyzing real programs, given as FILE SECTION
+// pairs on the command line. One CSV row is printed per benchmark, with the average time of a single operation.
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "CLI11.hpp"
+
+#include "asm_files.hpp"
+#include "asm_unmarshal.hpp"
+#include "config.hpp"
+#include "crab/cfg.hpp"
+#include "crab/ebpf_domain.hpp"
+#include "crab/fwd_analyzer.hpp"
+#include "crab/split_dbm.hpp"
+#include "crab_verifier.hpp"
+
+using namespace crab;
+using namespace crab::dsl_syntax;
+using crab::domains::SplitDBM;
+
+using std::string;
+using std::vector;
+
+// Keeps the results of the benchmarked operations observable, so that they are not optimized away.
+static volatile bool sink;
+
+struct benchmark_t {
+    string name;
+    // Performs one batch of `ops` operations.
+    std::function<void()> run;
+    size_t ops;
+};
+
+/** Run b in batches until at least min_seconds have passed, and print the average time of one operation. */
+static void measure(const benchmark_t& b, double min_seconds) {
+    using clock = std::chrono::steady_clock;
+    b.run(); // warm up
+    size_t batches = 1;
+    while (true) {
+        const auto start = clock::now();
+        for (size_t i = 0; i < batches; i++)
+            b.run();
+        const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if (seconds >= min_seconds || batches >= (size_t{1} << 30)) {
+            const size_t iterations = batches * b.ops;
+            std::cout << b.name << "," << seconds * 1e9 / iterations << "," << iterations << std::endl;
+            return;
+        }
+        batches *= 2;
+    }
+}
+
+// A zone over vars in which each pair of variables is related with probability density.
+static SplitDBM synthetic_zone(const vector<variable_t>& vars, double density, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::uniform_int_distribution<int> weight(0, 100);
+    SplitDBM dbm;
+    for (variable_t v : vars) {
+        dbm += v >= 0;
+        dbm += v <= 1000 + weight(rng);
+    }
+    for (size_t i = 0; i < vars.size(); i++) {
+        for (size_t j = 0; j < vars.size(); j++) {
+            if (i != j && coin(rng) < density)
+                dbm += vars[i] - vars[j] <= weight(rng);
+        }
+    }
+    return dbm;
+}
+
+// The SplitDBM benchmarks for zones over n variables of the given density.
+static void add_synthetic(vector<benchmark_t>& benchmarks, analysis_context_t& context, size_t n, double density) {
+    analysis_context_t::scope_t scope(context);
+    vector<variable_t> vars;
+    for (size_t i = 0; i < n; i++)
+        vars.push_back(variable_t::cell_var(data_kind_t::values, context.variables.make_cell(8 * i, 8)));
+    const SplitDBM a = synthetic_zone(vars, density, 1);
+    const SplitDBM b = synthetic_zone(vars, density, 2);
+    const variable_t x = vars[0];
+    const variable_t y = vars[n / 2];
+
+    const string prefix = "SplitDBM/" + std::to_string(n) + "/" + std::to_string((int)(density * 100)) + "%/";
+    auto add = [&](const string& op, std::function<void(SplitDBM&, const SplitDBM&)> f) {
+        benchmarks.push_back({prefix + op,
+                              [&context, a, b, f] {
+                                  analysis_context_t::scope_t scope(context);
+                                  SplitDBM r = a;
+                                  f(r, b);
+                                  sink = r.is_bottom();
+                              },
+                              1});
+    };
+    add("join", [](SplitDBM& r, const SplitDBM& o) { r = r | o; });
+    add("widen", [](SplitDBM& r, const SplitDBM& o) { r = r.widen(o); });
+    add("narrow", [](SplitDBM& r, const SplitDBM& o) { r = r.narrow(o); });
+    add("leq", [](SplitDBM& r, const SplitDBM& o) { sink = r <= o; });
+    add("meet", [](SplitDBM& r, const SplitDBM& o) { r = r & o; });
+    add("assign", [x, y](SplitDBM& r, const SplitDBM&) { r.assign(x, y + 3); });
+    add("add_constraint", [x, y](SplitDBM& r, const SplitDBM&) { r += x - y <= 5; });
+    add("forget", [x](SplitDBM& r, const SplitDBM&) { r -= x; });
+}
+
+// The states of a real program, with the context that their variables belong to.
+struct replay_t {
+    std::unique_ptr<analysis_context_t> context;
+    vector<std::pair<ebpf_domain_t, ebpf_domain_t>> states;
+};
+
+// Analyze the program in section of file, and keep the pre- and post-state of each reachable block.
+static std::shared_ptr<replay_t> capture_states(const string& file, const string& section) {
+    vector<raw_program> raw_progs = read_elf(file, section, create_map_crab);
+    if (raw_progs.size() != 1)
+        throw std::runtime_error("no single section " + section + " in " + file);
+    const raw_program& raw_prog = raw_progs.front();
+    auto prog_or_error = unmarshal(raw_prog);
+    if (std::holds_alternative<string>(prog_or_error))
+        throw std::runtime_error(file + " " + section + ": " + std::get<string>(prog_or_error));
+
+    cfg_t det_cfg = instruction_seq_to_cfg(std::get<InstructionSeq>(prog_or_error));
+    explicate_assertions(det_cfg, raw_prog.info);
+    cfg_t cfg = to_nondet(det_cfg);
+    if (global_options.simplify)
+        cfg.simplify();
+
+    auto replay = std::make_shared<replay_t>();
+    replay->context = std::make_unique<analysis_context_t>(raw_prog.info);
+    auto [pre, post] = run_forward_analyzer(cfg, *replay->context);
+    for (size_t i = 0; i < pre.size(); i++) {
+        if (!pre[i].is_bottom() && !post[i].is_bottom())
+            replay->states.emplace_back(std::move(pre[i]), std::move(post[i]));
+    }
+    return replay;
+}
+
+// The ebpf_domain_t benchmarks over the states captured from a real program; each batch visits every state once.
+// Forgetting a variable is not among them, as the domain only does so as part of other statements.
+static void add_replay(vector<benchmark_t>& benchmarks, const string& file, const string& section) {
+    std::shared_ptr<replay_t> replay = capture_states(file, section);
+    if (replay->states.empty())
+        return;
+    const string prefix = "replay/" + file + ":" + section + "/";
+    auto add = [&](const string& op, std::function<void(ebpf_domain_t&, const ebpf_domain_t&)> f) {
+        benchmarks.push_back({prefix + op,
+                              [replay, f] {
+                                  analysis_context_t::scope_t scope(*replay->context);
+                                  for (const auto& [pre, post] : replay->states) {
+                                      ebpf_domain_t r = pre;
+                                      f(r, post);
+                                      sink = r.is_bottom();
+                                  }
+                              },
+                              replay->states.size()});
+    };
+    add("join", [](ebpf_domain_t& r, const ebpf_domain_t& o) { r = r | o; });
+    add("widen", [](ebpf_domain_t& r, const ebpf_domain_t& o) { r = r.widen(o); });
+    add("narrow", [](ebpf_domain_t& r, const ebpf_domain_t& o) { r = r.narrow(o); });
+    add("leq", [](ebpf_domain_t& r, const ebpf_domain_t& o) { sink = r <= o; });
+    add("meet", [](ebpf_domain_t& r, const ebpf_domain_t& o) { r = r & o; });
+    // The domain only assigns and constrains through the statements of the program.
+    add("assign", [](ebpf_domain_t& r, const ebpf_domain_t&) {
+        r(Bin{.op = Bin::Op::MOV, .is64 = true, .dst = Reg{0}, .v = Reg{1}});
+    });
+    add("add_constraint", [](ebpf_domain_t& r, const ebpf_domain_t&) {
+        r(Assume{Condition{.op = Condition::Op::LE, .left = Reg{0}, .right = Reg{1}}});
+    });
+}
+
+int main(int argc, char** argv) {
+    CLI::App app{"Micro-benchmarks of the zone domain"};
+
+    vector<string> programs;
+    app.add_option("programs", programs, "Programs whose states are replayed")->type_name("FILE SECTION ...");
+    double min_seconds = 0.1;
+    app.add_option("--min-time", min_seconds, "Run each benchmark for at least SEC seconds (default: 0.1)")
+        ->type_name("SEC");
+    string filter;
+    app.add_option("--filter", filter, "Only run the benchmarks whose name contains STRING")->type_name("STRING");
+
+    CLI11_PARSE(app, argc, argv);
+    if (programs.size() % 2 != 0) {
+        std::cerr << "programs are given as FILE SECTION pairs\n";
+        return 64;
+    }
+
+    analysis_context_t synthetic_context(program_info{});
+    vector<benchmark_t> benchmarks;
+    for (size_t n : {8, 32, 128}) {
+        for (double density : {0.1, 0.5})
+            add_synthetic(benchmarks, synthetic_context, n, density);
+    }
+    for (size_t i = 0; i < programs.size(); i += 2)
+        add_replay(benchmarks, programs[i], programs[i + 1]);
+
+    std::cout << "benchmark,ns_per_op,iterations\n";
+    for (const benchmark_t& b : benchmarks) {
+        if (b.name.find(filter) != string::npos)
+            measure(b, min_seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Scaling benchmark of the verifier on generated programs.
+//
+// Programs of increasing size are built directly as instructions, without a compiler, from a few shape parameters:
+// the depth of the loop nests, the number of times their body is unrolled, the bytes of stack it uses, the number of
+// ways it branches, and the helpers it calls. Each program is verified in-process through verifier_session_t, and one
+// CSV row per size reports the verdict, the analysis time and the memory used, so that the scaling curves of the
+// analysis can be charted in one run.
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CLI11.hpp"
+
+#include "asm_marshal.hpp"
+#include "asm_ostream.hpp"
+#include "asm_syntax.hpp"
+#include "config.hpp"
+#include "ebpf_verifier.hpp"
+#include "memsize.hpp"
+#include "spec_prototypes.hpp"
+
+using std::string;
+using std::vector;
+
+// The shape of a generated program.
+struct shape_t {
+    unsigned depth = 1;
+    unsigned unroll = 4;
+    unsigned stack_bytes = 64;
+    unsigned branches = 2;
+    unsigned helpers = 1;
+    // The number of iterations of each loop.
+    unsigned iterations = 16;
+};
+
+// The value that the program computes on, in r6; loop counters are r7 to r9, from the outermost loop in.
+constexpr uint8_t value_reg = 6;
+constexpr uint8_t first_counter_reg = 7;
+// bpf_get_prandom_u32(), which takes no arguments and returns a number.
+constexpr int32_t prandom_helper = 7;
+
+/** Builds a program one instruction at a time; every instruction takes a single slot, and is labeled by its index.
+ *
+ *  Jumps are made to the index of their target, which forward jumps set once it is known.
+ */
+class program_builder_t final {
+    InstructionSeq _prog;
+
+  public:
+    size_t size() const { return _prog.size(); }
+
+    void add(Instruction ins) { _prog.emplace_back(std::to_string(_prog.size()), std::move(ins)); }
+
+    // A jump to target, or, if none is given yet, to the index later given to patch().
+    size_t jump(std::optional<Condition> cond, size_t target = 0) {
+        add(Jmp{std::move(cond), std::to_string(target)});
+        return _prog.size() - 1;
+    }
+
+    void patch(size_t jump, size_t target) {
+        std::get<Jmp>(std::get<1>(_prog.at(jump))).target = std::to_string(target);
+    }
+
+    const InstructionSeq& program() const { return _prog; }
+};
+
+static Bin bin(Bin::Op op, uint8_t dst, Value v) { return Bin{.op = op, .is64 = true, .dst = Reg{dst}, .v = v}; }
+
+static Mem stack_access(int offset, Value value, bool is_load) {
+    return Mem{.access = Deref{.width = 8, .basereg = Reg{10}, .offset = offset}, .value = value, .is_load = is_load};
+}
+
+// One copy of the body of the innermost loop: the helper calls, a store and a load of the stack, and the branches.
+static void add_step(program_builder_t& b, const shape_t& shape, size_t step) {
+    for (unsigned h = 0; h < shape.helpers; h++) {
+        b.add(get_helper_summary(prandom_helper).call);
+        b.add(bin(Bin::Op::ADD, value_reg, Reg{0}));
+    }
+    if (const unsigned slots = shape.stack_bytes / 8) {
+        b.add(stack_access(-8 * (int)(1 + step % slots), Reg{value_reg}, false));
+        b.add(stack_access(-8 * (int)(1 + (step + 1) % slots), Reg{value_reg}, true));
+    }
+    if (shape.branches > 1) {
+        // A chain of tests jumping to one arm each, the last arm being reached when none holds.
+        vector<size_t> tests;
+        for (unsigned i = 0; i + 1 < shape.branches; i++)
+            tests.push_back(b.jump(Condition{.op = Condition::Op::EQ, .left = Reg{value_reg}, .right = Imm{i}}));
+        vector<size_t> exits;
+        for (unsigned arm = shape.branches; arm-- > 0;) {
+            if (arm + 1 < shape.branches)
+                b.patch(tests[arm], b.size());
+            b.add(bin(Bin::Op::ADD, value_reg, Imm{arm + 1}));
+            if (arm > 0)
+                exits.push_back(b.jump({}));
+        }
+        for (size_t exit : exits)
+            b.patch(exit, b.size());
+    }
+}
+
+// The loops from the given depth in, around the unrolled body.
+static void add_loops(program_builder_t& b, const shape_t& shape, unsigned depth, size_t& steps) {
+    if (depth == shape.depth) {
+        for (unsigned i = 0; i < shape.unroll; i++)
+            add_step(b, shape, steps++);
+        return;
+    }
+    const uint8_t counter = first_counter_reg + depth;
+    b.add(bin(Bin::Op::MOV, counter, Imm{0}));
+    const size_t head = b.size();
+    add_loops(b, shape, depth + 1, steps);
+    b.add(bin(Bin::Op::ADD, counter, Imm{1}));
+    if (b.size() - head >= 0x7fff)
+        throw std::runtime_error("the body of a loop is too large for a jump; unroll less");
+    b.jump(Condition{.op = Condition::Op::LT, .left = Reg{counter}, .right = Imm{shape.iterations}}, head);
+}
+
+// A program of at least the given number of instructions, made of loop nests of the given shape one after another.
+static InstructionSeq generate(const shape_t& shape, size_t instructions) {
+    program_builder_t b;
+    b.add(bin(Bin::Op::MOV, value_reg, Imm{0}));
+    for (unsigned slot = 0; slot < shape.stack_bytes / 8; slot++)
+        b.add(stack_access(-8 * (int)(slot + 1), Imm{0}, false));
+    size_t steps = 0;
+    while (b.size() + 2 < instructions)
+        add_loops(b, shape, 0, steps);
+    b.add(bin(Bin::Op::MOV, 0, Imm{0}));
+    b.add(Exit{});
+    return b.program();
+}
+
+int main(int argc, char** argv) {
+    CLI::App app{"Benchmark the verifier on generated programs of increasing size"};
+
+    vector<size_t> sizes{1000, 10000, 100000};
+    app.add_option("-n,--instructions", sizes, "Sizes of the programs to verify (default: 1000 10000 100000)")
+        ->type_name("N ...");
+    shape_t shape;
+    app.add_option("--depth", shape.depth, "Depth of the loop nests (default: 1)")
+        ->check(CLI::Range(0, 3))
+        ->type_name("D");
+    app.add_option("--unroll", shape.unroll, "Copies of the body of the innermost loop (default: 4)")
+        ->check(CLI::Range(1, 100000))
+        ->type_name("N");
+    app.add_option("--stack", shape.stack_bytes, "Bytes of stack the body stores to and loads from (default: 64)")
+        ->check(CLI::Range(0, 512))
+        ->type_name("BYTES");
+    app.add_option("--branches", shape.branches, "Ways the body branches at each copy (default: 2)")
+        ->check(CLI::Range(1, 64))
+        ->type_name("N");
+    app.add_option("--helpers", shape.helpers, "Helper calls at each copy of the body (default: 1)")->type_name("N");
+    app.add_option("--iterations", shape.iterations, "Iterations of each loop (default: 16)")->type_name("N");
+    string domain = "zoneCrab";
+    app.add_option("-d,--domain", domain, "Domain to verify with (default: zoneCrab)")
+        ->check(CLI::IsMember({"zoneCrab", "intervals", "equalities"}))
+        ->type_name("DOMAIN");
+    app.add_flag("--warm-start-loops", global_options.warm_start_loops,
+                 "Start a nested loop entered again with a larger state from its previous fixpoint");
+    string asmfile;
+    app.add_option("--asm", asmfile, "Print the disassembly of the largest program to FILE")->type_name("FILE");
+
+    CLI11_PARSE(app, argc, argv);
+    global_options.relations = domain == "intervals"    ? relations_t::none
+                               : domain == "equalities" ? relations_t::equalities
+                                                        : relations_t::differences;
+    std::sort(sizes.begin(), sizes.end());
+
+    std::cout << "instructions,depth,unroll,stack,branches,helpers,passed,warnings,sec,wall_sec,kb,peak_kb"
+              << std::endl;
+    for (size_t size : sizes) {
+        const InstructionSeq prog = generate(shape, size);
+        if (!asmfile.empty() && size == sizes.back())
+            print(prog, asmfile);
+        const vector<ebpf_inst> insts = marshal(prog);
+        // A session of its own, so that the analysis does not reuse the invariants of the smaller program.
+        verifier_session_t session;
+        const verifier_session_t::result_t res = session.verify(insts.data(), insts.size(), BpfProgType::KPROBE, {});
+        if (!res.error.empty()) {
+            std::cerr << insts.size() << " instructions: " << res.error << "\n";
+            return 1;
+        }
+        std::cout << insts.size() << "," << shape.depth << "," << shape.unroll << "," << shape.stack_bytes << ","
+                  << shape.branches << "," << shape.helpers << "," << res.verified << "," << res.warnings << ","
+                  << res.cpu_seconds << "," << res.wall_seconds << "," << resident_set_size_kb() << ","
+                  << peak_resident_set_size_kb() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+// Fuzzing harness for the verifier, from the decoding of instructions to their analysis.
+//
+// Each input is a program as raw instructions, 8 bytes each; trailing bytes are ignored. It is unmarshalled, and if
+// it decodes to instructions that can be encoded again, marshalled and unmarshalled back, which must give the same
+// instructions; the program is then turned into a CFG and analyzed. Rejecting an input is not a failure, at any stage
+// and whether by an error or an exception: the process aborts only if the round trip changes the program, or if the
+// verifier crashes. Everything runs in one process, with no output per input, for as many inputs per second as the
+// analysis allows.
+//
+// As built here, the inputs are the files named on the command line, or programs generated from a seed with
+// --iterations. Built with afl-clang-fast, inputs are read in AFL's persistent mode; built with -DEBPF_LIBFUZZER and
+// -fsanitize=fuzzer, this is a libFuzzer target.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "CLI11.hpp"
+
+#include "asm_marshal.hpp"
+#include "asm_ostream.hpp"
+#include "asm_syntax.hpp"
+#include "asm_unmarshal.hpp"
+#include "config.hpp"
+#include "crab/cfg.hpp"
+#include "crab_verifier.hpp"
+
+using std::string;
+using std::vector;
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+// How far an input went, in the order of the stages.
+enum class outcome_t { undecodable, unencodable, rejected, unverified, verified };
+constexpr size_t outcomes = 5;
+static const char* const outcome_names[outcomes] = {"undecodable", "unencodable", "rejected", "unverified", "verified"};
+
+// Longer inputs are cut, so that no one input takes long to analyze.
+static size_t max_instructions = 4096;
+static BpfProgType program_type = BpfProgType::XDP;
+
+// The maps that generated programs load, by their analysis file descriptors.
+static const std::shared_ptr<const vector<map_def>>& fuzz_maps() {
+    static const std::shared_ptr<const vector<map_def>> maps = [] {
+        auto res = std::make_shared<vector<map_def>>();
+        const std::tuple<MapType, unsigned, unsigned> shapes[] = {{MapType::ARRAY, 4, 8}, {MapType::HASH, 8, 16}};
+        for (auto [type, key_size, value_size] : shapes) {
+            const int fd = create_map_crab((uint32_t)type, key_size, value_size, 0);
+            res->push_back(map_def{.original_fd = fd, .type = type, .key_size = key_size, .value_size = value_size});
+        }
+        return res;
+    }();
+    return maps;
+}
+
+// Whether marshal() can encode every instruction of prog back: it has no Undefined instruction, and every jump
+// targets one of its labels.
+static bool is_encodable(const InstructionSeq& prog) {
+    std::unordered_set<label_t> labels;
+    for (const auto& [label, ins] : prog)
+        labels.insert(label);
+    for (const auto& [label, ins] : prog) {
+        if (std::holds_alternative<Undefined>(ins))
+            return false;
+        if (std::holds_alternative<Jmp>(ins) && labels.count(std::get<Jmp>(ins).target) == 0)
+            return false;
+    }
+    return true;
+}
+
+[[noreturn]] static void report_round_trip(const raw_program& raw_prog, const InstructionSeq& prog,
+                                           const std::variant<InstructionSeq, string>& back) {
+    std::cerr << "the round trip through marshal() changed the program\ninput:\n";
+    for (const ebpf_inst& inst : raw_prog.prog) {
+        uint64_t bits;
+        std::memcpy(&bits, &inst, sizeof bits);
+        std::cerr << std::hex << bits << std::dec << "\n";
+    }
+    std::cerr << "\nunmarshalled:\n";
+    print(prog, std::cerr);
+    std::cerr << "\nafter the round trip:\n";
+    if (std::holds_alternative<string>(back))
+        std::cerr << std::get<string>(back) << "\n";
+    else
+        print(std::get<InstructionSeq>(back), std::cerr);
+    std::abort();
+}
+
+static outcome_t fuzz_one(const uint8_t* data, size_t size) {
+    const size_t count = std::min(size / sizeof(ebpf_inst), max_instructions);
+    raw_program raw_prog{"", "", vector<ebpf_inst>(count),
+                         program_info{program_type, fuzz_maps(), get_descriptor(program_type)}};
+    std::memcpy(raw_prog.prog.data(), data, count * sizeof(ebpf_inst));
+
+    auto prog_or_error = unmarshal(raw_prog);
+    if (std::holds_alternative<string>(prog_or_error))
+        return outcome_t::undecodable;
+    const InstructionSeq& prog = std::get<InstructionSeq>(prog_or_error);
+    if (!is_encodable(prog))
+        return outcome_t::unencodable;
+
+    raw_program again = raw_prog;
+    try {
+        again.prog = marshal(prog);
+    } catch (const std::exception&) {
+        report_round_trip(raw_prog, prog, string("marshal() threw"));
+    }
+    auto back = unmarshal(again);
+    if (!std::holds_alternative<InstructionSeq>(back) || std::get<InstructionSeq>(back) != prog)
+        report_round_trip(raw_prog, prog, back);
+
+    try {
+        cfg_t det_cfg = instruction_seq_to_cfg(prog);
+        explicate_assertions(det_cfg, raw_prog.info);
+        cfg_t cfg = to_nondet(det_cfg);
+        if (global_options.simplify)
+            cfg.simplify();
+        if (global_options.fold_constants)
+            fold_constants(cfg);
+        if (global_options.slice)
+            slice_to_assertions(cfg);
+        return verify_cfg(cfg, raw_prog.info).verified ? outcome_t::verified : outcome_t::unverified;
+    } catch (const std::exception&) {
+        return outcome_t::rejected;
+    }
+}
+
+#ifdef EBPF_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzz_one(data, size);
+    return 0;
+}
+
+#else
+
+/** Generates programs that mostly decode, so that the later stages see most of them.
+ *
+ *  Opcodes are drawn from those that unmarshal() decodes alone, registers mostly from r0 to r10, and offsets and
+ *  immediates mostly small; jumps stay within the program, which ends with an exit.
+ */
+class program_generator_t final {
+    std::mt19937_64 _rng;
+    vector<uint8_t> _opcodes;
+
+    uint32_t below(uint32_t n) { return (uint32_t)(_rng() % n); }
+
+  public:
+    explicit program_generator_t(uint64_t seed) : _rng(seed) {
+        for (unsigned opcode = 0; opcode < 256; opcode++) {
+            raw_program raw_prog;
+            raw_prog.prog = {ebpf_inst{.opcode = (uint8_t)opcode}, ebpf_inst{.opcode = EBPF_OP_EXIT}};
+            auto prog_or_error = unmarshal(raw_prog);
+            if (std::holds_alternative<InstructionSeq>(prog_or_error) &&
+                !std::holds_alternative<Undefined>(std::get<1>(std::get<InstructionSeq>(prog_or_error).front())))
+                _opcodes.push_back((uint8_t)opcode);
+        }
+    }
+
+    vector<ebpf_inst> next() {
+        const size_t count = 1 + below((uint32_t)std::min<size_t>(max_instructions, 64));
+        vector<ebpf_inst> res;
+        while (res.size() + 1 < count) {
+            ebpf_inst inst{
+                // One in 32 opcodes is any byte, to reach the errors of the decoder.
+                .opcode = below(32) == 0 ? (uint8_t)below(256) : _opcodes[below((uint32_t)_opcodes.size())],
+                .dst = (uint8_t)(below(16) == 0 ? below(16) : below(11)),
+                .src = (uint8_t)(below(16) == 0 ? below(16) : below(11)),
+                .offset = (int16_t)((int)below(129) - 64),
+                .imm = below(4) == 0 ? (int32_t)_rng() : (int32_t)below(65) - 32,
+            };
+            if ((inst.opcode & EBPF_CLS_MASK) == EBPF_CLS_JMP)
+                inst.offset = (int16_t)((int)below((uint32_t)count) - (int)res.size() - 1);
+            res.push_back(inst);
+            if (inst.opcode == EBPF_OP_LDDW_IMM) {
+                if (inst.src == 1)
+                    res.back().imm = (*fuzz_maps())[below((uint32_t)fuzz_maps()->size())].original_fd;
+                res.push_back(ebpf_inst{.imm = below(2) ? 0 : (int32_t)_rng()});
+            }
+        }
+        res.push_back(ebpf_inst{.opcode = EBPF_OP_EXIT});
+        return res;
+    }
+};
+
+static vector<uint8_t> read_file(const string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("cannot read " + path);
+    return vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char** argv) {
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    // AFL's persistent mode: the inputs are given in shared memory, many to the same process.
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+    __AFL_INIT();
+#endif
+    const unsigned char* buf = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(10000))
+        fuzz_one(buf, __AFL_FUZZ_TESTCASE_LEN);
+    return 0;
+#endif
+
+    CLI::App app{"Fuzz the verifier: unmarshal, round-trip through marshal, and analyze programs in one process"};
+
+    vector<string> files;
+    app.add_option("files", files, "Inputs, as raw instructions")->type_name("FILE ...");
+    unsigned long long iterations = 0;
+    app.add_option("-n,--iterations", iterations, "Generate and run this many programs instead")->type_name("N");
+    uint64_t seed = 1;
+    app.add_option("--seed", seed, "Seed of the generated programs (default: 1)")->type_name("N");
+    app.add_option("--max-instructions", max_instructions,
+                   "Instructions of an input past which it is cut (default: 4096)")
+        ->check(CLI::Range(1, 1 << 20))
+        ->type_name("N");
+    string last_input;
+    app.add_option("--last-input", last_input,
+                   "Write each generated program to FILE before running it, so that it holds the one that crashed")
+        ->type_name("FILE");
+    int type = (int)program_type;
+    app.add_option("--type", type, "Program type, by its number in BpfProgType (default: 6, XDP)")
+        ->check(CLI::Range((int)BpfProgType::UNSPEC, (int)BpfProgType::LIRC_MODE2))
+        ->type_name("N");
+    app.add_flag("--fold-constants", global_options.fold_constants,
+                 "Fold the constant operations and copies of each block before the analysis");
+    app.add_flag("--slice", global_options.slice, "Leave out the statements that no assertion depends on");
+    app.add_flag("--summarize-blocks", global_options.summarize_blocks,
+                 "Iterate over the blocks of loops through summaries of their statements compiled once");
+
+    CLI11_PARSE(app, argc, argv);
+    program_type = (BpfProgType)type;
+    if (files.empty() && iterations == 0) {
+        std::cerr << "files or --iterations is required\n";
+        return 64;
+    }
+
+    size_t counts[outcomes]{};
+    const auto start = std::chrono::steady_clock::now();
+    for (const string& file : files) {
+        const vector<uint8_t> input = read_file(file);
+        counts[(size_t)fuzz_one(input.data(), input.size())]++;
+    }
+    program_generator_t generator(seed);
+    for (unsigned long long i = 0; i < iterations; i++) {
+        const vector<ebpf_inst> prog = generator.next();
+        if (!last_input.empty())
+            std::ofstream(last_input, std::ios::binary)
+                .write((const char*)prog.data(), prog.size() * sizeof(ebpf_inst));
+        counts[(size_t)fuzz_one((const uint8_t*)prog.data(), prog.size() * sizeof(ebpf_inst))]++;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "inputs";
+    for (const char* name : outcome_names)
+        std::cout << "," << name;
+    std::cout << ",sec,inputs_per_sec\n";
+    const size_t inputs = files.size() + iterations;
+    std::cout << inputs;
+    for (size_t count : counts)
+        std::cout << "," << count;
+    std::cout << "," << seconds << "," << (seconds > 0 ? inputs / seconds : 0) << "\n";
+    return 0;
+}
+
+#endif
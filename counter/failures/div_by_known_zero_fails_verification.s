@@ -0,0 +1,16 @@
+# A division by a register that the known bits pin to 0: 12 >> 6 is 0, and BPF defines r6 / 0 as 0. The zone
+# divides by the interval [0, 0] instead, which leaves no state, and the store past the end of the stack that
+# follows would then pass unchecked.
+#
+#   llvm-mc -triple bpf -filetype=obj div_by_known_zero_fails_verification.s -o div_by_known_zero.o
+#   ./check div_by_known_zero.o    # Upper bound must be lower than STACK_SIZE
+	.section	socket1,"ax",@progbits
+	.globl	div_by_known_zero
+div_by_known_zero:
+	r7 = 12
+	w7 >>= 6
+	r6 = 100
+	r6 /= r7
+	*(u64 *)(r10 + 8) = r6
+	r0 = 0
+	exit
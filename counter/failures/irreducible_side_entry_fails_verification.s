@@ -0,0 +1,38 @@
+# An irreducible cycle nested in a loop: the cycle is entered at A, which clears r7, and at B, which carries r7 over
+# from the previous round of the outer loop, where it is 1. B then stores at r10 + r7 * 8 - 8, past the end of the
+# stack. The entry at A is the same on every round, so the cycle must not be skipped on account of it alone.
+#
+#   llvm-mc -triple bpf -filetype=obj irreducible_side_entry_fails_verification.s -o irreducible_side_entry.o
+#   ./check irreducible_side_entry.o    # Upper bound must be lower than STACK_SIZE
+	.section	socket1,"ax",@progbits
+	.globl	irreducible_side_entry
+irreducible_side_entry:
+	r7 = 0
+	r1 = 0
+	*(u64 *)(r10 - 8) = r1
+outer:
+	call 7
+	if r0 <= 5 goto enter_a
+	goto enter_b
+enter_a:
+	r7 = 0
+A:
+	call 7
+	if r0 > 3 goto done
+B:
+	r2 = r7
+	r2 <<= 3
+	r3 = r10
+	r3 += r2
+	r1 = 0
+	*(u64 *)(r3 - 8) = r1
+	call 7
+	if r0 > 3 goto A
+done:
+	r7 = 1
+	call 7
+	if r0 > 7 goto outer
+	r0 = 0
+	exit
+enter_b:
+	goto B
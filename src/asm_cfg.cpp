@@ -5,6 +5,7 @@
 #include <map>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "asm_syntax.hpp"
@@ -17,14 +18,14 @@ using std::string;
 using std::to_string;
 using std::vector;
 
-static optional<label_t> get_jump(Instruction ins) {
+static optional<label_t> get_jump(const Instruction& ins) {
     if (std::holds_alternative<Jmp>(ins)) {
         return std::get<Jmp>(ins).target;
     }
     return {};
 }
 
-static bool has_fall(Instruction ins) {
+static bool has_fall(const Instruction& ins) {
     if (std::holds_alternative<Exit>(ins))
         return false;
 
@@ -43,7 +44,7 @@ cfg_t instruction_seq_to_cfg(const InstructionSeq& insts) {
     if (exit_label.empty())
         throw std::runtime_error("no exit");
     cfg_t cfg("0", exit_label);
-    std::optional<label_t> falling_from = {};
+    std::optional<crab::block_id_t> falling_from = {};
     for (const auto& [label, inst] : insts) {
 
         if (std::holds_alternative<Undefined>(inst))
@@ -56,7 +57,7 @@ cfg_t instruction_seq_to_cfg(const InstructionSeq& insts) {
             falling_from = {};
         }
         if (has_fall(inst))
-            falling_from = label;
+            falling_from = bb.id();
         auto jump_target = get_jump(inst);
         if (jump_target)
             bb >> cfg.insert(*jump_target);
@@ -93,56 +94,71 @@ static Condition::Op reverse(Condition::Op op) {
 static Condition reverse(Condition cond) { return {.op = reverse(cond.op), .left = cond.left, .right = cond.right}; }
 
 template <typename T>
-static vector<label_t> unique(const std::pair<T, T>& be) {
-    vector<label_t> res;
+static vector<crab::block_id_t> unique(const std::pair<T, T>& be) {
+    vector<crab::block_id_t> res;
     std::unique_copy(be.first, be.second, std::back_inserter(res));
     return res;
 }
 
 cfg_t to_nondet(const cfg_t& cfg) {
-    cfg_t res(cfg.entry(), cfg.exit());
-    for (auto const& [this_label, bb] : cfg) {
-        basic_block_t& newbb = res.insert(this_label);
+    cfg_t res(cfg.get_node(cfg.entry()).label(), cfg.get_node(cfg.exit()).label());
+    // The block of res for each block of cfg, and for each conditional jump from one block of cfg to another, by their
+    // ids in cfg, so that each label is built and looked up only once, when its block is made.
+    vector<optional<crab::block_id_t>> ids(cfg.num_ids());
+    std::unordered_map<uint64_t, crab::block_id_t> edge_ids;
+    auto node = [&](crab::block_id_t id) -> basic_block_t& {
+        if (!ids[id])
+            ids[id] = res.insert(cfg.get_node(id).label()).id();
+        return res.get_node(*ids[id]);
+    };
+    auto edge = [&](crab::block_id_t from, crab::block_id_t to) -> basic_block_t& {
+        auto [it, inserted] = edge_ids.try_emplace(static_cast<uint64_t>(from) << 32 | to);
+        if (inserted)
+            it->second = res.insert(cfg.get_node(from).label() + ":" + cfg.get_node(to).label()).id();
+        return res.get_node(it->second);
+    };
+    // Successors are kept without duplicates, so a jump to the fallthrough has a single one.
+    auto is_conditional = [](const basic_block_t& bb) {
+        auto [begin, end] = bb.next_blocks();
+        return std::distance(begin, end) == 2;
+    };
+
+    for (basic_block_t const& bb : cfg) {
+        basic_block_t& newbb = node(bb.id());
 
-        for (auto ins : bb) {
+        for (const Instruction& ins : bb) {
             if (!std::holds_alternative<Jmp>(ins)) {
                 newbb.insert(ins);
             }
         }
 
-        auto [pb, pe] = bb.prev_blocks();
-        for (label_t prev_label : vector<label_t>(pb, pe)) {
-            bool is_one = unique(cfg.get_node(prev_label).next_blocks()).size() > 1;
-            basic_block_t& pbb = res.insert(is_one ? prev_label + ":" + this_label : prev_label);
+        for (crab::block_id_t prev : boost::make_iterator_range(bb.prev_blocks())) {
+            basic_block_t& pbb = is_conditional(cfg.get_node(prev)) ? edge(prev, bb.id()) : node(prev);
             pbb >> newbb;
         }
-        // note the special case where we jump to fallthrough
-        auto nextlist = unique(bb.next_blocks());
-        if (nextlist.size() == 2) {
-            label_t mid_label = this_label + ":";
+        if (is_conditional(bb)) {
             Condition cond = *std::get<Jmp>(*bb.rbegin()).cond;
-            vector<std::tuple<label_t, Condition>> jumps{
+            vector<std::tuple<crab::block_id_t, Condition>> jumps{
                 {*bb.next_blocks().first, cond},
                 {*std::next(bb.next_blocks().first), reverse(cond)},
             };
-            for (auto const& [next_label, cond1] : jumps) {
-                label_t l = mid_label + next_label;
-                basic_block_t& bb1 = res.insert(l);
+            for (auto const& [next, cond1] : jumps) {
+                basic_block_t& bb1 = edge(bb.id(), next);
                 bb1.insert<Assume>(cond1);
                 newbb >> bb1;
-                bb1 >> res.insert(next_label);
+                bb1 >> node(next);
             }
         } else {
-            for (auto label : nextlist)
-                newbb >> res.insert(label);
+            for (crab::block_id_t next : boost::make_iterator_range(bb.next_blocks()))
+                newbb >> node(next);
         }
     }
     return res;
 }
 
-static std::string instype(Instruction ins) {
+static std::string instype(const Instruction& ins) {
     if (std::holds_alternative<Call>(ins)) {
-        auto call = std::get<Call>(ins);
+        const Call& call = std::get<Call>(ins);
         if (call.returns_map) {
             return "call_1";
         }
@@ -188,18 +204,17 @@ std::map<std::string, int> collect_stats(const cfg_t& cfg) {
     for (const auto& h : stats_headers()) {
         res[h] = 0;
     }
-    for (const auto& this_label : cfg.labels()) {
+    for (basic_block_t const& bb : cfg) {
         res["basic_blocks"]++;
-        basic_block_t const& bb = cfg.get_node(this_label);
         res["instructions"] += bb.size();
-        for (Instruction ins : bb) {
+        for (const Instruction& ins : bb) {
             if (std::holds_alternative<LoadMapFd>(ins)) {
                 if (std::get<LoadMapFd>(ins).mapfd == -1) {
                     res["map_in_map"] = 1;
                 }
             }
             if (std::holds_alternative<Call>(ins)) {
-                auto call = std::get<Call>(ins);
+                const Call& call = std::get<Call>(ins);
                 if (call.func == 43 || call.func == 44)
                     res["adjust_head"] = 1;
             }
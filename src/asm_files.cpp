@@ -1,12 +1,22 @@
+#include <cassert>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "asm_files.hpp"
 #include "spec_type_descriptors.hpp"
 
-#include "elfio/elfio.hpp"
-
 using std::cout;
 using std::string;
 using std::vector;
@@ -28,15 +38,131 @@ struct bpf_map_data {
     struct bpf_load_map_def def;
 };
 
-template <typename T>
-static vector<T> vector_of(ELFIO::section* sec) {
-    if (!sec)
-        return {};
-    auto data = sec->get_data();
-    auto size = sec->get_size();
-    assert(size % sizeof(T) == 0);
-    return {(T*)data, (T*)(data + size)};
-}
+// A read-only mapping of a whole file.
+class mapped_file_t {
+    const char* _data{};
+    size_t _size{};
+
+  public:
+    explicit mapped_file_t(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                _data = static_cast<const char*>(data);
+                _size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+    ~mapped_file_t() {
+        if (_data)
+            munmap(const_cast<char*>(_data), _size);
+    }
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+};
+
+/** The sections of a 64-bit ELF file in the host byte order, read in place from its mapping.
+ *
+ *  Nothing is copied out of the file until asked for; the file must stay mapped while the view is used.
+ */
+class elf_view_t {
+  public:
+    struct section_t {
+        string name;
+        Elf64_Word type{};
+        const char* data{};
+        size_t size{};
+    };
+
+  private:
+    std::vector<section_t> _sections;
+
+    // Copy the object at offset in buf; the file data need not be aligned for T.
+    template <typename T>
+    static T read_at(const char* buf, size_t offset) {
+        T res;
+        std::memcpy(&res, buf + offset, sizeof(T));
+        return res;
+    }
+
+  public:
+    // Throw std::runtime_error if data is not such a file, or is truncated.
+    elf_view_t(const char* data, size_t size) {
+        constexpr unsigned char host_data = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? ELFDATA2LSB : ELFDATA2MSB;
+        if (size < sizeof(Elf64_Ehdr) || std::memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != ELFCLASS64 ||
+            data[EI_DATA] != host_data)
+            throw std::runtime_error("not a 64-bit ELF file in host byte order");
+        const auto ehdr = read_at<Elf64_Ehdr>(data, 0);
+        if (ehdr.e_shnum != 0 && (ehdr.e_shentsize != sizeof(Elf64_Shdr) || ehdr.e_shoff > size ||
+                                  (size - ehdr.e_shoff) / sizeof(Elf64_Shdr) < ehdr.e_shnum))
+            throw std::runtime_error("truncated section header table");
+
+        std::vector<Elf64_Shdr> headers;
+        for (size_t i = 0; i < ehdr.e_shnum; i++)
+            headers.push_back(read_at<Elf64_Shdr>(data, ehdr.e_shoff + i * sizeof(Elf64_Shdr)));
+        for (const Elf64_Shdr& h : headers) {
+            section_t& sec = _sections.emplace_back();
+            sec.type = h.sh_type;
+            if (h.sh_type != SHT_NOBITS) {
+                if (h.sh_offset > size || size - h.sh_offset < h.sh_size)
+                    throw std::runtime_error("truncated section");
+                sec.data = data + h.sh_offset;
+                sec.size = h.sh_size;
+            }
+        }
+        if (ehdr.e_shstrndx < _sections.size()) {
+            const section_t& strtab = _sections[ehdr.e_shstrndx];
+            for (size_t i = 0; i < headers.size(); i++) {
+                if (headers[i].sh_name < strtab.size) {
+                    const char* name = strtab.data + headers[i].sh_name;
+                    _sections[i].name = string(name, strnlen(name, strtab.size - headers[i].sh_name));
+                }
+            }
+        }
+    }
+
+    const std::vector<section_t>& sections() const { return _sections; }
+
+    // The first section named name, or nullptr.
+    const section_t* find(std::string_view name) const {
+        for (const section_t& sec : _sections) {
+            if (sec.name == name)
+                return &sec;
+        }
+        return nullptr;
+    }
+
+    // The number of T in sec, or 0 if there is no such section.
+    template <typename T>
+    static size_t count_of(const section_t* sec) {
+        return sec ? sec->size / sizeof(T) : 0;
+    }
+
+    // The T at offset in sec, which must hold it.
+    template <typename T>
+    static T read(const section_t* sec, size_t offset) {
+        assert(offset + sizeof(T) <= sec->size);
+        return read_at<T>(sec->data, offset);
+    }
+
+    template <typename T>
+    static vector<T> vector_of(const section_t* sec) {
+        if (!sec)
+            return {};
+        assert(sec->size % sizeof(T) == 0);
+        vector<T> res(sec->size / sizeof(T));
+        std::memcpy(res.data(), sec->data, res.size() * sizeof(T));
+        return res;
+    }
+};
 
 int create_map_crab(uint32_t map_type, uint32_t key_size, uint32_t value_size, uint32_t max_entries) {
     if (map_type == 12 || map_type == 13) {
@@ -88,44 +214,53 @@ static BpfProgType section_to_progtype(std::string section, std::string path) {
 
 vector<raw_program> read_elf(std::string path, std::string desired_section, MapFd* fd_alloc) {
     assert(fd_alloc != nullptr);
-    ELFIO::elfio reader;
-    if (!reader.load(path)) {
-        std::cerr << "Can't find or process ELF file " << path << "\n";
-        exit(2);
+    mapped_file_t file(path);
+    if (!file.data())
+        throw std::runtime_error("Can't find or process ELF file " + path);
+    std::optional<elf_view_t> maybe_reader;
+    try {
+        maybe_reader.emplace(file.data(), file.size());
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error("Can't find or process ELF file " + path + ": " + e.what());
     }
+    const elf_view_t& reader = *maybe_reader;
 
+    // One table of maps for all the sections, which the relocations of each fill in as they refer to its maps.
+    auto map_defs = std::make_shared<std::vector<map_def>>();
     program_info info{};
-    auto mapdefs = vector_of<bpf_load_map_def>(reader.sections["maps"]);
+    info.map_defs = map_defs;
+    auto mapdefs = elf_view_t::vector_of<bpf_load_map_def>(reader.find("maps"));
     for (auto s : mapdefs) {
-        info.map_defs.emplace_back(map_def{
-            .original_fd = fd_alloc(s.type, s.key_size, s.value_size, s.max_entries),
+        map_defs->emplace_back(map_def{
+            .original_fd = -1,
             .type = MapType{s.type},
             .key_size = s.key_size,
             .value_size = s.value_size,
         });
     }
-    for (size_t i = 0; i < mapdefs.size(); i++) {
-        unsigned int inner = mapdefs[i].inner_map_idx;
-        info.map_defs[i].inner_map_fd = info.map_defs[inner].original_fd;
-    }
 
-    ELFIO::const_symbol_section_accessor symbols{reader, reader.sections[".symtab"]};
-    auto read_reloc_value = [&symbols](int symbol) -> int {
-        string symbol_name;
-        ELFIO::Elf64_Addr value{};
-        ELFIO::Elf_Xword size;
-        unsigned char bind;
-        unsigned char type;
-        ELFIO::Elf_Half section_index;
-        unsigned char other;
-        symbols.get_symbol(symbol, symbol_name, value, size, bind, type, section_index, other);
-        return value / sizeof(bpf_load_map_def);
+    // Maps are created only once a selected section refers to them, and once per file,
+    // since creating one may be a system call.
+    vector<std::optional<int>> map_fds(mapdefs.size());
+    auto map_fd = [&](size_t i) {
+        if (!map_fds.at(i)) {
+            const bpf_load_map_def& s = mapdefs[i];
+            map_fds[i] = fd_alloc(s.type, s.key_size, s.value_size, s.max_entries);
+        }
+        return *map_fds[i];
+    };
+
+    const elf_view_t::section_t* symbols = reader.find(".symtab");
+    auto read_reloc_value = [symbols](size_t symbol) -> int {
+        if (symbol >= elf_view_t::count_of<Elf64_Sym>(symbols))
+            return 0;
+        return elf_view_t::read<Elf64_Sym>(symbols, symbol * sizeof(Elf64_Sym)).st_value / sizeof(bpf_load_map_def);
     };
 
     vector<raw_program> res;
 
-    for (const auto section : reader.sections) {
-        const string name = section->get_name();
+    for (const elf_view_t::section_t& section : reader.sections()) {
+        const string& name = section.name;
         if (!desired_section.empty() && name != desired_section)
             continue;
         if (name == "license" || name == "version" || name == "maps")
@@ -135,40 +270,32 @@ vector<raw_program> read_elf(std::string path, std::string desired_section, MapF
         }
         info.program_type = section_to_progtype(name, path);
         info.descriptor = get_descriptor(info.program_type);
-        if (section->get_size() == 0)
+        if (section.size == 0)
             continue;
-        raw_program prog{path, name, vector_of<ebpf_inst>(section), info};
-        auto prelocs = reader.sections[string(".rel") + name];
+        // The only copy of the instructions, which relocations patch in place.
+        raw_program prog{path, name, elf_view_t::vector_of<ebpf_inst>(&section), info};
+        auto prelocs = reader.find(".rel" + name);
         if (!prelocs)
-            prelocs = reader.sections[string(".rela") + name];
-
-        // // std::vector<int> updated_fds = sort_maps_by_size(info.map_defs);
-        // for (auto n : updated_fds) {
-        //     std::cout << "old=" << info.map_defs[n].original_fd << ", "
-        //               << "new=" << n << ", "
-        //               << "size=" << info.map_defs[n].value_size << "\n";
-        // }
+            prelocs = reader.find(".rela" + name);
+
         if (prelocs) {
-            ELFIO::const_relocation_section_accessor reloc{reader, prelocs};
-            ELFIO::Elf64_Addr offset;
-            ELFIO::Elf_Word symbol{};
-            ELFIO::Elf_Word type;
-            ELFIO::Elf_Sxword addend;
-            for (unsigned int i = 0; i < reloc.get_entries_num(); i++) {
-                if (reloc.get_entry(i, offset, symbol, type, addend)) {
-                    auto& inst = prog.prog[offset / sizeof(ebpf_inst)];
-                    inst.src = 1; // magic number for LoadFd
-                                  // if (fd_alloc == allocate_fds) {
-                                  //     std::cout << read_reloc_value(symbol) << "=" <<
-                    //     info.map_defs[updated_fds.at(read_reloc_value(symbol))].value_size << "\n"; inst.imm =
-                    //     updated_fds.at(read_reloc_value(symbol));
-                    // } else {
-                    inst.imm = info.map_defs[read_reloc_value(symbol)].original_fd;
-                    // }
+            // Elf64_Rela only adds an addend at the end of Elf64_Rel, which is all we read.
+            const size_t entry_size = prelocs->type == SHT_RELA ? sizeof(Elf64_Rela) : sizeof(Elf64_Rel);
+            for (size_t offset = 0; offset + entry_size <= prelocs->size; offset += entry_size) {
+                const auto r = elf_view_t::read<Elf64_Rel>(prelocs, offset);
+                auto& inst = prog.prog.at(r.r_offset / sizeof(ebpf_inst));
+                inst.src = 1; // magic number for LoadFd
+                const size_t map = read_reloc_value(ELF64_R_SYM(r.r_info));
+                map_def& def = map_defs->at(map);
+                def.original_fd = map_fd(map);
+                if (def.type == MapType::ARRAY_OF_MAPS || def.type == MapType::HASH_OF_MAPS) {
+                    const size_t inner = mapdefs[map].inner_map_idx;
+                    def.inner_map_fd = map_defs->at(inner).original_fd = map_fd(inner);
                 }
+                inst.imm = def.original_fd;
             }
         }
-        res.push_back(prog);
+        res.push_back(std::move(prog));
     }
     if (res.empty()) {
         std::cerr << "Could not find relevant section!\n";
@@ -11,6 +11,8 @@
 using MapFd = auto(uint32_t map_type, uint32_t key_size, uint32_t value_size, uint32_t max_entries) -> int;
 
 std::vector<raw_program> read_raw(std::string path, program_info info);
+// The programs in the sections of the ELF file at path, or only in section if it is not empty. Throws
+// std::runtime_error if the file cannot be read as ELF.
 std::vector<raw_program> read_elf(std::string path, std::string section, MapFd* allocate_fds);
 
 void write_binary_file(std::string path, const char* data, size_t size);
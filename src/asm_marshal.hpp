@@ -5,4 +5,6 @@
 #include <vector>
 
 std::vector<ebpf_inst> marshal(Instruction ins, pc_t pc);
+// The instructions of a whole program, whose jumps name the labels of their targets.
+std::vector<ebpf_inst> marshal(const InstructionSeq& insts);
 // TODO marshal to ostream?
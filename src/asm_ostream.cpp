@@ -1,4 +1,3 @@
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <unordered_map>
@@ -9,6 +8,7 @@
 #include "asm_ostream.hpp"
 #include "asm_syntax.hpp"
 #include "crab/cfg.hpp"
+#include "output_file.hpp"
 
 using std::optional;
 using std::string;
@@ -280,7 +280,7 @@ string to_string(AssertionConstraint const& constraint) {
     return str.str();
 }
 
-int size(Instruction inst) {
+int size(const Instruction& inst) {
     if (std::holds_alternative<Bin>(inst)) {
         if (std::get<Bin>(inst).lddw)
             return 2;
@@ -301,7 +301,7 @@ auto get_labels(const InstructionSeq& insts) {
     return pc_of_label;
 }
 
-static bool is_satisfied(Instruction ins) {
+static bool is_satisfied(const Instruction& ins) {
     return std::holds_alternative<Assert>(ins) && std::get<Assert>(ins).satisfied;
 }
 
@@ -336,17 +336,16 @@ void print(const InstructionSeq& insts, std::ostream& out) {
 }
 
 void print(const InstructionSeq& insts, const std::string& outfile) {
-    std::ofstream out{outfile};
-    print(insts, out);
+    print(insts, *open_output(outfile));
 }
 
 void print_dot(const cfg_t& cfg, std::ostream& out) {
     out << "digraph program {\n";
     out << "    node [shape = rectangle];\n";
-    for (const auto& label : cfg.labels()) {
+    for (const basic_block_t& bb : cfg) {
+        const label_t& label = bb.label();
         out << "    \"" << label << "\"[xlabel=\"" << label << "\",label=\"";
 
-        const auto& bb = cfg.get_node(label);
         for (const auto& ins : bb) {
             if (is_satisfied(ins))
                 continue;
@@ -354,22 +353,18 @@ void print_dot(const cfg_t& cfg, std::ostream& out) {
         }
 
         out << "\"];\n";
-        auto [b, e] = bb.next_blocks();
-        for (const label_t& next : std::vector<label_t>(b, e))
-            out << "    \"" << label << "\" -> \"" << next << "\";\n";
+        for (crab::block_id_t next : boost::make_iterator_range(bb.next_blocks()))
+            out << "    \"" << label << "\" -> \"" << cfg.get_node(next).label() << "\";\n";
         out << "\n";
     }
     out << "}\n";
 }
 
 void print_dot(const cfg_t& cfg, const std::string& outfile) {
-    std::ofstream out{outfile};
-    if (out.fail())
-        throw std::runtime_error(std::string("Could not open file ") + outfile);
-    print_dot(cfg, out);
+    print_dot(cfg, *open_output(outfile));
 }
 
-std::ostream& operator<<(std::ostream& o, const basic_block_t& bb) {
+void print(const cfg_t& cfg, const basic_block_t& bb, std::ostream& o) {
     o << bb.label() << ":\n";
     for (auto const& s : bb) {
         o << "  " << s << ";\n";
@@ -379,7 +374,7 @@ std::ostream& operator<<(std::ostream& o, const basic_block_t& bb) {
         o << "  "
           << "goto ";
         for (; it != et;) {
-            o << *it;
+            o << cfg.get_node(*it).label();
             ++it;
             if (it == et) {
                 o << ";";
@@ -389,23 +384,9 @@ std::ostream& operator<<(std::ostream& o, const basic_block_t& bb) {
         }
     }
     o << "\n";
-    return o;
-}
-
-std::ostream& operator<<(std::ostream& o, const crab::basic_block_rev_t& bb) {
-    o << bb.label() << ":\n";
-    for (auto const& s : bb) {
-        o << "  " << s << ";\n";
-    }
-    o << "--> [";
-    for (auto const& n : boost::make_iterator_range(bb.next_blocks())) {
-        o << n << ";";
-    }
-    o << "]\n";
-    return o;
 }
 
 std::ostream& operator<<(std::ostream& o, const cfg_t& cfg) {
-    cfg.dfs([&](const auto& bb) { o << bb; });
+    cfg.dfs([&](const auto& bb) { print(cfg, bb, o); });
     return o;
-}
\ No newline at end of file
+}
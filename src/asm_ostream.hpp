@@ -57,6 +57,6 @@ inline std::ostream& operator<<(std::ostream& os, Assert const& a) { return os <
 std::ostream& operator<<(std::ostream& os, AssertionConstraint const& a);
 std::string to_string(AssertionConstraint const& constraint);
 
-std::ostream& operator<<(std::ostream& o, const crab::basic_block_t& bb);
-std::ostream& operator<<(std::ostream& o, const crab::basic_block_rev_t& bb);
+// Print a block of cfg, naming its successors by label.
+void print(const cfg_t& cfg, const crab::basic_block_t& bb, std::ostream& out);
 std::ostream& operator<<(std::ostream& o, const cfg_t& cfg);
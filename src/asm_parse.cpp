@@ -1,142 +1,435 @@
-#include <algorithm>
-#include <boost/lexical_cast.hpp>
-#include <map>
-#include <regex>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
 #include <tuple>
 #include <unordered_set>
 
 #include "asm_parse.hpp"
+#include "spec_prototypes.hpp"
 
-using std::regex;
-using std::regex_match;
-
-#define REG R"_((r\d\d?)\s*)_"
-#define IMM R"_(([-+]?\d+))_"
-#define REG_OR_IMM R"_(([+-]?\d+|r\d\d?)\s*)_"
-
-#define FUNC IMM
-#define OPASSIGN R"_(\s*(\S*)=\s*)_"
-#define ASSIGN R"_(\s*=\s*)_"
-#define LONGLONG R"_(\s*(ll|)\s*)_"
-
-#define PLUSMINUS R"_((\s*[+-])\s*)_"
-#define LPAREN R"_(\s*\(\s*)_"
-#define RPAREN R"_(\s*\)\s*)_"
-#define PAREN(x) LPAREN x RPAREN
-#define STAR R"_(\s*\*\s*)_"
-#define DEREF STAR PAREN("u(\\d+)" STAR)
-
-#define CMPOP R"_(\s*(&?[=!]=|s?[<>]=?)\s*)_"
-#define LABEL R"_((\w[a-zA-Z_0-9]*))_"
-#define WRAPPED_LABEL "\\s*<" LABEL ">\\s*"
-
-const std::map<std::string, Bin::Op> str_to_binop = {
-    {"", Bin::Op::MOV},   {"+", Bin::Op::ADD},  {"-", Bin::Op::SUB},    {"*", Bin::Op::MUL},
-    {"/", Bin::Op::DIV},  {"%", Bin::Op::MOD},  {"|", Bin::Op::OR},     {"&", Bin::Op::AND},
-    {"<<", Bin::Op::LSH}, {">>", Bin::Op::RSH}, {">>>", Bin::Op::ARSH}, {"^", Bin::Op::XOR},
-};
+/** The textual assembly is read by hand rather than with regular expressions, which made parsing a line cost as
+ *  much as compiling each of its patterns again. The grammar is the one asm_ostream prints:
+ *
+ *      exit
+ *      call IMM
+ *      REG OP= REG
+ *      REG OP= IMM [ll]
+ *      REG = DEREF (REG +|- IMM)
+ *      DEREF (REG +|- IMM) = REG|IMM
+ *      lock DEREF (REG +|- IMM) += REG
+ *      r0 = DEREF skb[REG|IMM|REG +|- IMM]
+ *      [if REG CMPOP REG|IMM ]goto IMM <LABEL>
+ *
+ *  where DEREF is *(uN *), REG is r followed by one or two digits, IMM is a decimal number with an optional sign, and
+ *  space may surround any token but the keywords.
+ */
 
-const std::map<std::string, Condition::Op> str_to_cmpop = {
-    {"==", Condition::Op::EQ},  {"!=", Condition::Op::NE},   {"&==", Condition::Op::SET}, {"&!=", Condition::Op::NSET},
-    {"<", Condition::Op::LT},   {"<=", Condition::Op::LE},   {">", Condition::Op::GT},    {">=", Condition::Op::GE},
-    {"s<", Condition::Op::SLT}, {"s<=", Condition::Op::SLE}, {"s>", Condition::Op::SGT},  {"s>=", Condition::Op::SGE},
-};
+using std::string_view;
 
-const std::map<std::string, int> str_to_width = {
-    {"8", 1},
-    {"16", 2},
-    {"32", 4},
-    {"64", 8},
-};
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'; }
 
-Reg reg(std::string s) {
-    assert(s.at(0) == 'r');
-    uint8_t res = (uint8_t)boost::lexical_cast<uint16_t>(s.substr(1));
-    return Reg{res};
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool is_word(char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
 }
 
-Imm imm(std::string s) {
-    try {
-        return Imm{boost::lexical_cast<uint64_t>(s)};
-    } catch (const boost::bad_lexical_cast&) {
-        throw std::invalid_argument("number too large");
+static std::optional<Bin::Op> to_binop(string_view s) {
+    if (s.empty())
+        return Bin::Op::MOV;
+    if (s.size() == 1) {
+        switch (s[0]) {
+        case '+': return Bin::Op::ADD;
+        case '-': return Bin::Op::SUB;
+        case '*': return Bin::Op::MUL;
+        case '/': return Bin::Op::DIV;
+        case '%': return Bin::Op::MOD;
+        case '|': return Bin::Op::OR;
+        case '&': return Bin::Op::AND;
+        case '^': return Bin::Op::XOR;
+        }
+        return {};
     }
+    if (s == "<<")
+        return Bin::Op::LSH;
+    if (s == ">>")
+        return Bin::Op::RSH;
+    if (s == ">>>")
+        return Bin::Op::ARSH;
+    return {};
 }
 
-Value reg_or_imm(std::string s) {
-    if (s.at(0) == 'r')
-        return reg(s);
-    else
-        return imm(s);
+static int to_width(string_view bits) {
+    if (bits == "8")
+        return 1;
+    if (bits == "16")
+        return 2;
+    if (bits == "32")
+        return 4;
+    if (bits == "64")
+        return 8;
+    throw std::out_of_range("unknown width u" + std::string(bits));
 }
 
-static Deref deref(std::string width, std::string basereg, std::string sign, std::string _offset) {
-    int offset = boost::lexical_cast<int>(_offset);
-    return Deref{
-        .width = str_to_width.at(width),
-        .basereg = reg(basereg),
-        .offset = (sign == "-" ? -offset : +offset),
-    };
+// The magnitude of a number matched by lexer_t::number(), and whether it is negative.
+static std::tuple<uint64_t, bool> to_magnitude(string_view s) {
+    const bool negative = s[0] == '-';
+    if (s[0] == '-' || s[0] == '+')
+        s.remove_prefix(1);
+    uint64_t res = 0;
+    for (char c : s) {
+        const uint64_t digit = c - '0';
+        if (res > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+            throw std::invalid_argument("number too large");
+        res = res * 10 + digit;
+    }
+    return {res, negative};
 }
 
-Instruction parse_instruction(std::string text) {
-    std::smatch m;
-    if (regex_match(text, m, regex("exit"))) {
-        return Exit{};
+// A negative number wraps around, as the bits of the two's complement it stands for.
+static Imm imm(string_view s) {
+    auto [magnitude, negative] = to_magnitude(s);
+    return Imm{negative ? 0 - magnitude : magnitude};
+}
+
+static int to_int(string_view s) {
+    auto [magnitude, negative] = to_magnitude(s);
+    if (magnitude > (uint64_t)std::numeric_limits<int>::max() + (negative ? 1 : 0))
+        throw std::invalid_argument("number too large");
+    return negative ? (int)(0 - magnitude) : (int)magnitude;
+}
+
+namespace {
+
+// A memory access as matched, converted once the rest of the instruction matches too.
+struct address_t {
+    string_view bits;
+    Reg basereg;
+    bool negative;
+    string_view offset;
+
+    Deref deref() const {
+        const int n = to_int(offset);
+        return Deref{.width = to_width(bits), .basereg = basereg, .offset = negative ? -n : n};
     }
-    if (regex_match(text, m, regex("call " FUNC))) {
-        int func = boost::lexical_cast<int>(m[1]);
-        return Call{.func = func};
-    }
-    if (regex_match(text, m, regex(REG OPASSIGN REG))) {
-        return Bin{.op = str_to_binop.at(m[2]), .is64 = true, .dst = reg(m[1]), .v = reg(m[3]), .lddw = false};
-    }
-    if (regex_match(text, m, regex(REG OPASSIGN IMM LONGLONG))) {
-        return Bin{
-            .op = str_to_binop.at(m[2]), .is64 = true, .dst = reg(m[1]), .v = imm(m[3]), .lddw = !m[4].str().empty()};
-    }
-    if (regex_match(text, m, regex(REG ASSIGN DEREF PAREN(REG PLUSMINUS IMM)))) {
-        return Mem{
-            .access = deref(m[2], m[3], m[4], m[5]),
-            .value = reg(m[1]),
-            .is_load = true,
-        };
-    }
-    if (regex_match(text, m, regex(DEREF PAREN(REG PLUSMINUS IMM) ASSIGN REG_OR_IMM))) {
-        return Mem{
-            .access = deref(m[1], m[2], m[3], m[4]),
-            .value = reg_or_imm(m[5]),
-            .is_load = false,
-        };
-    }
-    if (regex_match(text, m, regex("lock " DEREF PAREN(REG PLUSMINUS IMM) " [+]= " REG))) {
-        return LockAdd{.access = deref(m[1], m[2], m[3], m[4]), .valreg = reg(m[5])};
-    }
-    if (regex_match(text, m, regex("r0 = " DEREF "skb\\[(.*)\\]"))) {
-        auto width = str_to_width.at(m[1]);
-        std::string access = m[2].str();
-        if (regex_match(access, m, regex(REG)))
-            return Packet{.width = width, .offset = 0, .regoffset = reg(m[1])};
-        if (regex_match(access, m, regex(IMM)))
-            return Packet{.width = width, .offset = (int)imm(m[1]).v, .regoffset = {}};
-        if (regex_match(access, m, regex(REG PLUSMINUS REG)))
-            return Packet{.width = width, .offset = 0 /* ? */, .regoffset = reg(m[2])};
-        if (regex_match(access, m, regex(REG PLUSMINUS IMM)))
-            return Packet{.width = width, .offset = (int)imm(m[2]).v, .regoffset = reg(m[1])};
-        return Undefined{0};
+};
+
+// A position in the text of an instruction, moved past each token it matches. A match that fails leaves the
+// position undefined; alternatives start from a copy.
+class lexer_t final {
+    string_view _text;
+    size_t _pos{};
+
+  public:
+    explicit lexer_t(string_view text) : _text(text) {}
+
+    bool at_end() const { return _pos == _text.size(); }
+
+    // Whether the last character matched is a space.
+    bool after_space() const { return _pos > 0 && _text[_pos - 1] == ' '; }
+
+    string_view rest() const { return _text.substr(_pos); }
+
+    void spaces() {
+        while (_pos < _text.size() && is_space(_text[_pos]))
+            _pos++;
+    }
+
+    // Any trailing space, then the end of the text.
+    bool end() {
+        spaces();
+        return at_end();
+    }
+
+    bool literal(string_view s) {
+        if (_text.substr(_pos, s.size()) != s)
+            return false;
+        _pos += s.size();
+        return true;
+    }
+
+    // A token, with any space around it.
+    bool token(char c) {
+        spaces();
+        if (_pos == _text.size() || _text[_pos] != c)
+            return false;
+        _pos++;
+        spaces();
+        return true;
+    }
+
+    string_view digits() {
+        const size_t start = _pos;
+        while (_pos < _text.size() && is_digit(_text[_pos]))
+            _pos++;
+        return _text.substr(start, _pos - start);
+    }
+
+    // [-+]?\d+
+    std::optional<string_view> number() {
+        const size_t start = _pos;
+        if (_pos < _text.size() && (_text[_pos] == '-' || _text[_pos] == '+'))
+            _pos++;
+        if (digits().empty())
+            return {};
+        return _text.substr(start, _pos - start);
+    }
+
+    // r\d\d?
+    std::optional<Reg> reg() {
+        if (_pos + 1 >= _text.size() || _text[_pos] != 'r' || !is_digit(_text[_pos + 1]))
+            return {};
+        uint8_t n = _text[_pos + 1] - '0';
+        _pos += 2;
+        if (_pos < _text.size() && is_digit(_text[_pos]))
+            n = n * 10 + (_text[_pos++] - '0');
+        return Reg{n};
+    }
+
+    std::optional<Value> reg_or_imm() {
+        if (auto r = reg())
+            return *r;
+        if (auto n = number())
+            return imm(*n);
+        return {};
     }
-    if (regex_match(text, m, regex("(if " REG CMPOP REG_OR_IMM " )?goto " IMM WRAPPED_LABEL))) {
-        // We ignore second IMM
-        Jmp res{.cond = {}, .target = m[6]};
-        if (m[1].matched) {
-            res.cond = Condition{
-                .op = str_to_cmpop.at(m[3]),
-                .left = reg(m[2]),
-                .right = reg_or_imm(m[4]),
-            };
+
+    // \w+
+    std::optional<string_view> label() {
+        const size_t start = _pos;
+        while (_pos < _text.size() && is_word(_text[_pos]))
+            _pos++;
+        if (_pos == start)
+            return {};
+        return _text.substr(start, _pos - start);
+    }
+
+    // OP= of an assignment, where OP is any run of characters but space; an assignment that follows is taken as part
+    // of the operator, so that "r1 == r2" is reported as the unknown operator "=".
+    std::optional<string_view> opassign() {
+        spaces();
+        const size_t start = _pos;
+        size_t end = _pos;
+        while (end < _text.size() && !is_space(_text[end]))
+            end++;
+        const size_t assign = _text.substr(start, end - start).rfind('=');
+        if (assign == string_view::npos)
+            return {};
+        _pos = start + assign + 1;
+        spaces();
+        return _text.substr(start, assign);
+    }
+
+    // *(uN *), returning N.
+    std::optional<string_view> deref_width() {
+        if (!token('*') || !token('(') || !literal("u"))
+            return {};
+        string_view bits = digits();
+        if (bits.empty() || !token('*') || !token(')'))
+            return {};
+        return bits;
+    }
+
+    // (REG +|- IMM), after deref_width().
+    std::optional<address_t> address(string_view bits) {
+        if (!token('('))
+            return {};
+        auto basereg = reg();
+        if (!basereg)
+            return {};
+        spaces();
+        const bool negative = literal("-");
+        if (!negative && !literal("+"))
+            return {};
+        spaces();
+        auto offset = number();
+        if (!offset || !token(')'))
+            return {};
+        return address_t{bits, *basereg, negative, *offset};
+    }
+
+    std::optional<address_t> deref() {
+        auto bits = deref_width();
+        if (!bits)
+            return {};
+        return address(*bits);
+    }
+
+    // &?[=!]= or s?[<>]=?
+    std::optional<Condition::Op> cmpop() {
+        spaces();
+        std::optional<Condition::Op> res;
+        if (literal("==")) {
+            res = Condition::Op::EQ;
+        } else if (literal("!=")) {
+            res = Condition::Op::NE;
+        } else if (literal("&==")) {
+            res = Condition::Op::SET;
+        } else if (literal("&!=")) {
+            res = Condition::Op::NSET;
+        } else {
+            const bool is_signed = literal("s");
+            if (literal("<"))
+                res = literal("=") ? (is_signed ? Condition::Op::SLE : Condition::Op::LE)
+                                   : (is_signed ? Condition::Op::SLT : Condition::Op::LT);
+            else if (literal(">"))
+                res = literal("=") ? (is_signed ? Condition::Op::SGE : Condition::Op::GE)
+                                   : (is_signed ? Condition::Op::SGT : Condition::Op::GT);
         }
+        spaces();
         return res;
     }
+};
+
+} // namespace
+
+static std::optional<Instruction> parse_call(string_view text) {
+    lexer_t in(text);
+    if (!in.literal("call "))
+        return {};
+    auto func = in.number();
+    if (!func || !in.at_end())
+        return {};
+    const int n = to_int(*func);
+    Call res = get_helper_summary(n).call;
+    res.func = n;
+    return res;
+}
+
+static std::optional<Instruction> parse_bin(string_view text) {
+    lexer_t in(text);
+    auto dst = in.reg();
+    if (!dst)
+        return {};
+    auto op = in.opassign();
+    if (!op)
+        return {};
+    auto to_op = [&] {
+        if (auto res = to_binop(*op))
+            return *res;
+        throw std::out_of_range("unknown operator " + std::string(*op) + "=");
+    };
+    lexer_t src = in;
+    if (auto r = src.reg(); r && src.end())
+        return Bin{.op = to_op(), .is64 = true, .dst = *dst, .v = *r, .lddw = false};
+    auto n = in.number();
+    if (!n)
+        return {};
+    in.spaces();
+    const bool lddw = in.literal("ll");
+    if (!in.end())
+        return {};
+    return Bin{.op = to_op(), .is64 = true, .dst = *dst, .v = imm(*n), .lddw = lddw};
+}
+
+static std::optional<Instruction> parse_load(string_view text) {
+    lexer_t in(text);
+    auto value = in.reg();
+    if (!value || !in.token('='))
+        return {};
+    auto access = in.deref();
+    if (!access || !in.at_end())
+        return {};
+    return Mem{.access = access->deref(), .value = *value, .is_load = true};
+}
+
+static std::optional<Instruction> parse_store(string_view text) {
+    lexer_t in(text);
+    auto access = in.deref();
+    if (!access || !in.token('='))
+        return {};
+    auto value = in.reg_or_imm();
+    if (!value || !in.end())
+        return {};
+    return Mem{.access = access->deref(), .value = *value, .is_load = false};
+}
+
+static std::optional<Instruction> parse_lock(string_view text) {
+    lexer_t in(text);
+    if (!in.literal("lock "))
+        return {};
+    auto access = in.deref();
+    if (!access || !in.after_space() || !in.literal("+= "))
+        return {};
+    auto valreg = in.reg();
+    if (!valreg || !in.end())
+        return {};
+    return LockAdd{.access = access->deref(), .valreg = *valreg};
+}
+
+// REG, IMM, or REG +|- IMM, between the brackets of skb[...].
+static Instruction parse_packet_access(int width, string_view access) {
+    lexer_t in(access);
+    if (auto n = in.number(); n && in.at_end())
+        return Packet{.width = width, .offset = (int)imm(*n).v, .regoffset = {}};
+    in = lexer_t(access);
+    auto regoffset = in.reg();
+    if (!regoffset)
+        return Undefined{0};
+    if (in.end())
+        return Packet{.width = width, .offset = 0, .regoffset = *regoffset};
+    const bool negative = in.literal("-");
+    if (!negative && !in.literal("+"))
+        return Undefined{0};
+    in.spaces();
+    auto n = in.number();
+    if (!n || !in.at_end())
+        return Undefined{0};
+    const int offset = (int)imm(*n).v;
+    return Packet{.width = width, .offset = negative ? -offset : offset, .regoffset = *regoffset};
+}
+
+static std::optional<Instruction> parse_packet(string_view text) {
+    lexer_t in(text);
+    if (!in.literal("r0 = "))
+        return {};
+    auto bits = in.deref_width();
+    if (!bits || !in.literal("skb["))
+        return {};
+    string_view access = in.rest();
+    if (access.empty() || access.back() != ']' || access.find_first_of("\n\r") != string_view::npos)
+        return {};
+    return parse_packet_access(to_width(*bits), access.substr(0, access.size() - 1));
+}
+
+static std::optional<Instruction> parse_jmp(string_view text) {
+    lexer_t in(text);
+    std::optional<Condition> cond;
+    if (in.literal("if ")) {
+        auto left = in.reg();
+        if (!left)
+            return {};
+        auto op = in.cmpop();
+        if (!op)
+            return {};
+        auto right = in.reg_or_imm();
+        if (!right)
+            return {};
+        in.spaces();
+        if (!in.after_space())
+            return {};
+        cond = Condition{.op = *op, .left = *left, .right = *right};
+    }
+    // The offset is ignored; the target is the label.
+    if (!in.literal("goto ") || !in.number())
+        return {};
+    in.spaces();
+    if (!in.literal("<"))
+        return {};
+    auto target = in.label();
+    if (!target || !in.literal(">") || !in.end())
+        return {};
+    return Jmp{.cond = cond, .target = std::string(*target)};
+}
+
+Instruction parse_instruction(std::string text) {
+    if (text == "exit")
+        return Exit{};
+    for (auto parse : {parse_call, parse_bin, parse_load, parse_store, parse_lock, parse_packet, parse_jmp}) {
+        if (std::optional<Instruction> ins = parse(text))
+            return std::move(*ins);
+    }
     return Undefined{0};
 }
 
@@ -149,19 +442,23 @@ std::vector<std::tuple<label_t, Instruction>> parse_program(std::istream& is) {
     std::optional<std::string> next_label;
     while (std::getline(is, line)) {
         lineno++;
-        std::smatch m;
-        if (regex_search(line, m, regex("^" LABEL ":"))) {
-            next_label = m[1];
-            if (seen_labels.count(m[1]) != 0)
+        lexer_t in(line);
+        lexer_t after_label = in;
+        if (auto label = after_label.label(); label && after_label.literal(":")) {
+            next_label = std::string(*label);
+            if (seen_labels.count(*next_label) != 0)
                 throw std::invalid_argument("duplicate labels");
-            line = m.suffix();
-        }
-        if (regex_search(line, m, regex(R"(^\s*(\d+:)?\s*)"))) {
-            line = m.suffix();
+            in = after_label;
         }
-        if (line.empty())
+        // The address of the instruction, as printed by print().
+        in.spaces();
+        lexer_t after_address = in;
+        if (!after_address.digits().empty() && after_address.literal(":"))
+            in = after_address;
+        in.spaces();
+        if (in.at_end())
             continue;
-        Instruction ins = parse_instruction(line);
+        Instruction ins = parse_instruction(std::string(in.rest()));
         if (std::holds_alternative<Undefined>(ins))
             continue;
 
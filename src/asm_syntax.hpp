@@ -2,10 +2,13 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <variant>
 #include <vector>
 
+#include <boost/container/static_vector.hpp>
+
 #include "crab/types.hpp"
 #include "spec_type_descriptors.hpp"
 
@@ -92,7 +95,7 @@ struct Jmp {
 
 struct ArgSingle {
     // see comments in spec_prototypes.hpp
-    enum class Kind {
+    enum class Kind : uint8_t {
         MAP_FD,
         PTR_TO_MAP_KEY,
         PTR_TO_MAP_VALUE,
@@ -103,7 +106,7 @@ struct ArgSingle {
 };
 
 struct ArgPair {
-    enum class Kind {
+    enum class Kind : uint8_t {
         PTR_TO_MEM,
         PTR_TO_MEM_OR_NULL,
         PTR_TO_UNINIT_MEM,
@@ -113,13 +116,16 @@ struct ArgPair {
     bool can_be_zero{};
 };
 
+// Kept free of heap members, since instructions are copied along with the cfg.
 struct Call {
     int32_t func{};
-    std::string name;
+    // Points into the static table of helper prototypes.
+    std::string_view name;
     bool pkt_access{};
     bool returns_map{};
-    std::vector<ArgSingle> singles;
-    std::vector<ArgPair> pairs;
+    // A helper takes at most 5 arguments, and a pair spans two of them.
+    boost::container::static_vector<ArgSingle, 5> singles;
+    boost::container::static_vector<ArgPair, 3> pairs;
 };
 
 struct Exit {};
@@ -236,7 +242,8 @@ using Instruction = std::variant<Undefined, Bin, Un, LoadMapFd, Call, Exit, Jmp,
 using LabeledInstruction = std::tuple<label_t, Instruction>;
 using InstructionSeq = std::vector<LabeledInstruction>;
 
-using pc_t = uint16_t;
+// Wide enough for programs of more than 64K instructions.
+using pc_t = uint32_t;
 
 // Helpers:
 
@@ -1,8 +1,10 @@
 #include <assert.h>
 #include <cstring> // memcmp
 #include <iostream>
+#include <optional>
 #include <string>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "linux_ebpf.hpp"
@@ -20,14 +22,6 @@ void compare(string field, T actual, T expected) {
         std::cerr << field << ": (actual) " << std::hex << (int)actual << " != " << (int)expected << " (expected)\n";
 }
 
-struct InvalidInstruction : std::invalid_argument {
-    explicit InvalidInstruction(const char* what) : std::invalid_argument{what} {}
-};
-
-struct UnsupportedMemoryMode : std::invalid_argument {
-    explicit UnsupportedMemoryMode(const char* what) : std::invalid_argument{what} {}
-};
-
 static auto getMemIsLoad(uint8_t opcode) -> bool {
     switch (opcode & EBPF_CLS_MASK) {
     case EBPF_CLS_LD: return true;
@@ -59,10 +53,26 @@ static auto getMemWidth(uint8_t opcode) -> int {
 // }
 
 struct Unmarshaller {
-    vector<vector<string>>& notes;
-    void note(const string& what) { notes.back().emplace_back(what); }
-    void note_next_pc() { notes.emplace_back(); }
-    explicit Unmarshaller(vector<vector<string>>& notes) : notes{notes} { note_next_pc(); }
+    // Where the notes of each pc go, if anywhere.
+    vector<vector<string>>* notes;
+    void note(const string& what) {
+        if (notes)
+            notes->back().emplace_back(what);
+    }
+    void note_next_pc() {
+        if (notes)
+            notes->emplace_back();
+    }
+    explicit Unmarshaller(vector<vector<string>>* notes) : notes{notes} { note_next_pc(); }
+
+    // Why the program cannot be unmarshalled, if it cannot: set by the first instruction found invalid, rather than
+    // only noted, after which unmarshalling stops. It is not thrown, so that rejecting the mostly invalid programs of
+    // a fuzzer costs no more than decoding valid ones.
+    std::optional<string> error;
+    void fail(const char* what) {
+        if (!error)
+            error = what;
+    }
 
     auto getAluOp(ebpf_inst inst) -> std::variant<Bin::Op, Un::Op> {
         switch ((inst.opcode >> 4) & 0xF) {
@@ -87,16 +97,16 @@ struct Unmarshaller {
             case 16: return Un::Op::LE16;
             case 32:
                 if ((inst.opcode & EBPF_CLS_MASK) == EBPF_CLS_ALU64)
-                    throw InvalidInstruction("invalid endian immediate 32 for 64 bit instruction");
+                    fail("invalid endian immediate 32 for 64 bit instruction");
                 return Un::Op::LE32;
             case 64:
                 if ((inst.opcode & EBPF_CLS_MASK) == EBPF_CLS_ALU)
-                    throw InvalidInstruction("invalid endian immediate 64 for 32 bit instruction");
+                    fail("invalid endian immediate 64 for 32 bit instruction");
                 return Un::Op::LE64;
             default: note("invalid endian immediate; falling back to 64"); return Un::Op::LE64;
             }
-        case 0xe: throw InvalidInstruction{"Invalid ALU op 0xe"};
-        case 0xf: throw InvalidInstruction{"Invalid ALU op 0xf"};
+        case 0xe: fail("Invalid ALU op 0xe"); return {};
+        case 0xf: fail("Invalid ALU op 0xf"); return {};
         }
         return {};
     }
@@ -115,7 +125,7 @@ struct Unmarshaller {
         }
     }
 
-    static auto getJmpOp(uint8_t opcode) -> Condition::Op {
+    auto getJmpOp(uint8_t opcode) -> Condition::Op {
         using Op = Condition::Op;
         switch ((opcode >> 4) & 0xF) {
         case 0x0: return {}; // goto
@@ -132,7 +142,7 @@ struct Unmarshaller {
         case 0xb: return Op::LE;
         case 0xc: return Op::SLT;
         case 0xd: return Op::SLE;
-        case 0xe: throw InvalidInstruction{"Invalid JMP op 0xe"};
+        case 0xe: fail("Invalid JMP op 0xe"); return {};
         }
         return {};
     }
@@ -146,22 +156,28 @@ struct Unmarshaller {
         switch ((inst.opcode & EBPF_MODE_MASK) >> 5) {
         case 0: note("Bad instruction"); return Undefined{(int)inst.opcode};
         case EBPF_ABS:
-            if (!isLD)
-                throw UnsupportedMemoryMode{"ABS but not LD"};
+            if (!isLD) {
+                fail("ABS but not LD");
+                return Undefined{(int)inst.opcode};
+            }
             if (width == 8)
                 note("invalid opcode LDABSDW");
             return Packet{.width = width, .offset = inst.imm, .regoffset = {}};
 
         case EBPF_IND:
-            if (!isLD)
-                throw UnsupportedMemoryMode{"IND but not LD"};
+            if (!isLD) {
+                fail("IND but not LD");
+                return Undefined{(int)inst.opcode};
+            }
             if (width == 8)
                 note("invalid opcode LDINDDW");
             return Packet{.width = width, .offset = inst.imm, .regoffset = Reg{inst.src}};
 
         case EBPF_MEM: {
-            if (isLD)
-                throw UnsupportedMemoryMode{"plain LD"};
+            if (isLD) {
+                fail("plain LD");
+                return Undefined{(int)inst.opcode};
+            }
             bool isLoad = getMemIsLoad(inst.opcode);
             if (isLoad && inst.dst == 10)
                 note("Cannot modify r10");
@@ -187,9 +203,9 @@ struct Unmarshaller {
             return res;
         }
 
-        case EBPF_LEN: throw UnsupportedMemoryMode{"LEN"};
+        case EBPF_LEN: fail("LEN"); return Undefined{(int)inst.opcode};
 
-        case EBPF_MSH: throw UnsupportedMemoryMode{"MSH"};
+        case EBPF_MSH: fail("MSH"); return Undefined{(int)inst.opcode};
 
         case EBPF_XADD:
             return LockAdd{
@@ -201,7 +217,7 @@ struct Unmarshaller {
                     },
                 .valreg = Reg{inst.src},
             };
-        case EBPF_MEM_UNUSED: throw UnsupportedMemoryMode{"Memory mode 7"};
+        case EBPF_MEM_UNUSED: fail("Memory mode 7"); return Undefined{(int)inst.opcode};
         }
         return {};
     }
@@ -249,55 +265,9 @@ struct Unmarshaller {
         };
     }
 
-    static ArgSingle::Kind toArgSingleKind(Arg t) {
-        switch (t) {
-        case Arg::ANYTHING: return ArgSingle::Kind::ANYTHING;
-        case Arg::CONST_SHARED_PTR: return ArgSingle::Kind::MAP_FD;
-        case Arg::PTR_TO_MAP_KEY: return ArgSingle::Kind::PTR_TO_MAP_KEY;
-        case Arg::PTR_TO_MAP_VALUE: return ArgSingle::Kind::PTR_TO_MAP_VALUE;
-        case Arg::PTR_TO_CTX: return ArgSingle::Kind::PTR_TO_CTX;
-        default: break;
-        }
-        return {};
-    }
-    static ArgPair::Kind toArgPairKind(Arg t) {
-        switch (t) {
-        case Arg::PTR_TO_MEM_OR_NULL: return ArgPair::Kind::PTR_TO_MEM_OR_NULL;
-        case Arg::PTR_TO_MEM: return ArgPair::Kind::PTR_TO_MEM;
-        case Arg::PTR_TO_UNINIT_MEM: return ArgPair::Kind::PTR_TO_UNINIT_MEM;
-        default: break;
-        }
-        return {};
-    }
-
     static auto makeCall(int32_t imm) {
-        bpf_func_proto proto = get_prototype(imm);
-        Call res;
+        Call res = get_helper_summary(imm).call;
         res.func = imm;
-        res.name = proto.name;
-        res.pkt_access = proto.pkt_access;
-        res.returns_map = proto.ret_type == Ret::PTR_TO_MAP_VALUE_OR_NULL;
-        std::array<Arg, 7> args = {{Arg::DONTCARE, proto.arg1_type, proto.arg2_type, proto.arg3_type, proto.arg4_type,
-                                    proto.arg5_type, Arg::DONTCARE}};
-        for (size_t i = 1; i < args.size() - 1; i++) {
-            switch (args[i]) {
-            case Arg::DONTCARE: return res;
-            case Arg::ANYTHING:
-            case Arg::CONST_SHARED_PTR:
-            case Arg::PTR_TO_MAP_KEY:
-            case Arg::PTR_TO_MAP_VALUE:
-            case Arg::PTR_TO_CTX: res.singles.push_back({toArgSingleKind(args[i]), Reg{(uint8_t)i}}); break;
-            case Arg::CONST_SIZE: assert(false); continue;
-            case Arg::CONST_SIZE_OR_ZERO: assert(false); continue;
-            case Arg::PTR_TO_MEM_OR_NULL:
-            case Arg::PTR_TO_MEM:
-            case Arg::PTR_TO_UNINIT_MEM:
-                bool can_be_zero = (args[i + 1] == Arg::CONST_SIZE_OR_ZERO);
-                res.pairs.push_back({toArgPairKind(args[i]), Reg{(uint8_t)i}, Reg{(uint8_t)(i + 1)}, can_be_zero});
-                i++;
-                break;
-            }
-        }
         return res;
     }
     auto makeJmp(ebpf_inst inst, const vector<ebpf_inst>& insts, pc_t pc) -> Instruction {
@@ -329,12 +299,13 @@ struct Unmarshaller {
         }
     }
 
-    vector<LabeledInstruction> unmarshal(vector<ebpf_inst> const& insts) {
+    std::variant<InstructionSeq, string> unmarshal(vector<ebpf_inst> const& insts) {
         vector<LabeledInstruction> prog;
         int exit_count = 0;
         if (insts.size() == 0) {
-            throw std::invalid_argument("Zero length programs are not allowed");
+            return string("Zero length programs are not allowed");
         }
+        prog.reserve(insts.size());
         for (pc_t pc = 0; pc < insts.size();) {
             ebpf_inst inst = insts[pc];
             Instruction new_ins;
@@ -369,8 +340,10 @@ struct Unmarshaller {
                 break;
             }
 
-            case EBPF_CLS_UNUSED: throw InvalidInstruction{"Invalid class 0x6"};
+            case EBPF_CLS_UNUSED: fail("Invalid class 0x6"); break;
             }
+            if (error)
+                return *error;
             /*
             vector<ebpf_inst> marshalled = marshal(new_ins[0], pc);
             ebpf_inst actual = marshalled[0];
@@ -386,7 +359,7 @@ struct Unmarshaller {
             */
             if (pc == insts.size() - 1 && fallthrough)
                 note("fallthrough in last instruction");
-            prog.emplace_back(std::to_string(pc), new_ins);
+            prog.emplace_back(std::to_string(pc), std::move(new_ins));
             pc++;
             note_next_pc();
             if (lddw) {
@@ -401,15 +374,9 @@ struct Unmarshaller {
 };
 
 std::variant<InstructionSeq, std::string> unmarshal(const raw_program& raw_prog, vector<vector<string>>& notes) {
-    try {
-        return Unmarshaller{notes}.unmarshal(raw_prog.prog);
-    } catch (InvalidInstruction& arg) {
-        std::cerr << arg.what() << "\n";
-        return arg.what();
-    }
+    return Unmarshaller{&notes}.unmarshal(raw_prog.prog);
 }
 
 std::variant<InstructionSeq, std::string> unmarshal(const raw_program& raw_prog) {
-    vector<vector<string>> notes;
-    return unmarshal(raw_prog, notes);
+    return Unmarshaller{nullptr}.unmarshal(raw_prog.prog);
 }
@@ -13,8 +13,11 @@
  *  of Instructions.
  *
  *  \param raw_prog is the input program to parse.
- *  \param notes is where errors and warnings are written to.
+ *  \param notes is where errors and warnings are written to, one vector per pc.
  *  \return a sequence of instruction if successful, an error string otherwise.
+ *
+ *  Does not throw: invalid instructions and empty programs give the error string.
  */
 std::variant<InstructionSeq, std::string> unmarshal(const raw_program& raw_prog, std::vector<std::vector<std::string>>& notes);
+// As above, without collecting notes.
 std::variant<InstructionSeq, std::string> unmarshal(const raw_program& raw_prog);
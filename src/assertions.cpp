@@ -1,11 +1,14 @@
+#include <array>
 #include <cinttypes>
 
+#include <optional>
 #include <utility>
 #include <vector>
 
 #include "asm_ostream.hpp"
 #include "asm_syntax.hpp"
 #include "crab/cfg.hpp"
+#include "spec_prototypes.hpp"
 #include "spec_type_descriptors.hpp"
 
 using std::string;
@@ -13,8 +16,7 @@ using std::to_string;
 using std::vector;
 
 class AssertExtractor {
-    program_info info;
-    const bool is_privileged = info.program_type == BpfProgType::KPROBE;
+    const bool is_privileged;
 
     static auto type_of(Reg r, TypeGroup t) { return Assert{TypeConstraint{r, t}}; };
 
@@ -23,71 +25,23 @@ class AssertExtractor {
     }
 
   public:
-    explicit AssertExtractor(program_info info) : info{std::move(info)} {}
+    explicit AssertExtractor(const program_info& info) : is_privileged{info.program_type == BpfProgType::KPROBE} {}
 
     template <typename T>
-    vector<Assert> operator()(T ins) {
+    vector<Assert> operator()(const T&) const {
         return {};
     }
 
-    vector<Assert> operator()(Packet const& ins) { return {type_of(Reg{6}, TypeGroup::ctx)}; }
+    vector<Assert> operator()(Packet const& ins) const { return {type_of(Reg{6}, TypeGroup::ctx)}; }
 
-    vector<Assert> operator()(Exit const& e) { return {type_of(Reg{0}, TypeGroup::num)}; }
+    vector<Assert> operator()(Exit const& e) const { return {type_of(Reg{0}, TypeGroup::num)}; }
 
-    vector<Assert> operator()(Call const& call) {
-        vector<Assert> res;
-        std::optional<Reg> map_fd_reg;
-        for (ArgSingle arg : call.singles) {
-            switch (arg.kind) {
-            case ArgSingle::Kind::ANYTHING:
-                // avoid pointer leakage:
-                if (!is_privileged)
-                    res.push_back(type_of(arg.reg, TypeGroup::num));
-                break;
-            case ArgSingle::Kind::MAP_FD:
-                res.push_back(type_of(arg.reg, TypeGroup::map_fd));
-                map_fd_reg = arg.reg;
-                break;
-            case ArgSingle::Kind::PTR_TO_MAP_KEY:
-            case ArgSingle::Kind::PTR_TO_MAP_VALUE:
-                res.push_back(type_of(arg.reg, TypeGroup::stack_or_packet));
-                res.push_back(
-                    Assert{ValidMapKeyValue{arg.reg, *map_fd_reg, arg.kind == ArgSingle::Kind::PTR_TO_MAP_KEY}});
-                break;
-            case ArgSingle::Kind::PTR_TO_CTX:
-                res.push_back(type_of(arg.reg, TypeGroup::ctx));
-                // TODO: the kernel has some other conditions here -
-                // maybe offset == 0
-                break;
-            }
-        }
-        for (ArgPair arg : call.pairs) {
-            bool or_null = false;
-            switch (arg.kind) {
-            case ArgPair::Kind::PTR_TO_MEM_OR_NULL:
-                res.push_back(type_of(arg.mem, TypeGroup::mem_or_num));
-                // res.push_back(Assert{OnlyZeroIfNum{arg.mem}});
-                or_null = true;
-                break;
-            case ArgPair::Kind::PTR_TO_MEM:
-                /* LINUX: pointer to valid memory (stack, packet, map value) */
-                // TODO: check initialization
-                res.push_back(type_of(arg.mem, TypeGroup::mem));
-                break;
-            case ArgPair::Kind::PTR_TO_UNINIT_MEM:
-                // memory may be uninitialized, i.e. write only
-                res.push_back(type_of(arg.mem, TypeGroup::mem));
-                break;
-            }
-            // TODO: reg is constant (or maybe it's not important)
-            res.push_back(type_of(arg.size, TypeGroup::num));
-            res.push_back(Assert{ValidSize{arg.size, arg.can_be_zero}});
-            check_access(res, arg.mem, 0, arg.size, or_null);
-        }
-        return res;
+    vector<Assert> operator()(Call const& call) const {
+        const helper_summary_t& helper = get_helper_summary(call.func);
+        return is_privileged ? helper.privileged_preconditions : helper.preconditions;
     }
 
-    vector<Assert> explicate(Condition cond) {
+    vector<Assert> explicate(const Condition& cond) const {
         if (is_privileged)
             return {};
         vector<Assert> res;
@@ -109,15 +63,15 @@ class AssertExtractor {
         return res;
     }
 
-    vector<Assert> operator()(Assume ins) { return explicate(ins.cond); }
+    vector<Assert> operator()(Assume const& ins) const { return explicate(ins.cond); }
 
-    vector<Assert> operator()(Jmp ins) {
+    vector<Assert> operator()(Jmp const& ins) const {
         if (!ins.cond)
             return {};
         return explicate(*ins.cond);
     }
 
-    vector<Assert> operator()(Mem ins) {
+    vector<Assert> operator()(Mem const& ins) const {
         vector<Assert> res;
         Reg reg = ins.access.basereg;
         Imm width{static_cast<uint32_t>(ins.access.width)};
@@ -138,7 +92,7 @@ class AssertExtractor {
         return res;
     };
 
-    vector<Assert> operator()(LockAdd ins) {
+    vector<Assert> operator()(LockAdd const& ins) const {
         vector<Assert> res;
         res.push_back(type_of(ins.access.basereg, TypeGroup::shared));
         check_access(res, ins.access.basereg, ins.access.offset, Imm{static_cast<uint32_t>(ins.access.width)});
@@ -147,7 +101,7 @@ class AssertExtractor {
 
     static void same_type(vector<Assert>& res, Reg r1, Reg r2) { res.push_back(Assert{Comparable{r1, r2}}); }
 
-    vector<Assert> operator()(Bin ins) {
+    vector<Assert> operator()(Bin const& ins) const {
         switch (ins.op) {
         case Bin::Op::MOV: return {};
         case Bin::Op::ADD:
@@ -175,14 +129,205 @@ class AssertExtractor {
     }
 };
 
+// The types of registers that are known without analysis, by a forward pass over the CFG that is much cheaper than
+// the numerical one: a register is a number after most ALU operations, and r10 points to the top of the stack.
+// Assertions that follow from these alone hold in every state the analysis may reach, so they are marked satisfied
+// and not checked.
+class SyntacticTypes {
+    // frame is the stack at offset STACK_SIZE, as r10 starts.
+    enum class Kind : uint8_t { unknown, num, stack, frame };
+    // Every register an instruction can name: unmarshal() notes those past r10 rather than rejecting them.
+    using regs_t = std::array<Kind, 16>;
+
+    regs_t regs{};
+
+    static bool is_stack(Kind kind) { return kind == Kind::stack || kind == Kind::frame; }
+    bool is(Reg r, Kind kind) const { return regs[r.v] == kind; }
+    bool is_stack(Reg r) const { return is_stack(regs[r.v]); }
+
+    void scratch_caller_saved_registers() {
+        for (uint8_t i = 1; i <= 5; i++)
+            regs[i] = Kind::unknown;
+    }
+
+    static bool contains(TypeGroup types, Kind kind) {
+        switch (kind) {
+        case Kind::num:
+            return types == TypeGroup::num || types == TypeGroup::non_map_fd || types == TypeGroup::mem_or_num ||
+                   types == TypeGroup::ptr_or_num;
+        case Kind::stack:
+        case Kind::frame:
+            return types == TypeGroup::stack || types == TypeGroup::non_map_fd || types == TypeGroup::mem ||
+                   types == TypeGroup::mem_or_num || types == TypeGroup::ptr || types == TypeGroup::ptr_or_num ||
+                   types == TypeGroup::stack_or_packet;
+        default: return false;
+        }
+    }
+
+    static Kind join(Kind a, Kind b) {
+        if (a == b)
+            return a;
+        if (is_stack(a) && is_stack(b))
+            return Kind::stack;
+        return Kind::unknown;
+    }
+
+    // Join other into this, returning whether anything changed.
+    bool join(const SyntacticTypes& other) {
+        bool changed = false;
+        for (size_t i = 0; i < regs.size(); i++) {
+            Kind k = join(regs[i], other.regs[i]);
+            changed |= k != regs[i];
+            regs[i] = k;
+        }
+        return changed;
+    }
+
+  public:
+    // The types at the entry of the program.
+    static SyntacticTypes entry() {
+        SyntacticTypes res;
+        res.regs[10] = Kind::frame;
+        return res;
+    }
+
+    // The types before each block of cfg, by block id, with nothing known at the blocks that cannot be reached.
+    static vector<SyntacticTypes> of(const cfg_t& cfg) {
+        vector<std::optional<SyntacticTypes>> pre(cfg.num_ids());
+        vector<bool> pending(cfg.num_ids());
+        vector<crab::block_id_t> todo{cfg.entry()};
+        pre[cfg.entry()] = entry();
+        pending[cfg.entry()] = true;
+        // Each register of each block only goes down from a kind to unknown, so this ends after a few visits each.
+        while (!todo.empty()) {
+            crab::block_id_t id = todo.back();
+            todo.pop_back();
+            pending[id] = false;
+            SyntacticTypes post = *pre[id];
+            for (const Instruction& ins : cfg.get_node(id))
+                post(ins);
+            for (crab::block_id_t next : cfg.next_nodes(id)) {
+                bool changed = !pre[next] ? (pre[next] = post, true) : pre[next]->join(post);
+                if (changed && !pending[next]) {
+                    pending[next] = true;
+                    todo.push_back(next);
+                }
+            }
+        }
+        vector<SyntacticTypes> res(pre.size());
+        for (size_t i = 0; i < pre.size(); i++)
+            if (pre[i])
+                res[i] = *pre[i];
+        return res;
+    }
+
+    bool satisfied(const Assert& a) const { return std::visit(*this, a.cst); }
+
+    bool operator()(const TypeConstraint& s) const { return contains(s.types, regs[s.reg.v]); }
+
+    bool operator()(const Comparable& s) const {
+        return is(s.r1, Kind::num) ? is(s.r2, Kind::num) : is_stack(s.r1) && is_stack(s.r2);
+    }
+
+    bool operator()(const Addable& s) const { return is(s.ptr, Kind::num) || is(s.num, Kind::num); }
+
+    bool operator()(const ValidStore& s) const { return is_stack(s.mem) || is(s.val, Kind::num); }
+
+    bool operator()(const ValidAccess& s) const {
+        if (s.or_null || !std::holds_alternative<Imm>(s.width))
+            return false;
+        int width = static_cast<int>(std::get<Imm>(s.width).v);
+        // A comparison check only constrains pointers.
+        if (width == 0 && is(s.reg, Kind::num))
+            return true;
+        return is(s.reg, Kind::frame) && s.offset >= -STACK_SIZE && s.offset + width <= 0;
+    }
+
+    template <typename T>
+    bool operator()(const T&) const {
+        return false;
+    }
+
+    // Apply an instruction.
+    void operator()(const Instruction& ins) { std::visit(*this, ins); }
+
+    void operator()(const Bin& ins) {
+        Kind& dst = regs[ins.dst.v];
+        if (std::holds_alternative<Imm>(ins.v)) {
+            switch (ins.op) {
+            case Bin::Op::ADD:
+            case Bin::Op::SUB:
+                if (dst == Kind::frame)
+                    dst = Kind::stack;
+                break;
+            default: dst = Kind::num; break;
+            }
+            return;
+        }
+        Kind src = regs[std::get<Reg>(ins.v).v];
+        switch (ins.op) {
+        case Bin::Op::MOV: dst = src; break;
+        case Bin::Op::ADD:
+            if (dst == Kind::num && src == Kind::num)
+                dst = Kind::num;
+            else if ((dst == Kind::num && is_stack(src)) || (is_stack(dst) && src == Kind::num))
+                dst = Kind::stack;
+            else
+                dst = Kind::unknown;
+            break;
+        case Bin::Op::SUB:
+            if (dst == Kind::num && src == Kind::num)
+                dst = Kind::num;
+            else if (is_stack(dst) && src == Kind::num)
+                dst = Kind::stack;
+            else if (is_stack(dst) && is_stack(src))
+                dst = Kind::num;
+            else
+                dst = Kind::unknown;
+            break;
+        default: dst = Kind::num; break;
+        }
+    }
+
+    void operator()(const Un& ins) { regs[ins.dst.v] = Kind::num; }
+
+    void operator()(const LoadMapFd& ins) { regs[ins.dst.v] = Kind::unknown; }
+
+    void operator()(const Mem& ins) {
+        if (ins.is_load)
+            regs[std::get<Reg>(ins.value).v] = Kind::unknown;
+    }
+
+    void operator()(const Call&) {
+        regs[0] = Kind::unknown;
+        scratch_caller_saved_registers();
+    }
+
+    void operator()(const Packet&) {
+        regs[0] = Kind::num;
+        scratch_caller_saved_registers();
+    }
+
+    template <typename T>
+    void operator()(const T&) {}
+};
+
 void explicate_assertions(cfg_t& cfg, const program_info& info) {
-    for (auto& [label, bb] : cfg) {
-        label.empty(); // placate the compiler
-        vector<Instruction> insts;
-        for (const auto& ins : vector<Instruction>(bb.begin(), bb.end())) {
-            for (auto a : std::visit(AssertExtractor{info}, ins))
-                insts.emplace_back(a);
-            insts.push_back(ins);
+    const AssertExtractor extractor{info};
+    const vector<SyntacticTypes> pre = SyntacticTypes::of(cfg);
+    // Reused across blocks, so that each block costs one pass and no allocation once it has grown.
+    vector<Instruction> insts;
+    for (basic_block_t& bb : cfg) {
+        insts.clear();
+        insts.reserve(2 * std::distance(bb.begin(), bb.end()));
+        SyntacticTypes types = pre[bb.id()];
+        for (Instruction& ins : bb) {
+            for (Assert& a : std::visit(extractor, ins)) {
+                a.satisfied = types.satisfied(a);
+                insts.emplace_back(std::move(a));
+            }
+            types(ins);
+            insts.push_back(std::move(ins));
         }
         bb.swap_instructions(insts);
     }
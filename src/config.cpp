@@ -1,8 +1,35 @@
+#include <climits>
+
 #include "config.hpp"
 
 global_options_t global_options{
     .simplify = true,
+    .fold_constants = false,
+    .slice = false,
     .check_semantic_reachability = false,
     .print_invariants = false,
-    .print_failures = false
+    .print_failures = false,
+    .widening_delay = 1,
+    .widening_thresholds = 0,
+    .max_narrowing_iterations = UINT_MAX,
+    .warm_start_loops = false,
+    .pack_variables = false,
+    .relations = relations_t::differences,
+    .fallback_to_zones = false,
+    .max_relational_variables = 0,
+    .fail_fast = false,
+    .timeout_seconds = 0,
+    .max_rss_mb = 0,
+    .print_phase_stats = false,
+    .print_perf_counters = false,
+    .closure_threads = 1,
+    .fixpoint_threads = 1,
+    .huge_pages = false,
+    .forget_dead_variables = true,
+    .known_bits = true,
+    .summarize_blocks = false,
+    .invariants_file = {},
+    .checkpoint_file = {},
+    .checkpoint_seconds = 60,
+    .resume = false
 };
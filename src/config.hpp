@@ -1,11 +1,71 @@
 #pragma once
 
+#include <string>
+
+// The relations between variables that the numeric domain keeps, from the cheapest to the most precise: none (only
+// intervals), equalities x = y + k, or all differences x - y <= k (zones).
+enum class relations_t { none, equalities, differences };
+
 // defaults are in definition
 struct global_options_t {
     bool simplify;
+    // fold the constant operations and copies of each block before the analysis
+    bool fold_constants;
+    // leave out the statements that no assertion depends on before the analysis
+    bool slice;
     bool check_semantic_reachability;
     bool print_invariants;
     bool print_failures;
+    // number of loop iterations joined before widening kicks in
+    unsigned int widening_delay;
+    // maximum number of constants per loop to widen to; 0 disables threshold widening
+    unsigned int widening_thresholds;
+    // maximum number of decreasing (narrowing) iterations per loop
+    unsigned int max_narrowing_iterations;
+    // start the iterations of a nested loop entered again with a larger state from its previous fixpoint
+    bool warm_start_loops;
+    // keep variables in separate zones until a constraint relates them
+    bool pack_variables;
+    // the relations between variables kept by the numeric domain
+    relations_t relations;
+    // verify again with all differences the programs that could not be proven with fewer relations
+    bool fallback_to_zones;
+    // the number of variables of each zone that may have relations; the least connected others only keep their
+    // bounds. 0 for no limit
+    unsigned int max_relational_variables;
+    // stop the analysis at the first assertion that cannot be proven
+    bool fail_fast;
+    // give up on the analysis after this many seconds of wall-clock time; 0 for no limit
+    unsigned int timeout_seconds;
+    // give up on the analysis once the process resident set size exceeds this many megabytes; 0 for no limit
+    unsigned long max_rss_mb;
+    // append the time of each verification phase and the analysis counters to the CSV output
+    bool print_phase_stats;
+    // with print_phase_stats, also append the hardware events counted during the fixpoint
+    bool print_perf_counters;
+    // threads closing each large zone after a meet or widening, counting the analyzing thread; 0 for one per core
+    unsigned int closure_threads;
+    // threads analyzing the parts of the program that do not depend on each other at once, and checking its blocks
+    // once the analysis is done, counting the analyzing thread; 0 for one per core
+    unsigned int fixpoint_threads;
+    // ask the kernel to back the chunks that the graphs of the analysis are carved from with transparent huge pages
+    bool huge_pages;
+    // forget the registers and stack cells that are dead at the end of each block
+    bool forget_dead_variables;
+    // keep the bits known of the value of each register through the ALU operations, and bound the values by them
+    bool known_bits;
+    // analyze the blocks of loops through summaries of their statements compiled once, without those that do not
+    // change their post-state
+    bool summarize_blocks;
+    // write the invariants of each block to this file, as JSON if it ends with .json and compactly otherwise; none if
+    // empty
+    std::string invariants_file;
+    // save the analysis to this file as it goes, so that it may be resumed if it is stopped; none if empty
+    std::string checkpoint_file;
+    // save the analysis at most once per this many seconds of wall-clock time
+    unsigned int checkpoint_seconds;
+    // start the analysis from checkpoint_file, if it exists
+    bool resume;
 };
 
 extern global_options_t global_options;
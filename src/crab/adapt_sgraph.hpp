@@ -1,6 +1,8 @@
 #pragma once
 
+#include "crab/arena.hpp"
 #include "crab/debug.hpp"
+#include "crab/stats.hpp"
 #include "crab/types.hpp"
 // Adaptive sparse-set based weighted graph implementation
 
@@ -10,8 +12,9 @@
 namespace crab {
 // An adaptive sparse-map.
 // Starts off as an unsorted vector, switching to a
-// sparse-set when |S| >= sparse_threshold
+// sparse-set when |S| > sparse_threshold
 // WARNING: Assumes Val is a basic type (so doesn't need a ctor/dtor call)
+// The arrays come from block_pool_t, as graph memory, and an empty map has none.
 template <class Val>
 class AdaptSMap {
     enum { sparse_threshold = 8 };
@@ -29,9 +32,7 @@ class AdaptSMap {
         val_t val;
     };
 
-    AdaptSMap()
-        : sz(0), dense_maxsz(sparse_threshold), sparse_ub(10), dense((elt_t*)malloc(sizeof(elt_t) * sparse_threshold)),
-          sparse(nullptr) {}
+    AdaptSMap() : sz(0), dense_maxsz(0), sparse_ub(0), dense(nullptr), sparse(nullptr) {}
 
     AdaptSMap(AdaptSMap&& o) noexcept
         : sz(o.sz), dense_maxsz(o.dense_maxsz), sparse_ub(o.sparse_ub), dense(o.dense), sparse(o.sparse) {
@@ -39,36 +40,28 @@ class AdaptSMap {
         o.sparse = nullptr;
         o.sz = 0;
         o.dense_maxsz = 0;
+        o.sparse_ub = 0;
     }
 
-    AdaptSMap(const AdaptSMap& o)
-        : sz(o.sz), dense_maxsz(o.dense_maxsz), sparse_ub(o.sparse_ub),
-          dense((elt_t*)malloc(sizeof(elt_t) * dense_maxsz)), sparse(nullptr) {
-        memcpy(static_cast<void*>(dense), o.dense, sizeof(elt_t) * sz);
-
-        if (o.sparse) {
-            sparse = (key_t*)malloc(sizeof(key_t) * sparse_ub);
-            for (key_t idx = 0; idx < sz; idx++)
-                sparse[dense[idx].key] = idx;
-        }
-    }
+    AdaptSMap(const AdaptSMap& o) : sz(0), dense_maxsz(0), sparse_ub(0), dense(nullptr), sparse(nullptr) { *this = o; }
 
     AdaptSMap& operator=(const AdaptSMap& o) {
         if (this != &o) {
-            if (dense_maxsz < o.dense_maxsz) {
-                dense_maxsz = o.dense_maxsz;
-                dense = (elt_t*)realloc(static_cast<void*>(dense), sizeof(elt_t) * dense_maxsz);
+            if (dense_maxsz < o.sz) {
+                free_dense();
+                dense = alloc_dense(o.sz, dense_maxsz);
             }
             sz = o.sz;
-            memcpy(static_cast<void*>(dense), o.dense, sizeof(elt_t) * sz);
-
-            if (o.sparse) {
-                if (!sparse || sparse_ub < o.sparse_ub) {
-                    sparse_ub = o.sparse_ub;
-                    sparse = (key_t*)realloc(static_cast<void*>(sparse), sizeof(key_t) * sparse_ub);
-                }
+            if (sz)
+                memcpy(static_cast<void*>(dense), o.dense, sizeof(elt_t) * sz);
+
+            // Follow o's representation, so that ours covers its keys.
+            if (!o.sparse) {
+                free_sparse();
+            } else if (!sparse || sparse_ub < o.sparse_ub) {
+                free_sparse();
+                sparse = alloc_sparse(o.sparse_ub, sparse_ub);
             }
-
             if (sparse) {
                 for (key_t idx = 0; idx < sz; idx++)
                     sparse[dense[idx].key] = idx;
@@ -79,10 +72,8 @@ class AdaptSMap {
     }
 
     AdaptSMap& operator=(AdaptSMap&& o) noexcept {
-        if (dense)
-            free(dense);
-        if (sparse)
-            free(sparse);
+        free_dense();
+        free_sparse();
 
         dense = o.dense;
         o.dense = nullptr;
@@ -99,10 +90,8 @@ class AdaptSMap {
     }
 
     ~AdaptSMap() {
-        if (dense)
-            free(dense);
-        if (sparse)
-            free(sparse);
+        free_dense();
+        free_sparse();
     }
 
     size_t size() const { return sz; }
@@ -116,7 +105,7 @@ class AdaptSMap {
         // for the "empty" iterator, otherwise we can trigger
         // undefined behavior.
         static key_iter_t empty_iterator() {
-            static std::unique_ptr<key_iter_t> it = nullptr;
+            static thread_local std::unique_ptr<key_iter_t> it = nullptr;
             if (!it)
                 it = std::unique_ptr<key_iter_t>(new key_iter_t());
             return *it;
@@ -166,9 +155,9 @@ class AdaptSMap {
 
     bool elem(key_t k) const {
         if (sparse) {
-            // NOTE: This can (often will) read beyond the bounds of sparse.
-            // This is totally okay. But valgrind will complain, and
-            // compiling with AddressSanitizer will probably break.
+            // Keys past sparse_ub are not in the map; reading sparse there would be out of its bounds.
+            if (k >= sparse_ub)
+                return false;
             int idx = sparse[k];
             return (idx < sz) && dense[idx].key == k;
         } else {
@@ -182,7 +171,8 @@ class AdaptSMap {
 
     bool lookup(key_t k, val_t* v_out) {
         if (sparse) {
-            // SEE ABOVE WARNING
+            if (k >= sparse_ub)
+                return false;
             int idx = sparse[k];
             if (idx < sz && dense[idx].key == k) {
                 (*v_out) = dense[idx].val;
@@ -223,46 +213,41 @@ class AdaptSMap {
             growDense(sz + 1);
 
         dense[sz] = elt_t(k, v);
+        sz++;
         if (sparse) {
             if (sparse_ub <= k)
                 growSparse(k + 1);
-            sparse[k] = sz;
+            sparse[k] = sz - 1;
+        } else if (sz > sparse_threshold) {
+            // Past the threshold, we switch to an sset.
+            key_t key_max = 0;
+            for (key_t key : keys())
+                key_max = std::max(key_max, key);
+            growSparse(key_max + 1);
         }
-        sz++;
     }
 
     void growDense(size_t new_max) {
         assert(dense_maxsz < new_max);
 
-        while (dense_maxsz < new_max)
-            dense_maxsz *= 2;
-        auto* new_dense = (elt_t*)realloc(static_cast<void*>(dense), sizeof(elt_t) * dense_maxsz);
-        if (!new_dense)
-            CRAB_ERROR("Allocation failure.");
+        size_t want = dense_maxsz ? dense_maxsz : sparse_threshold;
+        while (want < new_max)
+            want *= 2;
+        size_t new_maxsz;
+        elt_t* new_dense = alloc_dense(want, new_maxsz);
+        if (sz)
+            memcpy(static_cast<void*>(new_dense), dense, sizeof(elt_t) * sz);
+        free_dense();
         dense = new_dense;
-
-        if (!sparse) {
-            // After resizing the first time, we switch to an sset.
-            key_t key_max = 0;
-            for (key_t k : keys())
-                key_max = std::max(key_max, k);
-
-            sparse_ub = key_max + 1;
-            sparse = (key_t*)malloc(sizeof(key_t) * sparse_ub);
-            key_t idx = 0;
-            for (key_t k : keys())
-                sparse[k] = idx++;
-        }
+        dense_maxsz = new_maxsz;
     }
 
     void growSparse(size_t new_ub) {
-        while (sparse_ub < new_ub)
-            sparse_ub *= 2;
-        auto* new_sparse = (key_t*)malloc(sizeof(key_t) * (sparse_ub));
-        if (!new_sparse)
-            CRAB_ERROR("Allocation falure.");
-        free(sparse);
-        sparse = new_sparse;
+        size_t want = sparse_ub ? sparse_ub : 10;
+        while (want < new_ub)
+            want *= 2;
+        free_sparse();
+        sparse = alloc_sparse(want, sparse_ub);
 
         key_t idx = 0;
         for (key_t k : keys())
@@ -271,6 +256,33 @@ class AdaptSMap {
 
     void clear() { sz = 0; }
 
+    // The bytes of the arrays of the map.
+    size_t memory_bytes() const { return sizeof(elt_t) * dense_maxsz + sizeof(key_t) * sparse_ub; }
+
+  private:
+    // An array for at least n elements, whose actual capacity is stored to maxsz.
+    static elt_t* alloc_dense(size_t n, size_t& maxsz) {
+        const size_t bytes = block_pool_t::capacity(sizeof(elt_t) * n);
+        maxsz = bytes / sizeof(elt_t);
+        return static_cast<elt_t*>(block_pool_t::allocate(bytes, memory_kind_t::graph));
+    }
+    static key_t* alloc_sparse(size_t n, size_t& ub) {
+        const size_t bytes = block_pool_t::capacity(sizeof(key_t) * n);
+        ub = bytes / sizeof(key_t);
+        return static_cast<key_t*>(block_pool_t::allocate(bytes, memory_kind_t::graph));
+    }
+    void free_dense() {
+        block_pool_t::deallocate(dense, sizeof(elt_t) * dense_maxsz, memory_kind_t::graph);
+        dense = nullptr;
+        dense_maxsz = 0;
+    }
+    void free_sparse() {
+        block_pool_t::deallocate(sparse, sizeof(key_t) * sparse_ub, memory_kind_t::graph);
+        sparse = nullptr;
+        sparse_ub = 0;
+    }
+
+  public:
     size_t sz;
     size_t dense_maxsz;
     size_t sparse_ub;
@@ -281,6 +293,8 @@ class AdaptSMap {
 template <class Weight>
 class AdaptGraph : public writeable {
     using smap_t = AdaptSMap<size_t>;
+    template <class T>
+    using vector_t = std::vector<T, counting_allocator_t<T, memory_kind_t::graph>>;
 
   public:
     using vert_id = unsigned int;
@@ -336,7 +350,7 @@ class AdaptGraph : public writeable {
 
     class vert_iterator {
       public:
-        vert_iterator(vert_id _v, const std::vector<int>& _is_free) : v(_v), is_free(_is_free) {}
+        vert_iterator(vert_id _v, const vector_t<int>& _is_free) : v(_v), is_free(_is_free) {}
         vert_id operator*() const { return v; }
         bool operator!=(const vert_iterator& o) {
             while (v < o.v && is_free[v])
@@ -349,17 +363,17 @@ class AdaptGraph : public writeable {
         }
 
         vert_id v;
-        const std::vector<int>& is_free;
+        const vector_t<int>& is_free;
     };
     class vert_range {
       public:
-        explicit vert_range(const std::vector<int>& _is_free) : is_free(_is_free) {}
+        explicit vert_range(const vector_t<int>& _is_free) : is_free(_is_free) {}
 
         vert_iterator begin() const { return vert_iterator(0, is_free); }
         vert_iterator end() const { return vert_iterator(is_free.size(), is_free); }
 
         size_t size() const { return is_free.size(); }
-        const std::vector<int>& is_free;
+        const vector_t<int>& is_free;
     };
     vert_range verts() const { return vert_range(is_free); }
 
@@ -373,7 +387,7 @@ class AdaptGraph : public writeable {
     class edge_iter {
       public:
         using edge_ref = edge_ref_t;
-        edge_iter(const smap_t::elt_iter_t& _it, std::vector<Wt>& _ws) : it(_it), ws(&_ws) {}
+        edge_iter(const smap_t::elt_iter_t& _it, vector_t<Wt>& _ws) : it(_it), ws(&_ws) {}
         edge_iter(const edge_iter& o) : it(o.it), ws(o.ws) {}
         edge_iter() = default;
 
@@ -381,7 +395,7 @@ class AdaptGraph : public writeable {
         // for the "empty" iterator, otherwise we can trigger
         // undefined behavior.
         static edge_iter empty_iterator() {
-            static std::unique_ptr<edge_iter> it = nullptr;
+            static thread_local std::unique_ptr<edge_iter> it = nullptr;
             if (!it)
                 it = std::unique_ptr<edge_iter>(new edge_iter());
             return *it;
@@ -395,7 +409,7 @@ class AdaptGraph : public writeable {
         bool operator!=(const edge_iter& o) { return it != o.it; }
 
         smap_t::elt_iter_t it{};
-        std::vector<Wt>* ws{};
+        vector_t<Wt>* ws{};
     };
 
     using adj_range_t = typename smap_t::key_range_t;
@@ -406,14 +420,14 @@ class AdaptGraph : public writeable {
         using elt_range_t = typename smap_t::elt_range_t;
         using iterator = edge_iter;
         edge_range_t(const edge_range_t& o) : r(o.r), ws(o.ws) {}
-        edge_range_t(const elt_range_t& _r, std::vector<Wt>& _ws) : r(_r), ws(_ws) {}
+        edge_range_t(const elt_range_t& _r, vector_t<Wt>& _ws) : r(_r), ws(_ws) {}
 
         edge_iter begin() const { return edge_iter(r.begin(), ws); }
         edge_iter end() const { return edge_iter(r.end(), ws); }
         size_t size() const { return r.size(); }
 
         elt_range_t r;
-        std::vector<Wt>& ws;
+        vector_t<Wt>& ws;
     };
 
     using fwd_edge_iter = edge_iter;
@@ -499,6 +513,18 @@ class AdaptGraph : public writeable {
         edge_count = 0;
     }
 
+    // The bytes held by the graph, as counted in MemoryStats.
+    size_t memory_bytes() const {
+        size_t bytes = sizeof(smap_t) * (_preds.capacity() + _succs.capacity()) + sizeof(Wt) * _ws.capacity() +
+                       sizeof(int) * is_free.capacity() + sizeof(vert_id) * free_id.capacity() +
+                       sizeof(size_t) * free_widx.capacity();
+        for (const smap_t& m : _preds)
+            bytes += m.memory_bytes();
+        for (const smap_t& m : _succs)
+            bytes += m.memory_bytes();
+        return bytes;
+    }
+
     bool elem(vert_id s, vert_id d) { return _succs[s].elem(d); }
 
     Wt& edge_val(vert_id s, vert_id d) {
@@ -555,6 +581,16 @@ class AdaptGraph : public writeable {
         edge_count++;
     }
 
+    void remove_edge(vert_id s, vert_id d) {
+        size_t idx;
+        if (_succs[s].lookup(d, &idx)) {
+            free_widx.push_back(idx);
+            _succs[s].remove(d);
+            _preds[d].remove(s);
+            edge_count--;
+        }
+    }
+
     void update_edge(vert_id s, Wt w, vert_id d) {
         size_t idx;
         if (_succs[s].lookup(d, &idx)) {
@@ -599,15 +635,15 @@ class AdaptGraph : public writeable {
 
     // Ick. This'll have another indirection on every operation.
     // We'll see what the performance costs are like.
-    std::vector<smap_t> _preds;
-    std::vector<smap_t> _succs;
-    std::vector<Wt> _ws;
+    vector_t<smap_t> _preds;
+    vector_t<smap_t> _succs;
+    vector_t<Wt> _ws;
 
     int edge_count;
 
-    std::vector<int> is_free;
-    std::vector<vert_id> free_id;
-    std::vector<size_t> free_widx;
+    vector_t<int> is_free;
+    vector_t<vert_id> free_id;
+    vector_t<size_t> free_widx;
 };
 } // namespace crab
 #pragma GCC diagnostic pop
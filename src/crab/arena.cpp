@@ -0,0 +1,76 @@
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+#if __linux__
+#include <sys/mman.h>
+#endif
+
+#include "config.hpp"
+#include "crab/arena.hpp"
+
+namespace crab {
+
+namespace {
+
+// At the start of each chunk: the blocks carved from it and not yet retired, plus one while a thread carves from it.
+struct alignas(64) chunk_header_t {
+    std::atomic<size_t> blocks;
+};
+
+// The chunk that this thread carves blocks from, and the bytes of it already carved.
+struct current_chunk_t {
+    std::byte* chunk{};
+    size_t used{};
+
+    ~current_chunk_t();
+};
+
+thread_local current_chunk_t current;
+
+} // namespace
+
+static chunk_header_t* header(std::byte* chunk) { return reinterpret_cast<chunk_header_t*>(chunk); }
+
+static void drop(std::byte* chunk) {
+    if (header(chunk)->blocks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        header(chunk)->~chunk_header_t();
+        free(chunk);
+    }
+}
+
+current_chunk_t::~current_chunk_t() {
+    if (chunk)
+        drop(chunk);
+}
+
+static std::byte* new_chunk() {
+    void* p = aligned_alloc(chunk_arena_t::chunk_bytes, chunk_arena_t::chunk_bytes);
+    if (!p)
+        CRAB_ERROR("Allocation failure.");
+#if __linux__ && defined(MADV_HUGEPAGE)
+    if (global_options.huge_pages)
+        madvise(p, chunk_arena_t::chunk_bytes, MADV_HUGEPAGE);
+#endif
+    new (p) chunk_header_t{{1}};
+    return static_cast<std::byte*>(p);
+}
+
+void* chunk_arena_t::allocate(size_t bytes) {
+    if (!current.chunk || current.used + bytes > chunk_bytes) {
+        if (current.chunk)
+            drop(current.chunk);
+        current.chunk = new_chunk();
+        current.used = sizeof(chunk_header_t);
+    }
+    header(current.chunk)->blocks.fetch_add(1, std::memory_order_relaxed);
+    void* p = current.chunk + current.used;
+    current.used += bytes;
+    return p;
+}
+
+void chunk_arena_t::retire(void* p) {
+    drop(reinterpret_cast<std::byte*>(reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(chunk_bytes - 1)));
+}
+
+} // namespace crab
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+
+#include "crab/debug.hpp"
+#include "crab/stats.hpp"
+
+namespace crab {
+
+/** The chunks that the small blocks of block_pool_t are carved from.
+ *
+ *  Each thread carves blocks one after the other from a chunk of its own, and takes a new chunk once it is full. A
+ *  chunk counts the blocks carved from it that are still in use or on a free list of block_pool_t, and goes back to
+ *  the system once none is left and no thread carves from it any more, whichever thread retires its last block. Blocks
+ *  of the same analysis are thus packed together, and the end of an analysis returns its memory a chunk at a time.
+ *
+ *  With global_options.huge_pages, the chunks are aligned to and as large as a huge page, and the kernel is asked to
+ *  back them with transparent huge pages (Linux), for fewer TLB misses over the graphs of large programs.
+ */
+class chunk_arena_t final {
+  public:
+    static constexpr size_t chunk_bytes = size_t{2} << 20;
+    // The largest block carved from a chunk; larger ones are allocated on their own.
+    static constexpr size_t max_block = chunk_bytes / 32;
+
+    // A block of bytes, a multiple of 16 up to max_block, aligned to 16.
+    static void* allocate(size_t bytes);
+    // Give back the block at p, of any thread's chunk.
+    static void retire(void* p);
+};
+
+/** Storage for the arrays of AdaptSMap and the containers of the analysis, recycled by size class.
+ *
+ *  Copying a graph copies two maps per vertex, each holding an array or two of a few dozen bytes, so most of the
+ *  allocations of an analysis come in a handful of sizes. A freed block goes on a per-thread list for its size class,
+ *  a power of two, and is handed out again by the next allocation of that class; blocks up to
+ *  chunk_arena_t::max_block are carved from the chunks of chunk_arena_t, larger ones allocated on their own. release()
+ *  empties the lists; the analysis context calls it when an analysis is done. Blocks count as memory of the kind they
+ *  were allocated for while handed out.
+ */
+class block_pool_t final {
+    enum { min_class = 4, num_classes = 48 };
+
+    struct free_block_t {
+        free_block_t* next;
+    };
+    // No destructor, so that blocks freed during thread or program exit can still be pushed.
+    static inline thread_local free_block_t* free_lists[num_classes];
+
+    static unsigned size_class(size_t bytes) {
+        if (bytes <= (size_t{1} << min_class))
+            return min_class;
+        return 64 - __builtin_clzll(bytes - 1);
+    }
+
+  public:
+    // The bytes usable in a block allocated for bytes.
+    static size_t capacity(size_t bytes) { return size_t{1} << size_class(bytes); }
+
+    static void* allocate(size_t bytes, memory_kind_t kind) {
+        const unsigned c = size_class(bytes);
+        MemoryStats::allocated(kind, size_t{1} << c);
+        if (free_block_t* b = free_lists[c]) {
+            free_lists[c] = b->next;
+            return b;
+        }
+        if ((size_t{1} << c) <= chunk_arena_t::max_block)
+            return chunk_arena_t::allocate(size_t{1} << c);
+        void* p = malloc(size_t{1} << c);
+        if (!p)
+            CRAB_ERROR("Allocation failure.");
+        return p;
+    }
+
+    // Precondition: p was allocated for bytes, or is null.
+    static void deallocate(void* p, size_t bytes, memory_kind_t kind) {
+        if (!p)
+            return;
+        auto* b = static_cast<free_block_t*>(p);
+        const unsigned c = size_class(bytes);
+        MemoryStats::freed(kind, size_t{1} << c);
+        b->next = free_lists[c];
+        free_lists[c] = b;
+    }
+
+    static void release() {
+        for (unsigned c = 0; c < num_classes; c++) {
+            for (free_block_t*& head = free_lists[c]; head;) {
+                free_block_t* next = head->next;
+                if ((size_t{1} << c) <= chunk_arena_t::max_block)
+                    chunk_arena_t::retire(head);
+                else
+                    free(head);
+                head = next;
+            }
+        }
+    }
+};
+
+// An allocator from block_pool_t, which counts the bytes it holds as memory of Kind in MemoryStats.
+template <class T, memory_kind_t Kind>
+struct counting_allocator_t {
+    static_assert(alignof(T) <= 16, "blocks are aligned to 16");
+
+    using value_type = T;
+    template <class U>
+    struct rebind {
+        using other = counting_allocator_t<U, Kind>;
+    };
+
+    counting_allocator_t() = default;
+    template <class U>
+    counting_allocator_t(const counting_allocator_t<U, Kind>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(block_pool_t::allocate(n * sizeof(T), Kind)); }
+    void deallocate(T* p, size_t n) noexcept { block_pool_t::deallocate(p, n * sizeof(T), Kind); }
+
+    template <class U>
+    bool operator==(const counting_allocator_t<U, Kind>&) const noexcept {
+        return true;
+    }
+    template <class U>
+    bool operator!=(const counting_allocator_t<U, Kind>&) const noexcept {
+        return false;
+    }
+};
+
+} // namespace crab
@@ -43,8 +43,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <climits>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -57,177 +61,199 @@
 
 namespace crab {
 
-// GMP can convert directly from/to signed/unsigned long and
-// signed/unsigned int. However, the C++11 standard only guarantees:
+// Unbounded integers.
 //
-//  - unsigned/signed int  >= 16 bits.
-//  - unsigned/signed long >= 32 bits.
+// eBPF values fit in 64 bits, so almost every number the analysis
+// manipulates does too. Those are kept inline as an int64_t and their
+// arithmetic is overflow-checked with the compiler builtins; only a
+// result that does not fit is promoted to a GMP integer. The
+// representation is canonical: a value is held by GMP if and only if
+// it does not fit in an int64_t.
 //
-
-// TODO/FIXME:
-//
-// We don't have a conversion from GMP numbers to 64-bit integers,
-// because GMP cannot convert directly from/to int64_t or
-// uint64_t. For that, we need to use mpz_export and mpz_import but
-// they are significantly more expensive.
-//
-// Note that the actual size of **long** integer varies depending on
-// the architecture and OS (see e.g.,
-// https://en.cppreference.com/w/cpp/language/types). For instance,
-// both Linux and mac OS on an Intel 64, the size of long integers is
-// 8 bytes. But for Windows on Intel 64, the size is 4 bytes.
+// GMP converts directly from/to signed long, which is why this
+// assumes that long has 64 bits (as on Linux and mac OS on Intel 64).
+static_assert(sizeof(long) == sizeof(int64_t), "z_number requires 64-bit long integers");
 
 class z_number final {
   private:
-    mpz_class _n{0};
+    int64_t _small{0};
+    std::unique_ptr<mpz_class> _big;
 
-  public:
-    z_number() = default;
-    explicit z_number(mpz_class n) : _n(std::move(n)) {}
+    bool is_small() const { return !_big; }
+
+    mpz_class to_mpz() const { return is_small() ? mpz_class((signed long int)_small) : *_big; }
 
-    z_number(signed long long int n) : _n((signed long int)n) {
-        if (n > LONG_MAX) {
-            CRAB_ERROR(n, " cannot fit into a signed long int: use another mpz_class constructor");
+    static z_number from_mpz(mpz_class n) {
+        z_number res;
+        if (n.fits_slong_p()) {
+            res._small = n.get_si();
+        } else {
+            res._big = std::make_unique<mpz_class>(std::move(n));
         }
+        return res;
     }
 
+    unsigned long shift_amount() const {
+        if (*this < 0) {
+            CRAB_ERROR("z_number: negative shift amount ", *this);
+        }
+        return is_small() ? (unsigned long)_small : ULONG_MAX;
+    }
+
+  public:
+    z_number() = default;
+    explicit z_number(mpz_class n) : z_number(from_mpz(std::move(n))) {}
+
+    z_number(signed long long int n) : _small(n) {}
+
     explicit z_number(const std::string& s) {
         try {
-            _n = s;
+            *this = from_mpz(mpz_class(s));
         } catch (std::invalid_argument& e) {
             CRAB_ERROR("z_number: invalid string in constructor", s);
         }
     }
 
+    z_number(const z_number& o) : _small(o._small), _big(o._big ? std::make_unique<mpz_class>(*o._big) : nullptr) {}
+    z_number(z_number&& o) noexcept = default;
+
+    z_number& operator=(const z_number& o) {
+        if (this != &o) {
+            _small = o._small;
+            _big = o._big ? std::make_unique<mpz_class>(*o._big) : nullptr;
+        }
+        return *this;
+    }
+    z_number& operator=(z_number&& o) noexcept = default;
+
     // overloaded typecast operators
     explicit operator long() const {
-        if (_n.fits_slong_p()) {
-            return _n.get_si();
+        if (is_small()) {
+            return _small;
         } else {
-            CRAB_ERROR("mpz_class ", _n.get_str(), " does not fit into a signed long integer");
+            CRAB_ERROR("mpz_class ", _big->get_str(), " does not fit into a signed long integer");
         }
     }
 
     explicit operator int() const {
-        if (_n.fits_sint_p()) {
-            // get_si returns a signed long so we cast it to int
-            return (int)_n.get_si();
+        if (fits_sint()) {
+            return (int)_small;
         } else {
-            CRAB_ERROR("mpz_class ", _n.get_str(), " does not fit into a signed integer");
+            CRAB_ERROR("mpz_class ", to_mpz().get_str(), " does not fit into a signed integer");
         }
     }
 
-    explicit operator mpz_class() const { return _n; }
+    explicit operator mpz_class() const { return to_mpz(); }
 
     std::size_t hash() const {
+        if (is_small()) {
+            return boost::hash<int64_t>{}(_small);
+        }
         boost::hash<std::string> hasher;
-        return hasher(_n.get_str());
+        return hasher(_big->get_str());
     }
 
-    bool fits_sint() const { return _n.fits_sint_p(); }
+    bool fits_sint() const { return is_small() && _small >= INT_MIN && _small <= INT_MAX; }
 
-    bool fits_slong() const { return _n.fits_slong_p(); }
+    bool fits_slong() const { return is_small(); }
 
     z_number operator+(const z_number& x) const {
-        mpz_class r = _n + x._n;
-        return z_number(r);
+        int64_t r;
+        if (is_small() && x.is_small() && !__builtin_add_overflow(_small, x._small, &r)) {
+            return r;
+        }
+        return from_mpz(to_mpz() + x.to_mpz());
     }
 
     z_number operator+(int x) const { return operator+(z_number(x)); }
 
     z_number operator*(const z_number& x) const {
-        mpz_class r = _n * x._n;
-        return z_number(r);
+        int64_t r;
+        if (is_small() && x.is_small() && !__builtin_mul_overflow(_small, x._small, &r)) {
+            return r;
+        }
+        return from_mpz(to_mpz() * x.to_mpz());
     }
 
     z_number operator*(int x) const { return operator*(z_number(x)); }
 
     z_number operator-(const z_number& x) const {
-        mpz_class r = _n - x._n;
-        return z_number(r);
+        int64_t r;
+        if (is_small() && x.is_small() && !__builtin_sub_overflow(_small, x._small, &r)) {
+            return r;
+        }
+        return from_mpz(to_mpz() - x.to_mpz());
     }
 
     z_number operator-(int x) const { return operator-(z_number(x)); }
 
     z_number operator-() const {
-        mpz_class r = -_n;
-        return z_number(r);
+        if (is_small() && _small != std::numeric_limits<int64_t>::min()) {
+            return -_small;
+        }
+        return from_mpz(-to_mpz());
     }
 
+    // Both division and remainder truncate towards zero, as in C++.
     z_number operator/(const z_number& x) const {
-        if (x._n == 0) {
+        if (x == 0) {
             CRAB_ERROR("z_number: division by zero [1]");
+        } else if (is_small() && x.is_small() && !(_small == std::numeric_limits<int64_t>::min() && x._small == -1)) {
+            return _small / x._small;
         } else {
-            mpz_class r = _n / x._n;
-            return z_number(r);
+            return from_mpz(to_mpz() / x.to_mpz());
         }
     }
 
     z_number operator/(int x) const { return operator/(z_number(x)); }
 
     z_number operator%(const z_number& x) const {
-        if (x._n == 0) {
+        if (x == 0) {
             CRAB_ERROR("z_number: division by zero [2]");
+        } else if (is_small() && x.is_small()) {
+            return x._small == -1 ? 0 : _small % x._small;
         } else {
-            mpz_class r = _n % x._n;
-            return z_number(r);
+            return from_mpz(to_mpz() % x.to_mpz());
         }
     }
 
     z_number operator%(int x) const { return operator%(z_number(x)); }
 
-    z_number& operator+=(const z_number& x) {
-        _n += x._n;
-        return *this;
-    }
+    z_number& operator+=(const z_number& x) { return *this = *this + x; }
 
     z_number& operator+=(int x) { return operator+=(z_number(x)); }
 
-    z_number& operator*=(const z_number& x) {
-        _n *= x._n;
-        return *this;
-    }
+    z_number& operator*=(const z_number& x) { return *this = *this * x; }
 
     z_number& operator*=(int x) { return operator*=(z_number(x)); }
 
-    z_number& operator-=(const z_number& x) {
-        _n -= x._n;
-        return *this;
-    }
+    z_number& operator-=(const z_number& x) { return *this = *this - x; }
 
     z_number& operator-=(int x) { return operator-=(z_number(x)); }
 
     z_number& operator/=(const z_number& x) {
-        if (x._n == 0) {
+        if (x == 0) {
             CRAB_ERROR("z_number: division by zero [3]");
         } else {
-            _n /= x._n;
-            return *this;
+            return *this = *this / x;
         }
     }
 
     z_number& operator/=(int x) { return operator/=(z_number(x)); }
 
     z_number& operator%=(const z_number& x) {
-        if (x._n == 0) {
+        if (x == 0) {
             CRAB_ERROR("z_number: division by zero [4]");
         } else {
-            _n %= x._n;
-            return *this;
+            return *this = *this % x;
         }
     }
 
     z_number& operator%=(int x) { return operator%=(z_number(x)); }
 
-    z_number& operator--() & {
-        --(_n);
-        return *this;
-    }
+    z_number& operator--() & { return operator-=(1); }
 
-    z_number& operator++() & {
-        ++(_n);
-        return *this;
-    }
+    z_number& operator++() & { return operator+=(1); }
 
     z_number operator++(int) & {
         z_number r(*this);
@@ -241,63 +267,115 @@ class z_number final {
         return r;
     }
 
-    bool operator==(const z_number& x) const { return _n == x._n; }
+    // Three-way comparison; thanks to the canonical representation a big
+    // number is beyond the range of every small one.
+    int compare(const z_number& x) const {
+        if (is_small() && x.is_small()) {
+            return (_small > x._small) - (_small < x._small);
+        } else if (is_small()) {
+            return -sgn(*x._big);
+        } else if (x.is_small()) {
+            return sgn(*_big);
+        } else {
+            return cmp(*_big, *x._big);
+        }
+    }
+
+    bool operator==(const z_number& x) const { return compare(x) == 0; }
     bool operator==(int x) const { return operator==(z_number(x)); }
 
-    bool operator!=(const z_number& x) const { return _n != x._n; }
+    bool operator!=(const z_number& x) const { return compare(x) != 0; }
     bool operator!=(int x) const { return operator!=(z_number(x)); }
 
-    bool operator<(const z_number& x) const { return _n < x._n; }
+    bool operator<(const z_number& x) const { return compare(x) < 0; }
 
     bool operator<(int x) const { return operator<(z_number(x)); }
 
-    bool operator<=(const z_number& x) const { return _n <= x._n; }
+    bool operator<=(const z_number& x) const { return compare(x) <= 0; }
     bool operator<=(int x) const { return operator<=(z_number(x)); }
 
-    bool operator>(const z_number& x) const { return _n > x._n; }
+    bool operator>(const z_number& x) const { return compare(x) > 0; }
     bool operator>(int x) const { return operator>(z_number(x)); }
 
-    bool operator>=(const z_number& x) const { return _n >= x._n; }
+    bool operator>=(const z_number& x) const { return compare(x) >= 0; }
     bool operator>=(int x) const { return operator>=(z_number(x)); }
 
-    z_number operator&(const z_number& x) const { return z_number(_n & x._n); }
+    // Bitwise operations follow the two's complement semantics of GMP,
+    // which coincides with that of int64_t on small numbers.
+    z_number operator&(const z_number& x) const {
+        if (is_small() && x.is_small()) {
+            return _small & x._small;
+        }
+        return from_mpz(to_mpz() & x.to_mpz());
+    }
     z_number operator&(int x) const { return operator&(z_number(x)); }
 
-    z_number operator|(const z_number& x) const { return z_number(_n | x._n); }
+    z_number operator|(const z_number& x) const {
+        if (is_small() && x.is_small()) {
+            return _small | x._small;
+        }
+        return from_mpz(to_mpz() | x.to_mpz());
+    }
     z_number operator|(int x) const { return operator|(z_number(x)); }
 
-    z_number operator^(const z_number& x) const { return z_number(_n ^ x._n); }
+    z_number operator^(const z_number& x) const {
+        if (is_small() && x.is_small()) {
+            return _small ^ x._small;
+        }
+        return from_mpz(to_mpz() ^ x.to_mpz());
+    }
     z_number operator^(int x) const { return operator^(z_number(x)); }
 
-    z_number operator<<(z_number x) const {
-        mpz_t tmp;
-        mpz_init(tmp);
-        mpz_mul_2exp(tmp, _n.get_mpz_t(), mpz_get_ui(x._n.get_mpz_t()));
-        mpz_class result(tmp);
-        return z_number(result);
+    z_number operator<<(const z_number& x) const {
+        const unsigned long k = x.shift_amount();
+        int64_t r;
+        if (is_small() && (_small == 0 || (k < 63 && !__builtin_mul_overflow(_small, int64_t{1} << k, &r)))) {
+            return _small == 0 ? 0 : r;
+        }
+        mpz_class result;
+        mpz_class n = to_mpz();
+        mpz_mul_2exp(result.get_mpz_t(), n.get_mpz_t(), k);
+        return from_mpz(std::move(result));
     }
 
     z_number operator<<(int x) const { return operator<<(z_number(x)); }
 
-    z_number operator>>(z_number x) const {
-        mpz_class tmp(_n);
-        return z_number(tmp.operator>>=(mpz_get_ui(x._n.get_mpz_t())));
+    // Arithmetic shift, rounding towards minus infinity.
+    z_number operator>>(const z_number& x) const {
+        const unsigned long k = x.shift_amount();
+        if (is_small()) {
+            return _small >> std::min(k, 63ul);
+        }
+        mpz_class tmp(*_big);
+        return from_mpz(tmp >>= k);
     }
     z_number operator>>(int x) const { return operator>>(z_number(x)); }
 
     z_number fill_ones() const {
-        assert(_n >= 0);
-        if (_n == 0) {
-            return z_number(0);
+        assert(*this >= 0);
+        if (is_small()) {
+            // Smallest 2^k - 1 >= _small; computed unsigned since it may
+            // transiently exceed the int64_t range before the loop exits.
+            uint64_t result = 0;
+            while (result < (uint64_t)_small) {
+                result = 2 * result + 1;
+            }
+            return (int64_t)result;
         }
 
         mpz_class result;
-        for (result = 1; result < _n; result = 2 * result + 1)
+        for (result = 1; result < *_big; result = 2 * result + 1)
             ;
-        return z_number(result);
+        return from_mpz(std::move(result));
     }
 
-    void write(std::ostream& o) const { o << _n.get_str(); }
+    void write(std::ostream& o) const {
+        if (is_small()) {
+            o << _small;
+        } else {
+            o << _big->get_str();
+        }
+    }
 
 }; // class z_number
 
@@ -11,12 +11,13 @@
  *
  */
 #include <memory>
+#include <optional>
 #include <unordered_map>
-#include <unordered_set>
 #include <variant>
 #include <vector>
 
-#include <boost/iterator/transform_iterator.hpp>
+#include <boost/iterator/filter_iterator.hpp>
+#include <boost/iterator/indirect_iterator.hpp>
 #include <boost/range/iterator_range.hpp>
 
 #include "crab/bignums.hpp"
@@ -31,19 +32,23 @@ namespace crab {
 
 class cfg_t;
 
+// Dense index of a basic block in its cfg_t. Labels are only kept for printing and for looking blocks up by name
+// while the CFG is being built.
+using block_id_t = uint32_t;
+
 class basic_block_t final {
     friend class cfg_t;
 
   private:
-    using label_vec_t = std::vector<label_t>;
+    using id_vec_t = std::vector<block_id_t>;
 
   public:
     basic_block_t(const basic_block_t&) = delete;
     // -- iterators
 
     using stmt_list_t = std::vector<Instruction>;
-    using succ_iterator = label_vec_t::iterator;
-    using const_succ_iterator = label_vec_t::const_iterator;
+    using succ_iterator = id_vec_t::iterator;
+    using const_succ_iterator = id_vec_t::const_iterator;
     using pred_iterator = succ_iterator;
     using const_pred_iterator = const_succ_iterator;
     using iterator = typename stmt_list_t::iterator;
@@ -52,17 +57,18 @@ class basic_block_t final {
     using const_reverse_iterator = typename stmt_list_t::const_reverse_iterator;
 
   private:
+    block_id_t m_id;
     label_t m_label;
     stmt_list_t m_ts;
-    label_vec_t m_prev, m_next;
+    id_vec_t m_prev, m_next;
 
-    static void insert_adjacent(label_vec_t& c, const label_t& e) {
+    static void insert_adjacent(id_vec_t& c, block_id_t e) {
         if (std::find(c.begin(), c.end(), e) == c.end()) {
             c.push_back(e);
         }
     }
 
-    static void remove_adjacent(label_vec_t& c, const label_t& e) {
+    static void remove_adjacent(id_vec_t& c, block_id_t e) {
         if (std::find(c.begin(), c.end(), e) != c.end()) {
             c.erase(std::remove(c.begin(), c.end(), e), c.end());
         }
@@ -76,11 +82,13 @@ class basic_block_t final {
 
     void insert(const Instruction& arg) { m_ts.push_back(arg); }
 
-    explicit basic_block_t(label_t _label) : m_label(std::move(_label)) {}
+    basic_block_t(block_id_t _id, label_t _label) : m_id(_id), m_label(std::move(_label)) {}
 
     ~basic_block_t() = default;
 
-    label_t label() const { return m_label; }
+    block_id_t id() const { return m_id; }
+
+    const label_t& label() const { return m_label; }
 
     iterator begin() { return (m_ts.begin()); }
     iterator end() { return (m_ts.end()); }
@@ -108,14 +116,14 @@ class basic_block_t final {
 
     // Add a cfg_t edge from *this to b
     void operator>>(basic_block_t& b) {
-        insert_adjacent(m_next, b.m_label);
-        insert_adjacent(b.m_prev, m_label);
+        insert_adjacent(m_next, b.m_id);
+        insert_adjacent(b.m_prev, m_id);
     }
 
     // Remove a cfg_t edge from *this to b
     void operator-=(basic_block_t& b) {
-        remove_adjacent(m_next, b.m_label);
-        remove_adjacent(b.m_prev, m_label);
+        remove_adjacent(m_next, b.m_id);
+        remove_adjacent(b.m_prev, m_id);
     }
 
     // insert all statements of other at the back
@@ -144,7 +152,9 @@ class basic_block_rev_t final {
 
     explicit basic_block_rev_t(basic_block_t& bb) : _bb(bb) {}
 
-    label_t label() const { return _bb.label(); }
+    block_id_t id() const { return _bb.id(); }
+
+    const label_t& label() const { return _bb.label(); }
 
     iterator begin() { return _bb.rbegin(); }
 
@@ -167,7 +177,7 @@ class basic_block_rev_t final {
 
 class cfg_t final {
   public:
-    using node_t = label_t; // for Bgl graphs
+    using node_t = block_id_t; // for Bgl graphs
 
     using succ_iterator = typename basic_block_t::succ_iterator;
     using pred_iterator = typename basic_block_t::pred_iterator;
@@ -180,119 +190,141 @@ class cfg_t final {
     using const_pred_range = boost::iterator_range<const_pred_iterator>;
 
   private:
-    using basic_block_map_t = std::unordered_map<label_t, basic_block_t>;
-    using binding_t = typename basic_block_map_t::value_type;
+    // Blocks are indexed by id. A removed block leaves a null slot, so that ids (and references to the remaining
+    // blocks) stay valid for the lifetime of the CFG.
+    using basic_block_vec_t = std::vector<std::unique_ptr<basic_block_t>>;
 
-    struct get_label : public std::unary_function<binding_t, label_t> {
-        label_t operator()(const binding_t& p) const { return p.second.label(); }
+    struct is_live {
+        bool operator()(const std::unique_ptr<basic_block_t>& p) const { return p != nullptr; }
     };
 
   public:
-    using iterator = typename basic_block_map_t::iterator;
-    using const_iterator = typename basic_block_map_t::const_iterator;
-    using label_iterator = boost::transform_iterator<get_label, typename basic_block_map_t::iterator>;
-    using const_label_iterator = boost::transform_iterator<get_label, typename basic_block_map_t::const_iterator>;
+    using iterator = boost::indirect_iterator<boost::filter_iterator<is_live, basic_block_vec_t::iterator>>;
+    using const_iterator = boost::indirect_iterator<boost::filter_iterator<is_live, basic_block_vec_t::const_iterator>,
+                                                    const basic_block_t>;
 
   private:
-    label_t m_entry;
-    label_t m_exit;
-    basic_block_map_t m_blocks;
+    block_id_t m_entry;
+    block_id_t m_exit;
+    basic_block_vec_t m_blocks;
+    std::unordered_map<label_t, block_id_t> m_ids;
 
-    using visited_t = std::unordered_set<label_t>;
-    template <typename T>
-    void dfs_rec(const label_t& curId, visited_t& visited, T f) const {
-        if (!visited.insert(curId).second)
-            return;
-
-        const auto& cur = get_node(curId);
-        f(cur);
-        for (const auto& n : boost::make_iterator_range(cur.next_blocks())) {
-            dfs_rec(n, visited, f);
-        }
+    using visited_t = std::vector<bool>;
+
+    // Push the successors of bb onto a depth-first worklist, so that they are popped in order.
+    static void push_next(std::vector<block_id_t>& todo, const basic_block_t& bb) {
+        todo.insert(todo.end(), bb.m_next.rbegin(), bb.m_next.rend());
     }
+
   public:
 
+    // Call f on each block reachable from the entry, in depth-first preorder.
+    // The walk keeps its own stack, so that long chains of blocks cannot exhaust the call stack.
     template <typename T>
     void dfs(T f) const {
-        visited_t visited;
-        dfs_rec(m_entry, visited, f);
+        visited_t visited(num_ids());
+        std::vector<block_id_t> todo{m_entry};
+        while (!todo.empty()) {
+            block_id_t cur_id = todo.back();
+            todo.pop_back();
+            if (visited[cur_id])
+                continue;
+            visited[cur_id] = true;
+            const auto& cur = get_node(cur_id);
+            f(cur);
+            push_next(todo, cur);
+        }
     }
 
-    cfg_t(const label_t& entry, const label_t& exit) : m_entry(entry), m_exit(exit) {
-        m_blocks.emplace(entry, entry);
-        m_blocks.emplace(exit, exit);
+    cfg_t(const label_t& entry, const label_t& exit) {
+        m_entry = insert(entry).id();
+        m_exit = insert(exit).id();
     }
 
     cfg_t(const cfg_t&) = delete;
 
     cfg_t(cfg_t&& o) noexcept
-        : m_entry(std::move(o.m_entry)), m_exit(std::move(o.m_exit)), m_blocks(std::move(o.m_blocks)) {}
+        : m_entry(o.m_entry), m_exit(o.m_exit), m_blocks(std::move(o.m_blocks)), m_ids(std::move(o.m_ids)) {}
 
     ~cfg_t() = default;
 
-    label_t exit() const { return m_exit; }
+    block_id_t exit() const { return m_exit; }
 
     // --- Begin ikos fixpoint API
 
-    label_t entry() const { return m_entry; }
+    block_id_t entry() const { return m_entry; }
 
-    const_succ_range next_nodes(const label_t& _label) const {
-        return boost::make_iterator_range(get_node(_label).next_blocks());
+    const_succ_range next_nodes(block_id_t _id) const {
+        return boost::make_iterator_range(get_node(_id).next_blocks());
     }
 
-    const_pred_range prev_nodes(const label_t& _label) const {
-        return boost::make_iterator_range(get_node(_label).prev_blocks());
+    const_pred_range prev_nodes(block_id_t _id) const {
+        return boost::make_iterator_range(get_node(_id).prev_blocks());
     }
 
-    succ_range next_nodes(const label_t& _label) { return boost::make_iterator_range(get_node(_label).next_blocks()); }
+    succ_range next_nodes(block_id_t _id) { return boost::make_iterator_range(get_node(_id).next_blocks()); }
 
-    pred_range prev_nodes(const label_t& _label) { return boost::make_iterator_range(get_node(_label).prev_blocks()); }
+    pred_range prev_nodes(block_id_t _id) { return boost::make_iterator_range(get_node(_id).prev_blocks()); }
+
+    basic_block_t& get_node(block_id_t _id) {
+        if (_id >= m_blocks.size() || !m_blocks[_id]) {
+            CRAB_ERROR("Basic block ", _id, " not found in the CFG: ", __LINE__);
+        }
+        return *m_blocks[_id];
+    }
+
+    const basic_block_t& get_node(block_id_t _id) const {
+        if (_id >= m_blocks.size() || !m_blocks[_id]) {
+            CRAB_ERROR("Basic block ", _id, " not found in the CFG: ", __LINE__);
+        }
+        return *m_blocks[_id];
+    }
+
+    // --- End ikos fixpoint API
 
     basic_block_t& get_node(const label_t& _label) {
-        auto it = m_blocks.find(_label);
-        if (it == m_blocks.end()) {
+        auto it = m_ids.find(_label);
+        if (it == m_ids.end()) {
             CRAB_ERROR("Basic block ", _label, " not found in the CFG: ", __LINE__);
         }
-        return it->second;
+        return get_node(it->second);
     }
 
     const basic_block_t& get_node(const label_t& _label) const {
-        auto it = m_blocks.find(_label);
-        if (it == m_blocks.end()) {
+        auto it = m_ids.find(_label);
+        if (it == m_ids.end()) {
             CRAB_ERROR("Basic block ", _label, " not found in the CFG: ", __LINE__);
         }
-        return it->second;
+        return get_node(it->second);
     }
 
-    // --- End ikos fixpoint API
-
     basic_block_t& insert(const label_t& _label) {
-        auto it = m_blocks.find(_label);
-        if (it != m_blocks.end())
-            return it->second;
+        auto [it, inserted] = m_ids.emplace(_label, static_cast<block_id_t>(m_blocks.size()));
+        if (!inserted)
+            return get_node(it->second);
 
-        m_blocks.emplace(_label, _label);
-        return get_node(_label);
+        m_blocks.push_back(std::make_unique<basic_block_t>(it->second, _label));
+        return *m_blocks.back();
     }
 
-    void remove(const label_t& _label) {
-        if (_label == m_entry)
+    void remove(block_id_t _id) {
+        if (_id == m_entry)
             CRAB_ERROR("Cannot remove entry block");
 
-        if (_label == m_exit)
+        if (_id == m_exit)
             CRAB_ERROR("Cannot remove exit block");
 
         std::vector<std::pair<basic_block_t*, basic_block_t*>> dead_edges;
-        auto& bb = get_node(_label);
+        auto& bb = get_node(_id);
 
         for (const auto& id : boost::make_iterator_range(bb.prev_blocks())) {
-            if (_label != id) {
+            if (_id != id) {
                 dead_edges.emplace_back(&get_node(id), &bb);
             }
         }
 
         for (const auto& id : boost::make_iterator_range(bb.next_blocks())) {
-            if (_label != id) {
+            if (_id != id) {
                 dead_edges.emplace_back(&bb, &get_node(id));
             }
         }
@@ -301,35 +333,39 @@ class cfg_t final {
             (*p.first) -= (*p.second);
         }
 
-        m_blocks.erase(_label);
+        m_ids.erase(bb.label());
+        m_blocks[_id].reset();
     }
 
     //! return a begin iterator of basic_block_t's
-    iterator begin() { return m_blocks.begin(); }
+    iterator begin() {
+        return iterator(boost::make_filter_iterator<is_live>(m_blocks.begin(), m_blocks.end()));
+    }
 
     //! return an end iterator of basic_block_t's
-    iterator end() { return m_blocks.end(); }
-
-    const_iterator begin() const { return m_blocks.begin(); }
+    iterator end() { return iterator(boost::make_filter_iterator<is_live>(m_blocks.end(), m_blocks.end())); }
 
-    const_iterator end() const { return m_blocks.end(); }
-
-    //! return a begin iterator of label_t's
-    label_iterator label_begin() { return boost::make_transform_iterator(m_blocks.begin(), get_label()); }
+    const_iterator begin() const {
+        return const_iterator(boost::make_filter_iterator<is_live>(m_blocks.begin(), m_blocks.end()));
+    }
 
-    //! return an end iterator of label_t's
-    label_iterator label_end() { return boost::make_transform_iterator(m_blocks.end(), get_label()); }
+    const_iterator end() const {
+        return const_iterator(boost::make_filter_iterator<is_live>(m_blocks.end(), m_blocks.end()));
+    }
 
-    //! return a begin iterator of label_t's
-    std::vector<label_t> labels() const {
-        std::vector<label_t> res;
-        res.reserve(m_blocks.size());
-        for (const auto& p : m_blocks)
-            res.push_back(p.first);
+    //! return the ids of all blocks, in increasing order
+    std::vector<block_id_t> nodes() const {
+        std::vector<block_id_t> res;
+        res.reserve(m_ids.size());
+        for (const basic_block_t& bb : *this)
+            res.push_back(bb.id());
         return res;
     }
 
-    size_t size() const { return static_cast<size_t>(std::distance(begin(), end())); }
+    //! return an upper bound on block ids, for tables indexed by id
+    size_t num_ids() const { return m_blocks.size(); }
+
+    size_t size() const { return m_ids.size(); }
 
     void simplify() {
         merge_blocks();
@@ -344,72 +380,76 @@ class cfg_t final {
 
   private:
     // Helpers
-    bool has_one_child(const label_t& b) const {
+    bool has_one_child(block_id_t b) const {
         auto rng = next_nodes(b);
         return (std::distance(rng.begin(), rng.end()) == 1);
     }
 
-    bool has_one_parent(const label_t& b) const {
+    bool has_one_parent(block_id_t b) const {
         auto rng = prev_nodes(b);
         return (std::distance(rng.begin(), rng.end()) == 1);
     }
 
-    basic_block_t& get_child(const label_t& b) {
+    basic_block_t& get_child(block_id_t b) {
         assert(has_one_child(b));
         auto rng = next_nodes(b);
         return get_node(*(rng.begin()));
     }
 
-    basic_block_t& get_parent(const label_t& b) {
+    basic_block_t& get_parent(block_id_t b) {
         assert(has_one_parent(b));
         auto rng = prev_nodes(b);
         return get_node(*(rng.begin()));
     }
 
-    void merge_blocks_rec(const label_t& current_label, visited_t& visited) {
-        if (!visited.insert(current_label).second)
-            return;
-
-        auto& cur = get_node(current_label);
-
-        if (has_one_child(current_label) && has_one_parent(current_label)) {
-            auto& parent = get_parent(current_label);
-            auto& child = get_child(current_label);
-
-            // Merge with its parent if it's its only child.
-            if (has_one_child(parent.label())) {
-                // move all statements from cur to parent
-                parent.move_back(cur);
-                visited.erase(current_label);
-                if (current_label == m_exit)
-                    m_exit = child.label();
-                remove(current_label);
-                parent >> child;
-                merge_blocks_rec(child.label(), visited);
-                return;
-            }
-        }
-
-        for (const auto& n : boost::make_iterator_range(cur.next_blocks())) {
-            merge_blocks_rec(n, visited);
-        }
-    }
-
     // Merges a basic block into its predecessor if there is only one
     // and the predecessor only has one successor.
     void merge_blocks() {
-        visited_t visited;
-        merge_blocks_rec(entry(), visited);
+        visited_t visited(num_ids());
+        std::vector<block_id_t> todo{entry()};
+        while (!todo.empty()) {
+            block_id_t current_id = todo.back();
+            todo.pop_back();
+            if (visited[current_id])
+                continue;
+            visited[current_id] = true;
+
+            auto& cur = get_node(current_id);
+
+            if (has_one_child(current_id) && has_one_parent(current_id)) {
+                auto& parent = get_parent(current_id);
+                auto& child = get_child(current_id);
+
+                // Merge with its parent if it's its only child.
+                if (has_one_child(parent.id())) {
+                    // move all statements from cur to parent
+                    parent.move_back(cur);
+                    if (current_id == m_exit)
+                        m_exit = child.id();
+                    remove(current_id);
+                    parent >> child;
+                    todo.push_back(child.id());
+                    continue;
+                }
+            }
+            push_next(todo, cur);
+        }
     }
 
     // mark reachable blocks from curId
     template <class AnyCfg>
-    void mark_alive_blocks(label_t curId, AnyCfg& cfg_t, visited_t& visited) {
-        if (visited.count(curId) > 0)
-            return;
-        visited.insert(curId);
-        for (const auto& child : cfg_t.next_nodes(curId)) {
-            mark_alive_blocks(child, cfg_t, visited);
+    void mark_alive_blocks(block_id_t curId, AnyCfg& cfg_t, visited_t& visited) {
+        std::vector<block_id_t> todo{curId};
+        while (!todo.empty()) {
+            block_id_t id = todo.back();
+            todo.pop_back();
+            if (visited[id])
+                continue;
+            visited[id] = true;
+            for (const auto& child : cfg_t.next_nodes(id)) {
+                if (!visited[child])
+                    todo.push_back(child);
+            }
         }
     }
 
@@ -419,22 +459,20 @@ class cfg_t final {
     void remove_useless_blocks();
 
     void remove_joining_blocks() {
-        visited_t useless;
-        for (auto const& [label, bb] : *this) {
-            if (bb.size() == 0 && label != m_exit) {
-                useless.insert(label);
+        std::vector<block_id_t> useless;
+        for (const basic_block_t& bb : *this) {
+            if (bb.size() == 0 && bb.id() != m_exit) {
+                useless.push_back(bb.id());
             }
         }
-        if (useless.count(m_exit))
-            CRAB_ERROR("exit removed??");
-        for (const label_t& label : useless) {
-            auto& bb = get_node(label);
-            for (const label_t& prev : bb.m_prev) {
-                for (const label_t& next : bb.m_next) {
+        for (block_id_t id : useless) {
+            auto& bb = get_node(id);
+            for (block_id_t prev : bb.m_prev) {
+                for (block_id_t next : bb.m_next) {
                     get_node(prev) >> get_node(next);
                 }
             }
-            remove(label);
+            remove(id);
         }
     }
 };
@@ -442,7 +480,7 @@ class cfg_t final {
 // Viewing a cfg_t with all edges and block statements reversed. Useful for backward analysis.
 class cfg_rev_t final {
   public:
-    using node_t = label_t; // for Bgl graphs
+    using node_t = block_id_t; // for Bgl graphs
 
     using pred_range = typename cfg_t::succ_range;
     using succ_range = typename cfg_t::pred_range;
@@ -456,42 +494,21 @@ class cfg_rev_t final {
     using const_pred_iterator = typename basic_block_t::const_pred_iterator;
 
   private:
-    using visited_t = std::unordered_set<label_t>;
-
-    template <typename T>
-    void dfs_rec(const label_t& curId, visited_t& visited, T f) const {
-        if (!visited.insert(curId).second)
-            return;
-        f(get_node(curId));
-        for (const auto& n : next_nodes(curId)) {
-            dfs_rec(n, visited, f);
-        }
-    }
-
-    template <typename T>
-    void dfs(T f) const {
-        visited_t visited;
-        dfs_rec(entry(), visited, f);
-    }
-
   public:
-    using basic_block_rev_map_t = std::unordered_map<label_t, basic_block_rev_t>;
-    using iterator = typename basic_block_rev_map_t::iterator;
-    using const_iterator = typename basic_block_rev_map_t::const_iterator;
-    using label_iterator = typename cfg_t::label_iterator;
-    using const_label_iterator = typename cfg_t::const_label_iterator;
+    // Indexed by block id, like the blocks of the underlying cfg_t.
+    using basic_block_rev_vec_t = std::vector<std::optional<basic_block_rev_t>>;
 
   private:
     cfg_t& _cfg;
-    basic_block_rev_map_t _rev_bbs;
+    basic_block_rev_vec_t _rev_bbs;
 
   public:
-    explicit cfg_rev_t(cfg_t& cfg) : _cfg(cfg) {
+    explicit cfg_rev_t(cfg_t& cfg) : _cfg(cfg), _rev_bbs(cfg.num_ids()) {
         // Create basic_block_rev_t from basic_block_t objects
         // Note that basic_block_rev_t is also a view of basic_block_t so it
         // doesn't modify basic_block_t objects.
-        for (auto& [label, bb] : cfg) {
-            _rev_bbs.emplace(label, bb);
+        for (basic_block_t& bb : cfg) {
+            _rev_bbs[bb.id()].emplace(bb);
         }
     }
 
@@ -499,78 +516,58 @@ class cfg_rev_t final {
 
     cfg_rev_t(cfg_rev_t&& o) noexcept : _cfg(o._cfg), _rev_bbs(std::move(o._rev_bbs)) {}
 
-    label_t entry() const { return _cfg.exit(); }
+    block_id_t entry() const { return _cfg.exit(); }
 
-    const_succ_range next_nodes(const label_t& bb) const { return _cfg.prev_nodes(bb); }
+    const_succ_range next_nodes(block_id_t bb) const { return _cfg.prev_nodes(bb); }
 
-    const_pred_range prev_nodes(const label_t& bb) const { return _cfg.next_nodes(bb); }
+    const_pred_range prev_nodes(block_id_t bb) const { return _cfg.next_nodes(bb); }
 
-    succ_range next_nodes(const label_t& bb) { return _cfg.prev_nodes(bb); }
+    succ_range next_nodes(block_id_t bb) { return _cfg.prev_nodes(bb); }
 
-    pred_range prev_nodes(const label_t& bb) { return _cfg.next_nodes(bb); }
+    pred_range prev_nodes(block_id_t bb) { return _cfg.next_nodes(bb); }
 
-    basic_block_rev_t& get_node(const label_t& _label) {
-        auto it = _rev_bbs.find(_label);
-        if (it == _rev_bbs.end())
-            CRAB_ERROR("Basic block ", _label, " not found in the CFG: ", __LINE__);
-        return it->second;
+    basic_block_rev_t& get_node(block_id_t _id) {
+        if (_id >= _rev_bbs.size() || !_rev_bbs[_id])
+            CRAB_ERROR("Basic block ", _id, " not found in the CFG: ", __LINE__);
+        return *_rev_bbs[_id];
     }
 
-    const basic_block_rev_t& get_node(const label_t& _label) const {
-        auto it = _rev_bbs.find(_label);
-        if (it == _rev_bbs.end())
-            CRAB_ERROR("Basic block ", _label, " not found in the CFG: ", __LINE__);
-        return it->second;
+    const basic_block_rev_t& get_node(block_id_t _id) const {
+        if (_id >= _rev_bbs.size() || !_rev_bbs[_id])
+            CRAB_ERROR("Basic block ", _id, " not found in the CFG: ", __LINE__);
+        return *_rev_bbs[_id];
     }
 
-    iterator begin() { return _rev_bbs.begin(); }
-
-    iterator end() { return _rev_bbs.end(); }
-
-    const_iterator begin() const { return _rev_bbs.begin(); }
+    size_t num_ids() const { return _rev_bbs.size(); }
 
-    const_iterator end() const { return _rev_bbs.end(); }
-
-    label_iterator label_begin() { return _cfg.label_begin(); }
-
-    label_iterator label_end() { return _cfg.label_end(); }
-
-    label_t exit() const { return _cfg.entry(); }
+    block_id_t exit() const { return _cfg.entry(); }
 };
 
 inline void cfg_t::remove_useless_blocks() {
     cfg_rev_t rev_cfg(*this);
 
-    visited_t useful, useless;
+    visited_t useful(num_ids());
     mark_alive_blocks(rev_cfg.entry(), rev_cfg, useful);
 
-    if (!useful.count(m_exit))
+    if (!useful[m_exit])
         CRAB_ERROR("Exit block must be reachable");
-    for (auto const& label : labels()) {
-        if (!useful.count(label)) {
-            useless.insert(label);
+    for (block_id_t id : nodes()) {
+        if (!useful[id]) {
+            remove(id);
         }
     }
-
-    for (const auto& _label : useless) {
-        remove(_label);
-    }
 }
 
 inline void cfg_t::remove_unreachable_blocks() {
-    visited_t alive, dead;
+    visited_t alive(num_ids());
     mark_alive_blocks(entry(), *this, alive);
 
-    for (auto const& label : labels()) {
-        if (alive.count(label) <= 0) {
-            dead.insert(label);
-        }
-    }
-
-    if (dead.count(m_exit))
+    if (!alive[m_exit])
         CRAB_ERROR("Exit block must be reachable");
-    for (const auto& _label : dead) {
-        remove(_label);
+    for (block_id_t id : nodes()) {
+        if (!alive[id]) {
+            remove(id);
+        }
     }
 }
 
@@ -585,5 +582,16 @@ std::map<std::string, int> collect_stats(const cfg_t&);
 
 void explicate_assertions(cfg_t& cfg, const program_info& info);
 
+// Replaces the operations on registers that hold constants within a block by moves of their results, moves from the
+// last copy of a register by moves from the register it was copied from, and then removes the moves and operations
+// whose result is dead. The analysis gives the same invariant at the end of each block, with fewer operations to get
+// there.
+void fold_constants(cfg_t& cfg);
+
+// Removes the statements that only write registers or stack bytes which no assertion or assumption may read, directly
+// or through the statements that are kept, before the value is written again. Assertions check the same values, with
+// fewer variables for the analysis to track; the invariants leave out what was sliced away.
+void slice_to_assertions(cfg_t& cfg);
+
 void print_dot(const cfg_t& cfg, std::ostream& out);
 void print_dot(const cfg_t& cfg, const std::string& outfile);
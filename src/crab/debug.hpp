@@ -8,6 +8,7 @@
 #include <iosfwd>
 #include <set>
 #include <stdarg.h>
+#include <stdexcept>
 #include <string>
 
 namespace crab {
@@ -41,12 +42,25 @@ inline void ___print___(ArgTypes... args) {
     (void)expand_variadic_pack{0, ((std::cerr << args), void(), 0)...};
 }
 
-#define CRAB_ERROR(...)              \
-    do {                             \
-        std::cerr << "CRAB ERROR: "; \
-        ___print___(__VA_ARGS__);    \
-        std::cerr << "\n";           \
-        std::exit(EXIT_FAILURE);     \
+// Like ___print___, to os.
+template <typename... ArgTypes>
+inline void ___write___(std::ostream& os, const ArgTypes&... args) {
+    using expand_variadic_pack = int[];
+    (void)expand_variadic_pack{0, ((os << args), void(), 0)...};
+}
+
+// Thrown by CRAB_ERROR when the analysis reaches a state it cannot handle, such as an integer overflow, so that a
+// program that embeds the verifier rejects the program being verified rather than exits.
+struct crab_error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+#define CRAB_ERROR(...)                           \
+    do {                                          \
+        std::ostringstream ___os___;              \
+        ___os___ << "CRAB ERROR: ";               \
+        crab::___write___(___os___, __VA_ARGS__); \
+        throw crab::crab_error(___os___.str());   \
     } while (0)
 
 extern bool CrabWarningFlag;
@@ -0,0 +1,33 @@
+#include "crab/dense_closure.hpp"
+
+namespace crab {
+
+// row[j] = min(row[j], w + via[j]) for every j, where w is finite. The sum is computed with wrapping and its overflow
+// told by the signs, so that the loop has no branch and vectorizes; given the choice of instruction sets, the loader
+// picks the widest one the CPU has.
+__attribute__((target_clones("avx512f", "avx2", "default"))) static void
+relax_row(int64_t* __restrict row, const int64_t* __restrict via, int64_t w, size_t n) {
+    constexpr int64_t least = std::numeric_limits<int64_t>::min() + 1;
+    for (size_t j = 0; j < n; j++) {
+        const int64_t v = via[j];
+        const auto sum = (int64_t)((uint64_t)w + (uint64_t)v);
+        const bool overflow = ((w ^ sum) & (v ^ sum)) < 0;
+        // A negative overflow, from two negative weights, is clamped to a weaker bound; a positive one is no bound.
+        const int64_t clamped = overflow ? (v < 0 ? least : dense_infty) : sum;
+        const int64_t d = v == dense_infty ? dense_infty : clamped;
+        row[j] = d < row[j] ? d : row[j];
+    }
+}
+
+void close_dense_matrix(int64_t* m, size_t n) {
+    for (size_t k = 0; k < n; k++) {
+        const int64_t* row_k = m + k * n;
+        for (size_t i = 0; i < n; i++) {
+            const int64_t w_ik = m[i * n + k];
+            if (i != k && w_ik != dense_infty)
+                relax_row(m + i * n, row_k, w_ik, n);
+        }
+    }
+}
+
+} // namespace crab
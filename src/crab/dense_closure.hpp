@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace crab {
+
+// The distance between vertices with no path between them, in a dense distance matrix.
+constexpr int64_t dense_infty = std::numeric_limits<int64_t>::max();
+
+/** Close the n x n row-major distance matrix m: every entry becomes the length of the shortest path between its
+ *  vertices, or dense_infty if there is none. A path too short for int64_t is kept at the least value that fits,
+ *  a weaker and still sound bound. The matrix must have no negative cycle.
+ *
+ *  The inner loop over a row is built for AVX-512 and AVX2 as well as for the baseline instruction set, the best one
+ *  that the CPU supports being picked when the program is loaded.
+ */
+void close_dense_matrix(int64_t* m, size_t n);
+
+} // namespace crab
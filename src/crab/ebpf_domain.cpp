@@ -3,54 +3,91 @@
 namespace crab {
 namespace domains {
 
-// We use a global array map
-array_map_t global_array_map;
-
-/**
-    Ugly this needs to be fixed: needed if multiple analyses are
-    run so we can clear the array map from one run to another.
-**/
-void clear_global_state() {
-    if (!global_array_map.empty()) {
-        if constexpr (crab::CrabSanityCheckFlag) {
-            CRAB_WARN("array_expansion static variable map is being cleared");
-        }
-        global_array_map.clear();
-    }
+thread_local analysis_context_t* analysis_context_t::_current = nullptr;
+thread_local array_map_t* analysis_context_t::_array_map = nullptr;
+
+// The contexts of XDP programs and of those on sk_buffs, such as SCHED_CLS, have loads of their own; the others look
+// their layout up.
+static analysis_context_t::load_ctx_t load_ctx_for(const ptype_descr& desc) {
+    auto is = [&desc](const ptype_descr& o) {
+        return desc.size == o.size && desc.data == o.data && desc.end == o.end && desc.meta == o.meta;
+    };
+    if (is(xdp_md))
+        return ebpf_domain_t::do_load_ctx<ebpf_domain_t::fixed_layout_t<xdp_md>>;
+    if (is(sk_buff))
+        return ebpf_domain_t::do_load_ctx<ebpf_domain_t::fixed_layout_t<sk_buff>>;
+    return ebpf_domain_t::do_load_ctx<ebpf_domain_t::current_layout_t>;
 }
 
-void offset_map_t::remove_cell(const cell_t& c) {
-    if (std::optional<cell_set_t> cells = _map.lookup(c.get_offset())) {
-        if ((*cells).erase(c) > 0) {
-            _map.remove(c.get_offset());
-            if (!(*cells).empty()) {
-                // a bit of a waste ...
-                _map.insert(c.get_offset(), *cells);
-            }
-        }
+analysis_context_t::analysis_context_t(const program_info& info, relations_t relations)
+    : info(info), load_ctx(load_ctx_for(info.descriptor)), relations(relations) {}
+
+analysis_context_t::~analysis_context_t() {
+    // The zone graph scratch space is sized for the largest zone seen in this run; don't keep it around, nor the
+    // arrays freed by the zones of this run.
+    release_thread_scratch();
+}
+
+void analysis_context_t::release_thread_scratch() {
+    GraphOps<SafeInt64DefaultParams::graph_t>::release_scratch();
+    block_pool_t::release();
+}
+
+analysis_context_t& analysis_context_t::current() {
+    if (!_current)
+        CRAB_ERROR("no analysis context is current on this thread");
+    return *_current;
+}
+
+array_map_t& analysis_context_t::current_array_map() {
+    if (!_array_map)
+        CRAB_ERROR("no analysis context is current on this thread");
+    return *_array_map;
+}
+
+analysis_context_t::scope_t::scope_t(analysis_context_t& context, array_map_t& array_map)
+    : previous(_current), previous_variables(variable_factory_t::set_current(&context.variables)),
+      previous_array_map(_array_map), previous_relations(SplitDBM::set_relations(context.relations)) {
+    _current = &context;
+    _array_map = &array_map;
+}
+
+analysis_context_t::scope_t::~scope_t() {
+    _current = previous;
+    variable_factory_t::set_current(previous_variables);
+    _array_map = previous_array_map;
+    SplitDBM::set_relations(previous_relations);
+}
+
+bool offset_map_t::operator<=(const offset_map_t& o) const {
+    for (const auto& [offset, cells] : _map) {
+        auto it = o._map.find(offset);
+        if (it == o._map.end() || !std::includes(it->second.begin(), it->second.end(), cells.begin(), cells.end()))
+            return false;
     }
+    return true;
 }
 
-void offset_map_t::insert_cell(const cell_t& c) {
-    if (std::optional<cell_set_t> cells = _map.lookup(c.get_offset())) {
-        if ((*cells).insert(c).second) {
-            // a bit of a waste ...
-            _map.remove(c.get_offset());
-            _map.insert(c.get_offset(), *cells);
-        }
-    } else {
-        cell_set_t new_cells;
-        new_cells.insert(c);
-        _map.insert(c.get_offset(), new_cells);
+void offset_map_t::operator|=(const offset_map_t& o) {
+    for (const auto& [offset, cells] : o._map)
+        _map[offset].insert(cells.begin(), cells.end());
+}
+
+void offset_map_t::remove_cell(const cell_t& c) {
+    auto it = _map.find(c.get_offset());
+    if (it != _map.end() && it->second.erase(c) > 0 && it->second.empty()) {
+        _map.erase(it);
     }
 }
 
+void offset_map_t::insert_cell(const cell_t& c) { _map[c.get_offset()].insert(c); }
+
 std::optional<cell_t> offset_map_t::get_cell(offset_t o, unsigned size) const {
-    if (std::optional<cell_set_t> cells = _map.lookup(o)) {
-        cell_t tmp(o, size);
-        auto it = (*cells).find(tmp);
-        if (it != (*cells).end()) {
-            return *it;
+    auto it = _map.find(o);
+    if (it != _map.end()) {
+        auto cit = it->second.find(cell_t(o, size));
+        if (cit != it->second.end()) {
+            return *cit;
         }
     }
     // not found
@@ -63,106 +100,56 @@ cell_t offset_map_t::mk_cell(offset_t o, unsigned size) {
     auto maybe_c = get_cell(o, size);
     if (maybe_c)
         return *maybe_c;
-    // create a new scalar variable for representing the contents
+    // create new scalar variables for representing the contents
     // of bytes array[o,o+1,..., o+size-1]
     cell_t c(o, size);
+    c._scalars = variable_factory_t::current().make_cell(o.index(), size);
     insert_cell(c);
     return c;
 }
 
 // Return all cells that might overlap with (o, size).
-std::vector<cell_t> offset_map_t::get_overlap_cells(offset_t o, unsigned size) {
+std::vector<cell_t> offset_map_t::get_overlap_cells(offset_t o, unsigned size) const {
     std::vector<cell_t> out;
-    compare_binding_t comp;
-
-    bool added = false;
-    auto maybe_c = get_cell(o, size);
-    if (!maybe_c) {
-        maybe_c = cell_t(o, size);
-        insert_cell(*maybe_c);
-        added = true;
-    }
-
-    auto lb_it = std::lower_bound(_map.begin(), _map.end(), o, comp);
-    if (lb_it != _map.end()) {
-        // Store _map[begin,...,lb_it] into a vector so that we can
-        // go backwards from lb_it.
-        //
-        // TODO: give support for reverse iterator in patricia_tree.
-        std::vector<cell_set_t> upto_lb;
-        upto_lb.reserve(std::distance(_map.begin(), lb_it));
-        for (auto it = _map.begin(), et = lb_it; it != et; ++it) {
-            upto_lb.push_back(it->second);
-        }
-        upto_lb.push_back(lb_it->second);
-
-        for (int i = upto_lb.size() - 1; i >= 0; --i) {
-            ///////
-            // All the cells in upto_lb[i] have the same offset. They
-            // just differ in the size.
-            //
-            // If none of the cells in upto_lb[i] overlap with (o, size)
-            // we can stop.
-            ////////
-            bool continue_outer_loop = false;
-            for (const cell_t& x : upto_lb[i]) {
-                if (x.overlap(o, size)) {
-                    if (!(x == *maybe_c)) {
-                        // FIXME: we might have some duplicates. this is a very drastic solution.
-                        if (std::find(out.begin(), out.end(), x) == out.end()) {
-                            out.push_back(x);
-                        }
-                    }
-                    continue_outer_loop = true;
-                }
-            }
-            if (!continue_outer_loop) {
-                break;
-            }
-        }
-    }
-
-    // search for overlapping cells > o
-    auto ub_it = std::upper_bound(_map.begin(), _map.end(), o, comp);
-    for (; ub_it != _map.end(); ++ub_it) {
-        bool continue_outer_loop = false;
-        for (const cell_t& x : ub_it->second) {
-            if (x.overlap(o, size)) {
-                // FIXME: we might have some duplicates. this is a very drastic solution.
-                if (std::find(out.begin(), out.end(), x) == out.end()) {
-                    out.push_back(x);
-                }
-                continue_outer_loop = true;
-            }
-        }
-        if (!continue_outer_loop) {
-            break;
-        }
-    }
+    const cell_t c(o, size);
 
-    // do not forget the rest of overlapping cells == o
-    for (auto it = ++lb_it, et = ub_it; it != et; ++it) {
-        bool continue_outer_loop = false;
-        for (const cell_t& x : it->second) {
-            if (x == *maybe_c) { // we dont put it in out
-                continue;
-            }
+    // Add the cells of one offset that overlap with (o, size), other
+    // than c itself, and tell whether any of them (c included) did.
+    auto add_overlapping = [&](const cell_set_t& cells, bool at_o) {
+        bool overlaps = at_o;
+        for (const cell_t& x : cells) {
             if (x.overlap(o, size)) {
-                if (!(x == *maybe_c)) {
+                if (!(x == c)) {
+                    // FIXME: we might have some duplicates. this is a very drastic solution.
                     if (std::find(out.begin(), out.end(), x) == out.end()) {
                         out.push_back(x);
                     }
                 }
-                continue_outer_loop = true;
+                overlaps = true;
             }
         }
-        if (!continue_outer_loop) {
+        return overlaps;
+    };
+
+    // Go backwards from o. If none of the cells at an offset overlap
+    // with (o, size) we can stop. (o, size) itself always overlaps.
+    auto lb_it = _map.lower_bound(o);
+    auto ub_it = lb_it;
+    if (lb_it != _map.end() && lb_it->first == o) {
+        add_overlapping(lb_it->second, true);
+        ++ub_it;
+    }
+    for (auto it = map_t::const_reverse_iterator(lb_it), et = _map.crend(); it != et; ++it) {
+        if (!add_overlapping(it->second, false)) {
             break;
         }
     }
 
-    if (added) {
-        remove_cell(*maybe_c);
+    // search for overlapping cells > o
+    for (; ub_it != _map.end(); ++ub_it) {
+        if (!add_overlapping(ub_it->second, false)) {
+            break;
+        }
     }
     return out;
 }
@@ -171,8 +158,7 @@ void offset_map_t::write(std::ostream& o) const {
     if (_map.empty()) {
         o << "empty";
     } else {
-        for (auto it = _map.begin(), et = _map.end(); it != et; ++it) {
-            const cell_set_t& cells = it->second;
+        for (const auto& [offset, cells] : _map) {
             o << "{";
             for (auto cit = cells.begin(), cet = cells.end(); cit != cet;) {
                 o << *cit;
@@ -186,5 +172,35 @@ void offset_map_t::write(std::ostream& o) const {
     }
 }
 
+void ebpf_domain_t::forget_dead(const live_set_t& live) {
+    if (is_bottom())
+        return;
+    variable_vector_t dead;
+    for (int i = 0; i < 10; i++) {
+        if (!live.regs[i]) {
+            dead.push_back(reg_value(i));
+            dead.push_back(reg_offset(i));
+            dead.push_back(reg_type(i));
+            reg_bits.havoc(i);
+        }
+    }
+    // A cell is dead once none of its bytes is live.
+    for (const auto& [offset, cells] : analysis_context_t::current_array_map()._map) {
+        for (const cell_t& c : cells) {
+            const index_t lb = offset.index();
+            if (lb + c.get_size() > STACK_SIZE)
+                continue;
+            bool is_live = false;
+            for (index_t i = lb; i < lb + c.get_size() && !is_live; i++)
+                is_live = live.stack[i];
+            if (!is_live) {
+                for (data_kind_t kind : {data_kind_t::types, data_kind_t::values, data_kind_t::offsets})
+                    dead.push_back(c.get_scalar(kind));
+            }
+        }
+    }
+    forget(dead);
+}
+
 } // namespace domains
 } // namespace crab
\ No newline at end of file
@@ -22,23 +22,31 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <bitset>
 #include <functional>
 #include <optional>
 #include <set>
+#include <stdexcept>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-#include "boost/range/algorithm/set_algorithm.hpp"
+#include <boost/container/flat_map.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/container/flat_set.hpp>
 
+#include "crab/arena.hpp"
 #include "crab/debug.hpp"
 #include "crab/stats.hpp"
 #include "crab/types.hpp"
 
 #include "crab/interval.hpp"
-#include "crab/patricia_trees.hpp"
+#include "crab/liveness.hpp"
+#include "crab/packed_split_dbm.hpp"
 #include "crab/split_dbm.hpp"
+#include "crab/tnum.hpp"
 
 #include "config.hpp"
 #include "dsl_syntax.hpp"
@@ -46,11 +54,16 @@
 #include "spec_type_descriptors.hpp"
 #include "asm_ostream.hpp"
 
+namespace crab {
+class analysis_profile_t;
+class analysis_control_t;
+}
+
 namespace crab::domains {
 
-using NumAbsDomain = SplitDBM;
+using NumAbsDomain = PackedSplitDBM;
 
-// wrapper for using index_t as patricia_tree keys
+// wrapper for using index_t as offset_map_t keys
 class offset_t final {
     index_t _val{};
 
@@ -75,14 +88,14 @@ class offset_t final {
 };
 
 /*
-   Conceptually, a cell is tuple of an array, offset, size, and
-   scalar variable such that:
+   Conceptually, a cell is tuple of an offset, size, and scalar
+   variables such that, for each data kind k:
 
-       _scalar = array[_offset, _offset+1,...,_offset+_size-1]
+       _scalars[k] = stack[_offset, _offset+1,...,_offset+_size-1]
 
-   For simplicity, we don't carry the array inside the cell class.
-   Only, offset_map objects can create cells. They will consider the
-   array when generating the scalar variable.
+   The type, value and offset of the same bytes live in one cell, so
+   that an access looks it up once. Only offset_map objects can create
+   cells.
 */
 
 class offset_map_t;
@@ -93,6 +106,8 @@ class cell_t final {
 
     offset_t _offset{};
     unsigned _size{};
+    // The first of the scalars, see variable_factory_t::make_cell().
+    index_t _scalars{};
 
     // Only offset_map_t can create cells
     cell_t() = default;
@@ -110,7 +125,9 @@ class cell_t final {
 
     offset_t get_offset() const { return _offset; }
 
-    variable_t get_scalar(data_kind_t kind) const { return variable_t::cell_var(kind, _offset.index(), _size); }
+    unsigned get_size() const { return _size; }
+
+    variable_t get_scalar(data_kind_t kind) const { return variable_t::cell_var(kind, _scalars); }
 
     // ignore the scalar variable
     bool operator==(const cell_t& o) const { return to_interval() == o.to_interval(); }
@@ -133,29 +150,33 @@ class cell_t final {
         return res;
     }
 
+    // Return true if e may be equal to n in dom, where e is known to
+    // evaluate to range in dom. Only copies dom when range leaves it open.
+    static bool may_equal(const linear_expression_t& e, const interval_t& range, const number_t& n,
+                          const NumAbsDomain& dom) {
+        if (!range[n])
+            return false;
+        if (range.singleton())
+            return true;
+        NumAbsDomain tmp(dom);
+        tmp += linear_constraint_t(e - n, linear_constraint_t::INEQUALITY);
+        tmp += linear_constraint_t(linear_expression_t(n) - e, linear_constraint_t::INEQUALITY);
+        return !tmp.is_bottom();
+    }
+
     // Return true if [symb_lb, symb_ub] may overlap with the cell,
-    // where symb_lb and symb_ub are not constant expressions.
+    // where symb_lb and symb_ub are not constant expressions, and
+    // evaluate to symb_lb_range and symb_ub_range in dom.
     bool symbolic_overlap(const linear_expression_t& symb_lb, const linear_expression_t& symb_ub,
+                          const interval_t& symb_lb_range, const interval_t& symb_ub_range,
                           const NumAbsDomain& dom) const {
 
         interval_t x = to_interval();
         assert(x.lb().is_finite());
         assert(x.ub().is_finite());
-        linear_expression_t lb(*(x.lb().number()));
-        linear_expression_t ub(*(x.ub().number()));
-
-        NumAbsDomain tmp1(dom);
-        tmp1 += linear_constraint_t(symb_lb - lb, linear_constraint_t::INEQUALITY); //(lb >= symb_lb);
-        tmp1 += linear_constraint_t(lb - symb_lb, linear_constraint_t::INEQUALITY); //(lb <= symb_ub);
-        if (!tmp1.is_bottom()) {
-            CRAB_LOG("array-expansion-overlap", std::cout << "\tyes.\n";);
-            return true;
-        }
 
-        NumAbsDomain tmp2(dom);
-        tmp2 += linear_constraint_t(symb_ub - ub, linear_constraint_t::INEQUALITY); // (ub >= symb_lb);
-        tmp2 += linear_constraint_t(ub - symb_ub, linear_constraint_t::INEQUALITY); // (ub <= symb_ub);
-        if (!tmp2.is_bottom()) {
+        if (may_equal(symb_lb, symb_lb_range, *(x.lb().number()), dom) ||
+            may_equal(symb_ub, symb_ub_range, *(x.ub().number()), dom)) {
             CRAB_LOG("array-expansion-overlap", std::cout << "\tyes.\n";);
             return true;
         }
@@ -180,44 +201,20 @@ class offset_map_t final {
   private:
     friend class ebpf_domain_t;
 
-    using cell_set_t = std::set<cell_t>;
+    // Cells at the same offset, which only differ in their size; few offsets have more than one or two.
+    using cell_set_t = boost::container::small_flat_set<cell_t, 2>;
 
     /*
-      The keys in the patricia tree are processing in big-endian
-      order. This means that the keys are sorted. Sortedness is
-      very important to perform efficiently operations such as
-      checking for overlap cells. Since keys are treated as bit
-      patterns, negative offsets can be used but they are treated
-      as large unsigned numbers.
+      The offsets are kept sorted in a flat vector, and updated in
+      place. Sortedness is very important to perform efficiently
+      operations such as checking for overlap cells. Negative offsets
+      can be used but they are treated as large unsigned numbers.
     */
-    using patricia_tree_t = patricia_tree<offset_t, cell_set_t>;
-    using partial_order_t = typename patricia_tree_t::partial_order_t;
-
-    patricia_tree_t _map;
-
-    // for algorithm::lower_bound and algorithm::upper_bound
-    struct compare_binding_t {
-        bool operator()(const typename patricia_tree_t::binding_t& kv, const offset_t& o) const { return kv.first < o; }
-        bool operator()(const offset_t& o, const typename patricia_tree_t::binding_t& kv) const { return o < kv.first; }
-        bool operator()(const typename patricia_tree_t::binding_t& kv1,
-                        const typename patricia_tree_t::binding_t& kv2) const {
-            return kv1.first < kv2.first;
-        }
-    };
+    using map_t = boost::container::flat_map<
+        offset_t, cell_set_t, std::less<offset_t>,
+        counting_allocator_t<std::pair<offset_t, cell_set_t>, memory_kind_t::offset_map>>;
 
-    class domain_po : public partial_order_t {
-        bool leq(cell_set_t x, cell_set_t y) override {
-            {
-                cell_set_t z;
-                boost::set_difference(x, y, std::inserter(z, z.end()));
-                return z.empty();
-            }
-        }
-        // default value is bottom (i.e., empty map)
-        bool default_is_top() override { return false; }
-    }; // class domain_po
-
-    explicit offset_map_t(const patricia_tree_t& m) : _map(m) {}
+    map_t _map;
 
     void remove_cell(const cell_t& c);
 
@@ -235,10 +232,10 @@ class offset_map_t final {
     std::size_t size() const { return _map.size(); }
 
     // leq operator
-    bool operator<=(const offset_map_t& o) const {
-        domain_po po;
-        return _map.leq(o._map, po);
-    }
+    bool operator<=(const offset_map_t& o) const;
+
+    // Add the cells of o.
+    void operator|=(const offset_map_t& o);
 
     void operator-=(const cell_t& c) { remove_cell(c); }
 
@@ -248,14 +245,19 @@ class offset_map_t final {
         }
     }
 
+    // Add the cell [o, o + size) if it is not there yet, as for states whose scalars refer to it that were read
+    // rather than computed.
+    void declare_cell(offset_t o, unsigned size) { mk_cell(o, size); }
+
     // Return in out all cells that might overlap with (o, size).
-    std::vector<cell_t> get_overlap_cells(offset_t o, unsigned size);
+    std::vector<cell_t> get_overlap_cells(offset_t o, unsigned size) const;
 
-    std::vector<cell_t> get_overlap_cells_symbolic_offset(const NumAbsDomain& dom, const linear_expression_t& symb_lb,
+    std::vector<cell_t> get_overlap_cells_symbolic_offset(NumAbsDomain& dom, const linear_expression_t& symb_lb,
                                                           const linear_expression_t& symb_ub) const {
         std::vector<cell_t> out;
-        for (auto it = _map.begin(), et = _map.end(); it != et; ++it) {
-            const cell_set_t& o_cells = it->second;
+        const interval_t symb_lb_range = dom.eval_interval(symb_lb);
+        const interval_t symb_ub_range = dom.eval_interval(symb_ub);
+        for (const auto& [offset, o_cells] : _map) {
             // All cells in o_cells have the same offset. They only differ
             // in the size. If the largest cell overlaps with [offset,
             // offset + size) then the rest of cells are considered to
@@ -263,23 +265,9 @@ class offset_map_t final {
             // offset+size) can overlap with the largest cell but it
             // doesn't necessarily overlap with smaller cells. For
             // efficiency, we assume it overlaps with all.
-            cell_t largest_cell;
-            for (auto& c : o_cells) {
-                if (largest_cell.is_null()) {
-                    largest_cell = c;
-                } else {
-                    assert(c.get_offset() == largest_cell.get_offset());
-                    if (largest_cell < c) {
-                        largest_cell = c;
-                    }
-                }
-            }
-            if (!largest_cell.is_null()) {
-                if (largest_cell.symbolic_overlap(symb_lb, symb_ub, dom)) {
-                    for (auto& c : o_cells) {
-                        out.push_back(c);
-                    }
-                }
+            const cell_t& largest_cell = *o_cells.rbegin();
+            if (largest_cell.symbolic_overlap(symb_lb, symb_ub, symb_lb_range, symb_ub_range, dom)) {
+                out.insert(out.end(), o_cells.begin(), o_cells.end());
             }
         }
         return out;
@@ -306,16 +294,85 @@ class offset_map_t final {
     static offset_map_t top() { return offset_map_t(); }
 };
 
-// We use a global array map
-using array_map_t = std::unordered_map<data_kind_t, offset_map_t>;
-extern array_map_t global_array_map;
-void clear_global_state();
+// The cells of the stack, for all data kinds at once.
+using array_map_t = offset_map_t;
+
+/** State owned by a single verification run: the program being analyzed,
+ *  and the variables and array cells created while analyzing it.
+ *
+ *  The abstract domain reaches it through current(), so a context must be made current
+ *  (see scope_t) on the analyzing thread for the duration of the analysis.
+ *  Once the context is destroyed nothing of that run is left behind.
+ */
+class analysis_context_t final {
+    static thread_local analysis_context_t* _current;
+    static thread_local array_map_t* _array_map;
+
+  public:
+    // The transformer of a load from the context, for the layout of the context of the program type.
+    using load_ctx_t = NumAbsDomain (*)(NumAbsDomain inv, Reg target, const linear_expression_t& addr, int width);
+
+    const program_info info;
+    // The load from the context for info.descriptor, chosen once: compiled for that layout where it is one of the
+    // common ones, so that its offsets are constants.
+    const load_ctx_t load_ctx;
+    // The relations between variables kept by the numeric domain while the context is current. They may be raised
+    // between analyses, the invariants of the earlier ones remaining valid.
+    relations_t relations;
+    array_map_t array_map;
+    variable_factory_t variables;
+    // If set, the fixpoint records in it where its time goes.
+    analysis_profile_t* profile{};
+    // If set, the fixpoint reports its progress to it, and stops once it is cancelled.
+    analysis_control_t* control{};
+
+    // The context keeps its own program_info, which shares the table of maps of info.
+    explicit analysis_context_t(const program_info& info, relations_t relations = global_options.relations);
+    ~analysis_context_t();
+    analysis_context_t(const analysis_context_t&) = delete;
+    analysis_context_t& operator=(const analysis_context_t&) = delete;
+
+    static analysis_context_t& current();
+
+    // Free the scratch space of the graph algorithms and the arrays kept for reuse by the zones of the calling
+    // thread, as is done when a context is destroyed.
+    static void release_thread_scratch();
+
+    // The array cells of the calling thread: those of the current context, unless its scope stands others in.
+    static array_map_t& current_array_map();
+
+    // Makes a context current for the calling thread until the end of the scope. Scopes may nest.
+    class scope_t final {
+        analysis_context_t* previous;
+        variable_factory_t* previous_variables;
+        array_map_t* previous_array_map;
+        relations_t previous_relations;
+
+      public:
+        explicit scope_t(analysis_context_t& context) : scope_t(context, context.array_map) {}
+        // Likewise, but with array_map in place of the array cells of context, for a part of the analysis run on
+        // another thread.
+        scope_t(analysis_context_t& context, array_map_t& array_map);
+        ~scope_t();
+        scope_t(const scope_t&) = delete;
+        scope_t& operator=(const scope_t&) = delete;
+    };
+};
 
 class array_bitset_domain_t final : public writeable {
   private:
     using bits_t = std::bitset<STACK_SIZE>;
     bits_t non_numerical_bytes;
 
+    // The bytes [lb, lb + width), built with whole-word shifts rather than a bit at a time.
+    static bits_t range(int lb, int width) {
+        if (lb < 0 || width < 0 || lb + width > STACK_SIZE)
+            throw std::out_of_range("stack byte range");
+        if (width == 0)
+            return {};
+        return (bits_t{}.set() >> (STACK_SIZE - width)) << lb;
+    }
+
   public:
     array_bitset_domain_t() { non_numerical_bytes.set(); }
 
@@ -356,30 +413,24 @@ class array_bitset_domain_t final : public writeable {
     }
 
     std::pair<bool, bool> uniformity(int lb, int width) {
-        bool only_num = true;
-        bool only_non_num = true;
-        for (int j = 0; j < width; j++) {
-            bool b = non_numerical_bytes[lb + j];
-            only_num &= !b;
-            only_non_num &= b;
-        }
+        bits_t mask = range(lb, width);
+        bits_t bytes = non_numerical_bytes & mask;
+        bool only_num = bytes.none();
+        bool only_non_num = bytes == mask;
         return std::make_pair(only_num, only_non_num);
     }
 
     void store(int lb, int width, std::optional<number_t> val) {
-        for (int i = 0; i < width; i++) {
-            if (val && (long)*val == T_NUM)
-                non_numerical_bytes.reset(lb + i);
-            else
-                non_numerical_bytes.set(lb + i);
-        }
+        if (val && (long)*val == T_NUM)
+            non_numerical_bytes &= ~range(lb, width);
+        else
+            non_numerical_bytes |= range(lb, width);
     }
 
-    void havoc(int lb, int width) {
-        for (int i = 0; i < width; i++) {
-            non_numerical_bytes.set(lb + i);
-        }
-    }
+    void havoc(int lb, int width) { non_numerical_bytes |= range(lb, width); }
+
+    // The bytes not known to be numbers, by offset from the bottom of the stack.
+    const bits_t& non_numerical() const { return non_numerical_bytes; }
 
     void write(std::ostream& o) override {
         o << "Numbers -> {";
@@ -404,6 +455,137 @@ class array_bitset_domain_t final : public writeable {
     }
 };
 
+/** The bits known of the value of each register, r0 to r10, as tristate numbers (see tnum_t).
+ *
+ *  The zone keeps the bounds of the values, which say little of the result of a bitwise operation: masking a value
+ *  with 0xf0, say, leaves it between 0 and 0xf0 but also a multiple of 16, and shifting it right by 4 then gives a
+ *  value between 0 and 15, where the zone alone would know nothing. The bits are updated by the ALU operations, each
+ *  from those known of its operands, including the bits implied by their bounds, and give back bounds to the zone;
+ *  every other write of a register forgets its bits. Being a fixed array of words, the component is joined and
+ *  compared at the cost of a few instructions per register, and its height is finite, so that widening joins it.
+ */
+class register_bits_domain_t final {
+    std::array<tnum_t, 11> regs;
+
+  public:
+    void set_to_top() { regs.fill(tnum_t::top()); }
+
+    bool is_top() const {
+        return std::all_of(regs.begin(), regs.end(), [](const tnum_t& t) { return t.is_top(); });
+    }
+
+    const tnum_t& operator[](int reg) const { return regs[reg]; }
+    void set(int reg, tnum_t bits) { regs[reg] = bits; }
+    void havoc(int reg) { regs[reg] = tnum_t::top(); }
+
+    bool operator<=(const register_bits_domain_t& other) const {
+        for (size_t i = 0; i < regs.size(); i++) {
+            if (!(regs[i] <= other.regs[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool operator==(const register_bits_domain_t& other) const { return regs == other.regs; }
+
+    void operator|=(const register_bits_domain_t& other) {
+        for (size_t i = 0; i < regs.size(); i++)
+            regs[i] = regs[i] | other.regs[i];
+    }
+
+    register_bits_domain_t operator|(const register_bits_domain_t& other) const {
+        register_bits_domain_t res{*this};
+        res |= other;
+        return res;
+    }
+
+    register_bits_domain_t operator&(const register_bits_domain_t& other) const {
+        register_bits_domain_t res;
+        for (size_t i = 0; i < regs.size(); i++)
+            res.regs[i] = regs[i].meet(other.regs[i]);
+        return res;
+    }
+};
+
+/** The possible types of a register, as a finite set.
+ *
+ *  Types live in the zone domain, since shared regions encode their size in the type and type equalities between
+ *  registers matter. This is a cheaper view of one type variable, built from its bounds alone, that decides type
+ *  checks and prunes case splits on the type without going through the zone.
+ */
+class type_set_t {
+    // One bit per type from T_UNINIT to T_PACKET, then one each for 0, any shared region, and anything below T_UNINIT.
+    static constexpr int ZERO = T_SHARED - T_UNINIT;
+    static constexpr int SHARED = ZERO + 1;
+    static constexpr int BELOW = SHARED + 1;
+    using bits_t = std::bitset<BELOW + 1>;
+    bits_t bits;
+
+    explicit type_set_t(bits_t bits) : bits{bits} {}
+
+    // The types t with lb <= t, as a set.
+    static type_set_t at_least(int lb) {
+        bits_t res;
+        for (int t = lb; t < T_SHARED; t++)
+            res.set(t - T_UNINIT);
+        res.set(ZERO);
+        res.set(SHARED);
+        return type_set_t{res};
+    }
+
+  public:
+    static type_set_t single(int type) {
+        bits_t res;
+        res.set(type - T_UNINIT);
+        return type_set_t{res};
+    }
+
+    static type_set_t shared() { return type_set_t{bits_t{}.set(SHARED)}; }
+
+    static type_set_t of(const interval_t& t) {
+        bits_t res;
+        if (t.is_bottom())
+            return type_set_t{res};
+        for (int type = T_UNINIT; type <= T_SHARED; type++) {
+            if (t[type])
+                res.set(type - T_UNINIT);
+        }
+        if (t.ub() > T_SHARED)
+            res.set(SHARED);
+        if (t.lb() < T_UNINIT)
+            res.set(BELOW);
+        return type_set_t{res};
+    }
+
+    static type_set_t of(TypeGroup group) {
+        switch (group) {
+        case TypeGroup::num: return single(T_NUM);
+        case TypeGroup::map_fd: return single(T_MAP);
+        case TypeGroup::ctx: return single(T_CTX);
+        case TypeGroup::packet: return single(T_PACKET);
+        case TypeGroup::stack: return single(T_STACK);
+        case TypeGroup::shared: return shared();
+        case TypeGroup::non_map_fd: return at_least(T_NUM);
+        case TypeGroup::mem: return at_least(T_STACK);
+        case TypeGroup::mem_or_num: return type_set_t{at_least(T_NUM).bits.reset(T_CTX - T_UNINIT)};
+        case TypeGroup::ptr: return at_least(T_CTX);
+        case TypeGroup::ptr_or_num: return at_least(T_NUM);
+        case TypeGroup::stack_or_packet: return single(T_STACK) | single(T_PACKET);
+        }
+        return type_set_t{bits_t{}.set()};
+    }
+
+    type_set_t operator|(type_set_t o) const { return type_set_t{bits | o.bits}; }
+
+    type_set_t operator&(type_set_t o) const { return type_set_t{bits & o.bits}; }
+
+    bool is_empty() const { return bits.none(); }
+
+    bool subset_of(type_set_t o) const { return (bits & ~o.bits).none(); }
+
+    bool intersects(type_set_t o) const { return (bits & o.bits).any(); }
+};
+
 /**
  * Abstract forward transformer for all statements.
  **/
@@ -510,16 +692,43 @@ inline bool is_unsigned_cmp(Condition::Op op) {
 class ebpf_domain_t final {
   public:
     using variable_vector_t = std::vector<variable_t>;
-    typedef void check_require_func_t(NumAbsDomain&, const linear_constraint_t&, std::string);
+    // Formats the message of an assertion; only called when the assertion may fail.
+    using message_t = std::function<std::string()>;
+
+    /** A non-owning reference to the callable that checks each required constraint before it is assumed.
+     *
+     *  It is two words, so that domain copies and joins do not copy (or allocate for) a type-erased callable,
+     *  and require() makes a single indirect call. The callable must outlive the domain values it is set on.
+     */
+    class require_check_t final {
+        void* _check{};
+        void (*_call)(void*, NumAbsDomain&, const linear_constraint_t&, const message_t&){};
+
+      public:
+        require_check_t() = default;
+
+        template <typename F>
+        explicit require_check_t(F& check)
+            : _check(&check), _call([](void* f, NumAbsDomain& inv, const linear_constraint_t& cst, const message_t& s) {
+                  (*static_cast<F*>(f))(inv, cst, s);
+              }) {}
+
+        explicit operator bool() const { return _call != nullptr; }
+
+        void operator()(NumAbsDomain& inv, const linear_constraint_t& cst, const message_t& s) const {
+            _call(_check, inv, cst, s);
+        }
+    };
 
   private:
     // scalar domain
     NumAbsDomain m_inv;
     array_bitset_domain_t num_bytes;
-    std::function<check_require_func_t> check_require{};
+    register_bits_domain_t reg_bits;
+    require_check_t check_require{};
 
   public:
-    void set_require_check(std::function<check_require_func_t> f) { check_require = std::move(f); }
+    void set_require_check(require_check_t check) { check_require = check; }
 
     static ebpf_domain_t top() {
         ebpf_domain_t abs;
@@ -534,13 +743,27 @@ class ebpf_domain_t final {
     }
 
   private:
-    static offset_map_t& lookup_array_map(data_kind_t kind) { return global_array_map[kind]; }
+    static offset_map_t& lookup_array_map() { return analysis_context_t::current_array_map(); }
 
-    static void kill_cells(data_kind_t kind, const std::vector<cell_t>& cells, offset_map_t& offset_map, NumAbsDomain& dom) {
+    // The bits of the join with other, whose states only count if they are not bottom.
+    register_bits_domain_t join_bits(const ebpf_domain_t& other) const {
+        if (is_bottom())
+            return other.reg_bits;
+        if (other.is_bottom())
+            return reg_bits;
+        return reg_bits | other.reg_bits;
+    }
+
+    static void forget_scalars(const cell_t& c, NumAbsDomain& dom) {
+        for (data_kind_t kind : {data_kind_t::types, data_kind_t::values, data_kind_t::offsets})
+            dom -= c.get_scalar(kind);
+    }
+
+    static void kill_cells(const std::vector<cell_t>& cells, offset_map_t& offset_map, NumAbsDomain& dom) {
         if (!cells.empty()) {
             // Forget the scalars from the numerical domain
             for (auto c : cells) {
-                dom -= c.get_scalar(kind);
+                forget_scalars(c, dom);
             }
             // Remove the cells. If needed again they they will be re-created.
             offset_map -= cells;
@@ -550,23 +773,48 @@ class ebpf_domain_t final {
   public:
     ebpf_domain_t() : m_inv(NumAbsDomain::top()) {}
 
-    ebpf_domain_t(NumAbsDomain  inv, array_bitset_domain_t num_bytes) : m_inv(std::move(inv)), num_bytes(std::move(num_bytes)) {}
+    ebpf_domain_t(NumAbsDomain  inv, array_bitset_domain_t num_bytes, register_bits_domain_t reg_bits = {})
+        : m_inv(std::move(inv)), num_bytes(std::move(num_bytes)), reg_bits(reg_bits) {}
 
     void set_to_top() {
         m_inv.set_to_top();
         num_bytes.set_to_top();
+        reg_bits.set_to_top();
     }
 
     void set_to_bottom() { m_inv.set_to_bottom(); }
 
     bool is_bottom() const { return m_inv.is_bottom(); }
 
-    bool is_top() const { return m_inv.is_top() && num_bytes.is_top(); }
+    bool is_top() const { return m_inv.is_top() && num_bytes.is_top() && reg_bits.is_top(); }
+
+    // The number of vertices and edges of the zone.
+    std::pair<std::size_t, std::size_t> zone_size() const { return m_inv.size(); }
+
+    // The bytes held by the zone, unless they are in counted, shared with a state counted before; they are then added
+    // to it.
+    std::size_t memory_bytes(std::unordered_set<const void*>& counted) const { return m_inv.memory_bytes(counted); }
+
+    // The parts of the state, as written by crab/invariant_io.hpp and given back to the constructor when read.
+    const NumAbsDomain& numbers() const { return m_inv; }
+    const array_bitset_domain_t& stack_numbers() const { return num_bytes; }
+    const register_bits_domain_t& register_bits() const { return reg_bits; }
+
+    // Close the zone, which a widening may have left open. Reading a closed zone modifies nothing, so copies of it
+    // may then be read from several threads at once.
+    void normalize() { m_inv.normalize(); }
+
+    // Share the zone of other if this one holds the same, so that the two take the memory of one.
+    void share_if_equal(const ebpf_domain_t& other) { m_inv.share_if_equal(other.m_inv); }
 
-    bool operator<=(const ebpf_domain_t& other) { return m_inv <= other.m_inv && num_bytes <= other.num_bytes; }
+    // The bytes and bits are compared first, being much cheaper than the zone and enough to tell many states apart.
+    bool operator<=(const ebpf_domain_t& other) {
+        return num_bytes <= other.num_bytes && (reg_bits <= other.reg_bits || is_bottom()) && m_inv <= other.m_inv;
+    }
 
     bool operator==(ebpf_domain_t other) {
-        return num_bytes == other.num_bytes && m_inv <= other.m_inv && other.m_inv <= m_inv;
+        return num_bytes == other.num_bytes && reg_bits == other.reg_bits && m_inv <= other.m_inv &&
+               other.m_inv <= m_inv;
     }
 
     void operator|=(ebpf_domain_t&& other) {
@@ -574,6 +822,8 @@ class ebpf_domain_t final {
             *this = other;
             return;
         }
+        if (!other.is_bottom())
+            reg_bits |= other.reg_bits;
         m_inv |= std::move(other.m_inv);
         num_bytes |= other.num_bytes;
     }
@@ -588,36 +838,65 @@ class ebpf_domain_t final {
             *this = other;
             return;
         }
+        if (!other.is_bottom())
+            reg_bits |= other.reg_bits;
         m_inv |= other.m_inv;
         num_bytes |= other.num_bytes;
     }
 
+    // The join of all of xs, as folding them with |= from bottom gives.
+    static ebpf_domain_t join_all(const std::vector<const ebpf_domain_t*>& xs) {
+        std::vector<const NumAbsDomain*> invs;
+        array_bitset_domain_t num_bytes;
+        num_bytes.set_to_bottom();
+        register_bits_domain_t reg_bits;
+        // Until the first state that is not bottom, the fold takes each one whole.
+        bool bottom = true;
+        for (const ebpf_domain_t* x : xs) {
+            if (bottom)
+                num_bytes = x->num_bytes;
+            else
+                num_bytes |= x->num_bytes;
+            if (!x->is_bottom()) {
+                if (bottom)
+                    reg_bits = x->reg_bits;
+                else
+                    reg_bits |= x->reg_bits;
+                bottom = false;
+                invs.push_back(&x->m_inv);
+            }
+        }
+        return ebpf_domain_t(NumAbsDomain::join_all(invs), num_bytes, reg_bits);
+    }
+
     ebpf_domain_t operator|(ebpf_domain_t&& other) {
-        return ebpf_domain_t(m_inv | other.m_inv, num_bytes | other.num_bytes);
+        return ebpf_domain_t(m_inv | other.m_inv, num_bytes | other.num_bytes, join_bits(other));
     }
 
     ebpf_domain_t operator|(const ebpf_domain_t& other) & {
-        return ebpf_domain_t(m_inv | other.m_inv, num_bytes | other.num_bytes);
+        return ebpf_domain_t(m_inv | other.m_inv, num_bytes | other.num_bytes, join_bits(other));
     }
 
     ebpf_domain_t operator|(const ebpf_domain_t& other) && {
-        return ebpf_domain_t(m_inv | other.m_inv, num_bytes | other.num_bytes);
+        return ebpf_domain_t(m_inv | other.m_inv, num_bytes | other.num_bytes, join_bits(other));
     }
 
-    ebpf_domain_t operator&(ebpf_domain_t other) {
-        return ebpf_domain_t(m_inv & std::move(other.m_inv), num_bytes & other.num_bytes);
+    ebpf_domain_t operator&(const ebpf_domain_t& other) {
+        return ebpf_domain_t(m_inv & other.m_inv, num_bytes & other.num_bytes, reg_bits & other.reg_bits);
     }
 
+    // The bits have finite height, so that joining them is a widening.
     ebpf_domain_t widen(const ebpf_domain_t& other) {
-        return ebpf_domain_t(m_inv.widen(other.m_inv), num_bytes | other.num_bytes);
+        return ebpf_domain_t(m_inv.widen(other.m_inv), num_bytes | other.num_bytes, join_bits(other));
     }
 
     ebpf_domain_t widening_thresholds(const ebpf_domain_t& other, const iterators::thresholds_t& ts) {
-        return ebpf_domain_t(m_inv.widening_thresholds(other.m_inv, ts), num_bytes | other.num_bytes);
+        return ebpf_domain_t(m_inv.widening_thresholds(other.m_inv, ts), num_bytes | other.num_bytes,
+                             join_bits(other));
     }
 
     ebpf_domain_t narrow(const ebpf_domain_t& other) {
-        return ebpf_domain_t(m_inv.narrow(other.m_inv), num_bytes & other.num_bytes);
+        return ebpf_domain_t(m_inv.narrow(other.m_inv), num_bytes & other.num_bytes, reg_bits & other.reg_bits);
     }
 
     interval_t operator[](variable_t x) { return m_inv[x]; }
@@ -631,6 +910,9 @@ class ebpf_domain_t final {
         m_inv.forget(variables);
     }
 
+    // Forget the registers other than r10 and the stack cells that are not in live.
+    void forget_dead(const live_set_t& live);
+
     void operator+=(const linear_constraint_t& cst) { m_inv += cst; }
 
     void operator-=(variable_t var) { m_inv -= var; }
@@ -652,136 +934,125 @@ class ebpf_domain_t final {
     }
     // array_operators_api
 
-    void array_load(NumAbsDomain& inv, variable_t lhs, data_kind_t kind, const linear_expression_t& i, int width) {
-
+    // Load the type, value and offset of target from the stack bytes [i, i + width). Only the type is tracked for
+    // loads narrower than a register.
+    void stack_load(NumAbsDomain& inv, Reg target, const linear_expression_t& i, int width) {
         if (inv.is_bottom())
             return;
 
-        interval_t ii = inv.eval_interval(i);
-        if (std::optional<number_t> n = ii.singleton()) {
-            offset_map_t& offset_map = lookup_array_map(kind);
-            long k = (long)*n;
-            if (kind == data_kind_t::types) {
-                auto [only_num, only_non_num] = num_bytes.uniformity(k, width);
-                if (only_num) {
-                    inv.assign(lhs, T_NUM);
-                    return;
-                }
-                if (!only_non_num || width != 8) {
-                    inv -= lhs;
-                    return;
-                }
-            }
-            offset_t o(k);
-            unsigned size = (long)width;
-            std::vector<cell_t> cells = offset_map.get_overlap_cells(o, size);
-            if (cells.empty()) {
-                cell_t c = offset_map.mk_cell(o, size);
-                // Here it's ok to do assignment (instead of expand)
-                // because c is not a summarized variable. Otherwise, it
-                // would be unsound.
-                inv.assign(lhs, c.get_scalar(kind));
-                return;
-            } else {
-                CRAB_WARN("Ignored read from cell ", kind, "[", o, "...", o.index() + size - 1, "]",
-                          " because it overlaps with ", cells.size(), " cells");
-                /*
-                    TODO: we can apply here "Value Recomposition" 'a la'
-                    Mine'06 to construct values of some type from a sequence
-                    of bytes. It can be endian-independent but it would more
-                    precise if we choose between little- and big-endian.
-                */
-            }
-        } else {
+        const variable_t target_type = reg_type(target);
+        const variable_t target_value = reg_value(target);
+        const variable_t target_offset = reg_offset(target);
+        std::optional<number_t> n = inv.eval_interval(i).singleton();
+        if (!n) {
             // TODO: we can be more precise here
             CRAB_WARN("array expansion: ignored array load because of non-constant array index ", i);
+            inv -= target_type;
+            inv -= target_value;
+            inv -= target_offset;
+            return;
+        }
+        long k = (long)*n;
+        auto [only_num, only_non_num] = num_bytes.uniformity(k, width);
+        // The type is only read from a cell when none of its bytes is known to be a number.
+        const bool load_type = !only_num && only_non_num && width == 8;
+        if (only_num)
+            inv.assign(target_type, T_NUM);
+        else if (!load_type)
+            inv -= target_type;
+        if (width != 8) {
+            inv -= target_value;
+            inv -= target_offset;
+            return;
         }
 
-        inv -= lhs;
+        offset_map_t& offset_map = lookup_array_map();
+        offset_t o(k);
+        unsigned size = (long)width;
+        std::vector<cell_t> cells = offset_map.get_overlap_cells(o, size);
+        if (cells.empty()) {
+            cell_t c = offset_map.mk_cell(o, size);
+            // Here it's ok to do assignment (instead of expand)
+            // because c is not a summarized variable. Otherwise, it
+            // would be unsound.
+            if (load_type)
+                inv.assign(target_type, c.get_scalar(data_kind_t::types));
+            inv.assign(target_value, c.get_scalar(data_kind_t::values));
+            inv.assign(target_offset, c.get_scalar(data_kind_t::offsets));
+        } else {
+            CRAB_WARN("Ignored read from cell ", "[", o, "...", o.index() + size - 1, "]",
+                      " because it overlaps with ", cells.size(), " cells");
+            /*
+                TODO: we can apply here "Value Recomposition" 'a la'
+                Mine'06 to construct values of some type from a sequence
+                of bytes. It can be endian-independent but it would more
+                precise if we choose between little- and big-endian.
+            */
+            if (load_type)
+                inv -= target_type;
+            inv -= target_value;
+            inv -= target_offset;
+        }
     }
 
+    // Kill the cells that may overlap with [i, i + elem_size) other than the one at exactly these bytes, whose
+    // offset and size are returned if the bounds are constant.
     static std::optional<std::pair<offset_t, unsigned>>
-
-    kill_and_find_var(NumAbsDomain& inv, data_kind_t kind, const linear_expression_t& i, const linear_expression_t& elem_size) {
+    kill_and_find_var(NumAbsDomain& inv, const linear_expression_t& i, const linear_expression_t& elem_size) {
         if (inv.is_bottom())
             return {};
 
-        std::optional<std::pair<offset_t, unsigned>> res;
-
-        offset_map_t& offset_map = lookup_array_map(kind);
-        interval_t ii = inv.eval_interval(i);
-        std::vector<cell_t> cells;
-        if (std::optional<number_t> n = ii.singleton()) {
-            interval_t i_elem_size = inv.eval_interval(elem_size);
-            std::optional<number_t> n_bytes = i_elem_size.singleton();
-            if (n_bytes) {
-                unsigned size = (long)(*n_bytes);
-                // -- Constant index: kill overlapping cells
-                offset_t o((long)*n);
-                cells = offset_map.get_overlap_cells(o, size);
-                res = std::make_pair(o, size);
-            }
-        }
-        if (!res) {
-            // -- Non-constant index: kill overlapping cells
-            cells = offset_map.get_overlap_cells_symbolic_offset(inv, linear_expression_t(i),
-                                                                 linear_expression_t(i + elem_size));
-        }
-        kill_cells(kind, cells, offset_map, inv);
-
-        return res;
-    }
-
-    void array_store(NumAbsDomain& inv, data_kind_t kind, const linear_expression_t& idx, const linear_expression_t& elem_size,
-                     const linear_expression_t& val) {
-        auto maybe_cell = kill_and_find_var(inv, kind, idx, elem_size);
-        if (maybe_cell) {
-            // perform strong update
-            auto [offset, size] = *maybe_cell;
-            if (kind == data_kind_t::types) {
-                std::optional<number_t> t = inv.eval_interval(val).singleton();
-                num_bytes.store(offset.index(), size, t);
-            }
-            variable_t v = lookup_array_map(kind).mk_cell(offset, size).get_scalar(kind);
-            inv.assign(v, val);
-        }
-    }
-
-    void array_havoc(NumAbsDomain& inv, data_kind_t kind, const linear_expression_t& idx, const linear_expression_t& elem_size) {
-        auto maybe_cell = kill_and_find_var(inv, kind, idx, elem_size);
-        if (maybe_cell && kind == data_kind_t::types) {
-            auto [offset, size] = *maybe_cell;
-            num_bytes.havoc(offset.index(), size);
+        offset_map_t& offset_map = lookup_array_map();
+        std::optional<number_t> n = inv.eval_interval(i).singleton();
+        std::optional<number_t> n_bytes = inv.eval_interval(elem_size).singleton();
+        if (n && n_bytes) {
+            // -- Constant index: kill overlapping cells
+            offset_t o((long)*n);
+            unsigned size = (long)*n_bytes;
+            kill_cells(offset_map.get_overlap_cells(o, size), offset_map, inv);
+            return std::make_pair(o, size);
         }
-    }
-
-    // Perform array stores over an array segment
-    void array_store_numbers(NumAbsDomain& inv, variable_t _idx, variable_t _width) {
-
-        // TODO: this should be an user parameter.
-        const number_t max_num_elems = STACK_SIZE;
-
-        if (is_bottom())
-            return;
-
-        std::optional<number_t> idx_n = inv[_idx].singleton();
-        if (!idx_n) {
-            CRAB_WARN("array expansion store range ignored because ", "lower bound is not constant");
+        // -- Non-constant index: kill overlapping cells
+        kill_cells(offset_map.get_overlap_cells_symbolic_offset(inv, i, i + elem_size), offset_map, inv);
+        return {};
+    }
+
+    // Store a type, and possibly a value and an offset, to the stack bytes [idx, idx + elem_size). The scalars of
+    // the kinds not given are forgotten.
+    void stack_store(NumAbsDomain& inv, const linear_expression_t& idx, const linear_expression_t& elem_size,
+                     const linear_expression_t& val_type, const std::optional<linear_expression_t>& val_value,
+                     const std::optional<linear_expression_t>& val_offset) {
+        auto maybe_cell = kill_and_find_var(inv, idx, elem_size);
+        if (!maybe_cell)
             return;
-        }
-
-        std::optional<number_t> width = inv[_width].singleton();
-        if (!width) {
-            CRAB_WARN("array expansion store range ignored because ", "upper bound is not constant");
-            return;
-        }
+        // perform strong update
+        auto [offset, size] = *maybe_cell;
+        num_bytes.store(offset.index(), size, inv.eval_interval(val_type).singleton());
+        cell_t c = lookup_array_map().mk_cell(offset, size);
+        inv.assign(c.get_scalar(data_kind_t::types), val_type);
+        if (val_value)
+            inv.assign(c.get_scalar(data_kind_t::values), *val_value);
+        else
+            inv -= c.get_scalar(data_kind_t::values);
+        if (val_offset)
+            inv.assign(c.get_scalar(data_kind_t::offsets), *val_offset);
+        else
+            inv -= c.get_scalar(data_kind_t::offsets);
+    }
 
-        if (*idx_n + *width > max_num_elems) {
-            CRAB_WARN("array expansion store range ignored because ",
-                      "the number of elements is larger than default limit of ", max_num_elems);
+    // Forget the cells that may overlap [idx, idx + elem_size), as a helper does with memory it fills. When the
+    // bounds are constant, the bytes become numbers if numbers is set, and unknown otherwise.
+    void stack_havoc(NumAbsDomain& inv, variable_t idx, variable_t elem_size, bool numbers) {
+        auto maybe_cell = kill_and_find_var(inv, idx, elem_size);
+        if (!maybe_cell)
             return;
-        }
-        num_bytes.store((long)*idx_n, (long)*width, std::optional<number_t>(T_NUM));
+        auto [offset, size] = *maybe_cell;
+        if (std::optional<cell_t> c = lookup_array_map().get_cell(offset, size))
+            forget_scalars(*c, inv);
+        if (numbers && offset.index() + size <= STACK_SIZE)
+            num_bytes.store(offset.index(), size, std::optional<number_t>(T_NUM));
+        else
+            num_bytes.havoc(offset.index(), size);
     }
 
   private:
@@ -790,12 +1061,26 @@ class ebpf_domain_t final {
         return inv;
     }
 
+    // inv restricted to a type in wanted, where cond says exactly that and possible are the types inv allows.
+    // Whether cond is entailed or unsatisfiable is read off the type sets, sparing the zone the constraint.
+    static NumAbsDomain when_type(NumAbsDomain inv, type_set_t possible, type_set_t wanted,
+                                  const linear_constraint_t& cond) {
+        if (!possible.intersects(wanted))
+            return NumAbsDomain::bottom();
+        if (!possible.subset_of(wanted))
+            inv += cond;
+        return inv;
+    }
+
     void scratch_caller_saved_registers() {
+        variable_vector_t scratched;
         for (int i = 1; i <= 5; i++) {
-            havoc(reg_value(i));
-            havoc(reg_offset(i));
-            havoc(reg_type(i));
+            scratched.push_back(reg_value(i));
+            scratched.push_back(reg_offset(i));
+            scratched.push_back(reg_type(i));
+            reg_bits.havoc(i);
         }
+        forget(scratched);
     }
 
     template <typename NumOrVar>
@@ -843,12 +1128,28 @@ class ebpf_domain_t final {
     void assume(const linear_constraint_t& cst) { assume(m_inv, cst); }
     static void assume(NumAbsDomain& inv, const linear_constraint_t& cst) { inv += cst; }
 
-    void require(NumAbsDomain& inv, const linear_constraint_t& cst, std::string s) {
+    // Check cst with check_require, if set, and assume it. message is any callable returning the failure message.
+    template <typename F>
+    void require(NumAbsDomain& inv, const linear_constraint_t& cst, const F& message) {
         if (check_require)
-            check_require(inv, cst, std::move(s));
+            check_require(inv, cst, std::cref(message));
         assume(inv, cst);
     }
 
+    // Require the lower and then the upper bound of an access. Unless they are checked, both are assumed at once, so
+    // that the numeric domain closes its bounds once rather than after each: accesses to the packet and the stack
+    // take up most instructions.
+    template <typename F, typename G>
+    void require_bounds(NumAbsDomain& inv, const linear_constraint_t& lower, const F& lower_message,
+                        const linear_constraint_t& upper, const G& upper_message) {
+        if (check_require) {
+            require(inv, lower, lower_message);
+            require(inv, upper, upper_message);
+        } else {
+            inv.add_constraints({lower, upper});
+        }
+    }
+
     void havoc(variable_t v) { m_inv -= v; }
     void assign(variable_t lhs, variable_t rhs) { m_inv.assign(lhs, rhs); }
 
@@ -868,6 +1169,82 @@ class ebpf_domain_t final {
         return reg_type(v) >= T_CTX;
     }
 
+    // The bits of the value of r, with those implied by its bounds.
+    tnum_t known_bits(Reg r) { return reg_bits[r.v].meet(tnum_t::of(m_inv[reg_value(r)])); }
+
+    // The bits of the destination of bin after it, from those of its operands before it. The bounds of the operands
+    // are only read for the bitwise operations, where the bits may tell more than the zone.
+    tnum_t bin_bits(const Bin& bin) {
+        if (!global_options.known_bits || is_bottom())
+            return tnum_t::top();
+        const int width = bin.is64 ? 64 : 32;
+        const bool bitwise = bin.op == Bin::Op::AND || bin.op == Bin::Op::OR || bin.op == Bin::Op::XOR ||
+                             bin.op == Bin::Op::LSH || bin.op == Bin::Op::RSH || bin.op == Bin::Op::ARSH;
+        tnum_t src;
+        if (const Imm* imm = std::get_if<Imm>(&bin.v)) {
+            // As the zone has it: a 64-bit immediate only when it fits in 32 bits.
+            if (bin.lddw && (int64_t)imm->v != (int32_t)imm->v)
+                return tnum_t::top();
+            src = tnum_t::constant((uint64_t)(int64_t)(int32_t)imm->v);
+        } else {
+            const Reg r = std::get<Reg>(bin.v);
+            // The zone only keeps the difference of two pointers as that of their offsets.
+            if ((bin.op == Bin::Op::ADD || bin.op == Bin::Op::SUB) &&
+                (get_type(reg_type(r)) != T_NUM || get_type(reg_type(bin.dst)) != T_NUM))
+                return tnum_t::top();
+            src = bitwise ? known_bits(r) : reg_bits[r.v];
+        }
+        const tnum_t dst = bitwise ? known_bits(bin.dst) : reg_bits[bin.dst.v];
+        // The shifts of a constant amount within the width only.
+        auto shift = [&](auto f) {
+            if (!src.is_constant() || src.value >= (uint64_t)width)
+                return tnum_t::top();
+            return f((unsigned)src.value);
+        };
+        switch (bin.op) {
+        case Bin::Op::MOV: return src;
+        case Bin::Op::ADD: return dst.add(src);
+        case Bin::Op::SUB: return dst.sub(src);
+        case Bin::Op::AND: return dst.And(src);
+        case Bin::Op::OR: return dst.Or(src);
+        case Bin::Op::XOR: return dst.Xor(src);
+        case Bin::Op::LSH: return shift([&](unsigned k) { return dst.shl(k); });
+        case Bin::Op::RSH:
+            return shift([&](unsigned k) { return bin.is64 ? dst.lshr(k) : dst.zext32().lshr(k); });
+        case Bin::Op::ARSH:
+            return shift([&](unsigned k) { return bin.is64 ? dst.ashr(k) : dst.sext32().ashr(k); });
+        default: return tnum_t::top();
+        }
+    }
+
+    // Set the bits of the destination of bin to bits, computed by bin_bits() before it, and bound its value by them
+    // where the zone knows less, as it may after a bitwise or 32-bit operation. Bounds beyond those that overflow()
+    // keeps are left to the zone, whose weights would overflow.
+    void assume_bits(const Bin& bin, tnum_t bits) {
+        using namespace dsl_syntax;
+        if (!bin.is64 && global_options.known_bits)
+            bits = bits.zext32();
+        reg_bits.set(bin.dst.v, bits);
+        if (bits.is_top() || is_bottom() || (bin.is64 && (bin.op == Bin::Op::MOV || bin.op == Bin::Op::ADD ||
+                                                          bin.op == Bin::Op::SUB || bin.op == Bin::Op::MUL ||
+                                                          bin.op == Bin::Op::DIV || bin.op == Bin::Op::MOD)))
+            return;
+        const variable_t v = reg_value(bin.dst);
+        const interval_t bounds = bits.to_interval();
+        const interval_t current = m_inv[v];
+        if (current <= bounds)
+            return;
+        const number_t max(std::numeric_limits<int64_t>::max() / 2);
+        const number_t min(std::numeric_limits<int64_t>::min() / 2);
+        std::vector<linear_constraint_t> csts;
+        if (current.lb() < bounds.lb() && bounds.lb() > min)
+            csts.push_back(*bounds.lb().number() <= v);
+        if (current.ub() > bounds.ub() && bounds.ub() < max)
+            csts.push_back(v <= *bounds.ub().number());
+        if (!csts.empty())
+            m_inv.add_constraints(csts);
+    }
+
     void overflow(variable_t lhs) {
         using namespace dsl_syntax;
         auto interval = m_inv[lhs];
@@ -899,8 +1276,7 @@ class ebpf_domain_t final {
                     case T_UNINIT: break;
                     case T_NUM: {
                         if (!is_unsigned_cmp(cond.op))
-                            for (const linear_constraint_t& cst : jmp_to_cst_reg(cond.op, dst_value, src_value))
-                                m_inv += cst;
+                            m_inv.add_constraints(jmp_to_cst_reg(cond.op, dst_value, src_value));
                         return;
                     }
                     default: {
@@ -909,38 +1285,77 @@ class ebpf_domain_t final {
                     }
                 }
             }
-            NumAbsDomain different{m_inv};
-            different += neq(dst_type, src_type);
-
-            NumAbsDomain null_src{different};
-            null_src += is_pointer(dst);
-            NumAbsDomain null_dst{different};
-            null_dst += is_pointer(src);
-
-            m_inv += eq(dst_type, src_type);
-
-            NumAbsDomain numbers{m_inv};
-            numbers += dst_type == T_NUM;
-            if (!is_unsigned_cmp(cond.op))
-                for (const linear_constraint_t& cst : jmp_to_cst_reg(cond.op, dst_value, src_value))
-                    numbers += cst;
-
-            m_inv += is_pointer(dst);
-            m_inv += jmp_to_cst_offsets_reg(cond.op, dst_offset, src_offset);
-
-            m_inv |= std::move(numbers);
+            /* The comparison is of pointers of the same type, of numbers, or of different types of which dst or src
+               is a pointer. Only the cases that the possible types allow are analyzed, each on a copy but the first,
+               which takes m_inv; constraints that the types entail are not added. */
+            const interval_t stype_range = m_inv[src_type];
+            const interval_t dtype_range = m_inv[dst_type];
+            const type_set_t stypes = type_set_t::of(stype_range);
+            const type_set_t dtypes = type_set_t::of(dtype_range);
+            const type_set_t both = stypes & dtypes;
+            const type_set_t num = type_set_t::single(T_NUM);
+            const type_set_t ptr = type_set_t::of(TypeGroup::ptr);
+            const bool may_differ = !stype_range.singleton() || stype_range != dtype_range;
+
+            enum { pointers, numbers, dst_pointer, src_pointer };
+            std::vector<int> cases;
+            if (both.intersects(ptr))
+                cases.push_back(pointers);
+            if (both.intersects(num))
+                cases.push_back(numbers);
+            if (may_differ && dtypes.intersects(ptr))
+                cases.push_back(dst_pointer);
+            if (may_differ && stypes.intersects(ptr))
+                cases.push_back(src_pointer);
+            if (cases.empty()) {
+                set_to_bottom();
+                return;
+            }
 
-            m_inv |= std::move(null_src);
-            m_inv |= std::move(null_dst);
+            auto assume_case = [&](NumAbsDomain& inv, int c) {
+                switch (c) {
+                case pointers:
+                    inv += eq(dst_type, src_type);
+                    if (!dtypes.subset_of(ptr))
+                        inv += is_pointer(dst);
+                    inv += jmp_to_cst_offsets_reg(cond.op, dst_offset, src_offset);
+                    break;
+                case numbers:
+                    inv += eq(dst_type, src_type);
+                    if (!dtypes.subset_of(num))
+                        inv += dst_type == T_NUM;
+                    if (!is_unsigned_cmp(cond.op))
+                        inv.add_constraints(jmp_to_cst_reg(cond.op, dst_value, src_value));
+                    break;
+                case dst_pointer:
+                    inv += neq(dst_type, src_type);
+                    if (!dtypes.subset_of(ptr))
+                        inv += is_pointer(dst);
+                    break;
+                case src_pointer:
+                    inv += neq(dst_type, src_type);
+                    if (!stypes.subset_of(ptr))
+                        inv += is_pointer(src);
+                    break;
+                }
+            };
+            std::vector<NumAbsDomain> others;
+            for (size_t i = 1; i < cases.size(); i++) {
+                others.push_back(m_inv);
+                assume_case(others.back(), cases[i]);
+            }
+            assume_case(m_inv, cases[0]);
+            for (NumAbsDomain& other : others)
+                m_inv |= std::move(other);
         } else {
             int imm = static_cast<int>(std::get<Imm>(cond.right).v);
-            for (const linear_constraint_t& cst : jmp_to_cst_imm(cond.op, dst_value, imm))
-                assume(cst);
+            m_inv.add_constraints(jmp_to_cst_imm(cond.op, dst_value, imm));
         }
     }
 
     void operator()(Undefined const& a) {}
     void operator()(Un const& stmt) {
+        reg_bits.havoc(stmt.dst.v);
         switch (stmt.op) {
         case Un::Op::LE16:
         case Un::Op::LE32:
@@ -957,14 +1372,16 @@ class ebpf_domain_t final {
     void operator()(Exit const& a) {}
     void operator()(Jmp const& a) {}
 
-    void operator()(const Comparable& s) { require(m_inv, eq(reg_type(s.r1), reg_type(s.r2)), to_string(s)); }
+    void operator()(const Comparable& s) { require(m_inv, eq(reg_type(s.r1), reg_type(s.r2)), [&s] { return to_string(s); }); }
 
     void operator()(const Addable& s) {
         using namespace dsl_syntax;
         linear_constraint_t cond = reg_type(s.ptr) > T_NUM;
         NumAbsDomain is_ptr{m_inv};
         is_ptr += cond;
-        require(is_ptr, reg_type(s.num) == T_NUM, "only numbers can be added to pointers (" + to_string(s) + ")");
+        require(is_ptr, reg_type(s.num) == T_NUM, [&s] {
+            return "only numbers can be added to pointers (" + to_string(s) + ")";
+        });
 
         m_inv += cond.negate();
         m_inv |= std::move(is_ptr);
@@ -973,7 +1390,7 @@ class ebpf_domain_t final {
     void operator()(const ValidSize& s) {
         using namespace dsl_syntax;
         variable_t r = reg_value(s.reg);
-        require(m_inv, s.can_be_zero ? r >= 0 : r > 0, to_string(s));
+        require(m_inv, s.can_be_zero ? r >= 0 : r > 0, [&s] { return to_string(s); });
     }
 
     void operator()(const ValidMapKeyValue& s) {
@@ -988,11 +1405,14 @@ class ebpf_domain_t final {
         variable_t lb = reg_offset(s.access_reg);
         variable_t width = s.key ? variable_t::map_key_size() : variable_t::map_value_size();
         linear_expression_t ub = lb + width;
-        std::string m = std::string(" (") + to_string(s) + ")";
-        require(m_inv, reg_type(s.access_reg) >= T_STACK, "Only stack or packet can be used as a parameter" + m);
-        require(m_inv, reg_type(s.access_reg) <= T_PACKET, "Only stack or packet can be used as a parameter" + m);
-        m_inv = check_access_packet(when(m_inv, reg_type(s.access_reg) == T_PACKET), lb, ub, m, false) |
-                check_access_stack(when(m_inv, reg_type(s.access_reg) == T_STACK), lb, ub, m);
+        const message_t m = [&s] { return std::string(" (") + to_string(s) + ")"; };
+        variable_t t = reg_type(s.access_reg);
+        require_type(m_inv, t, TypeGroup::stack_or_packet,
+                     [&m] { return "Only stack or packet can be used as a parameter" + m(); });
+        type_set_t types = type_set_t::of(m_inv[t]);
+        m_inv = check_access_packet(when_type(m_inv, types, type_set_t::single(T_PACKET), t == T_PACKET), lb, ub, m,
+                                    false) |
+                check_access_stack(when_type(m_inv, types, type_set_t::single(T_STACK), t == T_STACK), lb, ub, m);
     }
 
     void operator()(const ValidAccess& s) {
@@ -1006,61 +1426,63 @@ class ebpf_domain_t final {
             ub = lb + std::get<Imm>(s.width).v;
         else
             ub = lb + reg_value(std::get<Reg>(s.width));
-        std::string m = std::string(" (") + to_string(s) + ")";
+        const message_t m = [&s] { return std::string(" (") + to_string(s) + ")"; };
 
+        variable_t t = reg_type(s.reg);
+        type_set_t types = type_set_t::of(m_inv[t]);
         NumAbsDomain assume_ptr =
-            check_access_packet(when(m_inv, reg_type(s.reg) == T_PACKET), lb, ub, m, is_comparison_check) |
-            check_access_stack(when(m_inv, reg_type(s.reg) == T_STACK), lb, ub, m) |
-            check_access_shared(when(m_inv, is_shared(reg_type(s.reg))), lb, ub, m, reg_type(s.reg)) |
-            check_access_context(when(m_inv, reg_type(s.reg) == T_CTX), lb, ub, m);
+            check_access_packet(when_type(m_inv, types, type_set_t::single(T_PACKET), t == T_PACKET), lb, ub, m,
+                                is_comparison_check) |
+            check_access_stack(when_type(m_inv, types, type_set_t::single(T_STACK), t == T_STACK), lb, ub, m) |
+            check_access_shared(when_type(m_inv, types, type_set_t::shared(), is_shared(t)), lb, ub, m, t) |
+            check_access_context(when_type(m_inv, types, type_set_t::single(T_CTX), t == T_CTX), lb, ub, m);
         if (is_comparison_check) {
             m_inv |= std::move(assume_ptr);
             return;
         } else if (s.or_null) {
             assume(m_inv, reg_type(s.reg) == T_NUM);
-            require(m_inv, reg_value(s.reg) == 0, "Pointers may be compared only to the number 0");
+            require(m_inv, reg_value(s.reg) == 0, [] { return "Pointers may be compared only to the number 0"; });
             m_inv |= std::move(assume_ptr);
             return;
         } else {
-            require(m_inv, reg_type(s.reg) > T_NUM, "Only pointers can be dereferenced");
+            require(m_inv, reg_type(s.reg) > T_NUM, [] { return "Only pointers can be dereferenced"; });
         }
         m_inv = std::move(assume_ptr);
     }
 
-    NumAbsDomain check_access_packet(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const std::string& s,
+    NumAbsDomain check_access_packet(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const message_t& s,
                                      bool is_comparison_check) {
         using namespace dsl_syntax;
-        require(inv, lb >= variable_t::meta_offset(), std::string("Lower bound must be higher than meta_offset") + s);
+        auto lower_message = [&s] { return "Lower bound must be higher than meta_offset" + s(); };
         if (is_comparison_check)
-            require(inv, ub <= MAX_PACKET_OFF,
-                    std::string("Upper bound must be lower than ") + std::to_string(MAX_PACKET_OFF) + s);
+            require_bounds(inv, lb >= variable_t::meta_offset(), lower_message, ub <= MAX_PACKET_OFF,
+                           [&s] { return "Upper bound must be lower than " + std::to_string(MAX_PACKET_OFF) + s(); });
         else
-            require(inv, ub <= variable_t::packet_size(),
-                    std::string("Upper bound must be lower than meta_offset") + s);
+            require_bounds(inv, lb >= variable_t::meta_offset(), lower_message, ub <= variable_t::packet_size(),
+                           [&s] { return "Upper bound must be lower than meta_offset" + s(); });
         return inv;
     }
 
-    NumAbsDomain check_access_stack(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const std::string& s) {
+    NumAbsDomain check_access_stack(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const message_t& s) {
         using namespace dsl_syntax;
-        require(inv, lb >= 0, std::string("Lower bound must be higher than 0") + s);
-        require(inv, ub <= STACK_SIZE, std::string("Upper bound must be lower than STACK_SIZE") + s);
+        require_bounds(inv, lb >= 0, [&s] { return "Lower bound must be higher than 0" + s(); }, ub <= STACK_SIZE,
+                       [&s] { return "Upper bound must be lower than STACK_SIZE" + s(); });
         return inv;
     }
 
-    NumAbsDomain check_access_shared(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const std::string& s,
+    NumAbsDomain check_access_shared(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const message_t& s,
                                      variable_t reg_type) {
         using namespace dsl_syntax;
-        require(inv, lb >= 0, std::string("Lower bound must be higher than 0") + s);
-        require(inv, ub <= reg_type, std::string("Upper bound must be lower than ") + reg_type.name() + s);
+        require_bounds(inv, lb >= 0, [&s] { return "Lower bound must be higher than 0" + s(); }, ub <= reg_type,
+                       [&] { return "Upper bound must be lower than " + reg_type.name() + s(); });
         return inv;
     }
 
-    NumAbsDomain check_access_context(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const std::string& s) {
+    NumAbsDomain check_access_context(NumAbsDomain inv, const linear_expression_t& lb, const linear_expression_t& ub, const message_t& s) {
         using namespace dsl_syntax;
-        require(inv, lb >= 0, std::string("Lower bound must be higher than 0") + s);
-        require(inv, ub <= global_program_info.descriptor.size,
-                std::string("Upper bound must be lower than ") + std::to_string(global_program_info.descriptor.size) +
-                    s);
+        const int size = analysis_context_t::current().info.descriptor.size;
+        require_bounds(inv, lb >= 0, [&s] { return "Lower bound must be higher than 0" + s(); }, ub <= size,
+                       [&] { return "Upper bound must be lower than " + std::to_string(size) + s(); });
         return inv;
     }
 
@@ -1070,44 +1492,55 @@ class ebpf_domain_t final {
 
         NumAbsDomain non_stack{m_inv};
         non_stack += cond;
-        require(non_stack, reg_type(s.val) == T_NUM, "Only numbers can be stored to externally-visible regions");
+        require(non_stack, reg_type(s.val) == T_NUM, [] {
+            return "Only numbers can be stored to externally-visible regions";
+        });
 
         m_inv += cond.negate();
         m_inv |= std::move(non_stack);
     }
 
     void operator()(const TypeConstraint& s) {
+        require_type(m_inv, reg_type(s.reg), s.types, [&s] { return to_string(s); });
+    }
+
+    void require_type(NumAbsDomain& inv, variable_t t, TypeGroup types, const message_t& str) {
         using namespace dsl_syntax;
-        variable_t t = reg_type(s.reg);
-        std::string str = to_string(s);
-        switch (s.types) {
-        case TypeGroup::num: require(m_inv, t == T_NUM, str); break;
-        case TypeGroup::map_fd: require(m_inv, t == T_MAP, str); break;
-        case TypeGroup::ctx: require(m_inv, t == T_CTX, str); break;
-        case TypeGroup::packet: require(m_inv, t == T_PACKET, str); break;
-        case TypeGroup::stack: require(m_inv, t == T_STACK, str); break;
-        case TypeGroup::shared: require(m_inv, t > T_SHARED, str); break;
-        case TypeGroup::non_map_fd: require(m_inv, t >= T_NUM, str); break;
-        case TypeGroup::mem: require(m_inv, t >= T_STACK, str); break;
+        if (type_set_t::of(inv[t]).subset_of(type_set_t::of(types)))
+            return;
+        switch (types) {
+        case TypeGroup::num: require(inv, t == T_NUM, str); break;
+        case TypeGroup::map_fd: require(inv, t == T_MAP, str); break;
+        case TypeGroup::ctx: require(inv, t == T_CTX, str); break;
+        case TypeGroup::packet: require(inv, t == T_PACKET, str); break;
+        case TypeGroup::stack: require(inv, t == T_STACK, str); break;
+        case TypeGroup::shared: require(inv, t > T_SHARED, str); break;
+        case TypeGroup::non_map_fd: require(inv, t >= T_NUM, str); break;
+        case TypeGroup::mem: require(inv, t >= T_STACK, str); break;
         case TypeGroup::mem_or_num:
-            require(m_inv, t >= T_NUM, str);
-            require(m_inv, t != T_CTX, str);
+            require(inv, t >= T_NUM, str);
+            require(inv, t != T_CTX, str);
             break;
-        case TypeGroup::ptr: require(m_inv, t >= T_CTX, str); break;
-        case TypeGroup::ptr_or_num: require(m_inv, t >= T_NUM, str); break;
+        case TypeGroup::ptr: require(inv, t >= T_CTX, str); break;
+        case TypeGroup::ptr_or_num: require(inv, t >= T_NUM, str); break;
         case TypeGroup::stack_or_packet:
-            require(m_inv, t >= T_STACK, str);
-            require(m_inv, t <= T_PACKET, str);
+            require(inv, t >= T_STACK, str);
+            require(inv, t <= T_PACKET, str);
             break;
         }
     }
 
-    void operator()(Assert const& stmt) { std::visit(*this, stmt.cst); };
+    // A satisfied assertion was found to hold before the analysis, and constrains nothing further.
+    void operator()(Assert const& stmt) {
+        if (!stmt.satisfied)
+            std::visit(*this, stmt.cst);
+    };
 
     void operator()(Packet const& a) {
         assign(reg_type(0), T_NUM);
         havoc(reg_offset(0));
         havoc(reg_value(0));
+        reg_bits.havoc(0);
         scratch_caller_saved_registers();
     }
 
@@ -1121,12 +1554,23 @@ class ebpf_domain_t final {
         return inv;
     }
 
+    // Where do_load_ctx finds the layout of the context: in the program of the current analysis, or in a constant.
+    struct current_layout_t {
+        static const ptype_descr& get() { return analysis_context_t::current().info.descriptor; }
+    };
+    template <const ptype_descr& Desc>
+    struct fixed_layout_t {
+        static constexpr const ptype_descr& get() { return Desc; }
+    };
+
+    // The load from a context laid out as Layout gives.
+    template <typename Layout>
     static NumAbsDomain do_load_ctx(NumAbsDomain inv, Reg target, const linear_expression_t& addr_vague, int width) {
         using namespace dsl_syntax;
         if (inv.is_bottom())
             return inv;
 
-        ptype_descr desc = global_program_info.descriptor;
+        const ptype_descr& desc = Layout::get();
 
         variable_t target_value = reg_value(target);
         variable_t target_offset = reg_offset(target);
@@ -1171,8 +1615,7 @@ class ebpf_domain_t final {
             return inv;
         }
         inv.assign(target_type, T_PACKET);
-        inv += 4098 <= target_value;
-        inv += target_value <= PTR_MAX;
+        inv.add_constraints({4098 <= target_value, target_value <= PTR_MAX});
         return inv;
     }
 
@@ -1180,15 +1623,7 @@ class ebpf_domain_t final {
         if (inv.is_bottom())
             return inv;
 
-        if (width == 8) {
-            array_load(inv, reg_type(target), data_kind_t::types, addr, width);
-            array_load(inv, reg_value(target), data_kind_t::values, addr, width);
-            array_load(inv, reg_offset(target), data_kind_t::offsets, addr, width);
-        } else {
-            array_load(inv, reg_type(target), data_kind_t::types, addr, width);
-            inv -= reg_value(target);
-            inv -= reg_offset(target);
-        }
+        stack_load(inv, target, addr, width);
         return inv;
     }
 
@@ -1212,14 +1647,33 @@ class ebpf_domain_t final {
 
         switch (type) {
             case T_UNINIT: {
-                m_inv = do_load_ctx(when(m_inv, mem_reg_type == T_CTX), target, addr, width) |
-                        do_load_packet_or_shared(when(m_inv, mem_reg_type >= T_PACKET), target, addr, width) |
-                        do_load_stack(when(m_inv, mem_reg_type == T_STACK), target, addr, width);
+                const type_set_t types = type_set_t::of(m_inv[mem_reg_type]);
+                const type_set_t ctx = type_set_t::single(T_CTX);
+                const type_set_t packet_or_shared =
+                    type_set_t::single(T_PACKET) | type_set_t::single(T_SHARED) | type_set_t::shared();
+                const type_set_t stack = type_set_t::single(T_STACK);
+                // The state is only split between the kinds of memory the type may be, and the last one takes it
+                // without a copy.
+                int cases = types.intersects(ctx) + types.intersects(packet_or_shared) + types.intersects(stack);
+                auto when_maybe = [&](type_set_t wanted, const linear_constraint_t& cond) {
+                    if (!types.intersects(wanted))
+                        return NumAbsDomain::bottom();
+                    NumAbsDomain inv = --cases == 0 ? std::move(m_inv) : NumAbsDomain(m_inv);
+                    if (!types.subset_of(wanted))
+                        inv += cond;
+                    return inv;
+                };
+                NumAbsDomain res = analysis_context_t::current().load_ctx(when_maybe(ctx, mem_reg_type == T_CTX),
+                                                                          target, addr, width);
+                res |= do_load_packet_or_shared(when_maybe(packet_or_shared, mem_reg_type >= T_PACKET), target, addr,
+                                                width);
+                res |= do_load_stack(when_maybe(stack, mem_reg_type == T_STACK), target, addr, width);
+                m_inv = std::move(res);
                 return;
             }
             case T_MAP: return;
             case T_NUM: return;
-            case T_CTX: m_inv = do_load_ctx(std::move(m_inv), target, addr, width); break;
+            case T_CTX: m_inv = analysis_context_t::current().load_ctx(std::move(m_inv), target, addr, width); break;
             case T_STACK: m_inv = do_load_stack(std::move(m_inv), target, addr, width); break;
             default: m_inv = do_load_packet_or_shared(std::move(m_inv), target, addr, width); break;
         }
@@ -1237,23 +1691,21 @@ class ebpf_domain_t final {
     template <typename A, typename X, typename Y, typename Z>
     void do_store_stack(NumAbsDomain& inv, int width, A addr, X val_type, Y val_value,
                         std::optional<Z> opt_val_offset) {
-        array_store(inv, data_kind_t::types, addr, width, val_type);
+        std::optional<linear_expression_t> value;
+        std::optional<linear_expression_t> offset;
         if (width == 8) {
-            array_store(inv, data_kind_t::values, addr, width, val_value);
+            value = linear_expression_t(val_value);
             if (opt_val_offset && get_type(val_type) != T_NUM)
-                array_store(inv, data_kind_t::offsets, addr, width, *opt_val_offset);
-            else
-                array_havoc(inv, data_kind_t::offsets, addr, width);
-        } else {
-            array_havoc(inv, data_kind_t::values, addr, width);
-            array_havoc(inv, data_kind_t::offsets, addr, width);
+                offset = linear_expression_t(*opt_val_offset);
         }
+        stack_store(inv, addr, width, val_type, value, offset);
     }
 
     void operator()(Mem const& b) {
         if (std::holds_alternative<Reg>(b.value)) {
             Reg data_reg = std::get<Reg>(b.value);
             if (b.is_load) {
+                reg_bits.havoc(data_reg.v);
                 do_load(b, data_reg);
             } else {
                 do_mem_store(b, reg_type(data_reg), reg_value(data_reg), reg_offset(data_reg));
@@ -1279,6 +1731,14 @@ class ebpf_domain_t final {
         switch (get_type(mem_reg_type)) {
             case T_STACK: do_store_stack(m_inv, width, addr, val_type, val_value, opt_val_offset); return;
             case T_UNINIT: { //maybe stack
+                // The state is only split when the bounds of the type allow both the stack and something else.
+                const type_set_t types = type_set_t::of(m_inv[mem_reg_type]);
+                if (!types.intersects(type_set_t::single(T_STACK)))
+                    return;
+                if (types.subset_of(type_set_t::single(T_STACK))) {
+                    do_store_stack(m_inv, width, addr, val_type, val_value, opt_val_offset);
+                    return;
+                }
                 NumAbsDomain assume_not_stack(m_inv);
                 assume_not_stack += mem_reg_type != T_STACK;
                 m_inv += mem_reg_type == T_STACK;
@@ -1297,17 +1757,8 @@ class ebpf_domain_t final {
 
     void operator()(Call const& call) {
         using namespace dsl_syntax;
-        for (ArgSingle param : call.singles) {
-            switch (param.kind) {
-            case ArgSingle::Kind::ANYTHING: break;
-            // should have been done in the assertion
-            case ArgSingle::Kind::MAP_FD: break;
-            case ArgSingle::Kind::PTR_TO_MAP_KEY: break;
-            case ArgSingle::Kind::PTR_TO_MAP_VALUE: break;
-            case ArgSingle::Kind::PTR_TO_CTX: break;
-            }
-        }
-        for (ArgPair param : call.pairs) {
+        // The single arguments are only checked, by the preconditions of the helper.
+        for (const ArgPair& param : call.pairs) {
             switch (param.kind) {
             case ArgPair::Kind::PTR_TO_MEM_OR_NULL:
             case ArgPair::Kind::PTR_TO_MEM:
@@ -1315,30 +1766,23 @@ class ebpf_domain_t final {
                 break;
 
             case ArgPair::Kind::PTR_TO_UNINIT_MEM: {
-                variable_t addr = reg_offset(param.mem);
-                variable_t width = reg_value(param.size);
                 interval_t t = m_inv[reg_type(param.mem)];
-                if (t[T_STACK]) {
-                    array_havoc(m_inv, data_kind_t::types, addr, width);
-                    array_havoc(m_inv, data_kind_t::values, addr, width);
-                    array_havoc(m_inv, data_kind_t::offsets, addr, width);
-                    if (t.singleton()) {
-                        array_store_numbers(m_inv, addr, width);
-                    }
-                }
+                // The helper fills the memory with numbers, if it is the stack for sure.
+                if (t[T_STACK])
+                    stack_havoc(m_inv, reg_offset(param.mem), reg_value(param.size), t.singleton().has_value());
             }
             }
         }
         scratch_caller_saved_registers();
         variable_t r0 = reg_value(0);
         havoc(r0);
+        reg_bits.havoc(0);
         if (call.returns_map) {
             // no support for map-in-map yet:
             //   if (machine.info.map_defs.at(map_type).type == MapType::ARRAY_OF_MAPS
             //    || machine.info.map_defs.at(map_type).type == MapType::HASH_OF_MAPS) { }
             // This is the only way to get a null pointer - note the `<=`:
-            m_inv += 0 <= r0;
-            m_inv += r0 <= PTR_MAX;
+            m_inv.add_constraints({0 <= r0, r0 <= PTR_MAX});
             assign(reg_offset(0), 0);
             assign(reg_type(0), variable_t::map_value_size());
         } else {
@@ -1353,10 +1797,12 @@ class ebpf_domain_t final {
         assign(reg_type(dst), T_MAP);
         assign(reg_value(dst), ins.mapfd);
         havoc(reg_offset(dst));
+        reg_bits.havoc(dst.v);
     }
 
     void operator()(Bin const& bin) {
         using namespace dsl_syntax;
+        const tnum_t bits = bin_bits(bin);
 
         Reg dst = bin.dst;
         variable_t dst_value = reg_value(dst);
@@ -1388,11 +1834,16 @@ class ebpf_domain_t final {
                 no_pointer(dst);
                 break;
             case Bin::Op::DIV:
-                div(dst_value, imm);
+                // BPF defines dst / 0 as 0, and dst % 0 as dst.
+                if (imm == 0)
+                    assign(dst_value, 0);
+                else
+                    div(dst_value, imm);
                 no_pointer(dst);
                 break;
             case Bin::Op::MOD:
-                rem(dst_value, imm);
+                if (imm != 0)
+                    rem(dst_value, imm);
                 no_pointer(dst);
                 break;
             case Bin::Op::OR:
@@ -1478,16 +1929,28 @@ class ebpf_domain_t final {
                 mul(dst_value, src_value);
                 no_pointer(dst);
                 break;
-            case Bin::Op::DIV:
-                // DIV is not checked for zerodiv
-                div(dst_value, src_value);
+            case Bin::Op::DIV: {
+                // DIV is not checked for zerodiv. BPF defines dst / 0 as 0, where the intervals would leave no state.
+                const interval_t divisor = m_inv[src_value];
+                if (divisor == interval_t(number_t(0)))
+                    assign(dst_value, 0);
+                else if (divisor[number_t(0)])
+                    havoc(dst_value);
+                else
+                    div(dst_value, src_value);
                 no_pointer(dst);
                 break;
-            case Bin::Op::MOD:
-                // See DIV comment
-                rem(dst_value, src_value);
+            }
+            case Bin::Op::MOD: {
+                // See DIV comment: BPF defines dst % 0 as dst.
+                const interval_t divisor = m_inv[src_value];
+                if (!divisor[number_t(0)])
+                    rem(dst_value, src_value);
+                else if (divisor != interval_t(number_t(0)))
+                    havoc(dst_value);
                 no_pointer(dst);
                 break;
+            }
             case Bin::Op::OR:
                 bitwise_or(dst_value, src_value);
                 no_pointer(dst);
@@ -1522,6 +1985,7 @@ class ebpf_domain_t final {
         if (!bin.is64) {
             bitwise_and(dst_value, UINT32_MAX);
         }
+        assume_bits(bin, bits);
     }
 
     friend std::ostream& operator<<(std::ostream& o, ebpf_domain_t dom) {
@@ -1529,6 +1993,16 @@ class ebpf_domain_t final {
             o << "_|_";
         } else {
             o << dom.m_inv << "\n" << dom.num_bytes;
+            // The bits that the bounds of the registers do not imply.
+            const char* sep = "\nBits -> {";
+            for (int i = 0; i <= 10; i++) {
+                if (tnum_t::of(dom.m_inv[reg_value(i)]) <= dom.reg_bits[i])
+                    continue;
+                o << sep << "r" << i << ": " << dom.reg_bits[i];
+                sep = ", ";
+            }
+            if (*sep == ',')
+                o << "}";
         }
         return o;
     }
@@ -1549,7 +2023,7 @@ class ebpf_domain_t final {
 
         inv += 0 <= variable_t::packet_size();
         inv += variable_t::packet_size() < MAX_PACKET_OFF;
-        if (global_program_info.descriptor.meta >= 0) {
+        if (analysis_context_t::current().info.descriptor.meta >= 0) {
             inv += variable_t::meta_offset() <= 0;
             inv += variable_t::meta_offset() >= -4098;
         } else {
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "crab/cfg.hpp"
+#include "crab/liveness.hpp"
+
+using crab::live_set_t;
+using crab::use_def_t;
+
+// The registers that a block may name, r0 to r10.
+constexpr size_t fold_registers = 11;
+
+// What is known of each register at one point of a block, from the statements of the block before it.
+struct block_facts_t {
+    // The value of the register, if the domain knows it exactly: it was last written with a constant.
+    std::array<std::optional<int64_t>, fold_registers> constant;
+    // The register it was last copied from with a 64-bit move, if neither was written since; the domain then gives
+    // both the same value, offset and type.
+    std::array<std::optional<uint8_t>, fold_registers> copy_of;
+
+    // After a statement that may narrow what regs hold, which the copies that they are part of would not see; a
+    // constant can only be narrowed to nothing.
+    void forget_copies(const std::bitset<fold_registers>& regs) {
+        for (size_t r = 0; r < fold_registers; r++) {
+            if (regs[r] || (copy_of[r] && regs[*copy_of[r]]))
+                copy_of[r].reset();
+        }
+    }
+
+    // After a statement that writes regs.
+    void forget(const std::bitset<fold_registers>& regs) {
+        forget_copies(regs);
+        for (size_t r = 0; r < fold_registers; r++) {
+            if (regs[r])
+                constant[r].reset();
+        }
+    }
+};
+
+// The value that ebpf_domain_t gives to dst after bin, if dst held c before and the domain computes the result
+// exactly: the operation is done on mathematical integers, a result the domain takes as an overflow is not known, and
+// 32-bit operations keep the low 32 bits. Operations the domain does not compute exactly are not folded.
+static std::optional<int64_t> fold(Bin::Op op, bool is64, int64_t c, int32_t imm) {
+    int64_t res;
+    bool overflow = false;
+    switch (op) {
+    case Bin::Op::ADD: overflow = __builtin_add_overflow(c, (int64_t)imm, &res); break;
+    case Bin::Op::SUB: overflow = __builtin_sub_overflow(c, (int64_t)imm, &res); break;
+    case Bin::Op::MUL: overflow = __builtin_mul_overflow(c, (int64_t)imm, &res); break;
+    case Bin::Op::AND: return is64 ? c & imm : c & imm & UINT32_MAX;
+    case Bin::Op::OR: return is64 ? c | imm : (c | imm) & UINT32_MAX;
+    case Bin::Op::XOR: return is64 ? c ^ imm : (c ^ imm) & UINT32_MAX;
+    default: return {};
+    }
+    if (overflow || res <= std::numeric_limits<int64_t>::min() / 2 || res >= std::numeric_limits<int64_t>::max() / 2)
+        return {};
+    return is64 ? res : res & UINT32_MAX;
+}
+
+// The immediate of a move that gives dst the value v, if there is one: moves sign-extend 32 bits, or zero-extend
+// them when they are 32-bit.
+static std::optional<Imm> mov_imm(bool is64, int64_t v) {
+    if (is64 ? v < INT32_MIN || v > INT32_MAX : v < 0 || v > UINT32_MAX)
+        return {};
+    return Imm{(uint32_t)v};
+}
+
+// The value that a move of imm gives to its destination.
+static int64_t mov_value(bool is64, Imm imm) {
+    const int32_t v = (int32_t)imm.v;
+    return is64 ? (int64_t)v : (int64_t)(uint32_t)v;
+}
+
+// Folds the constant operations of the statements of a block and shortens its chains of copies, forward.
+static void fold_statements(std::vector<Instruction>& statements) {
+    block_facts_t facts;
+    for (Instruction& ins : statements) {
+        const use_def_t ud = crab::use_def(ins);
+        Bin* bin = std::get_if<Bin>(&ins);
+        if (!bin) {
+            facts.forget_copies(ud.use.regs);
+            facts.forget(ud.def.regs);
+            continue;
+        }
+        const uint8_t dst = bin->dst.v;
+        std::optional<int64_t> constant;
+        std::optional<uint8_t> copy_of;
+        if (const Imm* imm = std::get_if<Imm>(&bin->v)) {
+            if (bin->lddw) {
+                // The domain only keeps 32 bits of a wide immediate; left as it is.
+            } else if (bin->op == Bin::Op::MOV) {
+                constant = mov_value(bin->is64, *imm);
+            } else if (facts.constant[dst]) {
+                constant = fold(bin->op, bin->is64, *facts.constant[dst], (int32_t)imm->v);
+                if (constant) {
+                    if (const auto folded = mov_imm(bin->is64, *constant))
+                        *bin = Bin{.op = Bin::Op::MOV, .is64 = bin->is64, .dst = bin->dst, .v = *folded};
+                }
+            }
+        } else if (bin->op == Bin::Op::MOV && bin->is64) {
+            Reg& src = std::get<Reg>(bin->v);
+            if (facts.copy_of[src.v] && *facts.copy_of[src.v] != dst)
+                src = Reg{*facts.copy_of[src.v]};
+            if (src.v != dst) {
+                copy_of = src.v;
+                constant = facts.constant[src.v];
+            }
+        }
+        facts.forget(ud.def.regs);
+        facts.constant[dst] = constant;
+        facts.copy_of[dst] = copy_of;
+    }
+}
+
+// Removes the moves and operations of a block whose result is overwritten or dead before anything reads it, backward
+// from what is live after the block.
+static void remove_dead_definitions(std::vector<Instruction>& statements, live_set_t live) {
+    std::vector<Instruction> kept;
+    kept.reserve(statements.size());
+    for (auto it = statements.rbegin(); it != statements.rend(); ++it) {
+        const use_def_t ud = crab::use_def(*it);
+        if (const Bin* bin = std::get_if<Bin>(&*it); bin && bin->dst.v != 10 && !live.regs[bin->dst.v])
+            continue;
+        live.regs = ud.use.regs | (live.regs & ~ud.def.regs);
+        live.stack = ud.use.stack | (live.stack & ~ud.def.stack);
+        kept.push_back(std::move(*it));
+    }
+    std::reverse(kept.begin(), kept.end());
+    statements = std::move(kept);
+}
+
+void fold_constants(cfg_t& cfg) {
+    std::vector<Instruction> statements;
+    for (basic_block_t& bb : cfg) {
+        bb.swap_instructions(statements);
+        fold_statements(statements);
+        bb.swap_instructions(statements);
+    }
+    // Folding leaves dead copies and moves behind, so liveness is found after it.
+    const crab::liveness_t liveness(cfg);
+    for (basic_block_t& bb : cfg) {
+        bb.swap_instructions(statements);
+        remove_dead_definitions(statements, liveness.live_out(bb.id()));
+        bb.swap_instructions(statements);
+    }
+}
+
+namespace crab {
+
+std::vector<Instruction> block_summary(const basic_block_t& bb, const live_set_t& live_out) {
+    std::vector<Instruction> res;
+    for (const Instruction& ins : bb) {
+        if (const Assert* a = std::get_if<Assert>(&ins); !a || !a->satisfied)
+            res.push_back(ins);
+    }
+    fold_statements(res);
+    remove_dead_definitions(res, live_out);
+    return res;
+}
+
+} // namespace crab
@@ -1,48 +1,77 @@
 #include "crab/fwd_analyzer.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
+#include "asm_ostream.hpp"
+#include "config.hpp"
+#include "memsize.hpp"
 #include "crab/cfg.hpp"
 #include "crab/debug.hpp"
+#include "crab/invariant_io.hpp"
+#include "crab/liveness.hpp"
+#include "crab/profile.hpp"
+#include "crab/stats.hpp"
+#include "crab/thread_pool.hpp"
+#include "crab/thresholds.hpp"
 #include "crab/wto.hpp"
 
 #include "crab/ebpf_domain.hpp"
 
 namespace crab {
 
+using domains::array_map_t;
 using domains::ebpf_domain_t;
 
-// Simple visitor to check if node is a member of the wto component.
-class member_component_visitor final : public wto_component_visitor_t {
-    label_t _node;
-    bool _found;
+// The WTO of cfg, timed as a phase of its own.
+static wto_t make_wto(cfg_t& cfg) {
+    CRAB_SCOPED_STOPWATCH("phase.wto");
+    return wto_t(cfg);
+}
 
-  public:
-    explicit member_component_visitor(label_t node) : _node(std::move(node)), _found(false) {}
+// The liveness of cfg, if dead variables are to be forgotten.
+static std::optional<liveness_t> make_liveness(const cfg_t& cfg) {
+    if (!global_options.forget_dead_variables)
+        return {};
+    return liveness_t(cfg);
+}
 
-    void visit(wto_vertex_t& c) override {
-        if (!_found) {
-            _found = (c.node() == _node);
+// The summaries of the blocks of cfg within the cycles of wto, by block, if global_options.summarize_blocks is set;
+// the others are only transformed once, and have none.
+static std::vector<std::optional<std::vector<Instruction>>>
+make_summaries(const cfg_t& cfg, const wto_t& wto, const std::optional<liveness_t>& liveness) {
+    std::vector<std::optional<std::vector<Instruction>>> res;
+    if (!global_options.summarize_blocks)
+        return res;
+    res.resize(cfg.num_ids());
+    const auto& elements = wto.elements();
+    for (uint32_t i = 0; i < elements.size();) {
+        if (!elements[i].is_cycle) {
+            i++;
+            continue;
         }
-    }
-
-    void visit(wto_cycle_t& c) override {
-        if (!_found) {
-            _found = (c.head() == _node);
-            if (!_found) {
-                for (auto& x : c) {
-                    if (_found)
-                        break;
-                    x.accept(this);
-                }
-            }
+        for (uint32_t j = i; j < elements[i].end; j++) {
+            const block_id_t node = elements[j].node;
+            res[node] = block_summary(cfg.get_node(node), liveness ? liveness->live_out(node) : live_set_t::all());
         }
+        i = elements[i].end;
     }
+    return res;
+}
 
-    bool is_member() const { return _found; }
-};
-
-class interleaved_fwd_fixpoint_iterator_t final : public wto_component_visitor_t {
+class interleaved_fwd_fixpoint_iterator_t final {
     using thresholds_t = iterators::thresholds_t;
     using wto_thresholds_t = iterators::wto_thresholds_t;
     using iterator = typename invariant_table_t::iterator;
@@ -52,30 +81,221 @@ class interleaved_fwd_fixpoint_iterator_t final : public wto_component_visitor_t
     wto_t _wto;
     invariant_table_t _pre, _post;
     // number of iterations until triggering widening
-    const unsigned int _widening_delay{1};
+    const unsigned int _widening_delay{global_options.widening_delay};
+    // number of decreasing iterations before giving up on refining a cycle
+    const unsigned int _max_narrowing_iterations{global_options.max_narrowing_iterations};
+    // start nested cycles entered again from a larger state from their previous fixpoint
+    const bool _warm_start_loops{global_options.warm_start_loops};
+    // constants to widen to, by cycle head
+    std::unordered_map<block_id_t, thresholds_t> _jump_set;
     // Used to skip the analysis until _entry is found
     bool _skip{true};
 
+    // Change tracking, used to skip blocks and nested cycles whose inputs did not change since their last visit.
+    // _clock advances whenever a post-state is recomputed; _post_stamp holds the time of the last recomputation
+    // and _visited_at the time at which a vertex (or the cycle it heads) was last brought up to date.
+    // Zero means never.
+    std::atomic<unsigned int> _clock{0};
+    std::vector<unsigned int> _post_stamp, _visited_at;
+    // The entry state each cycle was last analyzed from, by head.
+    invariant_table_t _cycle_entry;
+    // Likewise for the other blocks of an irreducible cycle that are entered from outside it, by head: each block,
+    // and the join of the post-states of its predecessors outside the cycle.
+    std::vector<std::vector<std::pair<block_id_t, ebpf_domain_t>>> _side_entries;
+    // What is live after each block, if global_options.forget_dead_variables is set; the post-state of a block
+    // forgets the rest, which no later statement reads.
+    const std::optional<liveness_t> _liveness;
+    // The statements to apply instead of those of each block within a cycle, if global_options.summarize_blocks is
+    // set; only the transfers that do not check assertions use them.
+    const std::vector<std::optional<std::vector<Instruction>>> _summaries;
+
+    // If set, checks each block once its pre-state is final, which is on its (only) visit outside of any cycle.
+    block_checker_t _check;
+    // The heads of the cycles being iterated over by the calling thread, outermost first. Outermost components
+    // may be analyzed on several threads, each starting with none.
+    static thread_local std::vector<block_id_t> _cycle_heads;
+    // Measures the analysis against the budgets of global_options.
+    const elapsed_time_t _elapsed;
+    // If set, records the time of each block, statement, join, widening and narrowing.
+    analysis_profile_t* _profile{analysis_context_t::current().profile};
+    // If set, where the analysis is saved as it goes, unless it checks blocks as it goes; see checkpoint().
+    std::string _checkpoint_file;
+    // The wall time of _elapsed at which the analysis was last saved.
+    double _checkpointed_at{};
+    // The cycle a saved analysis was within, to be resumed when the analysis reaches it.
+    const saved_cycle_t* _resume_cycle{};
+    // If set, follows the analysis and may stop it.
+    analysis_control_t* const _control{analysis_context_t::current().control};
+
   private:
-    inline void set_pre(const label_t& label, const ebpf_domain_t& v) { _pre[label] = v; }
+    inline void set_pre(block_id_t node, const ebpf_domain_t& v) {
+        // Outside of cycles, nothing reads the pre-state after checking the block.
+        if (!_check || !_cycle_heads.empty())
+            _pre[node] = v;
+    }
+
+    template <typename Statements>
+    void apply(ebpf_domain_t& inv, const Statements& statements, const basic_block_t& bb) {
+        for (const Instruction& statement : statements) {
+            if (_profile)
+                _profile->apply(inv, statement, bb.label());
+            else
+                std::visit(inv, statement);
+        }
+    }
+
+    inline void transform_to_post(block_id_t node, ebpf_domain_t pre) {
+        const auto start = _profile ? analysis_profile_t::clock::now() : analysis_profile_t::clock::time_point{};
+        const basic_block_t& bb = _cfg.get_node(node);
+        if (_check && _cycle_heads.empty()) {
+            _post[node] = _check(bb, std::move(pre));
+        } else {
+            if (!_summaries.empty() && _summaries[node])
+                apply(pre, *_summaries[node], bb);
+            else
+                apply(pre, bb, bb);
+            _post[node] = std::move(pre);
+        }
+        if (_liveness)
+            _post[node].forget_dead(_liveness->live_out(node));
+        _post_stamp[node] = ++_clock;
+        check_budget(node);
+        if (_profile)
+            _profile->record_block(bb.label(), start, _post[node].zone_size());
+    }
+
+    // Throw budget_exceeded if the analysis, now at node, ran out of time or memory. The clock is only read every
+    // few transfers, and the resident set size every few hundred, where it costs little next to the analysis.
+    void check_budget(block_id_t node) {
+        if (global_options.timeout_seconds > 0 && _clock % 16 == 0 &&
+            _elapsed.wall_seconds() > global_options.timeout_seconds)
+            throw_budget_exceeded("time budget of " + std::to_string(global_options.timeout_seconds) + "s", node);
+        if (global_options.max_rss_mb > 0 && _clock % 256 == 0 &&
+            resident_set_size_kb() / 1024 > (long)global_options.max_rss_mb)
+            throw_budget_exceeded("memory budget of " + std::to_string(global_options.max_rss_mb) + "MB", node);
+    }
+
+    [[noreturn]] void throw_budget_exceeded(const std::string& budget, block_id_t node) {
+        std::ostringstream msg;
+        msg << budget << " exceeded at block " << _cfg.get_node(node).label();
+        if (!_cycle_heads.empty()) {
+            msg << " in the loop at " << _cfg.get_node(_cycle_heads.back()).label();
+            if (_cycle_heads.size() > 1) {
+                msg << " (nested in";
+                for (size_t i = _cycle_heads.size() - 1; i-- > 0;)
+                    msg << " " << _cfg.get_node(_cycle_heads[i]).label();
+                msg << ")";
+            }
+        }
+        msg << ", after " << _clock.load() << " block transfers in " << _elapsed.cpu_seconds() << "s";
+        throw budget_exceeded(msg.str(), _cfg.get_node(node).label());
+    }
+
+    // The result of f, recorded in the profile as work of the given kind at the entry of node.
+    template <typename F>
+    auto profiled(block_id_t node, const char* kind, F f) {
+        if (!_profile)
+            return f();
+        const auto start = analysis_profile_t::clock::now();
+        auto res = f();
+        _profile->record(_cfg.get_node(node).label(), kind, start);
+        return res;
+    }
+
+    bool checkpointing() const { return !_checkpoint_file.empty() && !_check; }
+
+    void check_cancelled() const {
+        if (_control && _control->cancelled())
+            throw analysis_cancelled();
+    }
 
-    inline void transform_to_post(const label_t& label, ebpf_domain_t pre) {
-        for (const Instruction& statement : _cfg.get_node(label)) {
-            std::visit(pre, statement);
+    // Report the outermost component at index as done, before its post-states may be released.
+    void component_done(uint32_t index) {
+        if (_control)
+            _control->component_done(_post[_wto.elements()[_wto.elements()[index].end - 1].node].zone_size());
+    }
+
+    // Report that a cycle starts its iteration-th iteration from pre, unless the analysis is cancelled.
+    void start_iteration(unsigned int iteration, const ebpf_domain_t& pre) {
+        check_cancelled();
+        if (_control)
+            _control->cycle_iteration(iteration, pre.zone_size());
+    }
+
+    // Save the invariants of the outermost components before index done, and with iteration set, that the outermost
+    // cycle at done is to start that iteration from pre, to _checkpoint_file, if global_options.checkpoint_seconds
+    // passed since the analysis started or was last saved. The file is replaced at once, so that it always holds a
+    // complete analysis.
+    void checkpoint(uint32_t done, unsigned int iteration = 0, const ebpf_domain_t* pre = nullptr) {
+        if (!checkpointing() || _elapsed.wall_seconds() - _checkpointed_at < global_options.checkpoint_seconds)
+            return;
+        const auto& elements = _wto.elements();
+        auto saved = [&](block_id_t node, const ebpf_domain_t& before, const ebpf_domain_t& after) {
+            auto [statements, prevs] = block_signature(_cfg, _cfg.get_node(node));
+            return saved_block_t{std::move(statements), std::move(prevs), before, after,
+                                 _liveness ? _liveness->live_out(node) : live_set_t::all()};
+        };
+        const std::string tmp = _checkpoint_file + ".tmp";
+        std::ofstream out(tmp, std::ios::binary);
+        {
+            invariant_writer_t writer(out, invariant_writer_t::format_t::binary);
+            for (uint32_t i = 0; i < done; i++) {
+                const block_id_t node = elements[i].node;
+                writer.write(_cfg.get_node(node).label(), saved(node, _pre[node], _post[node]));
+            }
+            if (iteration > 0) {
+                const block_id_t head = elements[done].node;
+                writer.write_cycle(saved_cycle_t{_cfg.get_node(head).label(), iteration,
+                                                 saved(head, *pre, ebpf_domain_t::bottom())});
+            }
+        }
+        out.close();
+        if (!out || std::rename(tmp.c_str(), _checkpoint_file.c_str()) != 0)
+            std::cerr << "cannot write checkpoint " << _checkpoint_file << "\n";
+        _checkpointed_at = _elapsed.wall_seconds();
+    }
+
+    // Check the blocks of the outermost cycle at index once it is stable, and release their pre-states.
+    void check_cycle(uint32_t index) {
+        const auto& elements = _wto.elements();
+        for (uint32_t i = index; i < elements[index].end; i++) {
+            const block_id_t node = elements[i].node;
+            const basic_block_t& bb = _cfg.get_node(node);
+            // Blocks without assertions have nothing to check.
+            if (std::any_of(bb.begin(), bb.end(), [](const auto& s) { return std::holds_alternative<Assert>(s); }))
+                _check(bb, std::move(_pre[node]));
+            _pre[node] = ebpf_domain_t::bottom();
+            _cycle_entry[node] = ebpf_domain_t::bottom();
+            _side_entries[node].clear();
+        }
+    }
+
+    // Whether no predecessor of node accepted by the filter has a post-state stamp newer than since. A since of 0 means
+    // never, so that nothing is unchanged.
+    template <typename Filter>
+    bool inputs_unchanged(block_id_t node, Filter filter, unsigned int since) {
+        if (since == 0)
+            return false;
+        for (block_id_t prev : _cfg.prev_nodes(node)) {
+            if (filter(prev) && _post_stamp[prev] > since)
+                return false;
         }
-        _post[label] = std::move(pre);
+        return true;
     }
 
-    ebpf_domain_t extrapolate(const label_t& node, unsigned int iteration, ebpf_domain_t before,
+    ebpf_domain_t extrapolate(block_id_t node, unsigned int iteration, ebpf_domain_t before,
                               const ebpf_domain_t& after) {
         if (iteration <= _widening_delay) {
             return before | after;
-        } else {
-            return before.widen(after);
         }
+        auto it = _jump_set.find(node);
+        if (it != _jump_set.end()) {
+            return before.widening_thresholds(after, it->second);
+        }
+        return before.widen(after);
     }
 
-    static ebpf_domain_t refine(const label_t& node, unsigned int iteration, ebpf_domain_t before,
+    static ebpf_domain_t refine(block_id_t node, unsigned int iteration, ebpf_domain_t before,
                                 const ebpf_domain_t& after) {
         if (iteration == 1) {
             return before & after;
@@ -84,43 +304,375 @@ class interleaved_fwd_fixpoint_iterator_t final : public wto_component_visitor_t
         }
     }
 
-    ebpf_domain_t join_all_prevs(const label_t& node) {
-        ebpf_domain_t res = ebpf_domain_t::bottom();
-        for (const label_t& prev : _cfg.prev_nodes(node)) {
-            res |= get_post(prev);
+    ebpf_domain_t join_all_prevs(block_id_t node) {
+        std::vector<const ebpf_domain_t*> posts;
+        for (block_id_t prev : _cfg.prev_nodes(node))
+            posts.push_back(&_post.at(prev));
+        ebpf_domain_t res = ebpf_domain_t::join_all(posts);
+        // The join often gives back one of its inputs, as where one branch only narrowed the state that the other
+        // kept. Where the pre-state is kept, that post-state then shares its zone, which the join compacted, instead
+        // of holding a copy of its own; elsewhere the pre-state is checked and dropped, and sharing would only make the
+        // check copy the zone to modify it.
+        if (posts.size() > 1 && (!_check || !_cycle_heads.empty())) {
+            for (block_id_t prev : _cfg.prev_nodes(node))
+                _post.at(prev).share_if_equal(res);
         }
         return res;
     }
 
   public:
-    explicit interleaved_fwd_fixpoint_iterator_t(cfg_t& cfg) : _cfg(cfg), _wto(cfg) {
-        for (const auto& label : _cfg.labels()) {
-            _pre.emplace(label, ebpf_domain_t::bottom());
-            _post.emplace(label, ebpf_domain_t::bottom());
-        }
+    explicit interleaved_fwd_fixpoint_iterator_t(cfg_t& cfg)
+        : _cfg(cfg), _wto(make_wto(cfg)), _pre(cfg.num_ids(), ebpf_domain_t::bottom()),
+          _post(cfg.num_ids(), ebpf_domain_t::bottom()), _post_stamp(cfg.num_ids()), _visited_at(cfg.num_ids()),
+          _cycle_entry(cfg.num_ids(), ebpf_domain_t::bottom()), _side_entries(cfg.num_ids()),
+          _liveness(make_liveness(cfg)), _summaries(make_summaries(cfg, _wto, _liveness)) {
+        // An analysis given up within a cycle does not leave it.
+        _cycle_heads.clear();
         _pre[this->_cfg.entry()] = ebpf_domain_t::setup_entry();
+        if (global_options.widening_thresholds > 0) {
+            wto_thresholds_t thresholds(_cfg, global_options.widening_thresholds);
+            _wto.accept(&thresholds);
+            _jump_set = thresholds.get_thresholds_map();
+        }
+    }
+
+    ebpf_domain_t get_pre(block_id_t node) { return _pre.at(node); }
+
+    ebpf_domain_t get_post(block_id_t node) { return _post.at(node); }
+
+    // Analyze the components of the WTO at indices [begin, end), none of which is nested in another.
+    void visit_sequence(uint32_t begin, uint32_t end) {
+        const auto& elements = _wto.elements();
+        for (uint32_t i = begin; i < end; i = elements[i].end) {
+            if (elements[i].is_cycle)
+                visit_cycle(i);
+            else
+                visit_vertex(elements[i].node);
+        }
     }
 
-    ebpf_domain_t get_pre(const label_t& node) { return _pre.at(node); }
+    // Like visit_sequence, for the outermost components from begin to end; once the entry is found, those that do
+    // not depend on each other are analyzed concurrently by global_options.fixpoint_threads threads.
+    void visit_outermost(uint32_t begin, uint32_t end);
+
+    void visit_vertex(block_id_t node);
+
+    // Analyze the cycle whose head is at index in the WTO.
+    void visit_cycle(uint32_t index);
 
-    ebpf_domain_t get_post(const label_t& node) { return _post.at(node); }
+    void run() { visit_outermost(0, _wto.elements().size()); }
 
-    void visit(wto_vertex_t& vertex) override;
+    // Take from previous the invariants of the leading outermost components that did not change, and return the
+    // index of the first component left to analyze.
+    uint32_t reuse(const saved_invariants_t& previous, std::vector<block_id_t>& reused);
 
-    void visit(wto_cycle_t& cycle) override;
+    // Resume the analysis of cycle when the outermost cycle at index start, if it is the same, is reached.
+    void resume_cycle(uint32_t start, const saved_cycle_t& cycle);
 
-    friend std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg);
+    friend std::pair<invariant_table_t, invariant_table_t>
+    run_forward_analyzer(cfg_t& cfg, analysis_context_t& context, bool keep_postconditions);
+    friend void run_forward_analyzer(cfg_t& cfg, analysis_context_t& context, const block_checker_t& check);
+    friend std::pair<invariant_table_t, invariant_table_t>
+    run_forward_analyzer(cfg_t& cfg, analysis_context_t& context, const saved_invariants_t& previous,
+                         std::vector<block_id_t>& reused);
+    friend std::pair<invariant_table_t, invariant_table_t>
+    run_forward_analyzer(cfg_t& cfg, analysis_context_t& context, const checkpoint_t& from,
+                         const std::string& checkpoint_file);
 };
 
-std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg) {
+std::pair<std::vector<std::string>, std::vector<label_t>> block_signature(const cfg_t& cfg, const basic_block_t& bb) {
+    std::vector<std::string> statements;
+    for (const Instruction& statement : bb)
+        statements.push_back(to_string(statement));
+    std::vector<label_t> prevs;
+    for (block_id_t prev : cfg.prev_nodes(bb.id()))
+        prevs.push_back(cfg.get_node(prev).label());
+    std::sort(prevs.begin(), prevs.end());
+    return {std::move(statements), std::move(prevs)};
+}
+
+saved_invariants_t save_invariants(const cfg_t& cfg, invariant_table_t&& pre, invariant_table_t&& post) {
+    saved_invariants_t saved;
+    const std::optional<liveness_t> liveness = make_liveness(cfg);
+    for (const basic_block_t& bb : cfg) {
+        auto [statements, prevs] = block_signature(cfg, bb);
+        saved.emplace(bb.label(), saved_block_t{std::move(statements), std::move(prevs), std::move(pre.at(bb.id())),
+                                                std::move(post.at(bb.id())),
+                                                liveness ? liveness->live_out(bb.id()) : live_set_t::all()});
+    }
+    return saved;
+}
+
+uint32_t interleaved_fwd_fixpoint_iterator_t::reuse(const saved_invariants_t& previous,
+                                                    std::vector<block_id_t>& reused) {
+    const auto& elements = _wto.elements();
+    reused.clear();
+    uint32_t start = 0;
+    // Each component only depends on itself and the components before it, so that an unchanged prefix of the
+    // WTO has the same invariants as before.
+    while (start < elements.size()) {
+        const uint32_t end = elements[start].end;
+        std::vector<const saved_block_t*> saved;
+        for (uint32_t i = start; i < end; i++) {
+            const basic_block_t& bb = _cfg.get_node(elements[i].node);
+            auto it = previous.find(bb.label());
+            if (it == previous.end())
+                return start;
+            auto [statements, prevs] = block_signature(_cfg, bb);
+            if (statements != it->second.statements || prevs != it->second.prevs)
+                return start;
+            // The saved post-state must not have forgotten what the program now reads.
+            if (_liveness && !(_liveness->live_out(bb.id()) <= it->second.live))
+                return start;
+            saved.push_back(&it->second);
+        }
+        for (uint32_t i = start; i < end; i++) {
+            _pre[elements[i].node] = saved[i - start]->pre;
+            _post[elements[i].node] = saved[i - start]->post;
+            reused.push_back(elements[i].node);
+        }
+        // The entry is in the first component.
+        _skip = false;
+        start = end;
+    }
+    return start;
+}
+
+void interleaved_fwd_fixpoint_iterator_t::resume_cycle(uint32_t start, const saved_cycle_t& cycle) {
+    const auto& elements = _wto.elements();
+    if (start >= elements.size() || !elements[start].is_cycle)
+        return;
+    const basic_block_t& bb = _cfg.get_node(elements[start].node);
+    auto [statements, prevs] = block_signature(_cfg, bb);
+    if (bb.label() == cycle.head && statements == cycle.block.statements && prevs == cycle.block.prevs)
+        _resume_cycle = &cycle;
+}
+
+// Record the bytes held by the states of the tables in MemoryStats, for --phase-stats; walking them is not free.
+static void measure_invariants(const invariant_table_t& pre, const invariant_table_t& post) {
+    if (!CRAB_STATS || !global_options.print_phase_stats)
+        return;
+    std::unordered_set<const void*> counted;
+    size_t bytes = sizeof(ebpf_domain_t) * (pre.capacity() + post.capacity());
+    for (const invariant_table_t* table : {&pre, &post}) {
+        for (const ebpf_domain_t& inv : *table)
+            bytes += inv.memory_bytes(counted);
+    }
+    MemoryStats::measured(memory_kind_t::invariants, bytes);
+}
+
+std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg, analysis_context_t& context,
+                                                                     const saved_invariants_t& previous,
+                                                                     std::vector<block_id_t>& reused) {
+    analysis_context_t::scope_t scope(context);
+    interleaved_fwd_fixpoint_iterator_t analyzer(cfg);
+    const uint32_t start = analyzer.reuse(previous, reused);
+    analyzer.visit_outermost(start, analyzer._wto.elements().size());
+    measure_invariants(analyzer._pre, analyzer._post);
+    return std::make_pair(std::move(analyzer._pre), std::move(analyzer._post));
+}
+
+std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg, analysis_context_t& context,
+                                                                     const checkpoint_t& from,
+                                                                     const std::string& checkpoint_file) {
+    analysis_context_t::scope_t scope(context);
+    interleaved_fwd_fixpoint_iterator_t analyzer(cfg);
+    analyzer._checkpoint_file = checkpoint_file;
+    std::vector<block_id_t> reused;
+    const uint32_t start = analyzer.reuse(from.blocks, reused);
+    if (from.cycle)
+        analyzer.resume_cycle(start, *from.cycle);
+    analyzer.visit_outermost(start, analyzer._wto.elements().size());
+    measure_invariants(analyzer._pre, analyzer._post);
+    return std::make_pair(std::move(analyzer._pre), std::move(analyzer._post));
+}
+
+std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg, analysis_context_t& context,
+                                                                     bool keep_postconditions) {
+    analysis_context_t::scope_t scope(context);
     interleaved_fwd_fixpoint_iterator_t analyzer(cfg);
-    analyzer._wto.accept(&analyzer);
-    return std::make_pair(analyzer._pre, analyzer._post);
+    analyzer.run();
+    measure_invariants(analyzer._pre, analyzer._post);
+    if (!keep_postconditions) {
+        // Free the post-states before the caller starts checking assertions.
+        analyzer._post = invariant_table_t();
+    }
+    return std::make_pair(std::move(analyzer._pre), std::move(analyzer._post));
+}
+
+void run_forward_analyzer(cfg_t& cfg, analysis_context_t& context, const block_checker_t& check) {
+    analysis_context_t::scope_t scope(context);
+    interleaved_fwd_fixpoint_iterator_t analyzer(cfg);
+    analyzer._check = check;
+    analyzer.run();
+    measure_invariants(analyzer._pre, analyzer._post);
 }
 
-void interleaved_fwd_fixpoint_iterator_t::visit(wto_vertex_t& vertex) {
-    label_t node = vertex.node();
+thread_local std::vector<block_id_t> interleaved_fwd_fixpoint_iterator_t::_cycle_heads;
+
+thread_pool_t& fixpoint_pool() {
+    static thread_pool_t pool(thread_pool_t::threads_for(global_options.fixpoint_threads),
+                              analysis_context_t::release_thread_scratch);
+    return pool;
+}
+
+void interleaved_fwd_fixpoint_iterator_t::visit_outermost(uint32_t begin, uint32_t end) {
+    const auto& elements = _wto.elements();
+    if (_control) {
+        size_t components = 0, done = 0;
+        for (uint32_t i = 0; i < elements.size(); i = elements[i].end) {
+            components++;
+            done += i < begin;
+        }
+        _control->started(components, done);
+    }
+    // Until the entry is found, the components before it are skipped in order.
+    while (_skip && begin < end) {
+        check_cancelled();
+        visit_sequence(begin, elements[begin].end);
+        component_done(begin);
+        begin = elements[begin].end;
+    }
+    thread_pool_t& pool = fixpoint_pool();
+    // Neither the profile nor the phase stop watches can be kept from several threads, and a checkpoint is of the
+    // components before one.
+    const bool sequential = pool.threads() == 1 || _profile || global_options.print_phase_stats || checkpointing();
+    // Without checks as blocks go, the post-states are all returned, so they are only released when checking.
+    if (sequential && !_check) {
+        for (uint32_t i = begin; i < end; i = elements[i].end) {
+            check_cancelled();
+            visit_sequence(i, elements[i].end);
+            component_done(i);
+            checkpoint(elements[i].end);
+        }
+        return;
+    }
 
+    // The components, by their index in the WTO, and for each the earlier ones with an edge into it. A component
+    // only reads the post-states of those, so it may be analyzed as soon as they are done, and along with the
+    // components that are not among them.
+    std::vector<uint32_t> components;
+    std::vector<size_t> component_at(elements.size());
+    for (uint32_t i = begin; i < end; i = elements[i].end) {
+        std::fill(component_at.begin() + i, component_at.begin() + elements[i].end, components.size());
+        components.push_back(i);
+    }
+    if (components.size() < 2 && !_check) {
+        for (uint32_t index : components) {
+            check_cancelled();
+            visit_sequence(index, end);
+            component_done(index);
+        }
+        return;
+    }
+    std::vector<std::vector<size_t>> inputs(components.size());
+    // The number of components each one is an input of, which are yet to be started.
+    std::vector<size_t> readers(components.size());
+    for (size_t c = 0; c < components.size(); c++) {
+        for (uint32_t i = components[c]; i < elements[components[c]].end; i++) {
+            for (block_id_t prev : _cfg.prev_nodes(elements[i].node)) {
+                const uint32_t position = _wto.position(prev);
+                // Components before begin are done, and blocks out of the WTO are unreachable.
+                if (begin <= position && position < end && component_at[position] != c)
+                    inputs[c].push_back(component_at[position]);
+            }
+        }
+        std::sort(inputs[c].begin(), inputs[c].end());
+        inputs[c].erase(std::unique(inputs[c].begin(), inputs[c].end()), inputs[c].end());
+        for (size_t input : inputs[c])
+            readers[input]++;
+    }
+    std::vector<bool> is_last(components.size());
+    for (size_t c = 0; c < components.size(); c++)
+        is_last[c] = readers[c] == 0;
+    // When checking, the post-states of a component are released once all of its readers are done. Its blocks are
+    // checked by then, and nothing else reads them.
+    std::vector<size_t> unfinished_readers = readers;
+    auto release_posts = [&](size_t c) {
+        for (uint32_t i = components[c]; i < elements[components[c]].end; i++)
+            _post[elements[i].node] = ebpf_domain_t::bottom();
+    };
+    // Count c as done reading its inputs, and release what may be.
+    auto finish = [&](size_t c) {
+        if (!_check)
+            return;
+        for (size_t input : inputs[c]) {
+            if (--unfinished_readers[input] == 0)
+                release_posts(input);
+        }
+        if (unfinished_readers[c] == 0)
+            release_posts(c);
+    };
+
+    if (sequential) {
+        for (size_t c = 0; c < components.size(); c++) {
+            check_cancelled();
+            visit_sequence(components[c], elements[components[c]].end);
+            component_done(components[c]);
+            finish(c);
+        }
+        return;
+    }
+
+    /* The array cells of the context are shared by all the states of the analysis, which makes them depend on the
+     * order blocks are analyzed in. Rather than sharing them between threads, each component starts from the cells
+     * of its inputs, and the analysis ends with those of the components that are no other's input; the results
+     * then do not depend on the threads. The cells are dropped once every reader of a component has started. */
+    analysis_context_t& context = analysis_context_t::current();
+    std::vector<array_map_t> cells(components.size());
+    std::vector<bool> done(components.size());
+    bool aborted = false;
+    std::mutex mutex;
+    std::condition_variable finished;
+    pool.run(components.size(), [&](size_t c) {
+        array_map_t component_cells;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] {
+                return aborted || std::all_of(inputs[c].begin(), inputs[c].end(), [&](size_t i) { return done[i]; });
+            });
+            if (aborted)
+                return;
+            if (inputs[c].empty())
+                component_cells = context.array_map;
+            for (size_t input : inputs[c]) {
+                component_cells |= cells[input];
+                if (--readers[input] == 0)
+                    cells[input] = {};
+            }
+        }
+        try {
+            analysis_context_t::scope_t scope(context, component_cells);
+            _cycle_heads.clear();
+            const uint32_t index = components[c];
+            check_cancelled();
+            visit_sequence(index, elements[index].end);
+            component_done(index);
+            // Other threads read the post-states from copies, so they must not be closed from there.
+            for (uint32_t i = index; i < elements[index].end; i++)
+                _post[elements[i].node].normalize();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted = true;
+            finished.notify_all();
+            throw;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        cells[c] = std::move(component_cells);
+        done[c] = true;
+        finish(c);
+        finished.notify_all();
+    });
+
+    array_map_t last_cells;
+    for (size_t c = 0; c < components.size(); c++) {
+        if (is_last[c])
+            last_cells |= cells[c];
+    }
+    context.array_map = std::move(last_cells);
+}
+
+void interleaved_fwd_fixpoint_iterator_t::visit_vertex(block_id_t node) {
     /** decide whether skip vertex or not **/
     if (_skip && (node == _cfg.entry())) {
         _skip = false;
@@ -129,23 +681,38 @@ void interleaved_fwd_fixpoint_iterator_t::visit(wto_vertex_t& vertex) {
         return;
     }
 
-    ebpf_domain_t pre = node == _cfg.entry() ? get_pre(node) : join_all_prevs(node);
+    if (node == _cfg.entry()) {
+        transform_to_post(node, get_pre(node));
+        return;
+    }
+
+    if (inputs_unchanged(node, [](block_id_t) { return true; }, _visited_at[node]))
+        return;
+    bool visited = _visited_at[node] != 0;
+    ebpf_domain_t pre = profiled(node, "(join)", [&] { return join_all_prevs(node); });
+    _visited_at[node] = _clock;
+    if (visited && pre == _pre[node])
+        return;
 
     set_pre(node, pre);
     transform_to_post(node, pre);
 }
 
-void interleaved_fwd_fixpoint_iterator_t::visit(wto_cycle_t& cycle) {
-    label_t head = cycle.head();
+void interleaved_fwd_fixpoint_iterator_t::visit_cycle(uint32_t index) {
+    const uint32_t end = _wto.elements()[index].end;
+    block_id_t head = _wto.elements()[index].node;
+    // Whether node is the head of the cycle or in its body, including nested cycles.
+    auto is_inside = [&](block_id_t node) {
+        const uint32_t position = _wto.position(node);
+        return index <= position && position < end;
+    };
 
     /** decide whether skip cycle or not **/
     bool entry_in_this_cycle = false;
     if (_skip) {
         // We only skip the analysis of cycle is _entry is not a
         // component of it, included nested components.
-        member_component_visitor vis(_cfg.entry());
-        cycle.accept(&vis);
-        entry_in_this_cycle = vis.is_member();
+        entry_in_this_cycle = is_inside(_cfg.entry());
         _skip = !entry_in_this_cycle;
         if (_skip) {
             return;
@@ -156,51 +723,113 @@ void interleaved_fwd_fixpoint_iterator_t::visit(wto_cycle_t& cycle) {
     if (entry_in_this_cycle) {
         pre = get_pre(_cfg.entry());
     } else {
-        wto_nesting_t cycle_nesting = _wto.nesting(head);
-        for (const label_t& prev : _cfg.prev_nodes(head)) {
-            if (!(_wto.nesting(prev) > cycle_nesting)) {
-                pre |= get_post(prev);
+        // The fixpoint of a cycle only depends on the states entering it from outside: through its head, and, in an
+        // irreducible cycle, through blocks of its body as well.
+        auto is_outside = [&](block_id_t prev) { return !is_inside(prev); };
+        bool visited = _visited_at[head] != 0;
+        bool unchanged = visited;
+        for (uint32_t i = index; i < end && unchanged; i++)
+            unchanged = inputs_unchanged(_wto.elements()[i].node, is_outside, _visited_at[head]);
+        if (unchanged)
+            return;
+        std::vector<std::pair<block_id_t, ebpf_domain_t>> side_entries;
+        for (uint32_t i = index; i < end; i++) {
+            const block_id_t node = _wto.elements()[i].node;
+            ebpf_domain_t entry = ebpf_domain_t::bottom();
+            bool entered = false;
+            for (block_id_t prev : _cfg.prev_nodes(node)) {
+                if (is_outside(prev)) {
+                    entry |= get_post(prev);
+                    entered = true;
+                }
             }
+            if (node == head)
+                pre = std::move(entry);
+            else if (entered)
+                side_entries.emplace_back(node, std::move(entry));
         }
+        _visited_at[head] = _clock;
+        auto same_side_entries = [&]() {
+            std::vector<std::pair<block_id_t, ebpf_domain_t>>& previous = _side_entries[head];
+            if (previous.size() != side_entries.size())
+                return false;
+            for (size_t i = 0; i < previous.size(); i++) {
+                if (previous[i].first != side_entries[i].first || !(previous[i].second == side_entries[i].second))
+                    return false;
+            }
+            return true;
+        };
+        if (visited && pre == _cycle_entry[head] && same_side_entries())
+            return;
+        _side_entries[head] = std::move(side_entries);
+        // A nested cycle entered again from a larger state, as on each iteration of the cycle around it, starts
+        // from the fixpoint it reached before rather than from the entry alone; any start converges to a
+        // post-fixpoint, and one that is already close takes fewer iterations.
+        const bool warm = _warm_start_loops && visited && !_cycle_heads.empty() && _cycle_entry[head] <= pre;
+        _cycle_entry[head] = pre;
+        if (warm)
+            pre |= _pre[head];
+    }
+    unsigned int first_iteration = 1;
+    if (_resume_cycle && _cycle_heads.empty() && _cfg.get_node(head).label() == _resume_cycle->head) {
+        // Any state above the entry's leads to a post-fixpoint, as with a warm start.
+        pre |= _resume_cycle->block.pre;
+        first_iteration = _resume_cycle->iteration;
+        _resume_cycle = nullptr;
     }
 
-    for (unsigned int iteration = 1;; ++iteration) {
-        // keep track of how many times the cycle is visited by the fixpoint
-        cycle.increment_fixpo_visits();
-
+    _cycle_heads.push_back(head);
+    if (_profile)
+        _profile->enter_cycle(_cfg.get_node(head).label());
+    // The iterations of both sequences, as reported to _control.
+    unsigned int iterations = first_iteration - 1;
+    for (unsigned int iteration = first_iteration;; ++iteration) {
         // Increasing iteration sequence with widening
+        start_iteration(++iterations, pre);
+        if (_cycle_heads.size() == 1)
+            checkpoint(index, iteration, &pre);
         set_pre(head, pre);
         transform_to_post(head, pre);
-        for (auto& x : cycle) {
-            x.accept(this);
-        }
-        ebpf_domain_t new_pre = join_all_prevs(head);
-        if (new_pre <= pre) {
+        visit_sequence(index + 1, end);
+        ebpf_domain_t new_pre = profiled(head, "(join)", [&] { return join_all_prevs(head); });
+        if (profiled(head, "(leq)", [&] { return new_pre <= pre; })) {
             // Post-fixpoint reached
             set_pre(head, new_pre);
             pre = std::move(new_pre);
             break;
         } else {
-            pre = extrapolate(head, iteration, pre, new_pre);
+            pre = profiled(head, "(widen)", [&] { return extrapolate(head, iteration, pre, new_pre); });
         }
     }
 
-    for (unsigned int iteration = 1;; ++iteration) {
+    for (unsigned int iteration = 1; iteration <= _max_narrowing_iterations; ++iteration) {
         // Decreasing iteration sequence with narrowing
+        start_iteration(++iterations, pre);
         transform_to_post(head, pre);
 
-        for (auto& x : cycle) {
-            x.accept(this);
-        }
-        ebpf_domain_t new_pre = join_all_prevs(head);
-        if (pre <= new_pre) {
+        visit_sequence(index + 1, end);
+        ebpf_domain_t new_pre = profiled(head, "(join)", [&] { return join_all_prevs(head); });
+        if (profiled(head, "(leq)", [&] { return pre <= new_pre; })) {
             // No more refinement possible(pre == new_pre)
             break;
+        } else if (iteration == _max_narrowing_iterations) {
+            // Keep pre consistent with the post-states just computed from it.
+            break;
         } else {
-            pre = refine(head, iteration, pre, new_pre);
+            ebpf_domain_t refined = profiled(head, "(narrow)", [&] { return refine(head, iteration, pre, new_pre); });
+            // Narrowing the zones is a no-op, so a pre it leaves unchanged would be iterated on forever.
+            if (pre <= refined)
+                break;
+            pre = std::move(refined);
             set_pre(head, pre);
         }
     }
+    _cycle_heads.pop_back();
+
+    if (_check && _cycle_heads.empty())
+        check_cycle(index);
+    if (_profile)
+        _profile->leave_cycle();
 }
 
 } // namespace crab
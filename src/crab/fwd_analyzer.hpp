@@ -1,16 +1,165 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "crab/cfg.hpp"
 #include "crab/ebpf_domain.hpp"
+#include "crab/liveness.hpp"
+#include "crab/thread_pool.hpp"
 
 namespace crab {
 
+using domains::analysis_context_t;
 using domains::ebpf_domain_t;
-using invariant_table_t = std::unordered_map<label_t, ebpf_domain_t>;
+// Abstract states indexed by block id; ids of removed blocks map to bottom.
+using invariant_table_t = std::vector<ebpf_domain_t>;
+
+// The resulting invariants refer to variables of the given context, and are only meaningful while it is current.
+// Post-states are only needed during the fixpoint; unless keep_postconditions is set, the second table is empty.
+std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg, analysis_context_t& context,
+                                                                     bool keep_postconditions = true);
+
+// The threads of the fixpoint, of global_options.fixpoint_threads threads, which free their scratch space once done
+// with their part of an analysis; also those checking the blocks against the invariants found.
+thread_pool_t& fixpoint_pool();
+
+// Thrown by run_forward_analyzer when the analysis runs out of the time or memory set by global_options.
+// The message tells where the analysis was and how much it had done.
+struct budget_exceeded : std::runtime_error {
+    // The block being analyzed.
+    label_t label;
+
+    budget_exceeded(const std::string& msg, label_t label) : std::runtime_error(msg), label(std::move(label)) {}
+};
+
+// Thrown by run_forward_analyzer when the analysis_control_t of its context is cancelled.
+struct analysis_cancelled : std::runtime_error {
+    analysis_cancelled() : std::runtime_error("analysis cancelled") {}
+};
+
+// How far an analysis went, as analysis_control_t reports it.
+struct analysis_progress_t {
+    // The outermost components of the WTO of the program, and those completed, counting those reused.
+    size_t components{};
+    size_t components_done{};
+    // The iteration of the cycle analyzed last, from 1; 0 between outermost components.
+    unsigned int cycle_iteration{};
+    // The vertices and edges of the zone of the last state reported: the pre-state of a cycle head at each of its
+    // iterations, and the post-state of the last block of each outermost component.
+    size_t zone_vertices{};
+    size_t zone_edges{};
+};
+
+/** Lets other threads follow an analysis and stop it, through the control of its context.
+ *
+ *  The fixpoint reports its progress and checks whether it is to stop at the boundaries of the outermost components
+ *  of the WTO and of the iterations of each cycle, so that cancel() takes effect once the iteration of the innermost
+ *  cycle being analyzed is done. The analysis then throws analysis_cancelled. Every member may be called from any
+ *  thread; the fields of progress() are each up to date, but not read at once.
+ */
+class analysis_control_t final {
+    std::atomic<bool> _cancelled{};
+    std::atomic<size_t> _components{}, _components_done{};
+    std::atomic<unsigned int> _cycle_iteration{};
+    std::atomic<size_t> _zone_vertices{}, _zone_edges{};
+
+    void set_zone_size(std::pair<size_t, size_t> size) {
+        _zone_vertices.store(size.first, std::memory_order_relaxed);
+        _zone_edges.store(size.second, std::memory_order_relaxed);
+    }
+
+  public:
+    void cancel() { _cancelled.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return _cancelled.load(std::memory_order_relaxed); }
+
+    analysis_progress_t progress() const {
+        return {_components.load(std::memory_order_relaxed), _components_done.load(std::memory_order_relaxed),
+                _cycle_iteration.load(std::memory_order_relaxed), _zone_vertices.load(std::memory_order_relaxed),
+                _zone_edges.load(std::memory_order_relaxed)};
+    }
+
+    // Called by the analysis as it starts, with the components it has and those it reuses.
+    void started(size_t components, size_t done) {
+        _components.store(components, std::memory_order_relaxed);
+        _components_done.store(done, std::memory_order_relaxed);
+        _cycle_iteration.store(0, std::memory_order_relaxed);
+    }
+    void component_done(std::pair<size_t, size_t> zone_size) {
+        _components_done.fetch_add(1, std::memory_order_relaxed);
+        _cycle_iteration.store(0, std::memory_order_relaxed);
+        set_zone_size(zone_size);
+    }
+    void cycle_iteration(unsigned int iteration, std::pair<size_t, size_t> zone_size) {
+        _cycle_iteration.store(iteration, std::memory_order_relaxed);
+        set_zone_size(zone_size);
+    }
+};
+
+// The invariants of a block, with what they were computed from.
+struct saved_block_t {
+    // The statements of the block, as printed, and the labels of its predecessors, sorted.
+    std::vector<std::string> statements;
+    std::vector<label_t> prevs;
+    ebpf_domain_t pre, post;
+    // What post was restricted to, when dead variables were forgotten.
+    live_set_t live;
+};
+
+// The invariants of an analysis, by block label, kept so that the analysis of an edited program can start from them.
+using saved_invariants_t = std::unordered_map<label_t, saved_block_t>;
+
+saved_invariants_t save_invariants(const cfg_t& cfg, invariant_table_t&& pre, invariant_table_t&& post);
+
+// The statements and sorted predecessor labels of bb, as saved in a saved_block_t.
+std::pair<std::vector<std::string>, std::vector<label_t>> block_signature(const cfg_t& cfg, const basic_block_t& bb);
+
+// Like the above, but take the invariants of the longest prefix of outermost WTO components whose blocks have the
+// same statements and predecessors as in previous, instead of recomputing them; the analysis resumes at the first
+// component with a changed block. previous must have been saved from an analysis in the same context.
+// reused is set to the blocks whose invariants are taken from previous.
+std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg, analysis_context_t& context,
+                                                                     const saved_invariants_t& previous,
+                                                                     std::vector<block_id_t>& reused);
+
+// Where an analysis was within an outermost cycle when it was saved: the iteration of the cycle that was about to
+// start, from 1, and the head's block as in saved_block_t, with the state the head was to be analyzed from as pre.
+struct saved_cycle_t {
+    label_t head;
+    unsigned int iteration{};
+    saved_block_t block;
+};
+
+// An analysis saved while it runs: the invariants of the leading outermost components it completed, and the cycle
+// after them if it was iterating over one.
+struct checkpoint_t {
+    saved_invariants_t blocks;
+    std::optional<saved_cycle_t> cycle;
+};
+
+// Like run_forward_analyzer(cfg, context), but start from the analysis saved in from, and save the analysis to
+// checkpoint_file as it goes, every global_options.checkpoint_seconds, so that it may be resumed from there if it is
+// stopped. The invariants of from are reused as above. An outermost cycle it was within resumes at the iteration it
+// was at, from the state it reached; its nested cycles start over, so that the invariants may differ from those of
+// an analysis that was not stopped, and are as sound.
+std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg, analysis_context_t& context,
+                                                                     const checkpoint_t& from,
+                                                                     const std::string& checkpoint_file);
+
+// Applies the statements of a block to its pre-state, checking them along the way, and returns the post-state.
+using block_checker_t = std::function<ebpf_domain_t(const basic_block_t&, ebpf_domain_t)>;
 
-std::pair<invariant_table_t, invariant_table_t> run_forward_analyzer(cfg_t& cfg);
+// Like the above, but instead of returning the invariants, call check once on each block as soon as its pre-state
+// is final. Outside of cycles, that is the visit the analysis makes anyway, so the check comes at no extra cost;
+// blocks of a cycle that have assertions are checked again once the outermost cycle is stable. Pre-states are
+// released once checked.
+void run_forward_analyzer(cfg_t& cfg, analysis_context_t& context, const block_checker_t& check);
 
 } // namespace crab
@@ -1,8 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
 #include <optional>
+#include <type_traits>
+#include <vector>
 
+#include "crab/arena.hpp"
+#include "crab/dense_closure.hpp"
 #include "crab/heap.hpp"
+#include "crab/stats.hpp"
+#include "crab/thread_pool.hpp"
 
 //============================
 // A set of utility algorithms for manipulating graphs.
@@ -445,7 +454,7 @@ class GraphOps {
 
     using edge_vector = std::vector<std::pair<std::pair<vert_id, vert_id>, Wt>>;
 
-    using WtComp = DistComp<std::vector<Wt>>;
+    using WtComp = DistComp<Wt*>;
     using WtHeap = Heap<WtComp>;
 
     using edge_ref = std::pair<std::pair<vert_id, vert_id>, Wt>;
@@ -461,47 +470,140 @@ class GraphOps {
     enum QMarkT { BF_NONE = 0, BF_SCC = 1, BF_QUEUED = 2 };
     // ===========================================
     // Scratch space needed by the graph algorithms.
-    // Should really switch to some kind of arena allocator, rather
-    // than having all these static structures.
+    // All of it is carved out of a single per-thread arena, which
+    // grows geometrically but is otherwise reused from one closure
+    // operation to the next; release_scratch returns it once an
+    // analysis is done, so its size is bounded by the largest graph
+    // seen by that analysis.
     // ===========================================
-    static char* edge_marks;
+    static thread_local std::unique_ptr<std::byte[]> arena;
+    static thread_local size_t arena_bytes;
+    static thread_local unsigned int scratch_sz;
+
+    // The containers of the scratch space, counted in MemoryStats along with the arena.
+    template <class T>
+    using scratch_vector_t = std::vector<T, counting_allocator_t<T, memory_kind_t::scratch>>;
+
+    // Whether each vertex is stable, during close_after_widen.
+    static thread_local char* vert_flags;
 
     // Used for Bellman-Ford queueing
-    static vert_id* dual_queue;
-    static int* vert_marks;
-    static unsigned int scratch_sz;
+    static thread_local vert_id* dual_queue;
+    static thread_local int* vert_marks;
 
-    // For locality, should combine dists & dist_ts.
     // Wt must have an empty constructor, but does _not_
     // need a top or infty element.
     // dist_ts tells us which distances are current,
     // and ts_idx prevents wraparound problems, in the unlikely
     // circumstance that we have more than 2^sizeof(uint) iterations.
-    static std::vector<Wt> dists;
-    static std::vector<Wt> dists_alt;
-    static std::vector<unsigned int> dist_ts;
-    static unsigned int ts;
-    static unsigned int ts_idx;
+    static thread_local Wt* dists;
+    static thread_local Wt* dists_alt;
+    static thread_local unsigned int* dist_ts;
+    static thread_local unsigned int ts;
+    static thread_local unsigned int ts_idx;
+
+    // Row-major distances between the vertices of a small graph, for close_dense.
+    static thread_local scratch_vector_t<int64_t> dense_dists;
+
+    // An edge of the graph being closed after a meet, with its colour (CMarkT).
+    struct coloured_edge_t {
+        vert_id vert;
+        unsigned char mark;
+        Wt val;
+    };
+    // The edges out of vertex s are coloured_edges[coloured_first[s]] to coloured_edges[coloured_first[s + 1]]
+    // (excluded), in the graph's order.
+    static thread_local scratch_vector_t<coloured_edge_t> coloured_edges;
+    static thread_local scratch_vector_t<unsigned int> coloured_first;
+
+    // The heap of the Dijkstra variants, ordered by dists. It is kept from one call to the next so that its storage
+    // is reused; each call leaves it empty.
+    static thread_local WtHeap shared_heap;
+
+    static WtHeap& scratch_heap() {
+        // Empty already, unless an overflow interrupted the last call.
+        shared_heap.clear();
+        shared_heap.reserve(scratch_sz);
+        return shared_heap;
+    }
+
+    static_assert(std::is_trivially_copyable_v<Wt> && std::is_trivially_destructible_v<Wt> &&
+                      alignof(Wt) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                  "scratch weights live in raw arena storage");
+
+    // Free the scratch space; it is allocated again on demand.
+    static void release_scratch() {
+        MemoryStats::freed(memory_kind_t::scratch, arena_bytes);
+        arena.reset();
+        arena_bytes = 0;
+        scratch_sz = 0;
+        vert_flags = nullptr;
+        dual_queue = nullptr;
+        vert_marks = nullptr;
+        dists = nullptr;
+        dists_alt = nullptr;
+        dist_ts = nullptr;
+        ts_idx = 0;
+        dense_dists = {};
+        coloured_edges = {};
+        coloured_first = {};
+        shared_heap.release();
+    }
 
     static void grow_scratch(unsigned int sz) {
         if (sz <= scratch_sz)
             return;
 
-        if (scratch_sz == 0)
-            scratch_sz = 10; // Introduce enums for init_sz and growth_factor
-        while (scratch_sz < sz)
-            scratch_sz *= 1.5;
-
-        edge_marks = (char*)realloc(edge_marks, sizeof(char) * scratch_sz * scratch_sz);
-        dual_queue = (vert_id*)realloc(dual_queue, sizeof(vert_id) * 2 * scratch_sz);
-        vert_marks = (int*)realloc(vert_marks, sizeof(int) * scratch_sz);
-
-        // Initialize new elements as necessary.
-        while (dists.size() < scratch_sz) {
-            dists.push_back(Wt());
-            dists_alt.push_back(Wt());
-            dist_ts.push_back(ts - 1);
+        unsigned int new_sz = scratch_sz == 0 ? 10 : scratch_sz; // Introduce enums for init_sz and growth_factor
+        while (new_sz < sz)
+            new_sz *= 1.5;
+
+        // Lay the buffers out by decreasing alignment, so that each one is suitably aligned.
+        size_t bytes = 0;
+        auto reserve = [&](size_t align, size_t size) {
+            size_t offset = (bytes + align - 1) / align * align;
+            bytes = offset + size;
+            return offset;
+        };
+        const size_t dists_at = reserve(alignof(Wt), sizeof(Wt) * new_sz);
+        const size_t dists_alt_at = reserve(alignof(Wt), sizeof(Wt) * new_sz);
+        const size_t dual_queue_at = reserve(alignof(vert_id), sizeof(vert_id) * 2 * new_sz);
+        const size_t vert_marks_at = reserve(alignof(int), sizeof(int) * new_sz);
+        const size_t dist_ts_at = reserve(alignof(unsigned int), sizeof(unsigned int) * new_sz);
+        const size_t vert_flags_at = reserve(1, sizeof(char) * new_sz);
+
+        std::unique_ptr<std::byte[]> fresh(new std::byte[bytes]);
+        auto* new_dists = reinterpret_cast<Wt*>(&fresh[dists_at]);
+        auto* new_dists_alt = reinterpret_cast<Wt*>(&fresh[dists_alt_at]);
+        auto* new_dual_queue = reinterpret_cast<vert_id*>(&fresh[dual_queue_at]);
+        auto* new_vert_marks = reinterpret_cast<int*>(&fresh[vert_marks_at]);
+        auto* new_dist_ts = reinterpret_cast<unsigned int*>(&fresh[dist_ts_at]);
+        auto* new_vert_flags = reinterpret_cast<char*>(&fresh[vert_flags_at]);
+
+        // Keep the current contents, and initialize new elements as necessary.
+        std::copy_n(dists, scratch_sz, new_dists);
+        std::copy_n(dists_alt, scratch_sz, new_dists_alt);
+        std::copy_n(dual_queue, 2 * scratch_sz, new_dual_queue);
+        std::copy_n(vert_marks, scratch_sz, new_vert_marks);
+        std::copy_n(dist_ts, scratch_sz, new_dist_ts);
+        std::copy_n(vert_flags, scratch_sz, new_vert_flags);
+        for (unsigned int i = scratch_sz; i < new_sz; i++) {
+            new (&new_dists[i]) Wt();
+            new (&new_dists_alt[i]) Wt();
+            new_dist_ts[i] = ts - 1;
         }
+
+        MemoryStats::allocated(memory_kind_t::scratch, bytes);
+        MemoryStats::freed(memory_kind_t::scratch, arena_bytes);
+        arena = std::move(fresh);
+        arena_bytes = bytes;
+        scratch_sz = new_sz;
+        dists = new_dists;
+        dists_alt = new_dists_alt;
+        dual_queue = new_dual_queue;
+        vert_marks = new_vert_marks;
+        dist_ts = new_dist_ts;
+        vert_flags = new_vert_flags;
     }
 
     // Syntactic join.
@@ -741,6 +843,87 @@ class GraphOps {
         return true;
     }
 
+    // Graphs with up to this many vertices may be closed on a dense matrix (see close_dense).
+    enum { dense_closure_max_verts = 64 };
+
+    // Whether closing g, with vertices live vertices and edges edges, costs less on a dense matrix: Floyd-Warshall
+    // does vertices^3 steps, each a lane of a vectorized loop, where the chromatic Dijkstra from each vertex
+    // does about vertices * edges steps of heap operations and edge lookups.
+    static bool prefer_dense_closure(size_t vertices, size_t edges) {
+        return vertices <= dense_closure_max_verts && vertices * vertices <= 8 * edges;
+    }
+
+    // Closures doing less than this many steps (sources times edges) are not worth handing to other threads.
+    enum { parallel_closure_min_work = 1 << 16 };
+    // The number of sources whose shortest paths make up one task of a parallel closure.
+    enum { parallel_closure_chunk = 8 };
+
+    // Add to delta, for each vertex v of sources, the edges from v found by close_from(v, out), which appends to out
+    // the destination and weight of each. With a closure pool of several threads and enough work, the sources are
+    // shared among the threads; close_from then runs concurrently on other threads, and must only read g's
+    // thread-local scratch through its own calls. Either way delta is in the order of sources.
+    template <class F>
+    static void close_from_each(const std::vector<vert_id>& sources, size_t edges, edge_vector& delta,
+                                const F& close_from) {
+        std::vector<std::pair<vert_id, Wt>> adjs;
+        if (sources.size() * edges < parallel_closure_min_work || sources.size() < 2 * parallel_closure_chunk ||
+            thread_pool_t::closure_pool().threads() == 1) {
+            for (vert_id v : sources) {
+                adjs.clear();
+                close_from(v, adjs);
+                for (std::pair<vert_id, Wt>& p : adjs)
+                    delta.push_back(std::make_pair(std::make_pair(v, p.first), p.second));
+            }
+            return;
+        }
+
+        CRAB_COUNT("SplitDBM.count.parallel_closure");
+        std::vector<edge_vector> chunk_deltas((sources.size() + parallel_closure_chunk - 1) / parallel_closure_chunk);
+        thread_pool_t::closure_pool().run(chunk_deltas.size(), [&](size_t chunk) {
+            std::vector<std::pair<vert_id, Wt>> chunk_adjs;
+            const size_t end = std::min(sources.size(), (chunk + 1) * parallel_closure_chunk);
+            for (size_t i = chunk * parallel_closure_chunk; i < end; i++) {
+                chunk_adjs.clear();
+                close_from(sources[i], chunk_adjs);
+                for (std::pair<vert_id, Wt>& p : chunk_adjs)
+                    chunk_deltas[chunk].push_back(std::make_pair(std::make_pair(sources[i], p.first), p.second));
+            }
+        });
+        for (const edge_vector& d : chunk_deltas)
+            delta.insert(delta.end(), d.begin(), d.end());
+    }
+
+    // Close g by Floyd-Warshall on a dense matrix of its distances, adding to delta the edges that are missing or
+    // weaker than the shortest path, as the sparse closures do.
+    template <class G>
+    static void close_dense(G& g, edge_vector& delta) {
+        std::vector<vert_id> ids;
+        for (vert_id v : g.verts()) {
+            vert_marks[v] = ids.size();
+            ids.push_back(v);
+        }
+        const size_t n = ids.size();
+        dense_dists.assign(n * n, dense_infty);
+        int64_t* m = dense_dists.data();
+        for (size_t i = 0; i < n; i++) {
+            for (auto e : g.e_succs(ids[i]))
+                m[i * n + vert_marks[e.vert]] = (int64_t)e.val;
+        }
+
+        close_dense_matrix(m, n);
+
+        mut_val_ref_t w;
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < n; j++) {
+                const int64_t d = m[i * n + j];
+                if (i == j || d == dense_infty)
+                    continue;
+                if (!g.lookup(ids[i], ids[j], &w) || w.get() > Wt(d))
+                    delta.push_back(std::make_pair(std::make_pair(ids[i], ids[j]), Wt(d)));
+            }
+        }
+    }
+
     template <class G, class G1, class G2, class P>
     static void close_after_meet(G& g, const P& pots, G1& l, G2& r, edge_vector& delta) {
         // We assume the syntactic meet has already been computed,
@@ -751,13 +934,28 @@ class GraphOps {
         grow_scratch(sz);
         delta.clear();
 
-        std::vector<std::vector<vert_id>> colour_succs(2 * sz);
+        size_t vertices = 0;
+        size_t edges = 0;
+        for (vert_id s : g.verts()) {
+            vertices++;
+            for (vert_id d : g.succs(s)) {
+                (void)d;
+                edges++;
+            }
+        }
+        if (prefer_dense_closure(vertices, edges)) {
+            CRAB_COUNT("SplitDBM.count.dense_closure");
+            close_dense(g, delta);
+            return;
+        }
+
         mut_val_ref_t w;
 
-        // Partition edges into r-only/rb/b-only.
+        // Colour the edges as coming from l, r or both, in a copy of the graph laid out by source vertex.
+        coloured_edges.clear();
+        coloured_first.assign(sz + 1, 0);
         for (vert_id s : g.verts()) {
-            //        unsigned int g_count = 0;
-            //        unsigned int r_count = 0;
+            coloured_first[s] = coloured_edges.size();
             for (auto e : g.e_succs(s)) {
                 unsigned char mark = 0;
                 vert_id d = e.vert;
@@ -765,29 +963,22 @@ class GraphOps {
                     mark |= E_LEFT;
                 if (r.lookup(s, d, &w) && w.get() == e.val)
                     mark |= E_RIGHT;
-                // Add them to the appropriate coloured successor list
-                // Could do it inline, but this'll do.
                 assert(mark != 0);
-                switch (mark) {
-                case E_LEFT: colour_succs[2 * s].push_back(d); break;
-                case E_RIGHT: colour_succs[2 * s + 1].push_back(d); break;
-                default: break;
-                }
-                edge_marks[sz * s + d] = mark;
+                coloured_edges.push_back({d, mark, e.val});
             }
+            coloured_first[s + 1] = coloured_edges.size();
         }
 
         // We can run the chromatic Dijkstra variant
         // on each source.
-        std::vector<std::pair<vert_id, Wt>> adjs;
-        //      for(vert_id v = 0; v < sz; v++)
-        for (vert_id v : g.verts()) {
-            adjs.clear();
-            chrome_dijkstra(g, pots, colour_succs, v, adjs);
-
-            for (std::pair<vert_id, Wt>& p : adjs)
-                delta.push_back(std::make_pair(std::make_pair(v, p.first), p.second));
-        }
+        std::vector<vert_id> sources;
+        for (vert_id v : g.verts())
+            sources.push_back(v);
+        const scratch_vector_t<coloured_edge_t>& c_edges = coloured_edges;
+        const scratch_vector_t<unsigned int>& c_first = coloured_first;
+        close_from_each(sources, edges, delta, [&](vert_id v, std::vector<std::pair<vert_id, Wt>>& out) {
+            chrome_dijkstra(g, pots, c_edges, c_first, v, out);
+        });
     }
 
     static void apply_delta(graph_t& g, edge_vector& delta) {
@@ -809,20 +1000,18 @@ class GraphOps {
 
         // Reset all vertices to infty.
         dist_ts[ts_idx] = ts++;
-        ts_idx = (ts_idx + 1) % dists.size();
+        ts_idx = (ts_idx + 1) % scratch_sz;
 
         dists[src] = Wt(0);
         dist_ts[src] = ts;
 
-        WtComp comp(dists);
-        WtHeap heap(comp);
+        WtHeap& heap = scratch_heap();
 
         for (auto e : g.e_succs(src)) {
             vert_id dest = e.vert;
             dists[dest] = p[src] + e.val - p[dest];
             dist_ts[dest] = ts;
 
-            vert_marks[dest] = edge_marks[sz * src + dest];
             heap.insert(dest);
         }
 
@@ -853,8 +1042,10 @@ class GraphOps {
 
     // P is some vector-alike holding a valid system of potentials.
     // Don't need to clear/initialize
+    // The graph's edges are those of c_edges, laid out as coloured_edges.
     template <class G, class P>
-    static void chrome_dijkstra(G& g, const P& p, std::vector<std::vector<vert_id>>& colour_succs, vert_id src,
+    static void chrome_dijkstra(G& g, const P& p, const scratch_vector_t<coloured_edge_t>& c_edges,
+                                const scratch_vector_t<unsigned int>& c_first, vert_id src,
                                 std::vector<std::pair<vert_id, Wt>>& out) {
         unsigned int sz = g.size();
         if (sz == 0)
@@ -863,20 +1054,20 @@ class GraphOps {
 
         // Reset all vertices to infty.
         dist_ts[ts_idx] = ts++;
-        ts_idx = (ts_idx + 1) % dists.size();
+        ts_idx = (ts_idx + 1) % scratch_sz;
 
         dists[src] = Wt(0);
         dist_ts[src] = ts;
 
-        WtComp comp(dists);
-        WtHeap heap(comp);
+        WtHeap& heap = scratch_heap();
 
-        for (auto e : g.e_succs(src)) {
+        for (unsigned int i = c_first[src]; i < c_first[src + 1]; i++) {
+            const coloured_edge_t& e = c_edges[i];
             vert_id dest = e.vert;
             dists[dest] = p[src] + e.val - p[dest];
             dist_ts[dest] = ts;
 
-            vert_marks[dest] = edge_marks[sz * src + dest];
+            vert_marks[dest] = e.mark;
             heap.insert(dest);
         }
 
@@ -891,15 +1082,18 @@ class GraphOps {
             if (vert_marks[es] == (E_LEFT | E_RIGHT))
                 continue;
 
-            // Pick the appropriate set of successors
-            std::vector<vert_id>& es_succs =
-                (vert_marks[es] == E_LEFT) ? colour_succs[2 * es + 1] : colour_succs[2 * es];
-            for (vert_id ed : es_succs) {
-                Wt v = es_cost + g.edge_val(es, ed) - p[ed];
+            // Follow the edges of the other colour only
+            const unsigned char next_mark = (vert_marks[es] == E_LEFT) ? E_RIGHT : E_LEFT;
+            for (unsigned int i = c_first[es]; i < c_first[es + 1]; i++) {
+                const coloured_edge_t& e = c_edges[i];
+                if (e.mark != next_mark)
+                    continue;
+                vert_id ed = e.vert;
+                Wt v = es_cost + e.val - p[ed];
                 if (dist_ts[ed] != ts || v < dists[ed]) {
                     dists[ed] = v;
                     dist_ts[ed] = ts;
-                    vert_marks[ed] = edge_marks[sz * es + ed];
+                    vert_marks[ed] = next_mark;
 
                     if (heap.inHeap(ed)) {
                         heap.decrease(ed);
@@ -907,7 +1101,7 @@ class GraphOps {
                         heap.insert(ed);
                     }
                 } else if (v == dists[ed]) {
-                    vert_marks[ed] |= edge_marks[sz * es + ed];
+                    vert_marks[ed] |= next_mark;
                 }
             }
         }
@@ -929,13 +1123,12 @@ class GraphOps {
 
         // Reset all vertices to infty.
         dist_ts[ts_idx] = ts++;
-        ts_idx = (ts_idx + 1) % dists.size();
+        ts_idx = (ts_idx + 1) % scratch_sz;
 
         dists[src] = Wt(0);
         dist_ts[src] = ts;
 
-        WtComp comp(dists);
-        WtHeap heap(comp);
+        WtHeap& heap = scratch_heap();
 
         for (auto e : g.e_succs(src)) {
             vert_id dest = e.vert;
@@ -996,8 +1189,7 @@ class GraphOps {
         if (dists[jj] >= Wt(0))
             return true;
 
-        WtComp comp(dists);
-        WtHeap heap(comp);
+        WtHeap& heap = scratch_heap();
 
         heap.insert(jj);
 
@@ -1036,21 +1228,22 @@ class GraphOps {
         grow_scratch(sz);
         //      assert(orig.size() == sz);
 
+        std::vector<vert_id> sources;
+        size_t edges = 0;
         for (vert_id v : g.verts()) {
-            // We're abusing edge_marks to store _vertex_ flags.
-            // Should really just switch this to allocating types of a fixed-size buffer.
-            edge_marks[v] = is_stable[v] ? V_STABLE : V_UNSTABLE;
-        }
-
-        std::vector<std::pair<vert_id, Wt>> aux;
-        for (vert_id v : g.verts()) {
-            if (!edge_marks[v]) {
-                aux.clear();
-                dijkstra_recover(g, p, edge_marks, v, aux);
-                for (auto [vid, wt] : aux)
-                    delta.push_back(std::make_pair(std::make_pair(v, vid), wt));
+            vert_flags[v] = is_stable[v] ? V_STABLE : V_UNSTABLE;
+            if (!vert_flags[v])
+                sources.push_back(v);
+            for (vert_id d : g.succs(v)) {
+                (void)d;
+                edges++;
             }
         }
+
+        const char* const flags = vert_flags;
+        close_from_each(sources, edges, delta, [&](vert_id v, std::vector<std::pair<vert_id, Wt>>& out) {
+            dijkstra_recover(g, p, flags, v, out);
+        });
     }
 
     // Used for sorting successors of some vertex by increasing slack.
@@ -1156,30 +1349,38 @@ class GraphOps {
     }
 };
 
-// Static data allocation
-template <class Wt>
-char* GraphOps<Wt>::edge_marks = nullptr;
-
-// Used for Bellman-Ford queueing
-template <class Wt>
-typename GraphOps<Wt>::vert_id* GraphOps<Wt>::dual_queue = NULL;
-
-template <class Wt>
-int* GraphOps<Wt>::vert_marks = nullptr;
-
-template <class Wt>
-unsigned int GraphOps<Wt>::scratch_sz = 0;
-
+// Static data allocation (per thread, so independent analyses may run concurrently)
+template <class G>
+thread_local std::unique_ptr<std::byte[]> GraphOps<G>::arena;
+template <class G>
+thread_local size_t GraphOps<G>::arena_bytes = 0;
+template <class G>
+thread_local unsigned int GraphOps<G>::scratch_sz = 0;
+template <class G>
+thread_local char* GraphOps<G>::vert_flags = nullptr;
+template <class G>
+thread_local typename GraphOps<G>::vert_id* GraphOps<G>::dual_queue = nullptr;
+template <class G>
+thread_local int* GraphOps<G>::vert_marks = nullptr;
+template <class G>
+thread_local typename G::Wt* GraphOps<G>::dists = nullptr;
+template <class G>
+thread_local typename G::Wt* GraphOps<G>::dists_alt = nullptr;
+template <class G>
+thread_local unsigned int* GraphOps<G>::dist_ts = nullptr;
+template <class G>
+thread_local unsigned int GraphOps<G>::ts = 0;
 template <class G>
-std::vector<typename G::Wt> GraphOps<G>::dists;
+thread_local unsigned int GraphOps<G>::ts_idx = 0;
 template <class G>
-std::vector<typename G::Wt> GraphOps<G>::dists_alt;
+thread_local typename GraphOps<G>::template scratch_vector_t<int64_t> GraphOps<G>::dense_dists;
 template <class G>
-std::vector<unsigned int> GraphOps<G>::dist_ts;
+thread_local typename GraphOps<G>::template scratch_vector_t<typename GraphOps<G>::coloured_edge_t>
+    GraphOps<G>::coloured_edges;
 template <class G>
-unsigned int GraphOps<G>::ts = 0;
+thread_local typename GraphOps<G>::template scratch_vector_t<unsigned int> GraphOps<G>::coloured_first;
 template <class G>
-unsigned int GraphOps<G>::ts_idx = 0;
+thread_local typename GraphOps<G>::WtHeap GraphOps<G>::shared_heap{WtComp(dists)};
 
 } // namespace crab
 #pragma GCC diagnostic pop
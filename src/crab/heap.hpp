@@ -87,7 +87,8 @@ class Heap {
     }
 
     void insert(int n) {
-        indices.resize(n + 1, -1);
+        if (static_cast<size_t>(n) >= indices.size())
+            indices.resize(n + 1, -1);
         assert(!inHeap(n));
 
         indices[n] = heap.size();
@@ -106,11 +107,24 @@ class Heap {
         return x;
     }
 
+    // Make room for the elements below n, so that inserting them does not allocate.
+    void reserve(int n) {
+        if (indices.size() < static_cast<size_t>(n))
+            indices.resize(n, -1);
+        heap.reserve(n);
+    }
+
+    // Empty the heap and free its storage.
+    void release() {
+        std::vector<int>().swap(heap);
+        std::vector<int>().swap(indices);
+    }
+
     void clear() {
         for (size_t i = 0; i < heap.size(); i++)
             indices[heap[i]] = -1;
-#ifdef NDEBUG
-        for (int i = 0; i < indices.size(); i++)
+#ifndef NDEBUG
+        for (size_t i = 0; i < indices.size(); i++)
             assert(indices[i] == -1);
 #endif
         heap.clear();
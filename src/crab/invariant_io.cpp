@@ -0,0 +1,442 @@
+#include "crab/invariant_io.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "config.hpp"
+#include "output_file.hpp"
+
+namespace crab {
+
+/* The binary format starts with magic, followed by records that each start with a tag byte:
+ *
+ *   'v' defines the next variable number: 0 and the name of the variable, or 1, the offset and size of a stack cell
+ *       and the position of the variable among those of the cell;
+ *   'b' is a block: its label, statements and predecessor labels, its live registers and stack bytes, and its pre-
+ *       and post-states;
+ *   'c' is the cycle an analysis was within when it was saved: the iteration it was at, then its head as a block.
+ *
+ * A state is the stack bytes not known to be numbers, then 0 for bottom, or 1, the bits known of the registers and
+ * the zones, each with the numbers of its variables and its edges (see SplitDBM::edges_t). The bits are a varint with
+ * a bit for each register of which some are known, from r0, then the value and mask of each (see tnum_t). Integers are LEB128 varints, zigzag-coded if signed, and strings
+ * are their length and bytes. A bit set is a varint with two bits per word of 64 bits, from the lowest: 0 if the
+ * word is all zeros, 1 if it is all ones, and 2 if it follows, in little-endian order.
+ */
+static const std::string magic{"ebpfinv\2"};
+
+static void put_uint(std::string& b, uint64_t v) {
+    for (; v >= 0x80; v >>= 7)
+        b += (char)(v | 0x80);
+    b += (char)v;
+}
+
+static void put_int(std::string& b, int64_t v) { put_uint(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+
+static void put_string(std::string& b, const std::string& s) {
+    put_uint(b, s.size());
+    b += s;
+}
+
+template <size_t N>
+static void put_bits(std::string& b, const std::bitset<N>& bits) {
+    const std::bitset<N> word_mask{~0ULL};
+    uint64_t kinds = 0;
+    std::string words;
+    for (size_t i = 0; i < N; i += 64) {
+        const uint64_t word = ((bits >> i) & word_mask).to_ullong();
+        const uint64_t ones = ((std::bitset<N>{}.set() >> i) & word_mask).to_ullong();
+        const uint64_t kind = word == 0 ? 0 : word == ones ? 1 : 2;
+        kinds |= kind << (i / 32);
+        if (kind == 2) {
+            for (int j = 0; j < 64; j += 8)
+                words += (char)(word >> j);
+        }
+    }
+    put_uint(b, kinds);
+    b += words;
+}
+
+namespace {
+// Reads the encodings above, throwing on a truncated stream.
+class binary_in_t final {
+    std::istream& _in;
+
+  public:
+    explicit binary_in_t(std::istream& in) : _in(in) {}
+
+    uint8_t byte() {
+        const int c = _in.get();
+        if (c == EOF)
+            throw std::runtime_error("truncated invariants file");
+        return (uint8_t)c;
+    }
+
+    uint64_t uint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t c = byte();
+            v |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return v;
+        }
+        throw std::runtime_error("invalid integer in invariants file");
+    }
+
+    int64_t sint() {
+        const uint64_t v = uint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    std::string string() {
+        std::string s(uint(), '\0');
+        if (!_in.read(s.data(), (std::streamsize)s.size()))
+            throw std::runtime_error("truncated invariants file");
+        return s;
+    }
+
+    template <size_t N>
+    std::bitset<N> bits() {
+        static_assert(N <= 64 * 32, "the kinds of the words must fit in a varint");
+        const uint64_t kinds = uint();
+        std::bitset<N> res;
+        for (size_t i = 0; i < N; i += 64) {
+            uint64_t word = 0;
+            switch ((kinds >> (i / 32)) & 3) {
+            case 0: break;
+            case 1: word = ~0ULL; break;
+            case 2:
+                for (int j = 0; j < 64; j += 8)
+                    word |= (uint64_t)byte() << j;
+                break;
+            default: throw std::runtime_error("invalid bit set in invariants file");
+            }
+            res |= std::bitset<N>{word} << i;
+        }
+        return res;
+    }
+};
+} // namespace
+
+static std::string json_string(const std::string& s) {
+    std::string res = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            res += '\\';
+        res += c;
+    }
+    return res + "\"";
+}
+
+invariant_writer_t::invariant_writer_t(std::ostream& out, format_t format) : _out(out), _format(format) {
+    if (_format == format_t::binary)
+        _out << magic;
+    else
+        _out << "[";
+}
+
+invariant_writer_t::~invariant_writer_t() {
+    if (_format == format_t::json)
+        _out << "\n]\n";
+    _out.flush();
+}
+
+void invariant_writer_t::write(const label_t& label, const saved_block_t& block) {
+    if (_format == format_t::binary)
+        write_binary(label, block);
+    else
+        write_json(label, block);
+}
+
+void invariant_writer_t::put_block(std::string& defs, std::string& b, const label_t& label,
+                                   const saved_block_t& block) {
+    auto number = [&](variable_t v) {
+        auto [it, is_new] = _numbers.emplace(v.index(), _numbers.size());
+        if (is_new) {
+            defs += 'v';
+            if (auto cell = variable_factory_t::current().cell_of(v.index())) {
+                auto [offset, size, first] = *cell;
+                defs += '\1';
+                put_uint(defs, offset);
+                put_uint(defs, size);
+                put_uint(defs, v.index() - first);
+            } else {
+                defs += '\0';
+                put_string(defs, v.name());
+            }
+        }
+        return it->second;
+    };
+    auto put_state = [&](const ebpf_domain_t& state) {
+        put_bits(b, state.stack_numbers().non_numerical());
+        if (state.is_bottom()) {
+            b += '\0';
+            return;
+        }
+        b += '\1';
+        const domains::register_bits_domain_t& bits = state.register_bits();
+        uint64_t known = 0;
+        for (int i = 0; i <= 10; i++) {
+            if (!bits[i].is_top())
+                known |= 1ULL << i;
+        }
+        put_uint(b, known);
+        for (int i = 0; i <= 10; i++) {
+            if (known >> i & 1) {
+                put_uint(b, bits[i].value);
+                put_uint(b, bits[i].mask);
+            }
+        }
+        const std::vector<domains::SplitDBM::edges_t> zones = state.numbers().edges();
+        put_uint(b, zones.size());
+        for (const auto& [vars, edges] : zones) {
+            put_uint(b, vars.size());
+            for (variable_t v : vars)
+                put_uint(b, number(v));
+            put_uint(b, edges.size());
+            for (auto [s, d, k] : edges) {
+                put_uint(b, s);
+                put_uint(b, d);
+                put_int(b, k);
+            }
+        }
+    };
+
+    put_string(b, label);
+    put_uint(b, block.statements.size());
+    for (const std::string& statement : block.statements)
+        put_string(b, statement);
+    put_uint(b, block.prevs.size());
+    for (const label_t& prev : block.prevs)
+        put_string(b, prev);
+    put_bits(b, block.live.regs);
+    put_bits(b, block.live.stack);
+    put_state(block.pre);
+    put_state(block.post);
+}
+
+void invariant_writer_t::write_binary(const label_t& label, const saved_block_t& block) {
+    // The variables the block is the first to use are defined before it.
+    std::string defs, b{"b"};
+    put_block(defs, b, label, block);
+    _out << defs << b;
+}
+
+void invariant_writer_t::write_cycle(const saved_cycle_t& cycle) {
+    if (_format != format_t::binary)
+        throw std::logic_error("cycles are only written in the binary format");
+    std::string defs, b{"c"};
+    put_uint(b, cycle.iteration);
+    put_block(defs, b, cycle.head, cycle.block);
+    _out << defs << b;
+}
+
+// A state as JSON: null for bottom, or the ranges of stack offsets known to hold numbers, the bits known of the
+// registers of which some are, as strings of 0, 1 and x (unknown) from the highest known bit, and the zones.
+static void write_json_state(std::ostream& o, const ebpf_domain_t& state) {
+    if (state.is_bottom()) {
+        o << "null";
+        return;
+    }
+    o << "{\"stack_numbers\": [";
+    const auto& non_numerical = state.stack_numbers().non_numerical();
+    const char* sep = "";
+    for (int i = 0; i < STACK_SIZE; i++) {
+        if (non_numerical[i])
+            continue;
+        int j = i;
+        while (j + 1 < STACK_SIZE && !non_numerical[j + 1])
+            j++;
+        o << sep << "[" << i - STACK_SIZE << ", " << j - STACK_SIZE << "]";
+        sep = ", ";
+        i = j;
+    }
+    o << "], \"known_bits\": {";
+    sep = "";
+    for (int i = 0; i <= 10; i++) {
+        const tnum_t& bits = state.register_bits()[i];
+        if (bits.is_top())
+            continue;
+        std::ostringstream s;
+        s << bits;
+        o << sep << "\"r" << i << "\": " << json_string(s.str());
+        sep = ", ";
+    }
+    o << "}, \"zones\": [";
+    sep = "";
+    for (const auto& [vars, edges] : state.numbers().edges()) {
+        o << sep << "{\"vars\": [";
+        const char* var_sep = "";
+        for (variable_t v : vars) {
+            o << var_sep << json_string(v.name());
+            var_sep = ", ";
+        }
+        o << "], \"edges\": [";
+        const char* edge_sep = "";
+        for (auto [s, d, k] : edges) {
+            o << edge_sep << "[" << s << ", " << d << ", " << k << "]";
+            edge_sep = ", ";
+        }
+        o << "]}";
+        sep = ", ";
+    }
+    o << "]}";
+}
+
+void invariant_writer_t::write_json(const label_t& label, const saved_block_t& block) {
+    _out << (_first ? "\n" : ",\n") << "{\"label\": " << json_string(label) << ", \"statements\": [";
+    _first = false;
+    const char* sep = "";
+    for (const std::string& statement : block.statements) {
+        _out << sep << json_string(statement);
+        sep = ", ";
+    }
+    _out << "], \"prevs\": [";
+    sep = "";
+    for (const label_t& prev : block.prevs) {
+        _out << sep << json_string(prev);
+        sep = ", ";
+    }
+    _out << "],\n \"pre\": ";
+    write_json_state(_out, block.pre);
+    _out << ",\n \"post\": ";
+    write_json_state(_out, block.post);
+    _out << "}";
+}
+
+void write_invariants(std::ostream& out, invariant_writer_t::format_t format, const cfg_t& cfg,
+                      const invariant_table_t& pre, const invariant_table_t& post) {
+    // By label, so that the invariants of two versions of a program can be compared.
+    std::vector<const basic_block_t*> blocks;
+    for (const basic_block_t& bb : cfg)
+        blocks.push_back(&bb);
+    std::sort(blocks.begin(), blocks.end(),
+              [](const basic_block_t* a, const basic_block_t* b) { return a->label() < b->label(); });
+
+    // What the post-states were restricted to, as in save_invariants().
+    std::optional<liveness_t> liveness;
+    if (global_options.forget_dead_variables)
+        liveness.emplace(cfg);
+    invariant_writer_t writer(out, format);
+    for (const basic_block_t* bb : blocks) {
+        auto [statements, prevs] = block_signature(cfg, *bb);
+        writer.write(bb->label(), saved_block_t{std::move(statements), std::move(prevs), pre.at(bb->id()),
+                                                post.at(bb->id()),
+                                                liveness ? liveness->live_out(bb->id()) : live_set_t::all()});
+    }
+}
+
+void write_invariants(const std::string& path, const cfg_t& cfg, const invariant_table_t& pre,
+                      const invariant_table_t& post) {
+    const bool json = output_has_suffix(path, ".json");
+    try {
+        std::unique_ptr<std::ostream> out = open_output(path);
+        write_invariants(*out, json ? invariant_writer_t::format_t::json : invariant_writer_t::format_t::binary, cfg,
+                         pre, post);
+        if (!out->flush())
+            std::cerr << "cannot write " << path << "\n";
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+    }
+}
+
+saved_invariants_t read_invariants(std::istream& in) { return read_checkpoint(in).blocks; }
+
+checkpoint_t read_checkpoint(std::istream& in) {
+    binary_in_t r(in);
+    std::string header(magic.size(), '\0');
+    if (!in.read(header.data(), (std::streamsize)header.size()) || header != magic)
+        throw std::runtime_error("not an invariants file");
+
+    variable_factory_t& factory = variable_factory_t::current();
+    std::vector<variable_t> vars;
+    auto var = [&](uint64_t number) {
+        if (number >= vars.size())
+            throw std::runtime_error("undefined variable in invariants file");
+        return vars[number];
+    };
+    auto get_state = [&]() {
+        const domains::array_bitset_domain_t stack_numbers(r.bits<STACK_SIZE>());
+        if (!r.byte()) {
+            ebpf_domain_t res(domains::NumAbsDomain::top(), stack_numbers);
+            res.set_to_bottom();
+            return res;
+        }
+        domains::register_bits_domain_t bits;
+        const uint64_t known = r.uint();
+        if (known >> 11)
+            throw std::runtime_error("invalid register bits in invariants file");
+        for (int i = 0; i <= 10; i++) {
+            if (known >> i & 1) {
+                const uint64_t value = r.uint();
+                const uint64_t mask = r.uint();
+                bits.set(i, tnum_t{value & ~mask, mask});
+            }
+        }
+        std::vector<domains::SplitDBM::edges_t> zones(r.uint());
+        for (auto& [zone_vars, edges] : zones) {
+            for (uint64_t n = r.uint(); n > 0; n--)
+                zone_vars.push_back(var(r.uint()));
+            edges.resize(r.uint());
+            for (auto& [s, d, k] : edges) {
+                s = (uint32_t)r.uint();
+                d = (uint32_t)r.uint();
+                k = r.sint();
+            }
+        }
+        return ebpf_domain_t(domains::NumAbsDomain::from_edges(zones), stack_numbers, bits);
+    };
+
+    auto get_block = [&](label_t& label, saved_block_t& block) {
+        label = r.string();
+        block.statements.resize(r.uint());
+        for (std::string& statement : block.statements)
+            statement = r.string();
+        block.prevs.resize(r.uint());
+        for (label_t& prev : block.prevs)
+            prev = r.string();
+        block.live.regs = r.bits<11>();
+        block.live.stack = r.bits<STACK_SIZE>();
+        block.pre = get_state();
+        block.post = get_state();
+    };
+
+    checkpoint_t res;
+    for (int tag = in.get(); tag != EOF; tag = in.get()) {
+        if (tag == 'v') {
+            if (r.byte()) {
+                const uint64_t offset = r.uint();
+                const auto size = (unsigned)r.uint();
+                const uint64_t position = r.uint();
+                // In the order of the variables of a cell.
+                static constexpr data_kind_t kinds[] = {data_kind_t::values, data_kind_t::offsets, data_kind_t::types};
+                if (position > 2)
+                    throw std::runtime_error("invalid stack cell variable in invariants file");
+                // States that refer to the scalars of a cell must find it among the cells of the context.
+                analysis_context_t::current_array_map().declare_cell(domains::offset_t(offset), size);
+                vars.push_back(variable_t::cell_var(kinds[position], factory.make_cell(offset, size)));
+            } else {
+                vars.push_back(variable_t::make(r.string()));
+            }
+        } else if (tag == 'b') {
+            label_t label;
+            saved_block_t block;
+            get_block(label, block);
+            res.blocks.insert_or_assign(std::move(label), std::move(block));
+        } else if (tag == 'c') {
+            saved_cycle_t cycle;
+            cycle.iteration = (unsigned int)r.uint();
+            get_block(cycle.head, cycle.block);
+            res.cycle = std::move(cycle);
+        } else {
+            throw std::runtime_error("invalid record in invariants file");
+        }
+    }
+    return res;
+}
+
+} // namespace crab
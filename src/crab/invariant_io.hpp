@@ -0,0 +1,66 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include "crab/fwd_analyzer.hpp"
+
+namespace crab {
+
+/** Writes the invariants of an analysis to a stream as it goes, one block at a time.
+ *
+ *  The binary format is compact and is read back by read_invariants(): each zone is a sparse list of edges, the
+ *  bytes of the stack known to be numbers are raw words, and variables are numbered in the order they first appear,
+ *  each defined once by its name, or by the offset and size of its stack cell. JSON has the same blocks and states,
+ *  with variables by name, for other tools to read; it is not read back.
+ *
+ *  Blocks are written with what they were computed from, as in saved_block_t, so that the invariants of one version
+ *  of a program can be compared with those of the next, or reused by its analysis.
+ */
+class invariant_writer_t final {
+  public:
+    enum class format_t { binary, json };
+
+  private:
+    std::ostream& _out;
+    const format_t _format;
+    // The number of each variable already defined in the binary format.
+    std::unordered_map<index_t, uint64_t> _numbers;
+    bool _first{true};
+
+    // Append the encoding of block to b, and the definitions of the variables it is the first to use to defs.
+    void put_block(std::string& defs, std::string& b, const label_t& label, const saved_block_t& block);
+    void write_binary(const label_t& label, const saved_block_t& block);
+    void write_json(const label_t& label, const saved_block_t& block);
+
+  public:
+    invariant_writer_t(std::ostream& out, format_t format);
+    // Ends the JSON document.
+    ~invariant_writer_t();
+    invariant_writer_t(const invariant_writer_t&) = delete;
+    invariant_writer_t& operator=(const invariant_writer_t&) = delete;
+
+    void write(const label_t& label, const saved_block_t& block);
+    // Record the cycle an analysis is within, for read_checkpoint(); in the binary format only.
+    void write_cycle(const saved_cycle_t& cycle);
+};
+
+// Write the invariants of an analysis of cfg, by block label, in the context they were computed in.
+void write_invariants(std::ostream& out, invariant_writer_t::format_t format, const cfg_t& cfg,
+                      const invariant_table_t& pre, const invariant_table_t& post);
+
+// Like the above, to the file path, in JSON if it ends with ".json" and in the binary format otherwise, compressed if
+// it then ends with ".gz", as by open_output(). Errors are reported on std::cerr.
+void write_invariants(const std::string& path, const cfg_t& cfg, const invariant_table_t& pre,
+                      const invariant_table_t& post);
+
+// Read invariants in the binary format, with their variables and stack cells made in the current context, so that
+// run_forward_analyzer() may start from them. Throws std::runtime_error if in is not such a file.
+saved_invariants_t read_invariants(std::istream& in);
+
+// Like read_invariants, with the cycle recorded by write_cycle() if there is one.
+checkpoint_t read_checkpoint(std::istream& in);
+
+} // namespace crab
@@ -41,6 +41,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <optional>
 #include <unordered_map>
@@ -48,10 +49,9 @@
 #include <utility>
 #include <vector>
 
-#include <boost/container/flat_map.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/functional/hash.hpp>
 
-#include "crab/patricia_trees.hpp"
 #include "crab/types.hpp"
 
 namespace crab {
@@ -60,74 +60,68 @@ class linear_expression_t final {
 
   public:
     using component_t = std::pair<number_t, variable_t>;
-    using variable_set_t = patricia_tree_set<variable_t>;
+    using component_pair_t = std::pair<variable_t, number_t>;
+    // The variables of an expression, sorted. Expressions rarely have more than a handful of terms, so they are
+    // stored inline, like the terms themselves.
+    using variable_set_t = boost::container::small_vector<variable_t, 3>;
 
   private:
-    using map_t = boost::container::flat_map<variable_t, number_t>;
-    using map_ptr = std::shared_ptr<map_t>;
-    using pair_t = typename map_t::value_type;
+    // Terms with non-zero coefficients, sorted by variable.
+    // Expressions built by the transformers rarely have more than a handful
+    // of terms, so the first few are stored inline rather than on the heap.
+    using term_vector_t = boost::container::small_vector<component_pair_t, 3>;
 
-    map_ptr _map;
+    term_vector_t _terms;
     number_t _cst;
 
-    linear_expression_t(map_ptr map, number_t cst) : _map(std::move(map)), _cst(std::move(cst)) {}
+    linear_expression_t(term_vector_t terms, number_t cst) : _terms(std::move(terms)), _cst(std::move(cst)) {}
 
-    linear_expression_t(const map_t& map, number_t cst) : _map(std::make_shared<map_t>()), _cst(std::move(cst)) {
-        *this->_map = map;
+    typename term_vector_t::const_iterator find(variable_t x) const {
+        return std::lower_bound(_terms.begin(), _terms.end(), x,
+                                [](const component_pair_t& t, variable_t v) { return t.first < v; });
     }
 
     void add(variable_t x, const number_t& n) {
-        typename map_t::iterator it = this->_map->find(x);
-        if (it != this->_map->end()) {
-            number_t r = it->second + n;
-            if (r == 0) {
-                this->_map->erase(it);
-            } else {
-                it->second = r;
+        auto it = _terms.begin() + (find(x) - _terms.cbegin());
+        if (it != _terms.end() && it->first == x) {
+            it->second += n;
+            if (it->second == 0) {
+                _terms.erase(it);
             }
         } else {
             if (n != 0) {
-                this->_map->insert(pair_t(x, n));
+                _terms.emplace(it, x, n);
             }
         }
     }
 
   public:
-    using iterator = typename map_t::iterator;
-    using const_iterator = typename map_t::const_iterator;
+    using iterator = typename term_vector_t::const_iterator;
+    using const_iterator = typename term_vector_t::const_iterator;
 
-    linear_expression_t() : _map(std::make_shared<map_t>()), _cst(0) {}
+    linear_expression_t() : _cst(0) {}
 
     linear_expression_t(linear_expression_t&& other) = default;
     linear_expression_t(const linear_expression_t& other) = default;
 
-    explicit linear_expression_t(number_t n) : _map(std::make_shared<map_t>()), _cst(std::move(n)) {}
+    explicit linear_expression_t(number_t n) : _cst(std::move(n)) {}
 
-    linear_expression_t(signed long long int n) : _map(std::make_shared<map_t>()), _cst(number_t(n)) {}
+    linear_expression_t(signed long long int n) : _cst(number_t(n)) {}
 
-    linear_expression_t(variable_t x) : _map(std::make_shared<map_t>()), _cst(0) {
-        this->_map->insert(pair_t(x, number_t(1)));
-    }
-
-    linear_expression_t(const number_t& n, variable_t x) : _map(std::make_shared<map_t>()), _cst(0) {
-        this->_map->insert(pair_t(x, n));
-    }
+    linear_expression_t(variable_t x) : _cst(0) { _terms.emplace_back(x, number_t(1)); }
 
-    linear_expression_t& operator=(const linear_expression_t& e) {
-        if (this != &e) {
-            this->_map = e._map;
-            this->_cst = e._cst;
+    linear_expression_t(const number_t& n, variable_t x) : _cst(0) {
+        if (n != 0) {
+            _terms.emplace_back(x, n);
         }
-        return *this;
     }
 
-    const_iterator begin() const { return this->_map->begin(); }
+    linear_expression_t& operator=(const linear_expression_t& e) = default;
+    linear_expression_t& operator=(linear_expression_t&& e) = default;
 
-    const_iterator end() const { return this->_map->end(); }
+    const_iterator begin() const { return _terms.begin(); }
 
-    iterator begin() { return this->_map->begin(); }
-
-    iterator end() { return this->_map->end(); }
+    const_iterator end() const { return _terms.end(); }
 
     size_t hash() const {
         size_t res = 0;
@@ -139,40 +133,17 @@ class linear_expression_t final {
     }
 
     // syntactic equality
-    bool equal(const linear_expression_t& o) const {
-        if (is_constant()) {
-            if (!o.is_constant()) {
-                return false;
-            } else {
-                return (constant() == o.constant());
-            }
-        } else {
-            if (constant() != o.constant()) {
-                return false;
-            }
+    bool equal(const linear_expression_t& o) const { return _cst == o._cst && _terms == o._terms; }
 
-            if (size() != o.size()) {
-                return false;
-            } else {
-                for (const_iterator it = begin(), jt = o.begin(), et = end(); it != et; ++it, ++jt) {
-                    if (((*it).first != (*jt).first) || ((*it).second != (*jt).second)) {
-                        return false;
-                    }
-                }
-                return true;
-            }
-        }
-    }
-
-    bool is_constant() const { return (this->_map->empty()); }
+    bool is_constant() const { return _terms.empty(); }
 
     number_t constant() const { return this->_cst; }
 
-    std::size_t size() const { return this->_map->size(); }
+    std::size_t size() const { return _terms.size(); }
 
     number_t operator[](variable_t x) const {
-        typename map_t::const_iterator it = this->_map->find(x);
-        if (it != this->_map->end()) {
+        auto it = find(x);
+        if (it != _terms.end() && it->first == x) {
             return it->second;
         } else {
             return 0;
@@ -181,37 +152,28 @@ class linear_expression_t final {
 
     template <typename RenamingMap>
     linear_expression_t rename(const RenamingMap& map) const {
-        number_t cst(this->_cst);
-        linear_expression_t new_exp(cst);
-        for (auto v : this->variables()) {
+        linear_expression_t new_exp(this->_cst);
+        for (const auto& [v, n] : _terms) {
             auto const it = map.find(v);
-            if (it != map.end()) {
-                variable_t v_out((*it).second);
-                new_exp = new_exp + linear_expression_t(this->operator[](v), v_out);
-            } else {
-                new_exp = new_exp + linear_expression_t(this->operator[](v), v);
-            }
+            new_exp.add(it != map.end() ? variable_t((*it).second) : v, n);
         }
         return new_exp;
     }
 
-    linear_expression_t operator+(number_t n) const {
-        linear_expression_t r(this->_map, this->_cst + std::move(n));
-        return r;
-    }
+    linear_expression_t operator+(number_t n) const { return linear_expression_t(_terms, this->_cst + std::move(n)); }
 
     linear_expression_t operator+(int n) const { return this->operator+(number_t(n)); }
 
     linear_expression_t operator+(variable_t x) const {
-        linear_expression_t r(*this->_map, this->_cst);
+        linear_expression_t r(*this);
         r.add(x, number_t(1));
         return r;
     }
 
     linear_expression_t operator+(const linear_expression_t& e) const {
-        linear_expression_t r(*this->_map, this->_cst + e._cst);
-        for (typename map_t::const_iterator it = e._map->begin(); it != e._map->end(); ++it) {
-            r.add(it->first, it->second);
+        linear_expression_t r(_terms, this->_cst + e._cst);
+        for (const auto& [v, n] : e) {
+            r.add(v, n);
         }
         return r;
     }
@@ -221,7 +183,7 @@ class linear_expression_t final {
     linear_expression_t operator-(int n) const { return this->operator+(-number_t(n)); }
 
     linear_expression_t operator-(variable_t x) const {
-        linear_expression_t r(*this->_map, this->_cst);
+        linear_expression_t r(*this);
         r.add(x, number_t(-1));
         return r;
     }
@@ -229,9 +191,9 @@ class linear_expression_t final {
     linear_expression_t operator-() const { return this->operator*(number_t(-1)); }
 
     linear_expression_t operator-(const linear_expression_t& e) const {
-        linear_expression_t r(*this->_map, this->_cst - e._cst);
-        for (typename map_t::const_iterator it = e._map->begin(); it != e._map->end(); ++it) {
-            r.add(it->first, -it->second);
+        linear_expression_t r(_terms, this->_cst - e._cst);
+        for (const auto& [v, n] : e) {
+            r.add(v, -n);
         }
         return r;
     }
@@ -240,14 +202,12 @@ class linear_expression_t final {
         if (n == 0) {
             return linear_expression_t();
         } else {
-            map_ptr map = std::make_shared<map_t>();
-            for (typename map_t::const_iterator it = this->_map->begin(); it != this->_map->end(); ++it) {
-                number_t c = n * it->second;
-                if (c != 0) {
-                    map->insert(pair_t(it->first, c));
-                }
+            // Multiplying by a non-zero integer keeps every coefficient non-zero and the order intact.
+            linear_expression_t r(_terms, n * this->_cst);
+            for (auto& t : r._terms) {
+                t.second = n * t.second;
             }
-            return linear_expression_t(map, n * this->_cst);
+            return r;
         }
     }
 
@@ -256,7 +216,7 @@ class linear_expression_t final {
     variable_set_t variables() const {
         variable_set_t variables;
         for (const auto& v_c : *this) {
-            variables += v_c.first;
+            variables.push_back(v_c.first);
         }
         return variables;
     }
@@ -275,10 +235,10 @@ class linear_expression_t final {
             o << v;
             start = false;
         }
-        if (this->_cst > 0 && !this->_map->empty()) {
+        if (this->_cst > 0 && !_terms.empty()) {
             o << "+";
         }
-        if (this->_cst != 0 || this->_map->empty()) {
+        if (this->_cst != 0 || _terms.empty()) {
             o << this->_cst;
         }
     }
@@ -313,7 +273,7 @@ using linear_expression_unordered_map =
 class linear_constraint_t final {
 
   public:
-    using variable_set_t = patricia_tree_set<variable_t>;
+    using variable_set_t = linear_expression_t::variable_set_t;
     using constraint_kind_t = enum { EQUALITY, DISEQUATION, INEQUALITY, STRICT_INEQUALITY };
     using iterator = typename linear_expression_t::iterator;
     using const_iterator = typename linear_expression_t::const_iterator;
@@ -381,6 +341,8 @@ class linear_constraint_t final {
 
     const linear_expression_t& expression() const { return this->_expr; }
 
+    variable_set_t variables() const { return this->_expr.variables(); }
+
     constraint_kind_t kind() const { return this->_kind; }
 
     bool is_signed() const {
@@ -396,10 +358,6 @@ class linear_constraint_t final {
 
     const_iterator end() const { return this->_expr.end(); }
 
-    iterator begin() { return this->_expr.begin(); }
-
-    iterator end() { return this->_expr.end(); }
-
     std::size_t size() const { return this->_expr.size(); }
 
     // syntactic equality
@@ -0,0 +1,204 @@
+#include <optional>
+
+#include "crab/liveness.hpp"
+
+namespace crab {
+
+// The registers and stack bytes read and written by one statement.
+class statement_use_def_t final {
+  public:
+    live_set_t use, def;
+
+  private:
+    void read(Reg r) { use.regs.set(r.v); }
+
+    void read(const Value& v) {
+        if (const Reg* r = std::get_if<Reg>(&v))
+            read(*r);
+    }
+
+    void write(Reg r) { def.regs.set(r.v); }
+
+    void read_stack() { use.stack.set(); }
+
+    // The stack bytes of access, if it is through r10 at a constant offset within the stack.
+    static std::optional<std::bitset<STACK_SIZE>> stack_bytes(const Deref& access) {
+        const int lb = STACK_SIZE + access.offset;
+        if (access.basereg.v != 10 || lb < 0 || access.width <= 0 || lb + access.width > STACK_SIZE)
+            return {};
+        return (std::bitset<STACK_SIZE>{}.set() >> (STACK_SIZE - access.width)) << lb;
+    }
+
+    // Reading through access may read any stack byte unless it addresses the stack directly.
+    void read_stack(const Deref& access) {
+        if (auto bytes = stack_bytes(access))
+            use.stack |= *bytes;
+        else
+            read_stack();
+    }
+
+  public:
+    // Unknown instructions are not analyzed, but are taken to read everything.
+    void operator()(const Undefined&) {
+        use.regs.set();
+        read_stack();
+    }
+
+    void operator()(const Bin& b) {
+        if (b.op != Bin::Op::MOV)
+            read(b.dst);
+        read(b.v);
+        write(b.dst);
+    }
+
+    void operator()(const Un& u) {
+        read(u.dst);
+        write(u.dst);
+    }
+
+    void operator()(const LoadMapFd& l) { write(l.dst); }
+
+    void operator()(const Call& call) {
+        // Whatever the prototype, all argument registers count as read, and a helper that is given memory may read
+        // any of the stack.
+        for (uint8_t r = 1; r <= 5; r++)
+            read(Reg{r});
+        for (const ArgSingle& param : call.singles) {
+            if (param.kind == ArgSingle::Kind::PTR_TO_MAP_KEY || param.kind == ArgSingle::Kind::PTR_TO_MAP_VALUE)
+                read_stack();
+        }
+        for (const ArgPair& param : call.pairs) {
+            if (param.kind != ArgPair::Kind::PTR_TO_UNINIT_MEM)
+                read_stack();
+        }
+        for (uint8_t r = 0; r <= 5; r++)
+            write(Reg{r});
+    }
+
+    void operator()(const Exit&) { read(Reg{0}); }
+
+    void operator()(const Jmp& j) {
+        if (j.cond) {
+            read(j.cond->left);
+            read(j.cond->right);
+        }
+    }
+
+    void operator()(const Mem& m) {
+        read(m.access.basereg);
+        if (m.is_load) {
+            read_stack(m.access);
+            if (const Reg* r = std::get_if<Reg>(&m.value))
+                write(*r);
+        } else {
+            read(m.value);
+            if (auto bytes = stack_bytes(m.access))
+                def.stack |= *bytes;
+        }
+    }
+
+    void operator()(const Packet& p) {
+        // The packet is found through the context in r6.
+        read(Reg{6});
+        if (p.regoffset)
+            read(*p.regoffset);
+        for (uint8_t r = 0; r <= 5; r++)
+            write(Reg{r});
+    }
+
+    void operator()(const LockAdd& l) {
+        read(l.access.basereg);
+        read(l.valreg);
+        read_stack(l.access);
+    }
+
+    void operator()(const Assume& a) {
+        read(a.cond.left);
+        read(a.cond.right);
+    }
+
+    void operator()(const Assert& a) { std::visit(*this, a.cst); }
+
+    void operator()(const Comparable& s) {
+        read(s.r1);
+        read(s.r2);
+    }
+
+    void operator()(const Addable& s) {
+        read(s.ptr);
+        read(s.num);
+    }
+
+    void operator()(const ValidAccess& s) {
+        read(s.reg);
+        read(s.width);
+    }
+
+    void operator()(const ValidStore& s) {
+        read(s.mem);
+        read(s.val);
+    }
+
+    void operator()(const ValidSize& s) { read(s.reg); }
+
+    void operator()(const ValidMapKeyValue& s) {
+        read(s.access_reg);
+        read(s.map_fd_reg);
+    }
+
+    void operator()(const TypeConstraint& s) { read(s.reg); }
+};
+
+use_def_t use_def(const Instruction& ins) {
+    statement_use_def_t s;
+    std::visit(s, ins);
+    return {s.use, s.def};
+}
+
+// What is live before a sequence of statements with the given uses and definitions, given what is live after it.
+static live_set_t live_before(const live_set_t& use, const live_set_t& def, const live_set_t& live_after) {
+    live_set_t res;
+    res.regs = use.regs | (live_after.regs & ~def.regs);
+    res.stack = use.stack | (live_after.stack & ~def.stack);
+    return res;
+}
+
+liveness_t::liveness_t(const cfg_t& cfg) : _live_out(cfg.num_ids()) {
+    // The uses and definitions of each whole block, built from its last statement back.
+    std::vector<live_set_t> use(cfg.num_ids()), def(cfg.num_ids());
+    for (const basic_block_t& bb : cfg) {
+        live_set_t& block_use = use[bb.id()];
+        live_set_t& block_def = def[bb.id()];
+        for (auto it = bb.rbegin(); it != bb.rend(); ++it) {
+            statement_use_def_t s;
+            std::visit(s, *it);
+            block_use = live_before(s.use, s.def, block_use);
+            block_def |= s.def;
+        }
+    }
+
+    std::vector<block_id_t> todo = cfg.nodes();
+    std::vector<bool> pending(cfg.num_ids());
+    for (block_id_t node : todo)
+        pending[node] = true;
+    while (!todo.empty()) {
+        const block_id_t node = todo.back();
+        todo.pop_back();
+        pending[node] = false;
+        const live_set_t live_in = live_before(use[node], def[node], _live_out[node]);
+        for (block_id_t prev : cfg.prev_nodes(node)) {
+            if (live_in <= _live_out[prev])
+                continue;
+            _live_out[prev] |= live_in;
+            if (!pending[prev]) {
+                pending[prev] = true;
+                todo.push_back(prev);
+            }
+        }
+    }
+
+    for (live_set_t& live : _live_out)
+        live.regs.set(10);
+}
+
+} // namespace crab
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <bitset>
+#include <vector>
+
+#include "crab/cfg.hpp"
+#include "spec_type_descriptors.hpp"
+
+namespace crab {
+
+// Registers, by number, and stack bytes, by offset from the bottom of the stack.
+struct live_set_t {
+    std::bitset<11> regs;
+    std::bitset<STACK_SIZE> stack;
+
+    static live_set_t all() {
+        live_set_t res;
+        res.regs.set();
+        res.stack.set();
+        return res;
+    }
+
+    bool operator==(const live_set_t& o) const { return regs == o.regs && stack == o.stack; }
+    bool operator!=(const live_set_t& o) const { return !(*this == o); }
+
+    // Whether every element of this set is in o.
+    bool operator<=(const live_set_t& o) const { return (regs & ~o.regs).none() && (stack & ~o.stack).none(); }
+
+    void operator|=(const live_set_t& o) {
+        regs |= o.regs;
+        stack |= o.stack;
+    }
+};
+
+// The registers and stack bytes that one statement reads, and those that it writes.
+struct use_def_t {
+    live_set_t use, def;
+};
+
+use_def_t use_def(const Instruction& ins);
+
+/** The registers and stack bytes that may be read again after each block, before they are written.
+ *
+ *  The analysis runs backwards over the cfg once, before the fixpoint. Stack bytes are only told apart when they are
+ *  accessed through r10 at a constant offset; any other access to memory may read the whole stack, and so may a
+ *  helper that takes a pointer to memory. r10 is always live.
+ */
+class liveness_t final {
+    std::vector<live_set_t> _live_out;
+
+  public:
+    explicit liveness_t(const cfg_t& cfg);
+
+    const live_set_t& live_out(block_id_t node) const { return _live_out[node]; }
+};
+
+/** The statements of bb that the analysis needs to find its post-state, when it then forgets what is not in live_out
+ *  and does not check assertions: satisfied assertions are left out, and constants and copies are folded and dead
+ *  definitions removed as fold_constants() does.
+ */
+std::vector<Instruction> block_summary(const basic_block_t& bb, const live_set_t& live_out);
+
+} // namespace crab
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <numeric>
+#include <optional>
+
+#include "crab/packed_split_dbm.hpp"
+
+namespace crab::domains {
+
+static std::vector<variable_t> variables_of(const linear_expression_t& e) {
+    std::vector<variable_t> res;
+    for (auto [v, n] : e)
+        res.push_back(v);
+    return res;
+}
+
+PackedSplitDBM::PackedSplitDBM(bool is_bottom, bool packed) {
+    if (!packed) {
+        if (is_bottom)
+            _dbm.set_to_bottom();
+        return;
+    }
+    _packing = std::make_shared<packing_t>();
+    if (is_bottom)
+        _packing->packs.push_back(SplitDBM::bottom());
+}
+
+PackedSplitDBM::pack_id_t PackedSplitDBM::merge_packs(const std::vector<variable_t>& vars) {
+    auto& [packs, pack_of] = mutable_packing();
+    std::vector<pack_id_t> ids;
+    for (variable_t v : vars) {
+        auto it = pack_of.find(v);
+        if (it != pack_of.end() && std::find(ids.begin(), ids.end(), it->second) == ids.end())
+            ids.push_back(it->second);
+    }
+
+    pack_id_t target;
+    if (ids.empty()) {
+        target = packs.size();
+        packs.push_back(SplitDBM::top());
+    } else {
+        target = *std::min_element(ids.begin(), ids.end());
+        for (pack_id_t id : ids) {
+            if (id == target)
+                continue;
+            // The packs have no variable in common, so their meet is exact.
+            packs[target] = packs[target] & std::move(packs[id]);
+            packs[id].set_to_top();
+            for (auto& [v, pack] : pack_of) {
+                if (pack == id)
+                    pack = target;
+            }
+        }
+    }
+    for (variable_t v : vars)
+        pack_of.emplace(v, target);
+    return target;
+}
+
+SplitDBM PackedSplitDBM::restrict_to(const std::vector<variable_t>& vars) const {
+    const auto& [packs, pack_of] = packing();
+    std::vector<pack_id_t> ids;
+    for (variable_t v : vars) {
+        auto it = pack_of.find(v);
+        if (it != pack_of.end() && std::find(ids.begin(), ids.end(), it->second) == ids.end())
+            ids.push_back(it->second);
+    }
+    if (ids.empty())
+        return SplitDBM::top();
+    SplitDBM res = packs[ids[0]];
+    for (size_t i = 1; i < ids.size(); i++)
+        res = res & packs[ids[i]];
+    return res;
+}
+
+PackedSplitDBM PackedSplitDBM::combine(const PackedSplitDBM& x, const PackedSplitDBM& y,
+                                       const std::function<SplitDBM(SplitDBM&, SplitDBM&)>& op) {
+    const auto& [x_packs, x_pack_of] = x.packing();
+    const auto& [y_packs, y_pack_of] = y.packing();
+
+    // Union-find over the packs of both sides, x's first, linking packs that share a variable.
+    const size_t nx = x_packs.size();
+    std::vector<size_t> parent(nx + y_packs.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](size_t i) {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    for (auto [v, px] : x_pack_of) {
+        auto it = y_pack_of.find(v);
+        if (it != y_pack_of.end())
+            parent[find(nx + it->second)] = find(px);
+    }
+
+    // Conjoin the packs of each component on either side, and combine the results.
+    std::vector<SplitDBM> xs(parent.size());
+    std::vector<SplitDBM> ys(parent.size());
+    std::vector<bool> used(parent.size());
+    for (size_t i = 0; i < parent.size(); i++) {
+        size_t root = find(i);
+        used[root] = true;
+        if (i < nx)
+            xs[root] = xs[root] & x_packs[i];
+        else
+            ys[root] = ys[root] & y_packs[i - nx];
+    }
+
+    PackedSplitDBM res(false, true);
+    auto& [packs, pack_of] = *res._packing;
+    std::vector<std::optional<pack_id_t>> pack_of_root(parent.size());
+    for (size_t root = 0; root < parent.size(); root++) {
+        if (!used[root])
+            continue;
+        SplitDBM pack = op(xs[root], ys[root]);
+        if (pack.is_bottom())
+            return PackedSplitDBM(true, true);
+        // Variables of components that came out top are left without a pack.
+        if (pack.is_top())
+            continue;
+        pack_of_root[root] = packs.size();
+        packs.push_back(std::move(pack));
+    }
+    for (auto [v, p] : x_pack_of) {
+        if (auto id = pack_of_root[find(p)])
+            pack_of.emplace(v, *id);
+    }
+    for (auto [v, p] : y_pack_of) {
+        if (auto id = pack_of_root[find(nx + p)])
+            pack_of.emplace(v, *id);
+    }
+    return res;
+}
+
+bool PackedSplitDBM::is_top() const {
+    if (!_packing)
+        return _dbm.is_top();
+    const auto& packs = _packing->packs;
+    return std::all_of(packs.begin(), packs.end(), [](const SplitDBM& pack) { return pack.is_top(); });
+}
+
+bool PackedSplitDBM::packed_leq(const PackedSplitDBM& o) const {
+    if (is_bottom())
+        return true;
+    if (o.is_bottom())
+        return false;
+
+    // o is the conjunction of its packs, so it suffices to check each of them against what this says of its variables.
+    const auto& [o_packs, o_pack_of] = o.packing();
+    std::vector<std::vector<variable_t>> vars_of_pack(o_packs.size());
+    for (auto [v, p] : o_pack_of)
+        vars_of_pack[p].push_back(v);
+    for (size_t p = 0; p < o_packs.size(); p++) {
+        if (o_packs[p].is_top())
+            continue;
+        if (!(restrict_to(vars_of_pack[p]) <= o_packs[p]))
+            return false;
+    }
+    return true;
+}
+
+PackedSplitDBM PackedSplitDBM::packed_join(const PackedSplitDBM& o) const {
+    if (is_bottom())
+        return o;
+    if (o.is_bottom())
+        return *this;
+    return combine(*this, o, [](SplitDBM& x, SplitDBM& y) { return x | y; });
+}
+
+PackedSplitDBM PackedSplitDBM::packed_widen(const PackedSplitDBM& o) const {
+    if (is_bottom())
+        return o;
+    if (o.is_bottom())
+        return *this;
+    return combine(*this, o, [](SplitDBM& x, SplitDBM& y) { return x.widen(y); });
+}
+
+PackedSplitDBM PackedSplitDBM::packed_widening_thresholds(const PackedSplitDBM& o,
+                                                          const iterators::thresholds_t& ts) const {
+    if (is_bottom())
+        return o;
+    if (o.is_bottom())
+        return *this;
+    return combine(*this, o, [&ts](SplitDBM& x, SplitDBM& y) { return x.widening_thresholds(y, ts); });
+}
+
+PackedSplitDBM PackedSplitDBM::packed_meet(const PackedSplitDBM& o) const {
+    if (is_bottom() || o.is_bottom())
+        return PackedSplitDBM(true, true);
+    return combine(*this, o, [](SplitDBM& x, SplitDBM& y) { return x & y; });
+}
+
+PackedSplitDBM PackedSplitDBM::packed_narrow(const PackedSplitDBM& o) {
+    // Like SplitDBM, which narrows as a no-op.
+    if (is_bottom() || o.is_bottom())
+        return PackedSplitDBM(true, true);
+    if (is_top())
+        return o;
+    normalize();
+    return *this;
+}
+
+void PackedSplitDBM::normalize() const {
+    if (!_packing) {
+        _dbm.normalize();
+        return;
+    }
+    // Closing a pack leaves its value unchanged, so that a shared packing may be closed in place.
+    for (const SplitDBM& pack : packing().packs)
+        pack.normalize();
+}
+
+void PackedSplitDBM::packed_forget(variable_t v) {
+    if (!packing().pack_of.count(v))
+        return;
+    auto& [packs, pack_of] = mutable_packing();
+    auto it = pack_of.find(v);
+    packs[it->second] -= v;
+    pack_of.erase(it);
+}
+
+void PackedSplitDBM::packed_assign(variable_t x, const linear_expression_t& e) {
+    if (is_bottom())
+        return;
+    std::vector<variable_t> vars = variables_of(e);
+    // Unless x is assigned a function of itself, its former relations go away, and so does its former pack.
+    if (std::find(vars.begin(), vars.end(), x) == vars.end())
+        packed_forget(x);
+    vars.push_back(x);
+    pack_for(vars).assign(x, e);
+}
+
+void PackedSplitDBM::packed_apply(arith_binop_t op, variable_t x, variable_t y, variable_t z) {
+    if (is_bottom())
+        return;
+    if (x != y && x != z)
+        packed_forget(x);
+    SplitDBM& pack = pack_for({x, y, z});
+    pack.apply(op, x, y, z);
+    propagate_bottom(pack);
+}
+
+void PackedSplitDBM::packed_apply(arith_binop_t op, variable_t x, variable_t y, const number_t& k) {
+    if (is_bottom())
+        return;
+    if (x != y)
+        packed_forget(x);
+    SplitDBM& pack = pack_for({x, y});
+    pack.apply(op, x, y, k);
+    propagate_bottom(pack);
+}
+
+void PackedSplitDBM::packed_apply(bitwise_binop_t op, variable_t x, variable_t y, variable_t z) {
+    if (is_bottom())
+        return;
+    if (x != y && x != z)
+        packed_forget(x);
+    SplitDBM& pack = pack_for({x, y, z});
+    pack.apply(op, x, y, z);
+    propagate_bottom(pack);
+}
+
+void PackedSplitDBM::packed_apply(bitwise_binop_t op, variable_t x, variable_t y, const number_t& k) {
+    if (is_bottom())
+        return;
+    if (x != y)
+        packed_forget(x);
+    SplitDBM& pack = pack_for({x, y});
+    pack.apply(op, x, y, k);
+    propagate_bottom(pack);
+}
+
+void PackedSplitDBM::packed_set(variable_t x, const interval_t& intv) {
+    if (is_bottom())
+        return;
+    packed_forget(x);
+    SplitDBM& pack = pack_for({x});
+    pack.set(x, intv);
+    propagate_bottom(pack);
+}
+
+void PackedSplitDBM::packed_add(const linear_constraint_t& cst) {
+    if (is_bottom())
+        return;
+    SplitDBM& pack = pack_for(variables_of(cst.expression()));
+    pack += cst;
+    propagate_bottom(pack);
+}
+
+void PackedSplitDBM::packed_add_constraints(const std::vector<linear_constraint_t>& csts) {
+    if (is_bottom())
+        return;
+    std::vector<variable_t> vars;
+    for (const linear_constraint_t& cst : csts) {
+        for (auto [v, n] : cst.expression())
+            vars.push_back(v);
+    }
+    SplitDBM& pack = pack_for(vars);
+    pack.add_constraints(csts);
+    propagate_bottom(pack);
+}
+
+interval_t PackedSplitDBM::packed_get(variable_t x) const {
+    if (is_bottom())
+        return interval_t::bottom();
+    const auto& [packs, pack_of] = packing();
+    auto it = pack_of.find(x);
+    if (it == pack_of.end())
+        return interval_t::top();
+    // A copy shares the pack's graph, so this costs no more than reading it in place.
+    SplitDBM pack = packs[it->second];
+    return pack[x];
+}
+
+bool PackedSplitDBM::packed_entail(const linear_constraint_t& cst) const {
+    if (is_bottom())
+        return true;
+    return restrict_to(variables_of(cst.expression())).entail(cst);
+}
+
+bool PackedSplitDBM::packed_intersect(const linear_constraint_t& cst) const {
+    if (is_bottom())
+        return false;
+    return restrict_to(variables_of(cst.expression())).intersect(cst);
+}
+
+std::vector<SplitDBM::edges_t> PackedSplitDBM::edges() const {
+    std::vector<SplitDBM::edges_t> res;
+    if (!_packing) {
+        if (!_dbm.is_top())
+            res.push_back(_dbm.edges());
+        return res;
+    }
+    for (const SplitDBM& pack : _packing->packs) {
+        if (!pack.is_top())
+            res.push_back(pack.edges());
+    }
+    return res;
+}
+
+PackedSplitDBM PackedSplitDBM::from_edges(const std::vector<SplitDBM::edges_t>& parts) {
+    PackedSplitDBM res = top();
+    if (!res._packing) {
+        // The graphs have no variable in common, so their meet is exact.
+        for (const SplitDBM::edges_t& part : parts)
+            res._dbm = res._dbm & SplitDBM::from_edges(part);
+        return res;
+    }
+    auto& [packs, pack_of] = res.mutable_packing();
+    for (const SplitDBM::edges_t& part : parts) {
+        for (variable_t v : part.vars)
+            pack_of.emplace(v, packs.size());
+        packs.push_back(SplitDBM::from_edges(part));
+    }
+    return res;
+}
+
+void PackedSplitDBM::packed_write(std::ostream& o) {
+    if (is_bottom()) {
+        o << "_|_";
+        return;
+    }
+    if (is_top()) {
+        o << "{}";
+        return;
+    }
+    bool first = true;
+    for (SplitDBM& pack : mutable_packing().packs) {
+        if (pack.is_top())
+            continue;
+        if (!first)
+            o << "\n ";
+        first = false;
+        pack.write(o);
+    }
+}
+
+} // namespace crab::domains
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <boost/container/flat_map.hpp>
+
+#include "config.hpp"
+#include "crab/split_dbm.hpp"
+
+namespace crab::domains {
+
+/** A zone domain split into packs: independent SplitDBM graphs over disjoint sets of variables.
+ *
+ *  Variables share a pack only once a constraint or an assignment has related them, at which point their packs are
+ *  merged. Closure then only runs over the pack being changed, and binary operations only combine the packs that
+ *  overlap. The price is precision: relations that a single graph would derive between packs through their bounds
+ *  are not kept.
+ *
+ *  Packing is enabled by global_options.pack_variables when the domain is created. Otherwise the value is a single
+ *  SplitDBM, to which every operation forwards in line, so that the default configuration pays nothing for the option.
+ *
+ *  Likewise, the operations that may relate variables forget the relations that are not kept (see relations_t), if
+ *  any, making the domain one of intervals or of intervals and equalities, at the cost of a walk over the edges. The
+ *  same walk bounds the number of related variables, if global_options.max_relational_variables is set.
+ */
+class PackedSplitDBM final : public writeable {
+    using pack_id_t = size_t;
+    using pack_map_t = boost::container::flat_map<variable_t, pack_id_t>;
+
+    struct packing_t {
+        // Top has no pack at all, bottom is a single bottom pack, and no other value has a bottom pack.
+        std::vector<SplitDBM> packs;
+        // The pack of each variable that may be constrained.
+        pack_map_t pack_of;
+    };
+
+    // The value without packing; unused with it.
+    SplitDBM _dbm;
+    // The packs, shared between copies until one of them is modified. Null without packing.
+    std::shared_ptr<packing_t> _packing;
+
+    explicit PackedSplitDBM(bool is_bottom, bool packed);
+
+    explicit PackedSplitDBM(SplitDBM&& dbm) : _dbm(std::move(dbm)) {}
+
+    const packing_t& packing() const { return *_packing; }
+
+    // Take exclusive ownership of the packs before modifying them.
+    packing_t& mutable_packing() {
+        if (_packing.use_count() > 1)
+            _packing = std::make_shared<packing_t>(*_packing);
+        return *_packing;
+    }
+
+    // Merge the packs of vars into a single one, which also receives the variables not yet in any pack.
+    pack_id_t merge_packs(const std::vector<variable_t>& vars);
+
+    // The pack to update for an operation over vars.
+    SplitDBM& pack_for(const std::vector<variable_t>& vars) {
+        pack_id_t id = merge_packs(vars);
+        return _packing->packs[id];
+    }
+
+    // The conjunction of the packs of vars; top if none of them is constrained.
+    SplitDBM restrict_to(const std::vector<variable_t>& vars) const;
+
+    // Make the whole domain bottom if pack became bottom.
+    void propagate_bottom(const SplitDBM& pack) {
+        if (pack.is_bottom())
+            set_to_bottom();
+    }
+
+    // Forget the relations that are not kept, in every pack.
+    void restrict_relations() {
+        if (SplitDBM::keeps_all_relations())
+            return;
+        if (!_packing) {
+            _dbm.restrict_relations();
+            return;
+        }
+        for (SplitDBM& pack : mutable_packing().packs)
+            pack.restrict_relations();
+    }
+
+    PackedSplitDBM restricted() && {
+        restrict_relations();
+        return std::move(*this);
+    }
+
+    // Combine two packed values pack by pack, after merging the packs of each side that share variables.
+    static PackedSplitDBM combine(const PackedSplitDBM& x, const PackedSplitDBM& y,
+                                  const std::function<SplitDBM(SplitDBM&, SplitDBM&)>& op);
+
+    // The operations with packing.
+    bool packed_leq(const PackedSplitDBM& o) const;
+    PackedSplitDBM packed_join(const PackedSplitDBM& o) const;
+    PackedSplitDBM packed_widen(const PackedSplitDBM& o) const;
+    PackedSplitDBM packed_widening_thresholds(const PackedSplitDBM& o, const iterators::thresholds_t& ts) const;
+    PackedSplitDBM packed_meet(const PackedSplitDBM& o) const;
+    PackedSplitDBM packed_narrow(const PackedSplitDBM& o);
+    void packed_forget(variable_t v);
+    void packed_assign(variable_t x, const linear_expression_t& e);
+    void packed_apply(arith_binop_t op, variable_t x, variable_t y, variable_t z);
+    void packed_apply(arith_binop_t op, variable_t x, variable_t y, const number_t& k);
+    void packed_apply(bitwise_binop_t op, variable_t x, variable_t y, variable_t z);
+    void packed_apply(bitwise_binop_t op, variable_t x, variable_t y, const number_t& k);
+    void packed_set(variable_t x, const interval_t& intv);
+    void packed_add(const linear_constraint_t& cst);
+    void packed_add_constraints(const std::vector<linear_constraint_t>& csts);
+    interval_t packed_get(variable_t x) const;
+    bool packed_entail(const linear_constraint_t& cst) const;
+    bool packed_intersect(const linear_constraint_t& cst) const;
+    void packed_write(std::ostream& o);
+
+  public:
+    PackedSplitDBM() : PackedSplitDBM(false, global_options.pack_variables) {}
+
+    PackedSplitDBM(const PackedSplitDBM& o) = default;
+    PackedSplitDBM(PackedSplitDBM&& o) = default;
+
+    PackedSplitDBM& operator=(const PackedSplitDBM& o) = default;
+    PackedSplitDBM& operator=(PackedSplitDBM&& o) = default;
+
+    static PackedSplitDBM top() { return PackedSplitDBM(false, global_options.pack_variables); }
+
+    static PackedSplitDBM bottom() { return PackedSplitDBM(true, global_options.pack_variables); }
+
+    bool is_packed() const { return _packing != nullptr; }
+
+    void set_to_top() { *this = PackedSplitDBM(false, is_packed()); }
+
+    void set_to_bottom() { *this = PackedSplitDBM(true, is_packed()); }
+
+    bool is_bottom() const {
+        if (!_packing)
+            return _dbm.is_bottom();
+        return _packing->packs.size() == 1 && _packing->packs[0].is_bottom();
+    }
+
+    bool is_top() const;
+
+    bool operator<=(const PackedSplitDBM& o) const {
+        if (_packing)
+            return _packing == o._packing || packed_leq(o);
+        return _dbm <= o._dbm;
+    }
+
+    void operator|=(const PackedSplitDBM& o) {
+        if (_packing)
+            *this = packed_join(o);
+        else
+            _dbm |= o._dbm;
+        restrict_relations();
+    }
+    void operator|=(PackedSplitDBM&& o) {
+        if (!_packing)
+            _dbm |= std::move(o._dbm);
+        else if (is_bottom())
+            std::swap(*this, o);
+        else
+            *this = packed_join(o);
+        restrict_relations();
+    }
+
+    PackedSplitDBM operator|(const PackedSplitDBM& o) & {
+        return (_packing ? packed_join(o) : PackedSplitDBM(_dbm | o._dbm)).restricted();
+    }
+    PackedSplitDBM operator|(const PackedSplitDBM& o) && {
+        return (_packing ? packed_join(o) : PackedSplitDBM(std::move(_dbm) | o._dbm)).restricted();
+    }
+
+    // The join of all of xs, as folding them with |= gives; in one pass when they have a single pack each and all
+    // relations are kept (see SplitDBM::join_all).
+    static PackedSplitDBM join_all(const std::vector<const PackedSplitDBM*>& xs) {
+        if (xs.empty())
+            return bottom();
+        if (xs.size() > 2 && SplitDBM::keeps_all_relations() &&
+            std::none_of(xs.begin(), xs.end(), [](const PackedSplitDBM* x) { return x->is_packed(); })) {
+            std::vector<const SplitDBM*> dbms;
+            dbms.reserve(xs.size());
+            for (const PackedSplitDBM* x : xs)
+                dbms.push_back(&x->_dbm);
+            return PackedSplitDBM(SplitDBM::join_all(dbms));
+        }
+        PackedSplitDBM res = *xs[0];
+        for (size_t k = 1; k < xs.size(); k++)
+            res |= *xs[k];
+        return res;
+    }
+
+    PackedSplitDBM widen(const PackedSplitDBM& o) const {
+        return _packing ? packed_widen(o) : PackedSplitDBM(_dbm.widen(o._dbm));
+    }
+
+    PackedSplitDBM widening_thresholds(const PackedSplitDBM& o, const iterators::thresholds_t& ts) const {
+        return _packing ? packed_widening_thresholds(o, ts)
+                        : PackedSplitDBM(_dbm.widening_thresholds(o._dbm, ts));
+    }
+
+    PackedSplitDBM operator&(const PackedSplitDBM& o) const {
+        return (_packing ? packed_meet(o) : PackedSplitDBM(_dbm & o._dbm)).restricted();
+    }
+
+    PackedSplitDBM narrow(const PackedSplitDBM& o) {
+        return (_packing ? packed_narrow(o) : PackedSplitDBM(_dbm.narrow(o._dbm))).restricted();
+    }
+
+    void normalize() const;
+
+    // Share the graph of o if this one holds the same (see SplitDBM::share_if_equal); packed values are left alone.
+    void share_if_equal(const PackedSplitDBM& o) {
+        if (!_packing && !o._packing)
+            _dbm.share_if_equal(o._dbm);
+    }
+
+    void operator-=(variable_t v) {
+        if (_packing)
+            packed_forget(v);
+        else
+            _dbm -= v;
+    }
+
+    void forget(const std::vector<variable_t>& variables) {
+        if (!_packing) {
+            _dbm.forget(variables);
+            return;
+        }
+        for (variable_t v : variables)
+            packed_forget(v);
+    }
+
+    void assign(variable_t x, const linear_expression_t& e) {
+        if (_packing)
+            packed_assign(x, e);
+        else
+            _dbm.assign(x, e);
+        restrict_relations();
+    }
+    void assign(variable_t x, signed long long int n) {
+        if (_packing)
+            packed_assign(x, linear_expression_t(n));
+        else
+            _dbm.assign(x, n);
+    }
+
+    void apply(arith_binop_t op, variable_t x, variable_t y, variable_t z) {
+        if (_packing)
+            packed_apply(op, x, y, z);
+        else
+            _dbm.apply(op, x, y, z);
+        restrict_relations();
+    }
+
+    void apply(arith_binop_t op, variable_t x, variable_t y, const number_t& k) {
+        if (_packing)
+            packed_apply(op, x, y, k);
+        else
+            _dbm.apply(op, x, y, k);
+        restrict_relations();
+    }
+
+    void apply(bitwise_binop_t op, variable_t x, variable_t y, variable_t z) {
+        if (_packing)
+            packed_apply(op, x, y, z);
+        else
+            _dbm.apply(op, x, y, z);
+        restrict_relations();
+    }
+
+    void apply(bitwise_binop_t op, variable_t x, variable_t y, const number_t& k) {
+        if (_packing)
+            packed_apply(op, x, y, k);
+        else
+            _dbm.apply(op, x, y, k);
+        restrict_relations();
+    }
+
+    template <typename NumOrVar>
+    void apply(binop_t op, variable_t x, variable_t y, NumOrVar z) {
+        std::visit([&](auto top) { apply(top, x, y, z); }, op);
+    }
+
+    void set(variable_t x, const interval_t& intv) {
+        if (_packing)
+            packed_set(x, intv);
+        else
+            _dbm.set(x, intv);
+    }
+
+    void operator+=(const linear_constraint_t& cst) {
+        if (_packing)
+            packed_add(cst);
+        else
+            _dbm += cst;
+        restrict_relations();
+    }
+
+    void add_constraints(const std::vector<linear_constraint_t>& csts) {
+        if (_packing)
+            packed_add_constraints(csts);
+        else
+            _dbm.add_constraints(csts);
+        restrict_relations();
+    }
+
+    interval_t operator[](variable_t x) { return _packing ? packed_get(x) : _dbm[x]; }
+
+    interval_t eval_interval(const linear_expression_t& e) {
+        if (!_packing)
+            return _dbm.eval_interval(e);
+        interval_t r{e.constant()};
+        for (auto [v, n] : e)
+            r += n * packed_get(v);
+        return r;
+    }
+
+    bool entail(const linear_constraint_t& cst) { return _packing ? packed_entail(cst) : _dbm.entail(cst); }
+
+    bool intersect(const linear_constraint_t& cst) { return _packing ? packed_intersect(cst) : _dbm.intersect(cst); }
+
+    // The edges of each pack that is not top, or of the single graph without packing, for serialization. Not
+    // meaningful for bottom.
+    std::vector<SplitDBM::edges_t> edges() const;
+
+    // The value of the graphs parts, whose variables are disjoint, packed if global_options.pack_variables is set.
+    static PackedSplitDBM from_edges(const std::vector<SplitDBM::edges_t>& parts);
+
+    // The number of vertices and edges, over all packs.
+    std::pair<std::size_t, std::size_t> size() const {
+        if (!_packing)
+            return _dbm.size();
+        std::pair<std::size_t, std::size_t> res{0, 0};
+        for (const SplitDBM& pack : _packing->packs) {
+            res.first += pack.size().first;
+            res.second += pack.size().second;
+        }
+        return res;
+    }
+
+    // The bytes held by the graphs, as SplitDBM::memory_bytes() counts them.
+    std::size_t memory_bytes(std::unordered_set<const void*>& counted) const {
+        if (!_packing)
+            return _dbm.memory_bytes(counted);
+        if (!counted.insert(_packing.get()).second)
+            return 0;
+        std::size_t bytes = sizeof(packing_t) + sizeof(SplitDBM) * _packing->packs.capacity();
+        for (const SplitDBM& pack : _packing->packs)
+            bytes += pack.memory_bytes(counted);
+        return bytes;
+    }
+
+    void write(std::ostream& o) override {
+        if (_packing)
+            packed_write(o);
+        else
+            _dbm.write(o);
+    }
+};
+
+} // namespace crab::domains
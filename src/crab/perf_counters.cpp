@@ -0,0 +1,86 @@
+#include "crab/perf_counters.hpp"
+
+#if __linux__
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace crab {
+
+#if __linux__
+
+static int open_event(hw_event_t event, int group_fd) {
+    static const uint64_t configs[hw_events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[(size_t)event];
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // The calling thread, on any CPU.
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+perf_counters_t::perf_counters_t() {
+    _fds.fill(-1);
+    _fds[0] = open_event(hw_event_t::cycles, -1);
+    if (_fds[0] < 0)
+        return;
+    // An event the processor lacks is left out of the group, rather than the group given up.
+    for (size_t i = 1; i < hw_events; i++)
+        _fds[i] = open_event((hw_event_t)i, _fds[0]);
+}
+
+perf_counters_t::~perf_counters_t() {
+    for (int fd : _fds) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+hw_counts_t perf_counters_t::read() const {
+    hw_counts_t res;
+    if (!available())
+        return res;
+    // As PERF_FORMAT_GROUP lays it out: the events, then the times, then a count per event in the order they were
+    // opened.
+    uint64_t buf[3 + hw_events];
+    if (::read(_fds[0], buf, sizeof buf) < (ssize_t)(3 * sizeof(uint64_t)))
+        return res;
+    const uint64_t enabled = buf[1], running = buf[2];
+    if (running == 0)
+        return res;
+    size_t value = 3;
+    for (size_t i = 0; i < hw_events && value < 3 + buf[0]; i++) {
+        if (_fds[i] < 0)
+            continue;
+        uint64_t count = buf[value++];
+        if (running < enabled)
+            count = (uint64_t)((double)count * enabled / running);
+        res[i] = count;
+    }
+    return res;
+}
+
+#else
+
+perf_counters_t::perf_counters_t() { _fds.fill(-1); }
+
+perf_counters_t::~perf_counters_t() = default;
+
+hw_counts_t perf_counters_t::read() const { return {}; }
+
+#endif
+
+const char* perf_counters_t::name(hw_event_t event) {
+    static const char* const names[hw_events] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+    return names[(size_t)event];
+}
+
+} // namespace crab
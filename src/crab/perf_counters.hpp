@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace crab {
+
+// The hardware events that perf_counters_t counts.
+enum class hw_event_t : unsigned {
+    cycles,
+    instructions,
+    // Misses of the last level cache, as the processor defines them.
+    llc_misses,
+    branch_misses,
+};
+constexpr size_t hw_events = 4;
+
+// Counts of each hw_event_t; an event the processor or the kernel cannot count is none.
+using hw_counts_t = std::array<std::optional<uint64_t>, hw_events>;
+
+/** The hardware performance counters of the calling thread, read through perf_event_open(2).
+ *
+ *  The events are opened as one group, so that they are counted over the same intervals, in user space only, which
+ *  perf_event_paranoid allows unprivileged processes up to its level 2. If the kernel multiplexes the counters with
+ *  other groups, the counts are scaled to the time the group was enabled, as perf stat does. Where there is no
+ *  perf_event_open, or it is denied, nothing is counted: available() is false and every count reads as none.
+ */
+class perf_counters_t final {
+    std::array<int, hw_events> _fds;
+
+  public:
+    perf_counters_t();
+    ~perf_counters_t();
+    perf_counters_t(const perf_counters_t&) = delete;
+    perf_counters_t& operator=(const perf_counters_t&) = delete;
+
+    bool available() const { return _fds[0] >= 0; }
+    // The events counted since construction.
+    hw_counts_t read() const;
+
+    // The name of event in the columns of --perf-counters, such as "llc_misses".
+    static const char* name(hw_event_t event);
+};
+
+} // namespace crab
@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <iterator>
+#include <variant>
+
+#include "crab/profile.hpp"
+
+namespace crab {
+
+static double seconds_since(analysis_profile_t::clock::time_point start) {
+    return std::chrono::duration<double>(analysis_profile_t::clock::now() - start).count();
+}
+
+void analysis_profile_t::record_block(const label_t& label, clock::time_point start,
+                                      std::pair<std::size_t, std::size_t> zone_size) {
+    const double seconds = seconds_since(start);
+    block_t& b = _blocks[label];
+    b.visits++;
+    b.seconds += seconds;
+    b.max_vertices = std::max(b.max_vertices, zone_size.first);
+    b.max_edges = std::max(b.max_edges, zone_size.second);
+}
+
+void analysis_profile_t::record(const label_t& label, const std::string& kind, clock::time_point start) {
+    const double seconds = seconds_since(start);
+    entry_t& e = _blocks[label].kinds[kind];
+    e.visits++;
+    e.seconds += seconds;
+
+    std::string stack;
+    for (const label_t& head : _cycles)
+        stack += "loop@" + head + ";";
+    entry_t& s = _stacks[stack + label + ";" + kind];
+    s.visits++;
+    s.seconds += seconds;
+}
+
+void analysis_profile_t::write_folded(std::ostream& o) const {
+    for (const auto& [stack, e] : _stacks)
+        o << stack << " " << (unsigned long)(e.seconds * 1e9) << "\n";
+}
+
+static std::string json_string(const std::string& s) {
+    std::string res = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            res += '\\';
+        res += c;
+    }
+    return res + "\"";
+}
+
+void analysis_profile_t::write_json(std::ostream& o) const {
+    o << "{\"blocks\": {";
+    const char* sep = "\n";
+    for (const auto& [label, b] : _blocks) {
+        o << sep << "  " << json_string(label) << ": {\"visits\": " << b.visits << ", \"seconds\": " << b.seconds
+          << ", \"max_vertices\": " << b.max_vertices << ", \"max_edges\": " << b.max_edges << ", \"kinds\": {";
+        const char* kind_sep = "";
+        for (const auto& [kind, e] : b.kinds) {
+            o << kind_sep << json_string(kind) << ": {\"visits\": " << e.visits << ", \"seconds\": " << e.seconds
+              << "}";
+            kind_sep = ", ";
+        }
+        o << "}}";
+        sep = ",\n";
+    }
+    o << "\n}}\n";
+}
+
+std::string statement_kind(const Instruction& s) {
+    static const char* const names[] = {"Undefined", "Bin",     "Un",      "LoadMapFd", "Call",   "Exit",
+                                        "Jmp",       "Mem",     "Packet",  "LockAdd",   "Assume", "Assert"};
+    static_assert(std::size(names) == std::variant_size_v<Instruction>);
+    static const char* const assertions[] = {"Comparable", "Addable",          "ValidAccess",   "ValidStore",
+                                             "ValidSize",  "ValidMapKeyValue", "TypeConstraint"};
+    static_assert(std::size(assertions) == std::variant_size_v<AssertionConstraint>);
+    if (const auto* a = std::get_if<Assert>(&s))
+        return std::string("Assert/") + assertions[a->cst.index()];
+    return names[s.index()];
+}
+
+} // namespace crab
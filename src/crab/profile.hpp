@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "asm_syntax.hpp"
+
+namespace crab {
+
+// The name under which statements like s are profiled, e.g. "Bin" or "Assert/ValidAccess".
+std::string statement_kind(const Instruction& s);
+
+/** Where the fixpoint spends its time, by block and by kind of statement.
+ *
+ *  For each block, the number of visits, their time and the largest zone (in vertices and edges) a visit left behind;
+ *  within a block, the visits and time of each kind of statement, and of the joins, widenings and narrowings done at
+ *  its entry. Times are wall-clock, as measuring CPU time costs more than most statements.
+ *
+ *  The report is either folded stacks, whose frames are the heads of the enclosing cycles, the block and the
+ *  statement kind, weighted in nanoseconds (as read by flamegraph.pl), or JSON keyed by block label.
+ */
+class analysis_profile_t final {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    struct entry_t {
+        unsigned long visits{};
+        double seconds{};
+    };
+
+    struct block_t {
+        unsigned long visits{};
+        double seconds{};
+        std::size_t max_vertices{};
+        std::size_t max_edges{};
+        std::map<std::string, entry_t> kinds;
+    };
+
+  private:
+    // Labels of the heads of the cycles being iterated over, outermost first.
+    std::vector<label_t> _cycles;
+    std::map<label_t, block_t> _blocks;
+    // Time by folded stack, joined with ';'.
+    std::map<std::string, entry_t> _stacks;
+
+  public:
+    void enter_cycle(const label_t& head) { _cycles.push_back(head); }
+    void leave_cycle() { _cycles.pop_back(); }
+
+    // A visit of block label, which took since start and left a zone of the given size.
+    void record_block(const label_t& label, clock::time_point start, std::pair<std::size_t, std::size_t> zone_size);
+
+    // Work of the given kind done on block label since start.
+    void record(const label_t& label, const std::string& kind, clock::time_point start);
+
+    // Apply statement, a statement of block label, to inv.
+    template <typename Domain>
+    void apply(Domain& inv, const Instruction& statement, const label_t& label) {
+        const std::string kind = statement_kind(statement);
+        const clock::time_point start = clock::now();
+        std::visit(inv, statement);
+        record(label, kind, start);
+    }
+
+    void write_folded(std::ostream& o) const;
+    void write_json(std::ostream& o) const;
+};
+
+} // namespace crab
@@ -7,44 +7,26 @@
 #include <cstdint>
 #include <limits>
 
-#include "crab/bignums.hpp"
-#include "crab/safeint.hpp"
+#include "crab/debug.hpp"
 
 namespace crab {
 
 class safe_i64 {
 
-    // Current implementation is based on
-    // https://blog.regehr.org/archives/1139 using wider integers.
+    // Each operation is checked with the overflow builtins of the compiler, which compile to the native instruction
+    // and a test of its overflow flag, rather than widened to 128 bits and compared with the bounds.
 
-    // TODO/FIXME: the current code compiles assuming the type __int128
-    // exists. Both clang and gcc supports __int128 if the targeted
-    // architecture is x86/64, but it wont' work with 32 bits.
-    using wideint_t = __int128;
+    static int checked_add(int64_t a, int64_t b, int64_t* rp) { return __builtin_add_overflow(a, b, rp); }
 
-    inline int64_t get_max() const{ return std::numeric_limits<int64_t>::max(); }
-    inline int64_t get_min() const { return std::numeric_limits<int64_t>::min(); }
+    static int checked_sub(int64_t a, int64_t b, int64_t* rp) { return __builtin_sub_overflow(a, b, rp); }
 
-    int checked_add(int64_t a, int64_t b, int64_t* rp) const {
-        wideint_t lr = (wideint_t)a + (wideint_t)b;
-        *rp = lr;
-        return lr > get_max() || lr < get_min();
-    }
+    static int checked_mul(int64_t a, int64_t b, int64_t* rp) { return __builtin_mul_overflow(a, b, rp); }
 
-    int checked_sub(int64_t a, int64_t b, int64_t* rp) const{
-        wideint_t lr = (wideint_t)a - (wideint_t)b;
-        *rp = lr;
-        return lr > get_max() || lr < get_min();
-    }
-    int checked_mul(int64_t a, int64_t b, int64_t* rp) const{
-        wideint_t lr = (wideint_t)a * (wideint_t)b;
-        *rp = lr;
-        return lr > get_max() || lr < get_min();
-    }
-    int checked_div(int64_t a, int64_t b, int64_t* rp) const{
-        wideint_t lr = (wideint_t)a / (wideint_t)b;
-        *rp = lr;
-        return lr > get_max() || lr < get_min();
+    static int checked_div(int64_t a, int64_t b, int64_t* rp) {
+        if (a == std::numeric_limits<int64_t>::min() && b == -1)
+            return 1;
+        *rp = a / b;
+        return 0;
     }
 
   public:
@@ -52,8 +34,6 @@ class safe_i64 {
 
     safe_i64(int64_t num) : m_num(num) {}
 
-    safe_i64(const z_number& n) : m_num((long)n) {}
-
     operator long() const{ return (long)m_num; }
 
     // TODO: output parameters whether operation overflows
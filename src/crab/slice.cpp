@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <vector>
+
+#include "crab/cfg.hpp"
+#include "crab/liveness.hpp"
+
+using crab::block_id_t;
+using crab::live_set_t;
+using crab::use_def_t;
+
+// Whether ins does nothing but write registers or stack bytes, so that it can be left out when none of them is
+// relevant after it. Every other statement is part of the slice: assertions and assumptions, helper calls, whose
+// effects use_def() does not fully describe, and the statements that write nothing the analysis tracks.
+static bool only_writes(const Instruction& ins) {
+    return std::holds_alternative<Bin>(ins) || std::holds_alternative<Un>(ins) ||
+           std::holds_alternative<LoadMapFd>(ins) || std::holds_alternative<Mem>(ins) ||
+           std::holds_alternative<Packet>(ins);
+}
+
+// Whether ins, which reads and writes as ud says, may write what is relevant after it.
+static bool writes_relevant(const Instruction& ins, const use_def_t& ud, const live_set_t& relevant) {
+    if (const Mem* mem = std::get_if<Mem>(&ins); mem && !mem->is_load && ud.def.stack.none()) {
+        // A store that does not address the stack through r10 may still write any of it.
+        return relevant.stack.any();
+    }
+    return (ud.def.regs & relevant.regs).any() || (ud.def.stack & relevant.stack).any();
+}
+
+// Steps relevant back over ins: whether ins is in the slice, in which case what it reads becomes relevant in place of
+// what it writes.
+static bool step_back(const Instruction& ins, live_set_t& relevant) {
+    const use_def_t ud = crab::use_def(ins);
+    if (only_writes(ins) && !writes_relevant(ins, ud, relevant))
+        return false;
+    relevant.regs = ud.use.regs | (relevant.regs & ~ud.def.regs);
+    relevant.stack = ud.use.stack | (relevant.stack & ~ud.def.stack);
+    return true;
+}
+
+static live_set_t relevant_before(const basic_block_t& bb, live_set_t relevant) {
+    for (auto it = bb.rbegin(); it != bb.rend(); ++it)
+        step_back(*it, relevant);
+    return relevant;
+}
+
+void slice_to_assertions(cfg_t& cfg) {
+    // What is relevant after each block, found backwards as liveness_t finds what is live, except that a statement
+    // only makes what it reads relevant if it is in the slice.
+    std::vector<live_set_t> relevant_out(cfg.num_ids());
+    std::vector<block_id_t> todo = cfg.nodes();
+    std::vector<bool> pending(cfg.num_ids());
+    for (block_id_t node : todo)
+        pending[node] = true;
+    while (!todo.empty()) {
+        const block_id_t node = todo.back();
+        todo.pop_back();
+        pending[node] = false;
+        const live_set_t relevant_in = relevant_before(cfg.get_node(node), relevant_out[node]);
+        for (block_id_t prev : cfg.prev_nodes(node)) {
+            if (relevant_in <= relevant_out[prev])
+                continue;
+            relevant_out[prev] |= relevant_in;
+            if (!pending[prev]) {
+                pending[prev] = true;
+                todo.push_back(prev);
+            }
+        }
+    }
+
+    std::vector<Instruction> statements;
+    for (basic_block_t& bb : cfg) {
+        bb.swap_instructions(statements);
+        live_set_t relevant = relevant_out[bb.id()];
+        std::vector<Instruction> kept;
+        kept.reserve(statements.size());
+        for (auto it = statements.rbegin(); it != statements.rend(); ++it) {
+            if (step_back(*it, relevant))
+                kept.push_back(std::move(*it));
+        }
+        std::reverse(kept.begin(), kept.end());
+        statements = std::move(kept);
+        bb.swap_instructions(statements);
+    }
+}
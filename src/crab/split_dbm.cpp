@@ -1,5 +1,8 @@
 #include "crab/split_dbm.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <optional>
 #include <utility>
 
 #include "crab/debug.hpp"
@@ -7,7 +10,21 @@
 
 namespace crab::domains {
 
+thread_local relations_t SplitDBM::_relations = relations_t::differences;
+
+const std::shared_ptr<SplitDBM::graph_state_t>& SplitDBM::empty_state() {
+    static thread_local const std::shared_ptr<graph_state_t> empty = [] {
+        auto st = std::make_shared<graph_state_t>();
+        st->g.growTo(1); // Allocate the zero vector
+        st->potential.emplace_back(0);
+        st->rev_map.push_back(std::nullopt);
+        return st;
+    }();
+    return empty;
+}
+
 SplitDBM::vert_id SplitDBM::get_vert(variable_t v) {
+    auto& [vert_map, rev_map, g, potential, unstable] = mutable_state();
     auto it = vert_map.find(v);
     if (it != vert_map.end())
         return (*it).second;
@@ -23,7 +40,6 @@ SplitDBM::vert_id SplitDBM::get_vert(variable_t v) {
         potential.emplace_back(0);
         rev_map.push_back(v);
     }
-    vert_map.insert(vmap_elt_t(v, vert));
 
     assert(vert != 0);
 
@@ -31,7 +47,9 @@ SplitDBM::vert_id SplitDBM::get_vert(variable_t v) {
 }
 
 void SplitDBM::close_over_edge(vert_id ii, vert_id jj) {
+    CRAB_COUNT("SplitDBM.count.closure");
     assert(ii != 0 && jj != 0);
+    graph_t& g = mutable_state().g;
     SubGraph<graph_t> g_excl(g, 0);
 
     Wt c = g_excl.edge_val(ii, jj);
@@ -43,7 +61,9 @@ void SplitDBM::close_over_edge(vert_id ii, vert_id jj) {
     std::vector<std::pair<vert_id, Wt>> src_dec;
     for (auto edge : g_excl.e_preds(ii)) {
         vert_id se = edge.vert;
-        Wt wt_sij = edge.val + c;
+        // edge.val refers into the graph's weights, which add_edge may reallocate.
+        Wt p1 = edge.val;
+        Wt wt_sij = p1 + c;
 
         assert(g_excl.succs(se).begin() != g_excl.succs(se).end());
         if (se != jj) {
@@ -55,14 +75,15 @@ void SplitDBM::close_over_edge(vert_id ii, vert_id jj) {
             } else {
                 g_excl.add_edge(se, wt_sij, jj);
             }
-            src_dec.emplace_back(se, edge.val);
+            src_dec.emplace_back(se, p1);
         }
     }
 
     std::vector<std::pair<vert_id, Wt>> dest_dec;
     for (auto edge : g_excl.e_succs(jj)) {
         vert_id de = edge.vert;
-        Wt wt_ijd = edge.val + c;
+        Wt p2 = edge.val;
+        Wt wt_ijd = p2 + c;
         if (de != ii) {
             if (g_excl.lookup(ii, de, &w)) {
                 if (w.get() <= wt_ijd)
@@ -71,7 +92,7 @@ void SplitDBM::close_over_edge(vert_id ii, vert_id jj) {
             } else {
                 g_excl.add_edge(ii, wt_ijd, de);
             }
-            dest_dec.emplace_back(de, edge.val);
+            dest_dec.emplace_back(de, p2);
         }
     }
 
@@ -92,6 +113,24 @@ void SplitDBM::close_over_edge(vert_id ii, vert_id jj) {
     // Closure is now updated.
 }
 
+// The value of n, if it fits in a weight.
+static std::optional<int64_t> small_value(const number_t& n) {
+    if (!n.fits_slong())
+        return {};
+    return (int64_t)(long)n;
+}
+
+// a + b * c, if it does not overflow; a sum that would is no bound at all.
+static std::optional<int64_t> add_product(int64_t a, int64_t b, int64_t c) {
+    int64_t p, r;
+    if (__builtin_mul_overflow(b, c, &p) || __builtin_add_overflow(a, p, &r))
+        return {};
+    return r;
+}
+
+/* The difference constraints are extracted in int64_t rather than in weights, whose overflow is an error: a constant
+ * that does not fit makes no constraint, and one that overflows is unbounded, so that the constraints it would give
+ * are left out. */
 void SplitDBM::diffcsts_of_assign(variable_t x, const linear_expression_t& exp,
                                   /* if true then process the upper
                                      bounds, else the lower bounds */
@@ -101,47 +140,55 @@ void SplitDBM::diffcsts_of_assign(variable_t x, const linear_expression_t& exp,
                                   std::vector<std::pair<variable_t, Wt>>& diff_csts) {
 
     std::optional<variable_t> unbounded_var;
-    std::vector<std::pair<variable_t, Wt>> terms;
-    bool overflow;
+    std::vector<std::pair<variable_t, int64_t>> terms;
 
-    Wt residual(convert_NtoW(exp.constant(), overflow));
-    if (overflow) {
+    const std::optional<int64_t> constant = small_value(exp.constant());
+    if (!constant) {
         return;
     }
+    int64_t residual = *constant;
 
     for (auto [y, n] : exp) {
-        Wt coeff(convert_NtoW(n, overflow));
-        if (overflow) {
+        const std::optional<int64_t> coeff = small_value(n);
+        if (!coeff) {
             continue;
         }
 
-        if (coeff < Wt(0)) {
+        if (*coeff < 0) {
             // Can't do anything with negative coefficients.
             auto y_val = (extract_upper_bounds ? operator[](y).lb() : operator[](y).ub());
 
             if (y_val.is_infinite()) {
                 return;
             }
-            residual += convert_NtoW(*(y_val.number()), overflow) * coeff;
-            if (overflow) {
+            const std::optional<int64_t> ymin = small_value(*y_val.number());
+            if (!ymin) {
                 continue;
             }
-
+            const std::optional<int64_t> sum = add_product(residual, *ymin, *coeff);
+            if (!sum) {
+                return;
+            }
+            residual = *sum;
         } else {
             auto y_val = (extract_upper_bounds ? operator[](y).ub() : operator[](y).lb());
 
             if (y_val.is_infinite()) {
-                if (unbounded_var || coeff != Wt(1)) {
+                if (unbounded_var || *coeff != 1) {
                     return;
                 }
                 unbounded_var = y;
             } else {
-                Wt ymax(convert_NtoW(*(y_val.number()), overflow));
-                if (overflow) {
+                const std::optional<int64_t> ymax = small_value(*y_val.number());
+                if (!ymax) {
                     continue;
                 }
-                residual += ymax * coeff;
-                terms.emplace_back(y, ymax);
+                const std::optional<int64_t> sum = add_product(residual, *ymax, *coeff);
+                if (!sum) {
+                    return;
+                }
+                residual = *sum;
+                terms.emplace_back(y, *ymax);
             }
         }
     }
@@ -152,91 +199,103 @@ void SplitDBM::diffcsts_of_assign(variable_t x, const linear_expression_t& exp,
         diff_csts.emplace_back(*unbounded_var, residual);
     } else {
         for (auto [v, n] : terms) {
-            diff_csts.emplace_back(v, residual - n);
+            int64_t k;
+            if (!__builtin_sub_overflow(residual, n, &k)) {
+                diff_csts.emplace_back(v, k);
+            }
         }
     }
 }
 
 void SplitDBM::diffcsts_of_lin_leq(const linear_expression_t& exp,
                                    /* difference contraints */
-                                   std::vector<diffcst_t>& csts,
+                                   diffcst_vector_t& csts,
                                    /* x >= lb for each {x,lb} in lbs */
-                                   std::vector<std::pair<variable_t, Wt>>& lbs,
+                                   bound_vector_t& lbs,
                                    /* x <= ub for each {x,ub} in ubs */
-                                   std::vector<std::pair<variable_t, Wt>>& ubs) {
-    bool underflow, overflow;
-
-    Wt exp_ub = -(convert_NtoW(exp.constant(), overflow));
-    if (overflow) {
+                                   bound_vector_t& ubs) {
+    // We don't like MIN either because the code will compute
+    // minus MIN and it will silently overflow.
+    const std::optional<int64_t> constant = small_value(exp.constant());
+    if (!constant || *constant == std::numeric_limits<int64_t>::min()) {
         return;
     }
+    int64_t exp_ub = -*constant;
 
-    // temporary hack
-    convert_NtoW(exp.constant() - 1, underflow);
-    if (underflow) {
-        // We don't like MIN either because the code will compute
-        // minus MIN and it will silently overflow.
-        return;
-    }
-
-    Wt unbounded_lbcoeff;
-    Wt unbounded_ubcoeff;
+    int64_t unbounded_lbcoeff{};
+    int64_t unbounded_ubcoeff{};
     std::optional<variable_t> unbounded_lbvar;
     std::optional<variable_t> unbounded_ubvar;
 
-    std::vector<std::pair<std::pair<Wt, variable_t>, Wt>> pos_terms, neg_terms;
+    // The bounded terms, which are few enough to be kept inline (see linear_expression_t).
+    boost::container::small_vector<std::pair<std::pair<int64_t, variable_t>, int64_t>, 3> pos_terms, neg_terms;
     for (auto [y, n] : exp) {
-        Wt coeff(convert_NtoW(n, overflow));
-        if (overflow) {
+        const std::optional<int64_t> coeff = small_value(n);
+        if (!coeff) {
             continue;
         }
-        if (coeff > Wt(0)) {
+        if (*coeff > 0) {
             auto y_lb = operator[](y).lb();
             if (y_lb.is_infinite()) {
                 if (unbounded_lbvar) {
                     return;
                 }
                 unbounded_lbvar = y;
-                unbounded_lbcoeff = coeff;
+                unbounded_lbcoeff = *coeff;
             } else {
-                Wt ymin(convert_NtoW(*(y_lb.number()), overflow));
-                if (overflow) {
+                const std::optional<int64_t> ymin = small_value(*y_lb.number());
+                if (!ymin) {
                     continue;
                 }
-                exp_ub -= ymin * coeff;
-                pos_terms.push_back({{coeff, y}, ymin});
+                const std::optional<int64_t> ub = add_product(exp_ub, *ymin, -*coeff);
+                if (!ub) {
+                    return;
+                }
+                exp_ub = *ub;
+                pos_terms.push_back({{*coeff, y}, *ymin});
             }
         } else {
+            if (*coeff == std::numeric_limits<int64_t>::min()) {
+                return;
+            }
             auto y_ub = operator[](y).ub();
             if (y_ub.is_infinite()) {
                 if (unbounded_ubvar) {
                     return;
                 }
                 unbounded_ubvar = y;
-                unbounded_ubcoeff = -coeff;
+                unbounded_ubcoeff = -*coeff;
             } else {
-                Wt ymax(convert_NtoW(*(y_ub.number()), overflow));
-                if (overflow) {
+                const std::optional<int64_t> ymax = small_value(*y_ub.number());
+                if (!ymax) {
                     continue;
                 }
-                exp_ub -= ymax * coeff;
-                neg_terms.push_back({{-coeff, y}, ymax});
+                const std::optional<int64_t> ub = add_product(exp_ub, *ymax, -*coeff);
+                if (!ub) {
+                    return;
+                }
+                exp_ub = *ub;
+                neg_terms.push_back({{-*coeff, y}, *ymax});
             }
         }
     }
 
+    // Each bound below is left out if it overflows.
+    int64_t k;
     if (unbounded_lbvar) {
         variable_t x(*unbounded_lbvar);
         if (unbounded_ubvar) {
-            if (unbounded_lbcoeff != Wt(1) || unbounded_ubcoeff != Wt(1)) {
+            if (unbounded_lbcoeff != 1 || unbounded_ubcoeff != 1) {
                 return;
             }
             variable_t y(*unbounded_ubvar);
             csts.push_back({{x, y}, exp_ub});
         } else {
-            if (unbounded_lbcoeff == Wt(1)) {
-                for (auto [nv, k] : neg_terms) {
-                    csts.push_back({{x, nv.second}, exp_ub - k});
+            if (unbounded_lbcoeff == 1) {
+                for (auto [nv, n] : neg_terms) {
+                    if (!__builtin_sub_overflow(exp_ub, n, &k)) {
+                        csts.push_back({{x, nv.second}, k});
+                    }
                 }
             }
             // Add bounds for x
@@ -245,34 +304,47 @@ void SplitDBM::diffcsts_of_lin_leq(const linear_expression_t& exp,
     } else {
         if (unbounded_ubvar) {
             variable_t y(*unbounded_ubvar);
-            if (unbounded_ubcoeff == Wt(1)) {
-                for (auto [nv, k] : pos_terms) {
-                    csts.push_back({{nv.second, y}, exp_ub + k});
+            if (unbounded_ubcoeff == 1) {
+                for (auto [nv, n] : pos_terms) {
+                    if (!__builtin_add_overflow(exp_ub, n, &k)) {
+                        csts.push_back({{nv.second, y}, k});
+                    }
                 }
             }
             // Add bounds for y
-            lbs.emplace_back(y, -exp_ub / unbounded_ubcoeff);
+            if (exp_ub != std::numeric_limits<int64_t>::min()) {
+                lbs.emplace_back(y, -exp_ub / unbounded_ubcoeff);
+            }
         } else {
             for (auto [neg_nv, neg_k] : neg_terms) {
                 for (auto [pos_nv, pos_k] : pos_terms) {
-                    csts.push_back({{pos_nv.second, neg_nv.second}, exp_ub - neg_k + pos_k});
+                    int64_t d;
+                    if (!__builtin_sub_overflow(exp_ub, neg_k, &d) && !__builtin_add_overflow(d, pos_k, &k)) {
+                        csts.push_back({{pos_nv.second, neg_nv.second}, k});
+                    }
                 }
             }
             for (auto [neg_nv, neg_k] : neg_terms) {
-                lbs.emplace_back(neg_nv.second, -exp_ub / neg_nv.first + neg_k);
+                if (exp_ub != std::numeric_limits<int64_t>::min() &&
+                    !__builtin_add_overflow(-exp_ub / neg_nv.first, neg_k, &k)) {
+                    lbs.emplace_back(neg_nv.second, k);
+                }
             }
             for (auto [pos_nv, pos_k] : pos_terms) {
-                ubs.emplace_back(pos_nv.second, exp_ub / pos_nv.first + pos_k);
+                if (!__builtin_add_overflow(exp_ub / pos_nv.first, pos_k, &k)) {
+                    ubs.emplace_back(pos_nv.second, k);
+                }
             }
         }
     }
 }
 
-bool SplitDBM::add_linear_leq(const linear_expression_t& exp) {
-    std::vector<std::pair<variable_t, Wt>> lbs, ubs;
-    std::vector<diffcst_t> csts;
+bool SplitDBM::add_linear_leq_edges(const linear_expression_t& exp) {
+    bound_vector_t lbs, ubs;
+    diffcst_vector_t csts;
     diffcsts_of_lin_leq(exp, csts, lbs, ubs);
 
+    graph_t& g = mutable_state().g;
     typename graph_t::mut_val_ref_t w;
     for (auto [var, n] : lbs) {
         CRAB_LOG("zones-split", std::cout << var << ">=" << n << "\n");
@@ -310,14 +382,15 @@ bool SplitDBM::add_linear_leq(const linear_expression_t& exp) {
         }
         close_over_edge(src, dest);
     }
-    // Collect bounds
-    // GKG: Now done in close_over_edge
+    return true;
+}
 
+void SplitDBM::close_bounds() {
+    graph_state_t& st = mutable_state();
     edge_vector delta;
-    GrOps::close_after_assign(g, potential, 0, delta);
-    GrOps::apply_delta(g, delta);
-    // CRAB_WARN("SplitDBM::add_linear_leq not yet implemented.");
-    return true;
+    CRAB_COUNT("SplitDBM.count.closure");
+    GrOps::close_after_assign(st.g, st.potential, 0, delta);
+    GrOps::apply_delta(st.g, delta);
 }
 
 void SplitDBM::add_univar_disequation(variable_t x, const number_t& n) {
@@ -328,6 +401,7 @@ void SplitDBM::add_univar_disequation(variable_t x, const number_t& n) {
         set_to_bottom();
     } else if (!new_i.is_top() && (new_i <= i)) {
         vert_id v = get_vert(x);
+        graph_t& g = mutable_state().g;
         typename graph_t::mut_val_ref_t w;
         if (new_i.lb().is_finite()) {
             // strenghten lb
@@ -382,57 +456,82 @@ void SplitDBM::add_univar_disequation(variable_t x, const number_t& n) {
     }
 }
 
-bool SplitDBM::operator<=(SplitDBM o) {
-    CrabStats::count("SplitDBM.count.leq");
-    ScopedCrabStats __st__("SplitDBM.leq");
+bool SplitDBM::operator<=(const SplitDBM& o) const {
+    CRAB_COUNT("SplitDBM.count.leq");
+    CRAB_OP_STOPWATCH("SplitDBM.leq");
 
     // cover all trivial cases to avoid allocating a dbm matrix
     if (is_bottom())
         return true;
     else if (o.is_bottom())
         return false;
-    else if (o.is_top())
+    else if (_state == o._state) {
+        // Copies that neither has modified since, as when a loop head is compared with what came back unchanged.
+        CRAB_COUNT("SplitDBM.count.leq.identical");
+        return true;
+    } else if (o.is_top())
         return true;
     else if (is_top())
         return false;
     else {
         normalize();
+        auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
+        graph_state_t& o_state = o.shared_state();
 
         // CRAB_LOG("zones-split", std::cout << "operator<=: "<< *this<< "<=?"<< o <<"\n");
 
-        if (vert_map.size() < o.vert_map.size())
+        if (vert_map.size() < o_state.vert_map.size())
             return false;
 
         typename graph_t::mut_val_ref_t wx;
         typename graph_t::mut_val_ref_t wy;
 
-        // Set up a mapping from o to this.
-        std::vector<unsigned int> vert_renaming(o.g.size(), -1);
+        // Set up a mapping from o to this, on demand: the bounds are compared first, and a loop that has not
+        // converged usually differs in one of them, so most rejections never rename the relational vertices.
+        constexpr unsigned int unmapped = -1;
+        std::vector<unsigned int> vert_renaming(o_state.g.size(), unmapped);
         vert_renaming[0] = 0;
-        for (auto [v, n] : o.vert_map) {
-            if (o.g.succs(n).size() == 0 && o.g.preds(n).size() == 0)
-                continue;
+        // The vertex of this for vertex n of o, if this has one; we can't have this <= o if we're missing some
+        // vertex.
+        auto rename = [&](vert_id n) {
+            if (vert_renaming[n] == unmapped) {
+                auto it = vert_map.find(*o_state.rev_map[n]);
+                if (it == vert_map.end())
+                    return false;
+                vert_renaming[n] = it->second;
+            }
+            return true;
+        };
 
-            auto it = vert_map.find(v);
-            // We can't have this <= o if we're missing some
-            // vertex.
-            if (it == vert_map.end())
+        assert(g.size() > 0);
+
+        // Compare the bounds first. They are the cheapest edges to check, and
+        // usually enough to tell the two apart before any relational edge is looked at.
+        for (auto edge : o_state.g.e_succs(0)) {
+            if (!rename(edge.vert) || !g.lookup(0, vert_renaming[edge.vert], &wy) || !(wy.get() <= edge.val))
                 return false;
-            vert_renaming[n] = it->second;
-            // vert_renaming[(*it).second] = p.second;
+        }
+        for (auto edge : o_state.g.e_preds(0)) {
+            if (!rename(edge.vert) || !g.lookup(vert_renaming[edge.vert], 0, &wx) || !(wx.get() <= edge.val))
+                return false;
+        }
+        for (auto [v, n] : o_state.vert_map) {
+            if (o_state.g.succs(n).size() != 0 || o_state.g.preds(n).size() != 0) {
+                if (!rename(n))
+                    return false;
+            }
         }
 
-        assert(g.size() > 0);
-        // GrPerm g_perm(vert_renaming, g);
-
-        for (vert_id ox : o.g.verts()) {
-            if (o.g.succs(ox).size() == 0)
+        for (vert_id ox : o_state.g.verts()) {
+            if (ox == 0 || o_state.g.succs(ox).size() == 0)
                 continue;
 
             assert(vert_renaming[ox] != (unsigned)-1);
             vert_id x = vert_renaming[ox];
-            for (auto edge : o.g.e_succs(ox)) {
+            for (auto edge : o_state.g.e_succs(ox)) {
                 vert_id oy = edge.vert;
+                if (oy == 0)
+                    continue;
                 assert(vert_renaming[oy] != (unsigned)-1);
                 vert_id y = vert_renaming[oy];
                 Wt ow = edge.val;
@@ -450,15 +549,46 @@ bool SplitDBM::operator<=(SplitDBM o) {
     }
 }
 
-SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
-    CrabStats::count("SplitDBM.count.join");
-    ScopedCrabStats __st__("SplitDBM.join");
+void SplitDBM::share_if_equal(const SplitDBM& o) {
+    if (_is_bottom || o._is_bottom || _state == o._state)
+        return;
+    graph_state_t& x = shared_state();
+    graph_state_t& y = o.shared_state();
+    // A graph keeps the vertices of the variables it forgot until it is copied into another; sharing a larger one
+    // would keep them, and every copy of it would too.
+    if (x.g.num_edges() != y.g.num_edges() || x.vert_map.size() != y.vert_map.size() || y.g.size() > x.g.size() ||
+        !x.unstable.none() || !y.unstable.none())
+        return;
+    CRAB_COUNT("SplitDBM.count.share_if_equal");
+    // The vertices of the variables may be numbered differently in the two graphs.
+    constexpr vert_id unmapped = std::numeric_limits<vert_id>::max();
+    std::vector<vert_id> to_y(x.g.size(), unmapped);
+    to_y[0] = 0;
+    for (auto xi = x.vert_map.begin(), yi = y.vert_map.begin(); xi != x.vert_map.end(); ++xi, ++yi) {
+        if (xi->first != yi->first)
+            return;
+        to_y[xi->second] = yi->second;
+    }
+    typename graph_t::mut_val_ref_t w;
+    for (vert_id s : x.g.verts()) {
+        for (auto e : x.g.e_succs(s)) {
+            if (to_y[s] == unmapped || to_y[e.vert] == unmapped || !y.g.lookup(to_y[s], to_y[e.vert], &w) ||
+                w.get() != e.val)
+                return;
+        }
+    }
+    CRAB_COUNT("SplitDBM.count.shared");
+    _state = o._state;
+}
+
+SplitDBM SplitDBM::operator|(const SplitDBM& o) & {
+    CRAB_COUNT("SplitDBM.count.join");
+    CRAB_OP_STOPWATCH("SplitDBM.join");
 
-    if (is_bottom() || _o.is_top())
-        return _o;
-    else if (is_top() || _o.is_bottom())
+    if (is_bottom() || o.is_top())
+        return o;
+    else if (is_top() || o.is_bottom() || _state == o._state)
         return *this;
-    SplitDBM o{_o};
     CRAB_LOG("zones-split", std::cout << "Before join:\n"
                                       << "DBM 1\n"
                                       << *this << "\n"
@@ -467,6 +597,8 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
 
     normalize();
     o.normalize();
+    auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
+    graph_state_t& o_state = o.shared_state();
 
     // Figure out the common renaming, initializing the
     // resulting potentials as we go.
@@ -474,8 +606,8 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     std::vector<vert_id> perm_y;
     std::vector<variable_t> perm_inv;
 
-    std::vector<Wt> pot_rx;
-    std::vector<Wt> pot_ry;
+    potential_t pot_rx;
+    potential_t pot_ry;
     vert_map_t out_vmap;
     rev_map_t out_revmap;
     // Add the zero vertex
@@ -487,16 +619,16 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     out_revmap.push_back(std::nullopt);
 
     for (auto [v, n] : vert_map) {
-        auto it = o.vert_map.find(v);
+        auto it = o_state.vert_map.find(v);
         // Variable exists in both
-        if (it != o.vert_map.end()) {
+        if (it != o_state.vert_map.end()) {
             out_vmap.insert(vmap_elt_t(v, perm_x.size()));
             out_revmap.push_back(v);
 
             pot_rx.push_back(potential[n] - potential[0]);
             // XXX JNL: check this out
-            // pot_ry.push_back(o.potential[p.second] - o.potential[0]);
-            pot_ry.push_back(o.potential[it->second] - o.potential[0]);
+            // pot_ry.push_back(o_state.potential[p.second] - o_state.potential[0]);
+            pot_ry.push_back(o_state.potential[it->second] - o_state.potential[0]);
             perm_inv.push_back(v);
             perm_x.push_back(n);
             perm_y.push_back(it->second);
@@ -507,8 +639,8 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     // Build the permuted view of x and y.
     assert(g.size() > 0);
     GrPerm gx(perm_x, g);
-    assert(o.g.size() > 0);
-    GrPerm gy(perm_y, o.g);
+    assert(o_state.g.size() > 0);
+    GrPerm gy(perm_y, o_state.g);
 
     // Compute the deferred relations
     graph_t g_ix_ry;
@@ -529,6 +661,7 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     graph_t g_rx(GrOps::meet(gx, g_ix_ry, is_closed));
     if (!is_closed) {
         SubGraph<graph_t> g_rx_excl(g_rx, 0);
+        CRAB_COUNT("SplitDBM.count.closure");
         GrOps::close_after_meet(g_rx_excl, pot_rx, gx, g_ix_ry, delta);
         GrOps::apply_delta(g_rx, delta);
     }
@@ -553,6 +686,7 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     if (!is_closed) {
 
         SubGraph<graph_t> g_ry_excl(g_ry, 0);
+        CRAB_COUNT("SplitDBM.count.closure");
         GrOps::close_after_meet(g_ry_excl, pot_ry, gy, g_rx_iy, delta);
         GrOps::apply_delta(g_ry, delta);
     }
@@ -568,9 +702,12 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     std::vector<vert_id> ub_up;
     std::vector<vert_id> ub_down;
 
+    // These relations are differences, which are not kept otherwise.
     typename graph_t::mut_val_ref_t wx;
     typename graph_t::mut_val_ref_t wy;
     for (vert_id v : gx_excl.verts()) {
+        if (_relations != relations_t::differences)
+            break;
         if (gx.lookup(0, v, &wx) && gy.lookup(0, v, &wy)) {
             if (wx.get() < wy.get())
                 ub_up.push_back(v);
@@ -630,9 +767,161 @@ SplitDBM SplitDBM::operator|(const SplitDBM& _o) & {
     return res;
 }
 
-SplitDBM SplitDBM::widen(SplitDBM o) {
-    CrabStats::count("SplitDBM.count.widening");
-    ScopedCrabStats __st__("SplitDBM.widening");
+SplitDBM SplitDBM::join_all(const std::vector<const SplitDBM*>& xs) {
+    // The states to join, without those that are bottom or share their graph with an earlier one.
+    std::vector<const SplitDBM*> states;
+    for (const SplitDBM* x : xs) {
+        if (x->is_bottom())
+            continue;
+        if (x->is_top())
+            return *x;
+        if (std::none_of(states.begin(), states.end(), [&](const SplitDBM* y) { return y->_state == x->_state; }))
+            states.push_back(x);
+    }
+    if (states.empty())
+        return bottom();
+    // Masks of states below are one bit per state.
+    if (states.size() <= 2 || states.size() > 64) {
+        SplitDBM res = *states[0];
+        for (size_t k = 1; k < states.size(); k++)
+            res |= *states[k];
+        return res;
+    }
+
+    CRAB_COUNT("SplitDBM.count.join");
+    CRAB_OP_STOPWATCH("SplitDBM.join");
+    const size_t n = states.size();
+    for (const SplitDBM* x : states)
+        x->normalize();
+
+    // The common renaming, and the potentials of each state in it.
+    std::vector<std::vector<vert_id>> perms(n, std::vector<vert_id>{0});
+    std::vector<potential_t> pots(n, potential_t{0});
+    vert_map_t out_vmap;
+    rev_map_t out_revmap{std::nullopt};
+    std::vector<vert_id> verts(n);
+    for (auto [v, first] : states[0]->shared_state().vert_map) {
+        verts[0] = first;
+        bool common = true;
+        for (size_t k = 1; k < n && common; k++) {
+            const vert_map_t& vert_map = states[k]->shared_state().vert_map;
+            auto it = vert_map.find(v);
+            common = it != vert_map.end();
+            if (common)
+                verts[k] = it->second;
+        }
+        if (!common)
+            continue;
+        out_vmap.insert(out_vmap.end(), vmap_elt_t(v, perms[0].size()));
+        out_revmap.push_back(v);
+        for (size_t k = 0; k < n; k++) {
+            const potential_t& potential = states[k]->shared_state().potential;
+            pots[k].push_back(potential[verts[k]] - potential[0]);
+            perms[k].push_back(verts[k]);
+        }
+    }
+    const vert_id sz = perms[0].size();
+    std::vector<GrPerm> gs;
+    gs.reserve(n);
+    for (size_t k = 0; k < n; k++)
+        gs.emplace_back(perms[k], states[k]->shared_state().g);
+
+    // The relations between variables that any of the states has.
+    std::vector<std::pair<vert_id, vert_id>> relations;
+    for (GrPerm& g : gs) {
+        SubGraph<GrPerm> g_excl(g, 0);
+        for (vert_id s : g_excl.verts()) {
+            for (vert_id d : g_excl.succs(s))
+                relations.emplace_back(s, d);
+        }
+    }
+    std::sort(relations.begin(), relations.end());
+    relations.erase(std::unique(relations.begin(), relations.end()), relations.end());
+
+    // Each state with the relations that its bounds imply among those, closed again; then their edge-wise maximum,
+    // which is closed too.
+    typename graph_t::mut_val_ref_t ws;
+    typename graph_t::mut_val_ref_t wd;
+    edge_vector delta;
+    graph_t join_g;
+    for (size_t k = 0; k < n; k++) {
+        graph_t deferred;
+        deferred.growTo(sz);
+        for (auto [s, d] : relations) {
+            if (gs[k].lookup(s, 0, &ws) && gs[k].lookup(0, d, &wd))
+                deferred.add_edge(s, ws.get() + wd.get(), d);
+        }
+        bool is_closed;
+        graph_t g(GrOps::meet(gs[k], deferred, is_closed));
+        if (!is_closed) {
+            SubGraph<graph_t> g_excl(g, 0);
+            CRAB_COUNT("SplitDBM.count.closure");
+            GrOps::close_after_meet(g_excl, pots[k], gs[k], deferred, delta);
+            GrOps::apply_delta(g, delta);
+        }
+        join_g = k == 0 ? std::move(g) : GrOps::join(join_g, g);
+    }
+
+    // Now reapply the relations between a lower bound of one state and an upper bound of another, which are
+    // differences that no state has on its own. Each bound is kept with the mask of the states that have the
+    // weakest one, if all of them have one, and is implied by the bounds of the join otherwise.
+    if (_relations == relations_t::differences) {
+        const uint64_t all = n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+        auto weakest = [&](vert_id s, vert_id d, uint64_t& mask) {
+            Wt max{};
+            mask = 0;
+            for (size_t k = 0; k < n; k++) {
+                if (!gs[k].lookup(s, d, &ws))
+                    return false;
+                if (mask == 0 || max < ws.get()) {
+                    max = ws.get();
+                    mask = 0;
+                }
+                if (ws.get() == max)
+                    mask |= uint64_t{1} << k;
+            }
+            return mask != all;
+        };
+        std::vector<std::pair<vert_id, uint64_t>> lbs;
+        std::vector<std::pair<vert_id, uint64_t>> ubs;
+        uint64_t mask;
+        for (vert_id v = 1; v < sz; v++) {
+            if (weakest(v, 0, mask))
+                lbs.emplace_back(v, mask);
+            if (weakest(0, v, mask))
+                ubs.emplace_back(v, mask);
+        }
+        for (auto [s, s_mask] : lbs) {
+            for (auto [d, d_mask] : ubs) {
+                if (s == d || (s_mask & d_mask) != 0)
+                    continue;
+                Wt w = gs[0].edge_val(s, 0) + gs[0].edge_val(0, d);
+                for (size_t k = 1; k < n; k++)
+                    w = std::max(w, gs[k].edge_val(s, 0) + gs[k].edge_val(0, d));
+                join_g.update_edge(s, w, d);
+            }
+        }
+    }
+
+    // Now garbage collect any unused vertices
+    for (vert_id v : join_g.verts()) {
+        if (v == 0)
+            continue;
+        if (join_g.succs(v).size() == 0 && join_g.preds(v).size() == 0) {
+            join_g.forget(v);
+            if (out_revmap[v]) {
+                out_vmap.erase(*(out_revmap[v]));
+                out_revmap[v] = std::nullopt;
+            }
+        }
+    }
+
+    return SplitDBM(std::move(out_vmap), std::move(out_revmap), std::move(join_g), std::move(pots[0]), vert_set_t());
+}
+
+SplitDBM SplitDBM::widen(const SplitDBM& o) const {
+    CRAB_COUNT("SplitDBM.count.widening");
+    CRAB_OP_STOPWATCH("SplitDBM.widening");
 
     if (is_bottom())
         return o;
@@ -645,13 +934,15 @@ SplitDBM SplitDBM::widen(SplitDBM o) {
                                           << "DBM 2\n"
                                           << o << "\n");
         o.normalize();
+        auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
+        graph_state_t& o_state = o.shared_state();
 
         // Figure out the common renaming
         std::vector<vert_id> perm_x;
         std::vector<vert_id> perm_y;
         vert_map_t out_vmap;
         rev_map_t out_revmap;
-        std::vector<Wt> widen_pot;
+        potential_t widen_pot;
         vert_set_t widen_unstable(unstable);
 
         assert(!potential.empty());
@@ -660,9 +951,9 @@ SplitDBM SplitDBM::widen(SplitDBM o) {
         perm_y.push_back(0);
         out_revmap.push_back(std::nullopt);
         for (auto [v, n] : vert_map) {
-            auto it = o.vert_map.find(v);
+            auto it = o_state.vert_map.find(v);
             // Variable exists in both
-            if (it != o.vert_map.end()) {
+            if (it != o_state.vert_map.end()) {
                 out_vmap.insert(vmap_elt_t(v, perm_x.size()));
                 out_revmap.push_back(v);
 
@@ -675,14 +966,17 @@ SplitDBM SplitDBM::widen(SplitDBM o) {
         // Build the permuted view of x and y.
         assert(g.size() > 0);
         GrPerm gx(perm_x, g);
-        assert(o.g.size() > 0);
-        GrPerm gy(perm_y, o.g);
+        assert(o_state.g.size() > 0);
+        GrPerm gy(perm_y, o_state.g);
 
         // Now perform the widening
         std::vector<vert_id> destabilized;
         graph_t widen_g(GrOps::widen(gx, gy, destabilized));
-        for (vert_id v : destabilized)
-            widen_unstable.insert(v);
+        for (vert_id v : destabilized) {
+            if (v >= widen_unstable.size())
+                widen_unstable.resize(v + 1);
+            widen_unstable.set(v);
+        }
 
         SplitDBM res(std::move(out_vmap), std::move(out_revmap), std::move(widen_g), std::move(widen_pot),
                      std::move(widen_unstable));
@@ -691,9 +985,44 @@ SplitDBM SplitDBM::widen(SplitDBM o) {
         return res;
     }
 }
-SplitDBM SplitDBM::operator&(SplitDBM o) {
-    CrabStats::count("SplitDBM.count.meet");
-    ScopedCrabStats __st__("SplitDBM.meet");
+SplitDBM SplitDBM::widening_thresholds(const SplitDBM& o, const iterators::thresholds_t& ts) const {
+    if (is_bottom() || o.is_bottom())
+        return widen(o);
+
+    o.normalize();
+    SplitDBM res = widen(o);
+
+    // Plain widening drops a bound that grew. Keep it at the next threshold instead; the new weight is larger than
+    // the old one, so the potential inherited from *this stays valid.
+    bool overflow;
+    auto& [vert_map, rev_map, g, potential, unstable] = res.mutable_state();
+    for (auto [v, vert] : vert_map) {
+        interval_t before = get_interval(v);
+        interval_t after = o.get_interval(v);
+        if (!g.elem(0, vert) && before.ub().is_finite() && after.ub().is_finite() && before.ub() < after.ub()) {
+            bound_t ub = ts.get_next(after.ub());
+            if (ub.is_finite()) {
+                Wt w = convert_NtoW(*ub.number(), overflow);
+                if (!overflow)
+                    g.set_edge(0, w, vert);
+            }
+        }
+        if (!g.elem(vert, 0) && before.lb().is_finite() && after.lb().is_finite() && after.lb() < before.lb()) {
+            bound_t lb = ts.get_prev(after.lb());
+            if (lb.is_finite()) {
+                Wt w = convert_NtoW(-*lb.number(), overflow);
+                if (!overflow)
+                    g.set_edge(vert, w, 0);
+            }
+        }
+    }
+    CRAB_LOG("zones-split", std::cout << "Result widening with thresholds:\n" << res << "\n");
+    return res;
+}
+
+SplitDBM SplitDBM::operator&(const SplitDBM& o) const {
+    CRAB_COUNT("SplitDBM.count.meet");
+    CRAB_OP_STOPWATCH("SplitDBM.meet");
 
     if (is_bottom() || o.is_bottom())
         return SplitDBM::bottom();
@@ -709,6 +1038,8 @@ SplitDBM SplitDBM::operator&(SplitDBM o) {
                                           << o << "\n");
         normalize();
         o.normalize();
+        auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
+        graph_state_t& o_state = o.shared_state();
 
         // We map vertices in the left operand onto a contiguous range.
         // This will often be the identity map, but there might be gaps.
@@ -717,7 +1048,7 @@ SplitDBM SplitDBM::operator&(SplitDBM o) {
 
         std::vector<vert_id> perm_x;
         std::vector<vert_id> perm_y;
-        std::vector<Wt> meet_pi;
+        potential_t meet_pi;
         perm_x.push_back(0);
         perm_y.push_back(0);
         meet_pi.emplace_back(0);
@@ -733,7 +1064,7 @@ SplitDBM SplitDBM::operator&(SplitDBM o) {
         }
 
         // Add missing mappings from the right operand.
-        for (auto [v, n] : o.vert_map) {
+        for (auto [v, n] : o_state.vert_map) {
             auto it = meet_verts.find(v);
 
             if (it == meet_verts.end()) {
@@ -742,7 +1073,7 @@ SplitDBM SplitDBM::operator&(SplitDBM o) {
 
                 perm_y.push_back(n);
                 perm_x.push_back(-1);
-                meet_pi.push_back(o.potential[n] - o.potential[0]);
+                meet_pi.push_back(o_state.potential[n] - o_state.potential[0]);
                 meet_verts.insert(vmap_elt_t(v, vv));
             } else {
                 perm_y[it->second] = n;
@@ -752,8 +1083,8 @@ SplitDBM SplitDBM::operator&(SplitDBM o) {
         // Build the permuted view of x and y.
         assert(g.size() > 0);
         GrPerm gx(perm_x, g);
-        assert(o.g.size() > 0);
-        GrPerm gy(perm_y, o.g);
+        assert(o_state.g.size() > 0);
+        GrPerm gy(perm_y, o_state.g);
 
         // Compute the syntactic meet of the permuted graphs.
         bool is_closed;
@@ -772,6 +1103,7 @@ SplitDBM SplitDBM::operator&(SplitDBM o) {
             SubGraph<graph_t> meet_g_excl(meet_g, 0);
             // GrOps::close_after_meet(meet_g_excl, meet_pi, gx, gy, delta);
 
+            CRAB_COUNT("SplitDBM.count.closure");
             GrOps::close_after_meet(meet_g_excl, meet_pi, gx, gy, delta);
 
             GrOps::apply_delta(meet_g, delta);
@@ -793,45 +1125,100 @@ void SplitDBM::operator-=(variable_t v) {
         return;
     normalize();
 
-    auto it = vert_map.find(v);
-    if (it != vert_map.end()) {
-        g.forget(it->second);
-        rev_map[it->second] = std::nullopt;
+    auto it = shared_state().vert_map.find(v);
+    if (it != shared_state().vert_map.end()) {
+        vert_id vert = it->second;
+        auto& [vert_map, rev_map, g, potential, unstable] = mutable_state();
+        g.forget(vert);
+        rev_map[vert] = std::nullopt;
         vert_map.erase(v);
     }
 }
 
-void SplitDBM::operator+=(const linear_constraint_t& cst) {
-    CrabStats::count("SplitDBM.count.add_constraints");
-    ScopedCrabStats __st__("SplitDBM.add_constraints");
+// Whether the edges of exp <= 0 do not depend on the current bounds of its variables.
+// diffcsts_of_lin_leq only consults the bounds to derive edges for general linear
+// inequalities; for unit difference and bound constraints, whatever it derives from
+// them is also found by closing the bounds afterwards.
+static bool is_difference_constraint(const linear_expression_t& exp) {
+    switch (exp.size()) {
+    case 1: {
+        const number_t& n = exp.begin()->second;
+        return n == 1 || n == -1;
+    }
+    case 2: {
+        const number_t& n1 = exp.begin()->second;
+        const number_t& n2 = std::next(exp.begin())->second;
+        return (n1 == 1 && n2 == -1) || (n1 == -1 && n2 == 1);
+    }
+    default: return false;
+    }
+}
+
+std::optional<bound_t> SplitDBM::difference_upper_bound(const linear_expression_t& e) {
+    if (!is_difference_constraint(e)) {
+        return {};
+    }
+    normalize();
+
+    // e is x - y + c, where either x or y may be missing.
+    std::optional<variable_t> x, y;
+    for (auto [v, n] : e) {
+        if (n == 1) {
+            x = v;
+        } else {
+            y = v;
+        }
+    }
+    auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
+    bound_t ub = (x ? get_interval(*x).ub() : bound_t(0)) - (y ? get_interval(*y).lb() : bound_t(0));
+    if (x && y) {
+        auto vx = vert_map.find(*x);
+        auto vy = vert_map.find(*y);
+        if (vx != vert_map.end() && vy != vert_map.end() && g.elem(vy->second, vx->second)) {
+            ub = bound_t::min(ub, bound_t(number_t(g.edge_val(vy->second, vx->second))));
+        }
+    }
+    return ub + bound_t(e.constant());
+}
 
+bool SplitDBM::add_constraint(const linear_constraint_t& cst, bool& bounds_pending) {
     // XXX: we do nothing with unsigned linear inequalities
     if (cst.is_inequality() && cst.is_unsigned()) {
         CRAB_WARN("unsigned inequality ", cst, " skipped by split_dbm domain");
-        return;
+        return true;
     }
 
-    if (is_bottom())
-        return;
-    normalize();
-
     if (cst.is_tautology())
-        return;
+        return true;
 
     // g.check_adjs();
 
     if (cst.is_contradiction()) {
         set_to_bottom();
-        return;
+        return false;
     }
 
+    // Edges are inserted right away, but closing the bounds is deferred while
+    // the constraints that follow do not need them.
+    auto add_leq = [&](const linear_expression_t& exp) {
+        if (bounds_pending && !is_difference_constraint(exp)) {
+            close_bounds();
+            bounds_pending = false;
+        }
+        if (!add_linear_leq_edges(exp)) {
+            return false;
+        }
+        bounds_pending = true;
+        return true;
+    };
+
     if (cst.is_inequality()) {
-        if (!add_linear_leq(cst.expression())) {
+        if (!add_leq(cst.expression())) {
             set_to_bottom();
+            return false;
         }
         //  g.check_adjs();
-        CRAB_LOG("zones-split", std::cout << "--- " << cst << "\n" << *this << "\n");
-        return;
+        return true;
     }
 
     if (cst.is_strict_inequality()) {
@@ -840,38 +1227,78 @@ void SplitDBM::operator+=(const linear_constraint_t& cst) {
         auto nc = linear_constraint_t(cst.expression() + 1, constraint_kind_t::INEQUALITY, cst.is_signed());
         if (nc.is_inequality()) {
             // here we succeed
-            if (!add_linear_leq(nc.expression())) {
+            if (!add_leq(nc.expression())) {
                 set_to_bottom();
+                return false;
             }
-            CRAB_LOG("zones-split", std::cout << "--- " << cst << "\n" << *this << "\n");
-            return;
+            return true;
         }
     }
 
     if (cst.is_equality()) {
         const linear_expression_t& exp = cst.expression();
-        if (!add_linear_leq(exp) || !add_linear_leq(-exp)) {
+        if (!add_leq(exp) || !add_leq(-exp)) {
             CRAB_LOG("zones-split", std::cout << " ~~> _|_"
                                               << "\n");
             set_to_bottom();
+            return false;
         }
         // g.check_adjs();
-        CRAB_LOG("zones-split", std::cout << "--- " << cst << "\n" << *this << "\n");
-        return;
+        return true;
     }
 
     if (cst.is_disequation()) {
+        // Disequations are refined against the current bounds.
+        if (bounds_pending) {
+            close_bounds();
+            bounds_pending = false;
+        }
         add_disequation(cst.expression());
-        return;
+        return !is_bottom();
     }
 
     CRAB_WARN("Unhandled constraint ", cst, " by split_dbm");
-    CRAB_LOG("zones-split", std::cout << "---" << cst << "\n" << *this << "\n");
+    return true;
+}
+
+void SplitDBM::operator+=(const linear_constraint_t& cst) {
+    CRAB_COUNT("SplitDBM.count.add_constraints");
+    CRAB_OP_STOPWATCH("SplitDBM.add_constraints");
+
+    if (is_bottom())
+        return;
+    normalize();
+
+    bool bounds_pending = false;
+    if (add_constraint(cst, bounds_pending) && bounds_pending) {
+        close_bounds();
+    }
+    CRAB_LOG("zones-split", std::cout << "--- " << cst << "\n" << *this << "\n");
+}
+
+void SplitDBM::add_constraints(const std::vector<linear_constraint_t>& csts) {
+    CRAB_COUNT("SplitDBM.count.add_constraints");
+    CRAB_OP_STOPWATCH("SplitDBM.add_constraints");
+
+    if (is_bottom())
+        return;
+    normalize();
+
+    bool bounds_pending = false;
+    for (const linear_constraint_t& cst : csts) {
+        if (!add_constraint(cst, bounds_pending)) {
+            return;
+        }
+    }
+    if (bounds_pending) {
+        close_bounds();
+    }
+    CRAB_LOG("zones-split", std::cout << "--- " << csts.size() << " constraints\n" << *this << "\n");
 }
 
 void SplitDBM::assign(variable_t x, const linear_expression_t& e) {
-    CrabStats::count("SplitDBM.count.assign");
-    ScopedCrabStats __st__("SplitDBM.assign");
+    CRAB_COUNT("SplitDBM.count.assign");
+    CRAB_OP_STOPWATCH("SplitDBM.assign");
 
     if (is_bottom()) {
         return;
@@ -924,6 +1351,7 @@ void SplitDBM::assign(variable_t x, const linear_expression_t& e) {
                 operator-=(x);
                 return;
             }
+            auto& [vert_map, rev_map, g, potential, unstable] = mutable_state();
             // Allocate a new vertex for x
             vert_id vert = g.new_vertex();
             assert(vert <= rev_map.size());
@@ -948,6 +1376,7 @@ void SplitDBM::assign(variable_t x, const linear_expression_t& e) {
             GrOps::apply_delta(g, delta);
             delta.clear();
             SubGraph<graph_t> g_excl(g, 0);
+            CRAB_COUNT("SplitDBM.count.closure");
             GrOps::close_after_assign(g_excl, potential, vert, delta);
             GrOps::apply_delta(g, delta);
 
@@ -972,8 +1401,8 @@ void SplitDBM::assign(variable_t x, const linear_expression_t& e) {
 }
 
 void SplitDBM::rename(const variable_vector_t& from, const variable_vector_t& to) {
-    CrabStats::count("SplitDBM.count.rename");
-    ScopedCrabStats __st__("SplitDBM.rename");
+    CRAB_COUNT("SplitDBM.count.rename");
+    CRAB_OP_STOPWATCH("SplitDBM.rename");
 
     if (is_top() || is_bottom())
         return;
@@ -989,25 +1418,36 @@ void SplitDBM::rename(const variable_vector_t& from, const variable_vector_t& to
                                      << v << ";";
              std::cout << "}:\n"; std::cout << *this << "\n";);
 
-    vert_map_t new_vert_map;
-    for (auto kv : vert_map) {
-        ptrdiff_t pos = std::distance(from.begin(), std::find(from.begin(), from.end(), kv.first));
-        if ((long unsigned)pos < from.size()) {
-            variable_t new_v(to[pos]);
-            new_vert_map.insert(vmap_elt_t(new_v, kv.second));
-            rev_map[kv.second] = new_v;
-        } else {
-            new_vert_map.insert(kv);
-        }
+    auto& [vert_map, rev_map, g, potential, unstable] = mutable_state();
+    // Rewrite the keys of the entries in place and sort them once, rather than inserting them one at a time in a new
+    // map. The entries are looked up before any key changes, while they are still sorted.
+    auto entries = vert_map.extract_sequence();
+    std::vector<std::pair<size_t, variable_t>> renamed;
+    for (size_t i = 0; i < from.size(); i++) {
+        auto it = std::lower_bound(entries.begin(), entries.end(), from[i],
+                                   [](const vmap_elt_t& e, variable_t v) { return e.first < v; });
+        if (it != entries.end() && it->first == from[i])
+            renamed.emplace_back(it - entries.begin(), to[i]);
+    }
+    // A variable listed twice takes its first new name.
+    for (auto it = renamed.rbegin(); it != renamed.rend(); ++it) {
+        entries[it->first].first = it->second;
+        rev_map[entries[it->first].second] = it->second;
     }
-    std::swap(vert_map, new_vert_map);
+    // Of entries given the same name, the one that came first in the map is kept.
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const vmap_elt_t& a, const vmap_elt_t& b) { return a.first < b.first; });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](const vmap_elt_t& a, const vmap_elt_t& b) { return a.first == b.first; }),
+                  entries.end());
+    vert_map.adopt_sequence(boost::container::ordered_unique_range, std::move(entries));
 
     CRAB_LOG("zones-split", std::cout << "RESULT=" << *this << "\n");
 }
 
-SplitDBM SplitDBM::narrow(SplitDBM o) {
-    CrabStats::count("SplitDBM.count.narrowing");
-    ScopedCrabStats __st__("SplitDBM.narrowing");
+SplitDBM SplitDBM::narrow(const SplitDBM& o) const {
+    CRAB_COUNT("SplitDBM.count.narrowing");
+    CRAB_OP_STOPWATCH("SplitDBM.narrowing");
 
     if (is_bottom() || o.is_bottom())
         return SplitDBM::bottom();
@@ -1030,19 +1470,91 @@ SplitDBM SplitDBM::narrow(SplitDBM o) {
     }
 }
 
-void SplitDBM::normalize() {
-    CrabStats::count("SplitDBM.count.normalize");
-    ScopedCrabStats __st__("SplitDBM.normalize");
+void SplitDBM::drop_relations() {
+    if (is_bottom())
+        return;
+    normalize();
+    graph_t& g = shared_state().g;
+    typename graph_t::mut_val_ref_t w;
+    // Whether the edge s - d <= k, between two variables, is among the kept relations.
+    auto is_kept = [&](vert_id s, vert_id d, Wt k) {
+        switch (_relations) {
+        case relations_t::none: return false;
+        // It is half of an equality if d - s <= -k.
+        case relations_t::equalities: return g.lookup(d, s, &w) && w.get() == -k;
+        case relations_t::differences: return true;
+        }
+        return true;
+    };
+
+    // Beyond the limit on related variables, the least connected ones lose their relations. Since the graph is
+    // closed, what the others derive through them is already among their own edges.
+    const unsigned int max_related = global_options.max_relational_variables;
+    std::vector<bool> unrelated;
+    if (max_related > 0) {
+        std::vector<size_t> degree(g.size());
+        for (vert_id s : g.verts()) {
+            if (s == 0)
+                continue;
+            for (auto e : g.e_succs(s)) {
+                if (e.vert != 0 && is_kept(s, e.vert, e.val)) {
+                    degree[s]++;
+                    degree[e.vert]++;
+                }
+            }
+        }
+        std::vector<vert_id> related;
+        for (vert_id v : g.verts()) {
+            if (degree[v] > 0)
+                related.push_back(v);
+        }
+        if (related.size() > max_related) {
+            CRAB_COUNT("SplitDBM.count.unrelate");
+            std::sort(related.begin(), related.end(), [&](vert_id x, vert_id y) {
+                return degree[x] != degree[y] ? degree[x] < degree[y] : x < y;
+            });
+            unrelated.resize(g.size());
+            for (size_t i = 0; i < related.size() - max_related; i++)
+                unrelated[related[i]] = true;
+        }
+    }
+
+    // Find the edges to drop before taking ownership of the state, which is often shared and has none.
+    std::vector<std::pair<vert_id, vert_id>> dropped;
+    for (vert_id s : g.verts()) {
+        if (s == 0)
+            continue;
+        for (auto e : g.e_succs(s)) {
+            if (e.vert == 0)
+                continue;
+            if (!is_kept(s, e.vert, e.val) || (!unrelated.empty() && (unrelated[s] || unrelated[e.vert])))
+                dropped.emplace_back(s, e.vert);
+        }
+    }
+    if (dropped.empty())
+        return;
+    CRAB_COUNT("SplitDBM.count.drop_relations");
+    graph_t& mutable_g = mutable_state().g;
+    for (auto [s, d] : dropped)
+        mutable_g.remove_edge(s, d);
+}
+
+void SplitDBM::normalize() const {
+    CRAB_COUNT("SplitDBM.count.normalize");
 
     // dbm_canonical(_dbm);
-    // Always maintained in normal form, except for widening
-    if (unstable.empty())
+    // Always maintained in normal form, except for widening. Most calls find the graph closed, and return before the
+    // stop watch starts.
+    if (shared_state().unstable.none())
         return;
+    CRAB_OP_STOPWATCH("SplitDBM.normalize");
 
+    auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
     edge_vector delta;
     // GrOps::close_after_widen(g, potential, vert_set_wrap_t(unstable), delta);
     // GKG: Check
     SubGraph<graph_t> g_excl(g, 0);
+    CRAB_COUNT("SplitDBM.count.closure");
     GrOps::close_after_widen(g_excl, potential, vert_set_wrap_t(unstable), delta);
     // Retrive variable bounds
     GrOps::close_after_assign(g, potential, 0, delta);
@@ -1053,8 +1565,8 @@ void SplitDBM::normalize() {
 }
 
 void SplitDBM::set(variable_t x, const interval_t& intv) {
-    CrabStats::count("SplitDBM.count.assign");
-    ScopedCrabStats __st__("SplitDBM.assign");
+    CRAB_COUNT("SplitDBM.count.assign");
+    CRAB_OP_STOPWATCH("SplitDBM.assign");
 
     if (is_bottom())
         return;
@@ -1071,6 +1583,7 @@ void SplitDBM::set(variable_t x, const interval_t& intv) {
     }
 
     vert_id v = get_vert(x);
+    auto& [vert_map, rev_map, g, potential, unstable] = mutable_state();
     bool overflow;
     if (intv.ub().is_finite()) {
         Wt ub = convert_NtoW(*(intv.ub().number()), overflow);
@@ -1091,8 +1604,8 @@ void SplitDBM::set(variable_t x, const interval_t& intv) {
 }
 
 void SplitDBM::apply(arith_binop_t op, variable_t x, variable_t y, variable_t z) {
-    CrabStats::count("SplitDBM.count.apply");
-    ScopedCrabStats __st__("SplitDBM.apply");
+    CRAB_COUNT("SplitDBM.count.apply");
+    CRAB_OP_STOPWATCH("SplitDBM.apply");
 
     if (is_bottom()) {
         return;
@@ -1114,8 +1627,8 @@ void SplitDBM::apply(arith_binop_t op, variable_t x, variable_t y, variable_t z)
 }
 
 void SplitDBM::apply(arith_binop_t op, variable_t x, variable_t y, const number_t& k) {
-    CrabStats::count("SplitDBM.count.apply");
-    ScopedCrabStats __st__("SplitDBM.apply");
+    CRAB_COUNT("SplitDBM.count.apply");
+    CRAB_OP_STOPWATCH("SplitDBM.apply");
 
     if (is_bottom()) {
         return;
@@ -1137,8 +1650,8 @@ void SplitDBM::apply(arith_binop_t op, variable_t x, variable_t y, const number_
 }
 
 void SplitDBM::apply(bitwise_binop_t op, variable_t x, variable_t y, variable_t z) {
-    CrabStats::count("SplitDBM.count.apply");
-    ScopedCrabStats __st__("SplitDBM.apply");
+    CRAB_COUNT("SplitDBM.count.apply");
+    CRAB_OP_STOPWATCH("SplitDBM.apply");
 
     // Convert to intervals and perform the operation
     normalize();
@@ -1160,8 +1673,8 @@ void SplitDBM::apply(bitwise_binop_t op, variable_t x, variable_t y, variable_t
 }
 
 void SplitDBM::apply(bitwise_binop_t op, variable_t x, variable_t y, const number_t& k) {
-    CrabStats::count("SplitDBM.count.apply");
-    ScopedCrabStats __st__("SplitDBM.apply");
+    CRAB_COUNT("SplitDBM.count.apply");
+    CRAB_OP_STOPWATCH("SplitDBM.apply");
 
     // Convert to intervals and perform the operation
     normalize();
@@ -1185,13 +1698,81 @@ void SplitDBM::forget(const variable_vector_t& variables) {
     if (is_bottom() || is_top()) {
         return;
     }
+    normalize();
+
+    // Free the vertices in the order of the variables, as removing them one at a time would, and only then drop
+    // their entries from vert_map, in one pass rather than one shift of the map per variable.
+    graph_state_t* st = nullptr;
+    for (variable_t v : variables) {
+        auto it = shared_state().vert_map.find(v);
+        if (it == shared_state().vert_map.end())
+            continue;
+        const vert_id vert = it->second;
+        if (!st)
+            st = &mutable_state();
+        st->g.forget(vert);
+        st->rev_map[vert] = std::nullopt;
+    }
+    if (!st)
+        return;
+    auto entries = st->vert_map.extract_sequence();
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&](const vmap_elt_t& e) { return !st->rev_map[e.second]; }),
+                  entries.end());
+    st->vert_map.adopt_sequence(boost::container::ordered_unique_range, std::move(entries));
+}
+
+SplitDBM::edges_t SplitDBM::edges() const {
+    normalize();
+    edges_t res;
+    if (is_bottom())
+        return res;
+    auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
+    // The index of each vertex in res.
+    std::vector<uint32_t> index(g.size());
+    for (auto [v, vert] : vert_map) {
+        res.vars.push_back(v);
+        index[vert] = res.vars.size();
+    }
+    for (vert_id s : g.verts()) {
+        for (auto e : g.e_succs(s))
+            res.edges.emplace_back(index[s], index[e.vert], (int64_t)(long)e.val);
+    }
+    return res;
+}
 
-    for (auto v : variables) {
-        auto it = vert_map.find(v);
-        if (it != vert_map.end()) {
-            operator-=(v);
+SplitDBM SplitDBM::from_edges(const edges_t& e) {
+    if (e.vars.empty())
+        return top();
+    vert_map_t vert_map;
+    rev_map_t rev_map{std::nullopt};
+    graph_t g;
+    g.growTo(e.vars.size() + 1);
+    for (size_t i = 0; i < e.vars.size(); i++) {
+        vert_map.emplace(e.vars[i], (vert_id)(i + 1));
+        rev_map.emplace_back(e.vars[i]);
+    }
+    for (auto [s, d, k] : e.edges) {
+        if (s > e.vars.size() || d > e.vars.size())
+            throw std::out_of_range("edge vertex");
+        g.add_edge(s, Wt(k), d);
+    }
+    // The distances from a source with an edge of weight 0 to every vertex are a potential. The graph without
+    // vertex 0 is closed, so a shortest path takes at most an edge on either side of vertex 0, and a few rounds of
+    // relaxation find them.
+    potential_t potential(e.vars.size() + 1, Wt(0));
+    for (size_t round = 0; round <= e.vars.size(); round++) {
+        bool changed = false;
+        for (auto [s, d, k] : e.edges) {
+            if (potential[s] + Wt(k) < potential[d]) {
+                potential[d] = potential[s] + Wt(k);
+                changed = true;
+            }
         }
+        if (!changed)
+            break;
     }
+    return SplitDBM(std::move(vert_map), std::move(rev_map), std::move(g), std::move(potential), vert_set_t());
 }
 
 void SplitDBM::write(std::ostream& o) {
@@ -1206,6 +1787,7 @@ void SplitDBM::write(std::ostream& o) {
         o << "{}";
         return;
     }
+    auto& [vert_map, rev_map, g, potential, unstable] = shared_state();
     // Intervals
     bool first = true;
     o << "{";
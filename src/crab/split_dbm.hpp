@@ -17,13 +17,20 @@
 
 #pragma once
 
+#include <memory>
 #include <optional>
+#include <tuple>
 #include <type_traits>
 #include <unordered_set>
+#include <vector>
 
 #include <boost/container/flat_map.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/dynamic_bitset.hpp>
 #include <utility>
 
+#include "config.hpp"
+#include "crab/arena.hpp"
 #include "crab/adapt_sgraph.hpp"
 #include "crab/thresholds.hpp"
 #include "crab/bignums.hpp"
@@ -81,7 +88,7 @@ inline safe_i64 convert_NtoW(const z_number& n, bool& overflow) {
         overflow = true;
         return 0;
     }
-    return safe_i64(n);
+    return safe_i64((long)n);
 }
 
 class SplitDBM final : public writeable {
@@ -95,43 +102,78 @@ class SplitDBM final : public writeable {
     using Wt = typename Params::Wt;
     using graph_t = typename Params::graph_t;
     using vert_id = typename graph_t::vert_id;
-    using vert_map_t = boost::container::flat_map<variable_t, vert_id>;
+    using vert_map_t = boost::container::flat_map<
+        variable_t, vert_id, std::less<variable_t>,
+        counting_allocator_t<std::pair<variable_t, vert_id>, memory_kind_t::vert_map>>;
     using vmap_elt_t = typename vert_map_t::value_type;
-    using rev_map_t = std::vector<std::optional<variable_t>>;
+    using rev_map_t =
+        std::vector<std::optional<variable_t>, counting_allocator_t<std::optional<variable_t>, memory_kind_t::vert_map>>;
+    using potential_t = std::vector<Wt, counting_allocator_t<Wt, memory_kind_t::potential>>;
     using GrOps = GraphOps<graph_t>;
     using GrPerm = GraphPerm<graph_t>;
     using edge_vector = typename GrOps::edge_vector;
     // < <x, y>, k> == x - y <= k.
     using diffcst_t = std::pair<std::pair<variable_t, variable_t>, Wt>;
-    using vert_set_t = std::unordered_set<vert_id>;
+    // The difference constraints and bounds of one linear inequality, inline for the few variables it usually has.
+    using diffcst_vector_t = boost::container::small_vector<diffcst_t, 4>;
+    using bound_vector_t = boost::container::small_vector<std::pair<variable_t, Wt>, 3>;
+    // A set of vertices, as one bit per vertex id up to the largest in the set.
+    using vert_set_t = boost::dynamic_bitset<uint64_t, counting_allocator_t<uint64_t, memory_kind_t::graph>>;
 
   private:
     //================
     // Domain data
     //================
     // GKG: ranges are now maintained in the graph
-    vert_map_t vert_map; // Mapping from variables to vertices
-    rev_map_t rev_map;
-    graph_t g;                 // The underlying relation graph
-    std::vector<Wt> potential; // Stored potential for the vertex
-    vert_set_t unstable;
+    struct graph_state_t {
+        vert_map_t vert_map; // Mapping from variables to vertices
+        rev_map_t rev_map;
+        graph_t g;                 // The underlying relation graph
+        potential_t potential; // Stored potential for the vertex
+        // The vertices whose edges widening changed, until normalize() closes the graph again; empty otherwise.
+        vert_set_t unstable;
+    };
+    // Copies of a SplitDBM share their graph state until one of them is modified.
+    std::shared_ptr<graph_state_t> _state;
     bool _is_bottom;
 
+    // The state of a fresh top or bottom value, shared by all of them.
+    static const std::shared_ptr<graph_state_t>& empty_state();
+
+    // The relations kept by the values of the calling thread.
+    static thread_local relations_t _relations;
+
+    // Remove the edges between variables that restrict_relations() does not keep.
+    void drop_relations();
+
+    // Read access to a possibly shared state. Nothing may be modified through it; it is not const only because
+    // AdaptGraph's accessors are not const-qualified.
+    graph_state_t& shared_state() const { return *_state; }
+
+    // Take exclusive ownership of the state before modifying it.
+    graph_state_t& mutable_state() {
+        if (_state.use_count() > 1) {
+            CRAB_COUNT("SplitDBM.count.unshare");
+            _state = std::make_shared<graph_state_t>(*_state);
+        }
+        return *_state;
+    }
+
     vert_id get_vert(variable_t v);
 
     class vert_set_wrap_t {
       public:
         explicit vert_set_wrap_t(const vert_set_t& _vs) : vs(_vs) {}
 
-        bool operator[](vert_id v) const { return vs.find(v) != vs.end(); }
+        bool operator[](vert_id v) const { return v < vs.size() && vs.test(v); }
         const vert_set_t& vs;
     };
 
     // Evaluate the potential value of a variable.
-    Wt pot_value(variable_t v) {
-        auto it = vert_map.find(v);
-        if (it != vert_map.end())
-            return potential[(*it).second];
+    Wt pot_value(variable_t v) const {
+        auto it = shared_state().vert_map.find(v);
+        if (it != shared_state().vert_map.end())
+            return shared_state().potential[(*it).second];
         return ((Wt)0);
     }
 
@@ -147,7 +189,7 @@ class SplitDBM final : public writeable {
             if (overflow) {
                 return Wt(0);
             }
-            res += (pot_value(n) - potential[0]) * coef;
+            res += (pot_value(n) - shared_state().potential[0]) * coef;
         }
         return res;
     }
@@ -196,13 +238,22 @@ class SplitDBM final : public writeable {
      **/
     void diffcsts_of_lin_leq(const linear_expression_t& exp,
                              /* difference contraints */
-                             std::vector<diffcst_t>& csts,
+                             diffcst_vector_t& csts,
                              /* x >= lb for each {x,lb} in lbs */
-                             std::vector<std::pair<variable_t, Wt>>& lbs,
+                             bound_vector_t& lbs,
                              /* x <= ub for each {x,ub} in ubs */
-                             std::vector<std::pair<variable_t, Wt>>& ubs);
+                             bound_vector_t& ubs);
+
+    // Inserts the edges of exp <= 0, keeping the potential feasible and the
+    // graph without vertex 0 closed, but leaving the bounds to close_bounds.
+    bool add_linear_leq_edges(const linear_expression_t& exp);
+
+    // Restore closure of the edges to and from vertex 0.
+    void close_bounds();
 
-    bool add_linear_leq(const linear_expression_t& exp);
+    // Adds cst, possibly leaving the bounds unclosed, in which case bounds_pending is set.
+    // Returns false if the constraint made the domain bottom.
+    bool add_constraint(const linear_constraint_t& cst, bool& bounds_pending);
 
     // x != n
     void add_univar_disequation(variable_t x, const number_t& n);
@@ -217,45 +268,48 @@ class SplitDBM final : public writeable {
         }
     }
 
-    interval_t get_interval(variable_t x) { return get_interval(vert_map, g, x); }
+    interval_t get_interval(variable_t x) const { return get_interval(shared_state().vert_map, shared_state().g, x); }
 
     static interval_t get_interval(vert_map_t& m, graph_t& r, variable_t x) {
         auto it = m.find(x);
         if (it == m.end()) {
             return interval_t::top();
         }
+        // The bounds are the edges to and from vertex 0, whose weights are stored
+        // contiguously by the graph: a single lookup each.
         vert_id v = (*it).second;
-        interval_t x_out = interval_t(r.elem(v, 0) ? -number_t(r.edge_val(v, 0)) : bound_t::minus_infinity(),
-                                      r.elem(0, v) ? number_t(r.edge_val(0, v)) : bound_t::plus_infinity());
-        return x_out;
+        typename graph_t::mut_val_ref_t w;
+        bound_t lb = r.lookup(v, 0, &w) ? bound_t(-number_t(w.get())) : bound_t::minus_infinity();
+        bound_t ub = r.lookup(0, v, &w) ? bound_t(number_t(w.get())) : bound_t::plus_infinity();
+        return interval_t(lb, ub);
     }
 
     // Resore potential after an edge addition
-    bool repair_potential(vert_id src, vert_id dest) { return GrOps::repair_potential(g, potential, src, dest); }
+    bool repair_potential(vert_id src, vert_id dest) {
+        graph_state_t& st = mutable_state();
+        return GrOps::repair_potential(st.g, st.potential, src, dest);
+    }
 
     // Restore closure after a single edge addition
     void close_over_edge(vert_id ii, vert_id jj);
 
   public:
-    explicit SplitDBM(bool is_bottom = false) : _is_bottom(is_bottom) {
-        g.growTo(1); // Allocate the zero vector
-        potential.emplace_back(0);
-        rev_map.push_back(std::nullopt);
-    }
+    explicit SplitDBM(bool is_bottom = false) : _state(empty_state()), _is_bottom(is_bottom) {}
 
     // FIXME: Rewrite to avoid copying if o is _|_
-    SplitDBM(vert_map_t&& _vert_map, rev_map_t&& _rev_map, graph_t&& _g, std::vector<Wt>&& _potential,
+    SplitDBM(vert_map_t&& _vert_map, rev_map_t&& _rev_map, graph_t&& _g, potential_t&& _potential,
              vert_set_t&& _unstable)
-        : vert_map(std::move(_vert_map)), rev_map(std::move(_rev_map)), g(std::move(_g)),
-          potential(std::move(_potential)), unstable(std::move(_unstable)), _is_bottom(false) {
+        : _state(std::make_shared<graph_state_t>(graph_state_t{std::move(_vert_map), std::move(_rev_map), std::move(_g),
+                                                               std::move(_potential), std::move(_unstable)})),
+          _is_bottom(false) {
 
-        CrabStats::count("SplitDBM.count.copy");
-        ScopedCrabStats __st__("SplitDBM.copy");
+        CRAB_COUNT("SplitDBM.count.copy");
+        CRAB_OP_STOPWATCH("SplitDBM.copy");
 
         CRAB_LOG("zones-split-size", auto p = size();
                  std::cout << "#nodes = " << p.first << " #edges=" << p.second << "\n";);
 
-        assert(g.size() > 0);
+        assert(shared_state().g.size() > 0);
     }
 
     SplitDBM(const SplitDBM& o) = default;
@@ -283,10 +337,15 @@ class SplitDBM final : public writeable {
     bool is_top() const {
         if (_is_bottom)
             return false;
-        return g.is_empty();
+        return shared_state().g.is_empty();
     }
 
-    bool operator<=(SplitDBM o);
+    bool operator<=(const SplitDBM& o) const;
+
+    // Share the graph of o if this one has the same variables and edges, whatever the numbering of their vertices, as
+    // the input that a join gave back has; the two then take the memory of one, and compare and join in constant
+    // time. Nothing is closed, so graphs left open by a widening are not shared.
+    void share_if_equal(const SplitDBM& o);
 
     // FIXME: can be done more efficient
     void operator|=(const SplitDBM& o) { *this = *this | o; }
@@ -305,18 +364,24 @@ class SplitDBM final : public writeable {
         return static_cast<SplitDBM&>(*this) | o;
     }
 
-    SplitDBM widen(SplitDBM o);
+    /** The join of all of xs, as folding them with | gives, but closing each of them once rather than once per
+     *  join. Each graph is closed with the relations that any of the others has, and the result is their edge-wise
+     *  maximum, with the relations implied by the bounds of different states added back.
+     */
+    static SplitDBM join_all(const std::vector<const SplitDBM*>& xs);
 
-    SplitDBM widening_thresholds(SplitDBM o, const iterators::thresholds_t& ts) {
-        // TODO: use thresholds
-        return ((*this).widen(std::move(o)));
-    }
+    SplitDBM widen(const SplitDBM& o) const;
 
-    SplitDBM operator&(SplitDBM o);
+    // Widening that keeps unstable variable bounds at the next threshold instead of dropping them.
+    SplitDBM widening_thresholds(const SplitDBM& o, const iterators::thresholds_t& ts) const;
 
-    SplitDBM narrow(SplitDBM o);
+    SplitDBM operator&(const SplitDBM& o) const;
 
-    void normalize();
+    SplitDBM narrow(const SplitDBM& o) const;
+
+    // Close the graph after a widening. The closure keeps the value the same, so it is done in place even on state
+    // shared with other copies, which all benefit from it, and the binary operators need not copy their operands.
+    void normalize() const;
 
     void operator-=(variable_t v);
 
@@ -339,6 +404,10 @@ class SplitDBM final : public writeable {
 
     void operator+=(const linear_constraint_t& cst);
 
+    // Adds all of csts, as repeated += would, but closing the bounds only once for
+    // consecutive constraints whose edges do not depend on them.
+    void add_constraints(const std::vector<linear_constraint_t>& csts);
+
     interval_t eval_interval(const linear_expression_t& e) {
         interval_t r{e.constant()};
         for (auto [v, n] : e)
@@ -347,13 +416,13 @@ class SplitDBM final : public writeable {
     }
 
     interval_t operator[](variable_t x) {
-        CrabStats::count("SplitDBM.count.to_intervals");
-        ScopedCrabStats __st__("SplitDBM.to_intervals");
+        CRAB_COUNT("SplitDBM.count.to_intervals");
+        CRAB_OP_STOPWATCH("SplitDBM.to_intervals");
 
         if (is_bottom()) {
             return interval_t::bottom();
         } else {
-            return get_interval(vert_map, g, x);
+            return get_interval(x);
         }
     }
 
@@ -363,24 +432,101 @@ class SplitDBM final : public writeable {
 
     void rename(const variable_vector_t& from, const variable_vector_t& to);
 
+    // Set the relations kept by the values of the calling thread, returning the previous ones; see
+    // analysis_context_t::scope_t. Values are only restricted to them by restrict_relations() and joins.
+    static relations_t relations() { return _relations; }
+    static relations_t set_relations(relations_t relations) {
+        relations_t previous = _relations;
+        _relations = relations;
+        return previous;
+    }
+
+    // Whether restrict_relations() keeps every relation, as it does by default.
+    static bool keeps_all_relations() {
+        return _relations == relations_t::differences && global_options.max_relational_variables == 0;
+    }
+
+    // Forget the relations between variables other than the kept ones, and those of the least connected variables
+    // beyond global_options.max_relational_variables, after closing the graph so that their consequences on bounds
+    // are kept.
+    void restrict_relations() {
+        if (!keeps_all_relations())
+            drop_relations();
+    }
+
     // -- begin array_sgraph_domain_helper_traits
 
     // -- end array_sgraph_domain_helper_traits
 
+    // A value as a sparse list of edges, for serialization. Vertex 0 stands for zero and vertex i > 0 for vars[i - 1];
+    // an edge (s, d, k) means d - s <= k.
+    struct edges_t {
+        std::vector<variable_t> vars;
+        std::vector<std::tuple<uint32_t, uint32_t, int64_t>> edges;
+    };
+
+    // The edges of the closed graph, over its variables by increasing index. Not meaningful for bottom.
+    edges_t edges() const;
+
+    // The value of the closed graph e, as returned by edges(). It is not closed again; only a potential is computed.
+    static SplitDBM from_edges(const edges_t& e);
+
     // Output function
     void write(std::ostream& o) override;
 
+    // Copies share the state, so writing a const value through one costs nothing.
+    friend std::ostream& operator<<(std::ostream& o, const SplitDBM& dom) {
+        SplitDBM copy(dom);
+        copy.write(o);
+        return o;
+    }
+
     // return number of vertices and edges
-    std::pair<std::size_t, std::size_t> size() const { return {g.size(), g.num_edges()}; }
+    std::pair<std::size_t, std::size_t> size() const {
+        return {shared_state().g.size(), shared_state().g.num_edges()};
+    }
+
+    // The bytes held by the graph, its potentials and vertex maps, unless they are in counted, shared with a value
+    // counted before; they are then added to it.
+    std::size_t memory_bytes(std::unordered_set<const void*>& counted) const {
+        const graph_state_t& st = shared_state();
+        if (!counted.insert(&st).second)
+            return 0;
+        return sizeof(graph_state_t) + st.g.memory_bytes() + sizeof(Wt) * st.potential.capacity() +
+               sizeof(vmap_elt_t) * st.vert_map.capacity() + sizeof(std::optional<variable_t>) * st.rev_map.capacity() +
+               sizeof(uint64_t) * st.unstable.num_blocks();
+    }
 
   private:
+    // The least upper bound of e in the closed graph, when e is a unit difference
+    // or bound (see is_difference_constraint). Adding e <= k for any k below it,
+    // or its negation for any k above, is exactly what would make the graph
+    // infeasible, so this decides entailment without copying the domain.
+    std::optional<bound_t> difference_upper_bound(const linear_expression_t& e);
+
     bool entail_aux(const linear_constraint_t& cst) {
+        if (cst.is_inequality() && cst.is_signed()) {
+            if (auto ub = difference_upper_bound(cst.expression())) {
+                return *ub <= 0;
+            }
+        }
         SplitDBM dom(*this); // copy is necessary
         dom += cst.negate();
         return dom.is_bottom();
     }
 
     bool intersect_aux(const linear_constraint_t& cst) {
+        if (cst.is_inequality() && cst.is_signed()) {
+            if (auto ub = difference_upper_bound(-cst.expression())) {
+                return *ub >= 0;
+            }
+        } else if (cst.is_equality()) {
+            auto ub = difference_upper_bound(cst.expression());
+            auto neg_ub = difference_upper_bound(-cst.expression());
+            if (ub && neg_ub) {
+                return *ub >= 0 && *neg_ub >= 0;
+            }
+        }
         SplitDBM dom(*this); // copy is necessary
         dom += cst;
         return !dom.is_bottom();
@@ -402,6 +548,11 @@ class SplitDBM final : public writeable {
             return false;
         if (is_top() || cst.is_tautology())
             return true;
+        if (cst.is_strict_inequality()) {
+            // e < 0 --> e <= -1
+            return intersect_aux(
+                linear_constraint_t(cst.expression() + 1, linear_constraint_t::INEQUALITY, cst.is_signed()));
+        }
         return intersect_aux(cst);
     }
 
@@ -419,6 +570,10 @@ class SplitDBM final : public writeable {
             // negated we do not have disequalities.
             return entail_aux(linear_constraint_t(rhs.expression(), linear_constraint_t::INEQUALITY)) &&
                    entail_aux(linear_constraint_t(rhs.expression() * number_t(-1), linear_constraint_t::INEQUALITY));
+        } else if (rhs.is_strict_inequality()) {
+            // e < 0 --> e <= -1
+            return entail_aux(
+                linear_constraint_t(rhs.expression() + 1, linear_constraint_t::INEQUALITY, rhs.is_signed()));
         } else {
             return entail_aux(rhs);
         }
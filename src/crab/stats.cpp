@@ -1,20 +1,22 @@
 #include "crab/stats.hpp"
 
-#include <sys/resource.h>
-#include <sys/time.h>
+#include <ctime>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
 namespace crab {
 
-std::map<std::string, unsigned> CrabStats::counters;
-std::map<std::string, Stopwatch> CrabStats::sw;
-
-long Stopwatch::systemTime() const {
-    struct rusage ru;
-    getrusage(RUSAGE_SELF, &ru);
-    long r = ru.ru_utime.tv_sec * 1000000L + ru.ru_utime.tv_usec;
-    return r;
+// Unlike the user time of getrusage, which is sampled at clock ticks, this is precise enough to time the short phases
+// of a verification.
+long thread_cpu_time_us() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
 }
 
+long Stopwatch::systemTime() const { return thread_cpu_time_us(); }
+
 Stopwatch::Stopwatch() { start(); }
 
 void Stopwatch::start() {
@@ -62,49 +64,159 @@ void Stopwatch::Print(std::ostream& out) const {
     out << s << "s";
 }
 
+namespace {
+// The names of the registered statistics, and the totals of the threads that have exited.
+struct registry_t {
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::array<unsigned long, CrabStats::max_ids> counters{};
+    std::array<long, CrabStats::max_ids> elapsed{};
+};
+
+registry_t& registry() {
+    static registry_t r;
+    return r;
+}
+} // namespace
+
+thread_local CrabStats::thread_stats_t CrabStats::local;
+
+CrabStats::thread_stats_t::~thread_stats_t() {
+    registry_t& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (id_t i = 0; i < max_ids; i++) {
+        r.counters[i] += counters[i];
+        r.elapsed[i] += stopwatches[i].elapsed;
+    }
+}
+
+CrabStats::id_t CrabStats::id(const std::string& name) {
+    registry_t& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (id_t i = 0; i < r.names.size(); i++) {
+        if (r.names[i] == name)
+            return i;
+    }
+    if (r.names.size() == max_ids)
+        throw std::length_error("too many statistics");
+    r.names.push_back(name);
+    return r.names.size() - 1;
+}
+
 void CrabStats::reset() {
-    counters.clear();
-    sw.clear();
+#if CRAB_STATS
+    local.counters.fill(0);
+    local.stopwatches.fill({});
+    local.hw_elapsed = {};
+    MemoryStats::reset();
+#endif
+}
+
+std::array<std::atomic<long>, memory_kinds> MemoryStats::live{};
+std::array<std::atomic<long>, memory_kinds> MemoryStats::peak{};
+
+void MemoryStats::reset() {
+    for (size_t i = 0; i < memory_kinds; i++)
+        peak[i].store(live[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
 }
 
-void CrabStats::count(const std::string& name) { ++counters[name]; }
-void CrabStats::count_max(const std::string& name, unsigned v) { counters[name] = std::max(counters[name], v); }
+const char* MemoryStats::name(memory_kind_t kind) {
+    static const char* const names[memory_kinds] = {"graph", "potential", "vert_map", "offset_map", "invariants",
+                                                     "scratch"};
+    return names[(size_t)kind];
+}
+
+std::atomic<CrabStats::id_t> CrabStats::hw_id{max_ids};
 
-unsigned CrabStats::uset(const std::string& n, unsigned v) { return counters[n] = v; }
-unsigned CrabStats::get(const std::string& n) { return counters[n]; }
+void CrabStats::start_hardware_events() {
+    if (!local.perf)
+        local.perf = std::make_unique<perf_counters_t>();
+    local.hw_started = local.perf->read();
+}
 
-void CrabStats::start(const std::string& name) { sw[name].start(); }
-void CrabStats::stop(const std::string& name) { sw[name].stop(); }
-void CrabStats::resume(const std::string& name) { sw[name].resume(); }
+void CrabStats::stop_hardware_events() {
+    const hw_counts_t now = local.perf->read();
+    for (size_t i = 0; i < hw_events; i++) {
+        if (now[i] && local.hw_started[i])
+            local.hw_elapsed[i] = local.hw_elapsed[i].value_or(0) + (*now[i] - *local.hw_started[i]);
+    }
+}
+
+void CrabStats::start(id_t id) {
+#if CRAB_STATS
+    local.stopwatches[id] = {thread_cpu_time_us(), 0, true};
+    if (id == hw_id.load(std::memory_order_relaxed)) {
+        local.hw_elapsed = {};
+        start_hardware_events();
+    }
+#endif
+}
+
+void CrabStats::stop(id_t id) {
+#if CRAB_STATS
+    stopwatch_t& sw = local.stopwatches[id];
+    if (sw.running) {
+        sw.elapsed += thread_cpu_time_us() - sw.started;
+        sw.running = false;
+        if (id == hw_id.load(std::memory_order_relaxed) && local.perf)
+            stop_hardware_events();
+    }
+#endif
+}
+
+void CrabStats::resume(id_t id) {
+#if CRAB_STATS
+    stopwatch_t& sw = local.stopwatches[id];
+    if (!sw.running) {
+        sw.started = thread_cpu_time_us();
+        sw.running = true;
+        if (id == hw_id.load(std::memory_order_relaxed))
+            start_hardware_events();
+    }
+#endif
+}
+
+void CrabStats::count_hardware_events(id_t id) { hw_id.store(id, std::memory_order_relaxed); }
+
+hw_counts_t CrabStats::hardware_events() { return local.hw_elapsed; }
+
+double CrabStats::seconds(id_t id) {
+    const stopwatch_t& sw = local.stopwatches[id];
+    long elapsed = sw.elapsed + (sw.running ? thread_cpu_time_us() - sw.started : 0);
+    return (double)elapsed / 1000000;
+}
+
+// Call f(name, count, seconds) with the totals of each registered statistic over the exited threads and this one.
+template <typename F>
+static void for_each_total(F f) {
+    registry_t& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (CrabStats::id_t i = 0; i < r.names.size(); i++) {
+        f(r.names[i], r.counters[i] + CrabStats::get(i), (double)r.elapsed[i] / 1000000 + CrabStats::seconds(i));
+    }
+}
 
 /** Outputs all statistics to std output */
 void CrabStats::Print(std::ostream& OS) {
     OS << "\n\n************** STATS ***************** \n";
-    for (auto& kv : counters)
-        OS << kv.first << ": " << kv.second << "\n";
-    for (auto& kv : sw)
-        OS << kv.first << ": " << kv.second << "\n";
+    for_each_total([&](const std::string& name, unsigned long count, double secs) {
+        if (count)
+            OS << name << ": " << count << "\n";
+        if (secs > 0)
+            OS << name << ": " << secs << "s\n";
+    });
     OS << "************** STATS END ***************** \n";
 }
 
 void CrabStats::PrintBrunch(std::ostream& OS) {
     OS << "\n\n************** BRUNCH STATS ***************** \n";
-    for (auto& kv : counters)
-        OS << "BRUNCH_STAT " << kv.first << " " << kv.second << "\n";
-    for (auto& kv : sw)
-        OS << "BRUNCH_STAT " << kv.first << " " << (kv.second).toSeconds() << "sec \n";
+    for_each_total([&](const std::string& name, unsigned long count, double secs) {
+        if (count)
+            OS << "BRUNCH_STAT " << name << " " << count << "\n";
+        if (secs > 0)
+            OS << "BRUNCH_STAT " << name << " " << secs << "sec \n";
+    });
     OS << "************** BRUNCH STATS END ***************** \n";
 }
 
-ScopedCrabStats::ScopedCrabStats(const std::string& name, bool reset) : m_name(name) {
-    if (reset) {
-        m_name += ".last";
-        CrabStats::start(m_name);
-    } else {
-        CrabStats::resume(m_name);
-    }
-}
-
-ScopedCrabStats::~ScopedCrabStats() { CrabStats::stop(m_name); }
-
 } // namespace crab
@@ -1,12 +1,44 @@
 #pragma once
 
-#include <map>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
 #include <string>
 
-#include "crab/types.hpp"
+#include "crab/perf_counters.hpp"
+
+// Set to 0 to compile out the collection of statistics (see the CRAB_STATS option of the build).
+#ifndef CRAB_STATS
+#define CRAB_STATS 1
+#endif
+
+// Set to 1 to also time each operation of the numerical domains. Reading the thread's CPU clock is a system call,
+// which costs as much as many of the operations it would measure, so it is off unless asked for.
+#ifndef CRAB_OP_TIMERS
+#define CRAB_OP_TIMERS 0
+#endif
 
 namespace crab {
 
+// CPU time consumed by the calling thread, in microseconds.
+long thread_cpu_time_us();
+
+// The wall time and the CPU time of the calling thread elapsed since construction. CPU time is unaffected by analyses
+// running concurrently on other threads; wall time compares with tools that only report it.
+class elapsed_time_t {
+    std::chrono::steady_clock::time_point wall_start{std::chrono::steady_clock::now()};
+    long cpu_start{thread_cpu_time_us()};
+
+  public:
+    double cpu_seconds() const { return (double)(thread_cpu_time_us() - cpu_start) / 1000000; }
+    double wall_seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    }
+};
+
 class Stopwatch {
     long started;
     long finished;
@@ -29,34 +61,185 @@ inline std::ostream& operator<<(std::ostream& OS, const Stopwatch& sw) {
     return OS;
 }
 
+/** Counters and stop watches of the analysis, each identified by a small integer that is registered once per name.
+ *
+ *  Every thread updates its own storage, without locking. get() and seconds() read the calling thread's, which
+ *  reset() clears. When a thread exits its storage is merged into the process totals, which Print() reports along
+ *  with the calling thread's.
+ *
+ *  One stop watch may also count the hardware events of the threads while it runs (see count_hardware_events()).
+ *
+ *  With CRAB_STATS set to 0 the updates compile to nothing and every statistic reads as 0.
+ */
 class CrabStats {
-    static std::map<std::string, unsigned> counters;
-    static std::map<std::string, Stopwatch> sw;
+  public:
+    using id_t = unsigned;
+    static constexpr id_t max_ids = 64;
+
+  private:
+    struct stopwatch_t {
+        long started;
+        long elapsed;
+        bool running;
+    };
+
+    struct thread_stats_t {
+        std::array<unsigned, max_ids> counters{};
+        std::array<stopwatch_t, max_ids> stopwatches{};
+        // Opened the first time the stop watch of count_hardware_events() starts on the thread.
+        std::unique_ptr<perf_counters_t> perf;
+        hw_counts_t hw_started{};
+        hw_counts_t hw_elapsed{};
+        ~thread_stats_t();
+    };
+
+    static thread_local thread_stats_t local;
+    // The stop watch that counts hardware events, max_ids for none.
+    static std::atomic<id_t> hw_id;
+
+    static void start_hardware_events();
+    static void stop_hardware_events();
 
   public:
+    // The id of the statistic called name, registering it on first use. Meant to be called once per call site;
+    // see CRAB_STAT_ID.
+    static id_t id(const std::string& name);
+
+    // Also starts the peaks of MemoryStats over.
     static void reset();
 
     /* counters */
-    static unsigned get(const std::string& n);
-    static unsigned uset(const std::string& n, unsigned v);
-    static void count(const std::string& name);
-    static void count_max(const std::string& name, unsigned v);
+    static void count(id_t id) {
+#if CRAB_STATS
+        ++local.counters[id];
+#endif
+    }
+    static void count_max(id_t id, unsigned v) {
+#if CRAB_STATS
+        if (local.counters[id] < v)
+            local.counters[id] = v;
+#endif
+    }
+    static unsigned get(id_t id) { return CRAB_STATS ? local.counters[id] : 0; }
 
     /* stop watch */
-    static void start(const std::string& name);
-    static void stop(const std::string& name);
-    static void resume(const std::string& name);
+    static void start(id_t id);
+    static void stop(id_t id);
+    static void resume(id_t id);
+    // Seconds measured by stop watch id.
+    static double seconds(id_t id);
+
+    // Count the hardware events of each thread while stop watch id runs, from the next time it starts. None is by
+    // default, as each start, stop and resume then reads the counters with a system call.
+    static void count_hardware_events(id_t id);
+    // The hardware events counted on the calling thread by the stop watch of count_hardware_events(), each none if it
+    // could not be counted.
+    static hw_counts_t hardware_events();
 
     /** Outputs all statistics to std output */
     static void Print(std::ostream& OS);
     static void PrintBrunch(std::ostream& OS);
 };
 
+// The structures of the analysis whose memory MemoryStats accounts for.
+enum class memory_kind_t : unsigned {
+    // The adjacency maps, weights and free lists of the zone graphs.
+    graph,
+    // The potentials of the zone graphs.
+    potential,
+    // The maps between variables and graph vertices.
+    vert_map,
+    // The cells of the stack.
+    offset_map,
+    // The states kept in the invariant tables.
+    invariants,
+    // The scratch space of the graph algorithms.
+    scratch,
+};
+constexpr size_t memory_kinds = 6;
+
+/** The bytes held by the main structures of the analysis, by kind, and the most held at once since the last reset().
+ *
+ *  Most kinds are counted as they are allocated and freed, by the containers of the structures (see
+ *  counting_allocator_t in arena.hpp) and the arenas they draw from. The counts are those of the whole process, since
+ *  a structure made on one thread may be freed on another. The states of the invariant tables share most of their storage with
+ *  each other and with the states being computed, so they are measured instead, once the fixpoint is done, each
+ *  shared graph being counted once.
+ *
+ *  With CRAB_STATS set to 0 nothing is counted and every peak reads as 0.
+ */
+class MemoryStats {
+    static std::array<std::atomic<long>, memory_kinds> live;
+    static std::array<std::atomic<long>, memory_kinds> peak;
+
+    static void raise_peak(size_t i, long bytes) {
+        long p = peak[i].load(std::memory_order_relaxed);
+        while (bytes > p && !peak[i].compare_exchange_weak(p, bytes, std::memory_order_relaxed)) {
+        }
+    }
+
+  public:
+    static void allocated(memory_kind_t kind, size_t bytes) {
+#if CRAB_STATS
+        const auto i = (size_t)kind;
+        raise_peak(i, live[i].fetch_add((long)bytes, std::memory_order_relaxed) + (long)bytes);
+#endif
+    }
+    static void freed(memory_kind_t kind, size_t bytes) {
+#if CRAB_STATS
+        live[(size_t)kind].fetch_sub((long)bytes, std::memory_order_relaxed);
+#endif
+    }
+    // Record that bytes of kind were measured to be held at once.
+    static void measured(memory_kind_t kind, size_t bytes) {
+#if CRAB_STATS
+        raise_peak((size_t)kind, (long)bytes);
+#endif
+    }
+
+    // Start the peaks over from the bytes held now.
+    static void reset();
+    static long peak_kb(memory_kind_t kind) { return peak[(size_t)kind].load(std::memory_order_relaxed) / 1024; }
+    // The name of kind in the columns of --phase-stats, such as "graph".
+    static const char* name(memory_kind_t kind);
+};
+
+// Measures its scope with stop watch id, in addition to the time it measured before.
 class ScopedCrabStats {
-    std::string m_name;
+    CrabStats::id_t m_id;
 
   public:
-    explicit ScopedCrabStats(const std::string& name, bool reset = false);
-    ~ScopedCrabStats();
+    explicit ScopedCrabStats(CrabStats::id_t id) : m_id(id) { CrabStats::resume(id); }
+    ~ScopedCrabStats() { CrabStats::stop(m_id); }
+    ScopedCrabStats(const ScopedCrabStats&) = delete;
+    ScopedCrabStats& operator=(const ScopedCrabStats&) = delete;
 };
 } // namespace crab
+
+#define CRAB_STATS_CONCAT_(a, b) a##b
+#define CRAB_STATS_CONCAT(a, b) CRAB_STATS_CONCAT_(a, b)
+
+#if CRAB_STATS
+// The id of the statistic named by the string literal name, registered the first time the call site runs.
+#define CRAB_STAT_ID(name)                                                      \
+    ([] {                                                                       \
+        static const crab::CrabStats::id_t crab_stat_id = crab::CrabStats::id(name); \
+        return crab_stat_id;                                                    \
+    }())
+// Count one occurrence of the event name.
+#define CRAB_COUNT(name) crab::CrabStats::count(CRAB_STAT_ID(name))
+// Measure the rest of the enclosing scope with the stop watch name.
+#define CRAB_SCOPED_STOPWATCH(name) \
+    crab::ScopedCrabStats CRAB_STATS_CONCAT(crab_stopwatch_, __LINE__)(CRAB_STAT_ID(name))
+#else
+#define CRAB_STAT_ID(name) crab::CrabStats::id_t{}
+#define CRAB_COUNT(name) ((void)0)
+#define CRAB_SCOPED_STOPWATCH(name) ((void)0)
+#endif
+
+#if CRAB_STATS && CRAB_OP_TIMERS
+// Measure the rest of the enclosing domain operation with the stop watch name.
+#define CRAB_OP_STOPWATCH(name) CRAB_SCOPED_STOPWATCH(name)
+#else
+#define CRAB_OP_STOPWATCH(name) ((void)0)
+#endif
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <utility>
+
+#include "config.hpp"
+#include "crab/thread_pool.hpp"
+
+namespace crab {
+
+thread_pool_t::thread_pool_t(unsigned threads, std::function<void()> after_loop) : _after_loop(std::move(after_loop)) {
+    for (unsigned i = 1; i < threads; i++)
+        _workers.emplace_back([this] { worker(); });
+}
+
+thread_pool_t::~thread_pool_t() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _started.notify_all();
+    for (std::thread& w : _workers)
+        w.join();
+}
+
+unsigned thread_pool_t::threads_for(unsigned option) {
+    return option == 0 ? std::max(1u, std::thread::hardware_concurrency()) : option;
+}
+
+thread_pool_t& thread_pool_t::closure_pool() {
+    static thread_pool_t pool(threads_for(global_options.closure_threads));
+    return pool;
+}
+
+void thread_pool_t::work() {
+    for (size_t i = _next++; i < _tasks; i = _next++) {
+        try {
+            (*_task)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_error)
+                _error = std::current_exception();
+            _next = _tasks;
+        }
+    }
+}
+
+void thread_pool_t::worker() {
+    unsigned long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _started.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop)
+                return;
+            seen = _generation;
+        }
+        work();
+        if (_after_loop)
+            _after_loop();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_busy == 0)
+                _finished.notify_one();
+        }
+    }
+}
+
+void thread_pool_t::run(size_t tasks, const std::function<void(size_t)>& task) {
+    std::unique_lock<std::mutex> running(_running, std::try_to_lock);
+    if (!running || _workers.empty() || tasks < 2) {
+        for (size_t i = 0; i < tasks; i++)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _tasks = tasks;
+        _next = 0;
+        _error = nullptr;
+        _busy = _workers.size();
+        _generation++;
+    }
+    _started.notify_all();
+    work();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _finished.wait(lock, [&] { return _busy == 0; });
+        _task = nullptr;
+        std::swap(error, _error);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace crab
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace crab {
+
+/** A fixed set of threads that run the tasks of one parallel loop at a time, along with the thread that started it.
+ *
+ *  Tasks are handed out one at a time and in order from a shared counter, so a thread that is done with a cheap task
+ *  takes the next one rather than waiting on a partition fixed in advance; a task may thus wait for the tasks before
+ *  it without deadlocking the loop. The loop returns once every task is done; the first
+ *  exception thrown by a task is thrown again by run(), and the tasks not yet started are skipped.
+ *
+ *  run() may be called from any number of threads, but only one loop runs on the pool at a time: a call made while
+ *  the pool is busy runs its tasks on the calling thread alone. The workers keep their thread-local state, such as
+ *  the scratch space of the graph algorithms, from one loop to the next, unless the pool is given a function to free
+ *  it with after each loop.
+ */
+class thread_pool_t final {
+    std::vector<std::thread> _workers;
+
+    // Held by the thread whose loop is running.
+    std::mutex _running;
+
+    std::mutex _mutex;
+    std::condition_variable _started;
+    std::condition_variable _finished;
+    // Incremented for every loop, to wake the workers.
+    unsigned long _generation{};
+    // The workers still in the current loop.
+    size_t _busy{};
+    bool _stop{};
+    // Run by each worker once it is done with a loop.
+    const std::function<void()> _after_loop;
+
+    const std::function<void(size_t)>* _task{};
+    size_t _tasks{};
+    std::atomic<size_t> _next{};
+    std::exception_ptr _error;
+
+    void work();
+    void worker();
+
+  public:
+    // A pool running loops on the given number of threads, counting the caller.
+    explicit thread_pool_t(unsigned threads, std::function<void()> after_loop = {});
+    ~thread_pool_t();
+    thread_pool_t(const thread_pool_t&) = delete;
+    thread_pool_t& operator=(const thread_pool_t&) = delete;
+
+    // The pool of the closure operations, of global_options.closure_threads threads; created on first use.
+    static thread_pool_t& closure_pool();
+
+    // The number of threads meant by an option such as global_options.closure_threads, where 0 is one per core.
+    static unsigned threads_for(unsigned option);
+
+    // The number of threads running a loop, counting the caller.
+    [[nodiscard]] unsigned threads() const { return _workers.size() + 1; }
+
+    // Run task(i) for every i up to tasks (excluded), returning once all are done.
+    void run(size_t tasks, const std::function<void(size_t)>& task);
+};
+
+} // namespace crab
@@ -1,5 +1,8 @@
+#include <map>
+
 #include "crab/thresholds.hpp"
 #include "crab/cfg.hpp"
+#include "crab/ebpf_domain.hpp"
 
 namespace crab {
 
@@ -33,6 +36,16 @@ void thresholds_t::add(bound_t v1) {
     }
 }
 
+bound_t thresholds_t::get_next(const bound_t& v) const {
+    // m_thresholds always ends with +oo
+    return *std::lower_bound(m_thresholds.begin(), m_thresholds.end(), v);
+}
+
+bound_t thresholds_t::get_prev(const bound_t& v) const {
+    // m_thresholds always starts with -oo
+    return *std::prev(std::upper_bound(m_thresholds.begin(), m_thresholds.end(), v));
+}
+
 void thresholds_t::write(std::ostream& o) const {
     o << "{";
     for (typename std::vector<bound_t>::const_iterator it = m_thresholds.begin(), et = m_thresholds.end(); it != et;) {
@@ -46,14 +59,43 @@ void thresholds_t::write(std::ostream& o) const {
 }
 
 void wto_thresholds_t::get_thresholds(const basic_block_t& bb, thresholds_t& thresholds) const {
-
+    // Loop bounds show up as comparisons against constants, either immediate or moved to a register earlier in the
+    // block, by register. Comparisons of two registers are also those of packet pointers against the end of the
+    // packet, whose offsets the size of a packet bounds.
+    std::map<uint8_t, int64_t> constants;
+    for (const Instruction& ins : bb) {
+        if (const Bin* bin = std::get_if<Bin>(&ins)) {
+            const Imm* imm = std::get_if<Imm>(&bin->v);
+            if (bin->op == Bin::Op::MOV && imm && !bin->lddw) {
+                // As the domain moves it: 32 bits, sign-extended or zero-extended.
+                const int v = static_cast<int>(imm->v);
+                constants[bin->dst.v] = bin->is64 ? (int64_t)v : (int64_t)(uint32_t)v;
+            } else {
+                constants.erase(bin->dst.v);
+            }
+        } else if (const Assume* assume = std::get_if<Assume>(&ins)) {
+            const Condition& cond = assume->cond;
+            if (const Imm* imm = std::get_if<Imm>(&cond.right)) {
+                // The domain compares against the immediate sign-extended from 32 bits.
+                thresholds.add(bound_t(number_t((int64_t) static_cast<int>(imm->v))));
+                continue;
+            }
+            for (uint8_t r : {cond.left.v, std::get<Reg>(cond.right).v}) {
+                if (auto it = constants.find(r); it != constants.end())
+                    thresholds.add(bound_t(number_t(it->second)));
+            }
+            thresholds.add(bound_t(number_t(domains::MAX_PACKET_OFF)));
+        } else if (!std::holds_alternative<Assert>(ins)) {
+            constants.clear();
+        }
+    }
 }
 
 void wto_thresholds_t::visit(wto_vertex_t& vertex) {
     if (m_stack.empty())
         return;
 
-    label_t head = m_stack.back();
+    cfg_t::node_t head = m_stack.back();
     auto it = m_head_to_thresholds.find(head);
     if (it != m_head_to_thresholds.end()) {
         thresholds_t& thresholds = it->second;
@@ -37,6 +37,12 @@ class thresholds_t final {
 
     void add(bound_t v1);
 
+    // Return the smallest threshold that is not less than v.
+    bound_t get_next(const bound_t& v) const;
+
+    // Return the largest threshold that is not greater than v.
+    bound_t get_prev(const bound_t& v) const;
+
     void write(std::ostream& o) const;
 };
 
@@ -55,15 +61,17 @@ class wto_thresholds_t final : public wto_component_visitor_t {
     // maximum number of thresholds
     size_t m_max_size;
     // keep a set of thresholds per wto head
-    std::unordered_map<label_t, thresholds_t> m_head_to_thresholds;
+    std::unordered_map<cfg_t::node_t, thresholds_t> m_head_to_thresholds;
     // the top of the stack is the current wto head
-    std::vector<label_t> m_stack;
+    std::vector<cfg_t::node_t> m_stack;
 
     void get_thresholds(const basic_block_t& bb, thresholds_t& thresholds) const;
 
   public:
     wto_thresholds_t(cfg_t& cfg, size_t max_size) : m_cfg(cfg), m_max_size(max_size) {}
 
+    const std::unordered_map<cfg_t::node_t, thresholds_t>& get_thresholds_map() const { return m_head_to_thresholds; }
+
     void visit(wto_vertex_t& vertex) override;
 
     void visit(wto_cycle_t& cycle) override;
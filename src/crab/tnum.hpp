@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+#include "crab/interval.hpp"
+
+namespace crab {
+
+/** The bits of a 64-bit value that are known, as a tristate number: each bit is known to be 0, known to be 1, or
+ *  unknown.
+ *
+ *  A bit is unknown if it is set in mask; otherwise it is the bit of value. The unknown bits of value are 0. The
+ *  operations are those of the registers, on the two's complement pattern of their value, and hold for every value
+ *  of their operands: the result of an operation has every bit that it can be made of known, as far as a bit of it
+ *  does not depend on the unknown bits of its operands. A value between two bounds of the same sign has the bits
+ *  above their highest difference known, and known bits give bounds; see of() and to_interval().
+ */
+struct tnum_t {
+    uint64_t value{};
+    uint64_t mask{~0ULL};
+
+    static tnum_t top() { return {}; }
+    static tnum_t constant(uint64_t v) { return {v, 0}; }
+
+    // The values from lb to ub, as unsigned numbers.
+    static tnum_t range(uint64_t lb, uint64_t ub) {
+        const uint64_t chi = lb ^ ub;
+        if (chi == 0)
+            return constant(lb);
+        const int bits = 64 - __builtin_clzll(chi);
+        if (bits >= 64)
+            return top();
+        const uint64_t delta = (1ULL << bits) - 1;
+        return {lb & ~delta, delta};
+    }
+
+    // The values of the 64-bit signed numbers in i; unknown for bounds of different signs or out of range.
+    static tnum_t of(const interval_t& i) {
+        const std::optional<number_t> lb = i.lb().number();
+        const std::optional<number_t> ub = i.ub().number();
+        if (!lb || !ub || !lb->fits_slong() || !ub->fits_slong() || (*lb < 0) != (*ub < 0))
+            return top();
+        return range((uint64_t)(long)*lb, (uint64_t)(long)*ub);
+    }
+
+    bool is_top() const { return mask == ~0ULL; }
+    bool is_constant() const { return mask == 0; }
+
+    // The 64-bit signed numbers with these bits.
+    interval_t to_interval() const {
+        constexpr uint64_t sign = 1ULL << 63;
+        uint64_t lb = value, ub = value | mask;
+        if (mask & sign) {
+            lb |= sign;
+            ub &= ~sign;
+        }
+        return interval_t{number_t{(int64_t)lb}, number_t{(int64_t)ub}};
+    }
+
+    bool operator==(const tnum_t& o) const { return value == o.value && mask == o.mask; }
+    bool operator!=(const tnum_t& o) const { return !(*this == o); }
+
+    // Whether the values with these bits also have those of o.
+    bool operator<=(const tnum_t& o) const { return (mask & ~o.mask) == 0 && ((value ^ o.value) & ~o.mask) == 0; }
+
+    // The bits known to be the same in both.
+    tnum_t operator|(const tnum_t& o) const {
+        const uint64_t mu = mask | o.mask | (value ^ o.value);
+        return {value & ~mu, mu};
+    }
+
+    // The bits known in either; this if they contradict each other, which no value satisfies.
+    tnum_t meet(const tnum_t& o) const {
+        if ((value ^ o.value) & ~mask & ~o.mask)
+            return *this;
+        return {value | o.value, mask & o.mask};
+    }
+
+    tnum_t And(const tnum_t& o) const {
+        const uint64_t v = value & o.value;
+        return {v, (value | mask) & (o.value | o.mask) & ~v};
+    }
+
+    tnum_t Or(const tnum_t& o) const {
+        const uint64_t v = value | o.value;
+        return {v, (mask | o.mask) & ~v};
+    }
+
+    tnum_t Xor(const tnum_t& o) const {
+        const uint64_t mu = mask | o.mask;
+        return {(value ^ o.value) & ~mu, mu};
+    }
+
+    // The carries of the unknown bits may reach every bit above the lowest of them.
+    tnum_t add(const tnum_t& o) const {
+        const uint64_t sv = value + o.value;
+        const uint64_t chi = (sv + mask + o.mask) ^ sv;
+        const uint64_t mu = chi | mask | o.mask;
+        return {sv & ~mu, mu};
+    }
+
+    tnum_t sub(const tnum_t& o) const {
+        const uint64_t dv = value - o.value;
+        const uint64_t chi = (dv + mask) ^ (dv - o.mask);
+        const uint64_t mu = chi | mask | o.mask;
+        return {dv & ~mu, mu};
+    }
+
+    // Precondition for the shifts: k < 64.
+    tnum_t shl(unsigned k) const { return {value << k, mask << k}; }
+    tnum_t lshr(unsigned k) const { return {value >> k, mask >> k}; }
+    // The sign bit is copied into the bits shifted in, known or not.
+    tnum_t ashr(unsigned k) const { return {(uint64_t)((int64_t)value >> k), (uint64_t)((int64_t)mask >> k)}; }
+
+    // The low 32 bits, zero-extended, as the 32-bit operations leave their result.
+    tnum_t zext32() const { return {value & 0xFFFFFFFF, mask & 0xFFFFFFFF}; }
+    // The low 32 bits, sign-extended, for the arithmetic shift of a 32-bit operation.
+    tnum_t sext32() const { return {(uint64_t)(int64_t)(int32_t)value, (uint64_t)(int64_t)(int32_t)mask}; }
+
+    // Known bits as 0 or 1 and unknown ones as x, from the highest known one, as in 0x...x01.
+    friend std::ostream& operator<<(std::ostream& o, const tnum_t& t) {
+        if (t.is_top())
+            return o << "x";
+        int bit = 63;
+        while (bit > 0 && !((t.value | t.mask) >> bit & 1))
+            bit--;
+        o << "0b";
+        for (; bit >= 0; bit--)
+            o << ((t.mask >> bit & 1) ? 'x' : (t.value >> bit & 1) ? '1' : '0');
+        return o;
+    }
+};
+
+} // namespace crab
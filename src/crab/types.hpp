@@ -1,10 +1,15 @@
 #pragma once
 
+#include <deque>
 #include <iosfwd>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "crab/bignums.hpp"
@@ -34,14 +39,59 @@ inline std::ostream& operator<<(std::ostream& o, writeable& x) {
 enum class data_kind_t { types, values, offsets };
 std::ostream& operator<<(std::ostream& o, const data_kind_t& s);
 
+// Maps variable names to indices. Each analysis owns one (see analysis_context_t), so that
+// names created while analyzing one program do not accumulate across runs.
+// The threads of a parallel fixpoint share their analysis' factory, so it is locked.
+class variable_factory_t final {
+    // A deque keeps the names in place as it grows, so that name() may return a reference.
+    std::deque<std::string> names;
+    std::unordered_map<std::string, index_t> ids;
+    // Stack cells, keyed by (offset, size), so that looking one up needs no formatting.
+    std::unordered_map<uint64_t, index_t> cell_ids;
+    // The key of each cell, by its first variable.
+    std::unordered_map<index_t, uint64_t> cell_keys;
+    mutable std::mutex _mutex;
+
+    static thread_local variable_factory_t* _current;
+
+    index_t add(std::string name);
+    index_t make_locked(const std::string& name);
+
+  public:
+    // Starts with the predefined variables (registers, etc.), so these have the same index in every factory.
+    variable_factory_t();
+
+    index_t make(const std::string& name);
+    // The first of the variables of the stack cell [offset, offset + size), one per data kind, which follow each
+    // other in the same order as those of a register.
+    index_t make_cell(index_t offset, unsigned size);
+    // The offset and size of the stack cell that id is a variable of, and the first of its variables; none if id was
+    // not made by make_cell().
+    std::optional<std::tuple<index_t, unsigned, index_t>> cell_of(index_t id) const;
+    const std::string& name(index_t id) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return names.at(id);
+    }
+
+    // The factory in use by the calling thread: the one installed by set_current(),
+    // or a thread-local default one if none was installed.
+    static variable_factory_t& current();
+    // Install a factory for the calling thread, returning the previous one (nullptr for the default).
+    static variable_factory_t* set_current(variable_factory_t* factory);
+};
+
 // Container for typed variables used by the crab abstract domains
 // and linear_constraints.
 class variable_t final {
     index_t _id;
-    static std::vector<std::string> names;
 
-    explicit variable_t(index_t id) : _id(id) {}
-    static variable_t make(const std::string& name);
+    constexpr explicit variable_t(index_t id) : _id(id) {}
+
+    // Indices of the predefined variables; must match the order of names in variable_factory_t().
+    static constexpr index_t reg_index(data_kind_t kind, int i) {
+        return 3 * i + (kind == data_kind_t::values ? 0 : kind == data_kind_t::offsets ? 1 : 2);
+    }
+    enum : index_t { map_value_size_index = 38, map_key_size_index, packet_size_index, meta_offset_index };
 
   public:
     variable_t(const variable_t& o) = default;
@@ -59,15 +109,21 @@ class variable_t final {
 
     bool operator<(const variable_t& o) const { return _id < o._id; }
 
-    void write(std::ostream& o) const { o << names.at(_id); }
-    std::string name() const { return names.at(_id); }
+    void write(std::ostream& o) const { o << variable_factory_t::current().name(_id); }
+    std::string name() const { return variable_factory_t::current().name(_id); }
+
+    // The variable named name, as read back from what write() printed.
+    static variable_t make(const std::string& name);
 
-    static variable_t reg(data_kind_t, int);
-    static variable_t cell_var(data_kind_t array, index_t offset, unsigned size);
-    static variable_t map_value_size();
-    static variable_t map_key_size();
-    static variable_t meta_offset();
-    static variable_t packet_size();
+    static constexpr variable_t reg(data_kind_t kind, int i) { return variable_t(reg_index(kind, i)); }
+    // The variable of the given kind among those of a stack cell, starting at first (see make_cell()).
+    static constexpr variable_t cell_var(data_kind_t kind, index_t first) {
+        return variable_t(first + reg_index(kind, 0));
+    }
+    static constexpr variable_t map_value_size() { return variable_t(map_value_size_index); }
+    static constexpr variable_t map_key_size() { return variable_t(map_key_size_index); }
+    static constexpr variable_t meta_offset() { return variable_t(meta_offset_index); }
+    static constexpr variable_t packet_size() { return variable_t(packet_size_index); }
 }; // class variable_t
 
 inline size_t hash_value(const variable_t& v) { return v.hash(); }
@@ -2,34 +2,66 @@
  * Factories for variable names.
  */
 
+#include <sstream>
+
 #include "crab/types.hpp"
 
 namespace crab {
 
-variable_t variable_t::make(const std::string& name) {
-    auto it = std::find(names.begin(), names.end(), name);
-    if (it == names.end()) {
-        names.emplace_back(name);
-        return variable_t(names.size() - 1);
-    } else {
-        return variable_t(std::distance(names.begin(), it));
+variable_factory_t::variable_factory_t() {
+    for (const char* name : {"r0",        "off0",      "t0",
+                             "r1",        "off1",      "t1",
+                             "r2",        "off2",      "t2",
+                             "r3",        "off3",      "t3",
+                             "r4",        "off4",      "t4",
+                             "r5",        "off5",      "t5",
+                             "r6",        "off6",      "t6",
+                             "r7",        "off7",      "t7",
+                             "r8",        "off8",      "t8",
+                             "r9",        "off9",      "t9",
+                             "r10",       "off10",     "t10",
+                             "S_r",       "S_off",     "S_t",
+                             "data_size", "meta_size", "map_value_size",
+                             "map_key_size", "packet_size", "meta_offset"}) {
+        add(name);
     }
 }
 
-std::vector<std::string> variable_t::names{"r0",          "off0",      "t0",
-                                           "r1",          "off1",      "t1",
-                                           "r2",          "off2",      "t2",
-                                           "r3",          "off3",      "t3",
-                                           "r4",          "off4",      "t4",
-                                           "r5",          "off5",      "t5",
-                                           "r6",          "off6",      "t6",
-                                           "r7",          "off7",      "t7",
-                                           "r8",          "off8",      "t8",
-                                           "r9",          "off9",      "t9",
-                                           "r10",         "off10",     "t10",
-                                           "S_r",         "S_off",     "S_t",
-                                           "data_size",   "meta_size", "map_value_size",
-                                           "map_key_size"};
+index_t variable_factory_t::add(std::string name) {
+    index_t id = names.size();
+    ids.emplace(name, id);
+    names.push_back(std::move(name));
+    return id;
+}
+
+index_t variable_factory_t::make(const std::string& name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return make_locked(name);
+}
+
+index_t variable_factory_t::make_locked(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end())
+        return it->second;
+    return add(name);
+}
+
+thread_local variable_factory_t* variable_factory_t::_current = nullptr;
+
+variable_factory_t& variable_factory_t::current() {
+    if (_current)
+        return *_current;
+    static thread_local variable_factory_t default_factory;
+    return default_factory;
+}
+
+variable_factory_t* variable_factory_t::set_current(variable_factory_t* factory) {
+    variable_factory_t* previous = _current;
+    _current = factory;
+    return previous;
+}
+
+variable_t variable_t::make(const std::string& name) { return variable_t(variable_factory_t::current().make(name)); }
 
 static std::string name_of(data_kind_t kind) {
     switch (kind) {
@@ -40,8 +72,6 @@ static std::string name_of(data_kind_t kind) {
     return {};
 }
 
-variable_t variable_t::reg(data_kind_t kind, int i) { return make(name_of(kind) + std::to_string(i)); }
-
 std::ostream& operator<<(std::ostream& o, const data_kind_t& s) {
     switch (s) {
     case data_kind_t::offsets: return o << "S_off";
@@ -61,13 +91,32 @@ static std::string mk_scalar_name(data_kind_t kind, int o, int size) {
     return os.str();
 }
 
-variable_t variable_t::cell_var(data_kind_t array, index_t offset, unsigned size) {
-    return make(mk_scalar_name(array, - (512 - (int)offset), (int)size));
+index_t variable_factory_t::make_cell(index_t offset, unsigned size) {
+    const uint64_t key = (offset << 32) | uint64_t{size};
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = cell_ids.find(key);
+    if (it != cell_ids.end())
+        return it->second;
+    // Cell names are only made here, so the three are new and get consecutive indices.
+    index_t id = add(mk_scalar_name(data_kind_t::values, -(512 - (int)offset), (int)size));
+    add(mk_scalar_name(data_kind_t::offsets, -(512 - (int)offset), (int)size));
+    add(mk_scalar_name(data_kind_t::types, -(512 - (int)offset), (int)size));
+    cell_ids.emplace(key, id);
+    cell_keys.emplace(id, key);
+    return id;
 }
 
-variable_t variable_t::map_value_size() { return make("map_value_size"); }
-variable_t variable_t::map_key_size() { return make("map_key_size"); }
-variable_t variable_t::meta_offset() { return make("meta_offset"); }
-variable_t variable_t::packet_size() { return make("packet_size"); }
+std::optional<std::tuple<index_t, unsigned, index_t>> variable_factory_t::cell_of(index_t id) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // The variables of a cell are consecutive, so id is one of them if the first is at most two before it.
+    for (index_t first = id; first + 2 >= id; first--) {
+        auto it = cell_keys.find(first);
+        if (it != cell_keys.end())
+            return std::make_tuple(it->second >> 32, (unsigned)(it->second & 0xffffffff), first);
+        if (first == 0)
+            break;
+    }
+    return {};
+}
 
 } // end namespace crab
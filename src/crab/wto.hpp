@@ -45,15 +45,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include <memory>
-#include <set>
 #include <vector>
 #include <forward_list>
-#include <unordered_map>
 
 #include <boost/iterator/indirect_iterator.hpp>
 
-#include "crab/cfg_bgl.hpp"
+#include "crab/cfg.hpp"
 #include "crab/debug.hpp"
 #include "crab/interval.hpp"
 #include "crab/stats.hpp"
@@ -62,13 +62,7 @@
 namespace crab {
 
 
-using vertex_descriptor_t = typename boost::graph_traits<cfg_t>::vertex_descriptor;
-
-
-using out_edge_iterator_t = typename boost::graph_traits<cfg_t>::out_edge_iterator;
-
-
-using edge_descriptor_t = typename boost::graph_traits<cfg_t>::edge_descriptor;
+using vertex_descriptor_t = block_id_t;
 
 
 class wto_t;
@@ -77,93 +71,79 @@ class wto_cycle_t;
 class wto_component_visitor_t;
 
 
+// The heads of the cycles that contain a node, outermost first. A head is not part of its own nesting.
+//
+// The nesting of every node is stored once by the wto_t, as its depth and the head of its innermost cycle; a
+// wto_nesting_t only refers to those tables, so copying one is free, and comparing two takes O(depth) steps
+// without allocating.
 class wto_nesting_t final {
 
     friend class wto_t;
-    friend class wto_vertex_t;
-    friend class wto_cycle_t;
-
-  private:
-    using node_list_t = std::vector<vertex_descriptor_t>;
-    using node_list_ptr = std::shared_ptr<node_list_t>;
-
-    node_list_ptr _nodes;
 
   public:
-    using iterator = typename node_list_t::iterator;
-    using const_iterator = typename node_list_t::const_iterator;
+    static constexpr vertex_descriptor_t no_head = std::numeric_limits<vertex_descriptor_t>::max();
 
   private:
-    explicit wto_nesting_t(const node_list_ptr& l) : _nodes(std::make_shared<node_list_t>(*l)) {}
-
-    int compare(wto_nesting_t& other) const {
-        auto this_it = this->begin();
-        auto other_it = other.begin();
-        while (this_it != this->end()) {
-            if (other_it == other.end()) {
-                return 1;
-            } else if (*this_it == *other_it) {
-                ++this_it;
-                ++other_it;
-            } else {
+    // By node, the head of the innermost cycle containing it, and the number of cycles containing it.
+    const std::vector<vertex_descriptor_t>* _heads{};
+    const std::vector<unsigned>* _depths{};
+    // The innermost head of this nesting, or no_head if empty.
+    vertex_descriptor_t _innermost{no_head};
+    unsigned _depth{0};
+
+    wto_nesting_t(const std::vector<vertex_descriptor_t>& heads, const std::vector<unsigned>& depths,
+                  vertex_descriptor_t innermost, unsigned depth)
+        : _heads(&heads), _depths(&depths), _innermost(innermost), _depth(depth) {}
+
+    // This nesting without its innermost depth - d heads.
+    wto_nesting_t prefix(unsigned d) const {
+        wto_nesting_t res = *this;
+        for (; res._depth > d; res._depth--)
+            res._innermost = (*_heads)[res._innermost];
+        return res;
+    }
+
+    // 0 if equal, 1 if other is a proper prefix of this, -1 if this is a proper prefix of other, 2 otherwise.
+    int compare(const wto_nesting_t& other) const {
+        if (_depth >= other._depth) {
+            if (prefix(other._depth)._innermost != other._innermost)
                 return 2; // Nestings are not comparable
-            }
-        }
-        if (other_it == other.end()) {
-            return 0;
-        } else {
-            return -1;
+            return _depth == other._depth ? 0 : 1;
         }
+        return other.compare(*this) == 1 ? -1 : 2;
     }
 
   public:
-    wto_nesting_t() : _nodes(std::make_shared<node_list_t>()) {}
+    wto_nesting_t() = default;
 
-    void operator+=(const vertex_descriptor_t& n) {
-        this->_nodes = std::make_shared<node_list_t>(*(this->_nodes));
-        this->_nodes->push_back(n);
-    }
-
-    wto_nesting_t operator+(const vertex_descriptor_t& n) {
-        wto_nesting_t res(this->_nodes);
-        res._nodes->push_back(n);
-        return res;
-    }
-
-    iterator begin() { return _nodes->begin(); }
-
-    iterator end() { return _nodes->end(); }
-
-    const_iterator begin() const { return _nodes->begin(); }
+    unsigned depth() const { return _depth; }
 
-    const_iterator end() const { return _nodes->end(); }
-
-    wto_nesting_t operator^(wto_nesting_t other) const {
-        wto_nesting_t res;
-        for (const_iterator this_it = this->begin(), other_it = other.begin();
-             this_it != this->end() && other_it != other.end(); ++this_it, ++other_it) {
-            if (*this_it == *other_it) {
-                res._nodes->push_back(*this_it);
-            } else {
-                break;
-            }
+    // The longest common prefix of this and other.
+    wto_nesting_t operator^(const wto_nesting_t& other) const {
+        wto_nesting_t a = prefix(std::min(_depth, other._depth));
+        wto_nesting_t b = other.prefix(a._depth);
+        while (a._innermost != b._innermost) {
+            a = a.prefix(a._depth - 1);
+            b = b.prefix(b._depth - 1);
         }
-        return res;
+        return a;
     }
 
-    bool operator<=(wto_nesting_t other) const { return this->compare(other) <= 0; }
+    bool operator<=(const wto_nesting_t& other) const { return this->compare(other) <= 0; }
 
-    bool operator==(wto_nesting_t other) const { return this->compare(other) == 0; }
+    bool operator==(const wto_nesting_t& other) const { return this->compare(other) == 0; }
 
-    bool operator>(wto_nesting_t other) const { return this->compare(other) == 1; }
+    bool operator>(const wto_nesting_t& other) const { return this->compare(other) == 1; }
 
     void write(std::ostream& o) const {
+        std::vector<vertex_descriptor_t> heads;
+        for (wto_nesting_t n = *this; n._depth > 0; n = n.prefix(n._depth - 1))
+            heads.push_back(n._innermost);
         o << "[";
-        for (auto it = this->begin(); it != this->end();) {
-            vertex_descriptor_t n = *it;
-            o << n;
+        for (auto it = heads.rbegin(); it != heads.rend();) {
+            o << *it;
             ++it;
-            if (it != this->end()) {
+            if (it != heads.rend()) {
                 o << ", ";
             }
         }
@@ -281,115 +261,170 @@ class wto_cycle_t final : public wto_component_t {
 }; // class wto_cycle
 
 class wto_t final {
+  public:
+    // A component of the WTO in its flat form (see elements()).
+    struct element_t {
+        vertex_descriptor_t node;
+        // The index past the element and, for the head of a cycle, past the whole cycle.
+        uint32_t end;
+        bool is_cycle;
+    };
+
   private:
     using wto_component_ptr = std::shared_ptr<wto_component_t>;
     using wto_vertex_ptr = std::shared_ptr<wto_vertex_t>;
     using wto_cycle_ptr = std::shared_ptr<wto_cycle_t>;
     using wto_component_list_t = std::forward_list<wto_component_ptr>;
     using wto_component_list_ptr = std::shared_ptr<wto_component_list_t>;
-    using dfn_t = bound_t;
-    using dfn_table_t = std::unordered_map<vertex_descriptor_t, dfn_t>;
-    using dfn_table_ptr = std::shared_ptr<dfn_table_t>;
+    // Depth-first numbers, by node; 0 for unvisited nodes, and dfn_infinity once a node's component is built.
+    using dfn_t = unsigned;
+    static constexpr dfn_t dfn_infinity = std::numeric_limits<dfn_t>::max();
+    using dfn_table_t = std::vector<dfn_t>;
     using stack_t = std::vector<vertex_descriptor_t>;
-    using stack_ptr = std::shared_ptr<stack_t>;
-    using nesting_table_t = std::unordered_map<vertex_descriptor_t, wto_nesting_t>;
-    using nesting_table_ptr = std::shared_ptr<nesting_table_t>;
+
+    // The successors of every node, flattened: those of n are succs[offsets[n]] to succs[offsets[n + 1]], in the
+    // order of the CFG. The depth-first search reads them from two arrays rather than from the blocks.
+    struct succ_graph_t {
+        std::vector<uint32_t> offsets;
+        std::vector<vertex_descriptor_t> succs;
+
+        succ_graph_t() = default;
+
+        explicit succ_graph_t(const cfg_t& g) {
+            offsets.reserve(g.num_ids() + 1);
+            for (const basic_block_t& bb : g) {
+                // Removed blocks, whose ids come before bb, have no successors.
+                offsets.resize(bb.id() + 1, (uint32_t)succs.size());
+                auto [first, last] = bb.next_blocks();
+                succs.insert(succs.end(), first, last);
+            }
+            offsets.resize(g.num_ids() + 1, (uint32_t)succs.size());
+        }
+    };
+    // Marks the nodes that are not part of the WTO in the table of depths.
+    static constexpr unsigned not_in_wto = std::numeric_limits<unsigned>::max();
 
     wto_component_list_ptr _wto_components;
-    dfn_table_ptr _dfn_table;
+    succ_graph_t _graph;
+    dfn_table_t _dfn_table;
+    // By node, whether an edge to it closes a cycle, which makes it the head of a component if its own dfn is the
+    // smallest reached from it.
+    std::vector<bool> _loop_nodes;
     dfn_t _num;
-    stack_ptr _stack;
-    nesting_table_ptr _nesting_table;
+    stack_t _stack;
+    // The nesting of each node (see wto_nesting_t).
+    std::vector<vertex_descriptor_t> _heads;
+    std::vector<unsigned> _depths;
+    // The components in their flat form, and the index of each node among them.
+    std::vector<element_t> _elements;
+    std::vector<uint32_t> _positions;
 
     class nesting_builder : public wto_component_visitor_t {
       private:
-        wto_nesting_t _nesting;
-        nesting_table_ptr _nesting_table;
+        std::vector<vertex_descriptor_t>& _heads;
+        std::vector<unsigned>& _depths;
+        vertex_descriptor_t _innermost{wto_nesting_t::no_head};
+        unsigned _depth{0};
 
       public:
-        explicit nesting_builder(nesting_table_ptr nesting_table) : _nesting_table(std::move(nesting_table)) {}
+        nesting_builder(std::vector<vertex_descriptor_t>& heads, std::vector<unsigned>& depths)
+            : _heads(heads), _depths(depths) {}
 
         void visit(wto_cycle_t& cycle) override {
             vertex_descriptor_t head = cycle.head();
-            wto_nesting_t previous_nesting = this->_nesting;
-            this->_nesting_table->insert(std::make_pair(head, this->_nesting));
-            this->_nesting += head;
+            vertex_descriptor_t previous_innermost = _innermost;
+            _heads[head] = _innermost;
+            _depths[head] = _depth;
+            _innermost = head;
+            _depth++;
             for (typename wto_cycle_t::iterator it = cycle.begin(); it != cycle.end(); ++it) {
                 it->accept(this);
             }
-            this->_nesting = previous_nesting;
+            _depth--;
+            _innermost = previous_innermost;
         }
 
         void visit(wto_vertex_t& vertex) override {
-            this->_nesting_table->insert(std::make_pair(vertex.node(), this->_nesting));
+            _heads[vertex.node()] = _innermost;
+            _depths[vertex.node()] = _depth;
         }
 
     }; // class nesting_builder
 
-    dfn_t get_dfn(const vertex_descriptor_t& n) {
-        auto it = this->_dfn_table->find(n);
-        if (it == this->_dfn_table->end()) {
-            return 0;
-        } else {
-            return it->second;
+    class flat_builder : public wto_component_visitor_t {
+      private:
+        std::vector<element_t>& _elements;
+        std::vector<uint32_t>& _positions;
+
+      public:
+        flat_builder(std::vector<element_t>& elements, std::vector<uint32_t>& positions)
+            : _elements(elements), _positions(positions) {}
+
+        void visit(wto_cycle_t& cycle) override {
+            const size_t index = _elements.size();
+            _positions[cycle.head()] = index;
+            _elements.push_back({cycle.head(), 0, true});
+            for (typename wto_cycle_t::iterator it = cycle.begin(); it != cycle.end(); ++it) {
+                it->accept(this);
+            }
+            _elements[index].end = _elements.size();
         }
-    }
 
-    void set_dfn(const vertex_descriptor_t& n, const dfn_t& dfn) {
-        std::pair<typename dfn_table_t::iterator, bool> res = this->_dfn_table->insert(std::make_pair(n, dfn));
-        if (!res.second) {
-            (res.first)->second = dfn;
+        void visit(wto_vertex_t& vertex) override {
+            _positions[vertex.node()] = _elements.size();
+            _elements.push_back({vertex.node(), (uint32_t)_elements.size() + 1, false});
         }
-    }
+    }; // class flat_builder
+
+    dfn_t get_dfn(const vertex_descriptor_t& n) { return this->_dfn_table[n]; }
+
+    void set_dfn(const vertex_descriptor_t& n, const dfn_t& dfn) { this->_dfn_table[n] = dfn; }
 
     vertex_descriptor_t pop() {
-        if (this->_stack->empty()) {
+        if (this->_stack.empty()) {
             CRAB_ERROR("WTO computation: empty stack");
         } else {
-            vertex_descriptor_t top = this->_stack->back();
-            this->_stack->pop_back();
+            vertex_descriptor_t top = this->_stack.back();
+            this->_stack.pop_back();
             return top;
         }
     }
 
-    void push(const vertex_descriptor_t& n) { this->_stack->push_back(n); }
+    void push(const vertex_descriptor_t& n) { this->_stack.push_back(n); }
 
-    wto_cycle_ptr component(cfg_t& g, const vertex_descriptor_t& vertex) {
+    wto_cycle_ptr component(const vertex_descriptor_t& vertex) {
         auto partition = std::make_shared<wto_component_list_t>();
-        std::pair<out_edge_iterator_t, out_edge_iterator_t> succ_edges = out_edges(vertex, g);
-        for (out_edge_iterator_t it = succ_edges.first, et = succ_edges.second; it != et; ++it) {
-            vertex_descriptor_t succ = target(*it, g);
+        for (uint32_t i = _graph.offsets[vertex], e = _graph.offsets[vertex + 1]; i != e; ++i) {
+            vertex_descriptor_t succ = _graph.succs[i];
             if (this->get_dfn(succ) == 0) {
-                this->visit(g, succ, partition);
+                this->visit(succ, partition);
             }
         }
         return wto_cycle_ptr(new wto_cycle_t(vertex, partition));
     }
 
     struct visit_stack_elem {
-        using succ_iterator = out_edge_iterator_t;
         vertex_descriptor_t _node;
-        succ_iterator _it; // begin iterator for node's successors
-        succ_iterator _et; // end iterator for node's successors
-        dfn_t _min;        // smallest dfn number of any (direct or
-                           // indirect) node's successor through node's
-                           // DFS subtree, included node.
-
-        visit_stack_elem(vertex_descriptor_t node, const std::pair<succ_iterator, succ_iterator>& succs, const dfn_t& min)
-            : _node(std::move(node)), _it(succs.first), _et(succs.second), _min(min) {}
+        uint32_t _it; // index in _graph.succs of node's next successor
+        uint32_t _et; // index in _graph.succs past node's successors
+        dfn_t _min;   // smallest dfn number of any (direct or
+                      // indirect) node's successor through node's
+                      // DFS subtree, included node.
+
+        visit_stack_elem(vertex_descriptor_t node, const succ_graph_t& g, const dfn_t& min)
+            : _node(node), _it(g.offsets[node]), _et(g.offsets[node + 1]), _min(min) {}
     };
 
-    void visit(cfg_t& g, const vertex_descriptor_t& vertex, const wto_component_list_ptr& partition) {
+    void visit(const vertex_descriptor_t& vertex, const wto_component_list_ptr& partition) {
 
         std::vector<visit_stack_elem> visit_stack;
-        std::set<vertex_descriptor_t> loop_nodes;
 
         /* discover vertex */
         push(vertex);
         _num += 1;
         set_dfn(vertex, _num);
 
-        visit_stack.emplace_back(vertex, out_edges(vertex, g), _num);
+        visit_stack.emplace_back(vertex, _graph, _num);
         CRAB_LOG("wto-nonrec", std::cout << "WTO: Node " << vertex << ": dfs num=" << _num << "\n";);
         while (!visit_stack.empty()) {
             /*
@@ -400,21 +435,20 @@ class wto_t final {
              * visit_stack one more descendant.
              */
             while (visit_stack.back()._it != visit_stack.back()._et) {
-                edge_descriptor_t e = *visit_stack.back()._it++;
-                vertex_descriptor_t child = target(e, g);
+                vertex_descriptor_t child = _graph.succs[visit_stack.back()._it++];
                 dfn_t child_dfn = get_dfn(child);
                 if (child_dfn == 0) {
                     /* discover new vertex */
                     push(child);
                     _num += 1;
                     set_dfn(child, _num);
-                    visit_stack.emplace_back(child, out_edges(child, g), _num);
+                    visit_stack.emplace_back(child, _graph, _num);
                     CRAB_LOG("wto-nonrec", std::cout << "WTO: Node " << child << ": dfs num=" << _num << "\n";);
                 } else {
                     if (child_dfn <= visit_stack.back()._min) {
                         visit_stack.back()._min = child_dfn;
                         CRAB_LOG("wto-nonrec", std::cout << "WTO: loop found " << child << "\n";);
-                        loop_nodes.insert(child);
+                        _loop_nodes[child] = true;
                     }
                 }
             }
@@ -422,7 +456,7 @@ class wto_t final {
             // propagate min from child to parent
             vertex_descriptor_t visiting_node = visit_stack.back()._node;
             dfn_t min_visiting_node = visit_stack.back()._min;
-            bool is_loop = loop_nodes.count(visiting_node) > 0;
+            bool is_loop = _loop_nodes[visiting_node];
             visit_stack.pop_back();
             if (!visit_stack.empty() && visit_stack.back()._min > min_visiting_node) {
                 visit_stack.back()._min = min_visiting_node;
@@ -435,17 +469,19 @@ class wto_t final {
             if (min_visiting_node == get_dfn(visiting_node)) {
                 CRAB_LOG("wto-nonrec",
                          std::cout << "WTO: BEGIN building partition for node " << visiting_node << "\n";);
-                set_dfn(visiting_node, dfn_t::plus_infinity());
+                set_dfn(visiting_node, dfn_infinity);
                 vertex_descriptor_t element = pop();
                 if (is_loop) {
                     while (!(element == visiting_node)) {
+                        // The node is visited again as part of the component, which must find its cycles anew.
                         set_dfn(element, 0);
+                        _loop_nodes[element] = false;
                         CRAB_LOG("wto-nonrec", std::cout << "\tWTO: node " << element << ": dfn num=0\n";);
                         element = pop();
                     }
                     CRAB_LOG("wto-nonrec",
                              std::cout << "\tWTO: adding component starting from " << visiting_node << "\n";);
-                    partition->push_front(component(g, visiting_node));
+                    partition->push_front(component(visiting_node));
                 } else {
                     CRAB_LOG("wto-nonrec", std::cout << "\tWTO: adding vertex " << visiting_node << "\n";);
                     partition->push_front(wto_vertex_ptr(new wto_vertex_t(visiting_node)));
@@ -456,9 +492,11 @@ class wto_t final {
     }
 
     void build_nesting() {
-        nesting_builder builder(this->_nesting_table);
+        nesting_builder builder(this->_heads, this->_depths);
+        flat_builder flat(this->_elements, this->_positions);
         for (iterator it = this->begin(); it != this->end(); ++it) {
             it->accept(&builder);
+            it->accept(&flat);
         }
     }
 
@@ -467,32 +505,24 @@ class wto_t final {
     using const_iterator = boost::indirect_iterator<typename wto_component_list_t::const_iterator>;
 
     explicit wto_t(cfg_t& g)
-        : _wto_components(std::make_shared<wto_component_list_t>()), _dfn_table(std::make_shared<dfn_table_t>()),
-          _num(0), _stack(std::make_shared<stack_t>()), _nesting_table(std::make_shared<nesting_table_t>()) {
-        ScopedCrabStats __st__("Fixpo.WTO");
-
-        this->visit(g, entry(g), this->_wto_components);
-        this->_dfn_table.reset();
-        this->_stack.reset();
+        : _wto_components(std::make_shared<wto_component_list_t>()), _graph(g), _dfn_table(g.num_ids()),
+          _loop_nodes(g.num_ids()), _num(0),
+          _heads(g.num_ids(), wto_nesting_t::no_head), _depths(g.num_ids(), not_in_wto),
+          _positions(g.num_ids(), std::numeric_limits<uint32_t>::max()) {
+        CRAB_SCOPED_STOPWATCH("Fixpo.WTO");
+
+        this->visit(g.entry(), this->_wto_components);
+        this->_graph = succ_graph_t();
+        this->_dfn_table = dfn_table_t();
+        this->_loop_nodes = std::vector<bool>();
+        this->_stack = stack_t();
         this->build_nesting();
     }
 
+    // Nestings refer to the tables of the wto_t, which must not move once they are handed out.
     wto_t(const wto_t& other) = delete;
-
-    wto_t(const wto_t&& other) noexcept
-        : _wto_components(other._wto_components), _dfn_table(other._dfn_table), _num(other._num),
-          _stack(other._stack), _nesting_table(other._nesting_table) {}
-
-    wto_t& operator=(const wto_t& other) {
-        if (this != &other) {
-            this->_wto_components = other._wto_components;
-            this->_dfn_table = other._dfn_table;
-            this->_num = other._num;
-            this->_stack = other._stack;
-            this->_nesting_table = other._nesting_table;
-        }
-        return *this;
-    }
+    wto_t(wto_t&& other) = default;
+    wto_t& operator=(const wto_t& other) = delete;
 
     iterator begin() { return boost::make_indirect_iterator(_wto_components->begin()); }
 
@@ -502,15 +532,22 @@ class wto_t final {
 
     const_iterator end() const { return boost::make_indirect_iterator(_wto_components->end()); }
 
-    wto_nesting_t nesting(vertex_descriptor_t n) {
-        auto it = this->_nesting_table->find(n);
-        if (it == this->_nesting_table->end()) {
+    wto_nesting_t nesting(vertex_descriptor_t n) const {
+        if (n >= _depths.size() || _depths[n] == not_in_wto) {
             CRAB_ERROR("WTO nesting: node ", n, " not found");
-        } else {
-            return it->second;
         }
+        return wto_nesting_t(_heads, _depths, _heads[n], _depths[n]);
     }
 
+    /** The WTO as a sequence of components in iteration order, where each cycle is its head followed by the
+     *  elements of its body. The element after i is at elements()[i].end, so that a loop over a sequence skips
+     *  nested cycles, and a node belongs to the cycle at i if its position is in [i, elements()[i].end).
+     */
+    const std::vector<element_t>& elements() const { return _elements; }
+
+    // The index of n in elements().
+    uint32_t position(vertex_descriptor_t n) const { return _positions.at(n); }
+
     void accept(wto_component_visitor_t* v) {
         for (iterator it = this->begin(); it != this->end(); ++it) {
             it->accept(v);
@@ -2,144 +2,471 @@
  *  This module is about selecting the numerical and memory domains, initiating
  *  the verification process and returning the results.
  **/
+#include <algorithm>
+#include <charconv>
 #include <cinttypes>
 
+#include <cstdio>
 #include <ctime>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
-#include <boost/lexical_cast.hpp>
-
 #include "crab/ebpf_domain.hpp"
 #include "crab/cfg.hpp"
 #include "crab/fwd_analyzer.hpp"
+#include "crab/invariant_io.hpp"
+#include "crab/profile.hpp"
+#include "crab/stats.hpp"
+#include "crab/thread_pool.hpp"
 
 #include "asm_syntax.hpp"
+#include "crab_verifier.hpp"
 #include "spec_type_descriptors.hpp"
 
 using std::string;
 
 using crab::linear_constraint_t;
 
-program_info global_program_info;
-
 // Numerical domains over integers
 //using sdbm_domain_t = crab::domains::SplitDBM;
 using crab::domains::ebpf_domain_t;
 
+// Blocks are checked from the threads of a parallel fixpoint, so checks_db records are made under this lock.
+static std::mutex checks_db_mutex;
+
 // Toy database to store invariants.
 struct checks_db final {
     std::map<label_t, std::vector<std::string>> m_db;
     int total_warnings{};
     int total_unreachable{};
+    // The number of warnings by label.
+    std::map<label_t, int> warnings_at;
 
     void add(const label_t& label, const std::string& msg) {
         m_db[label].emplace_back(msg);
     }
 
-    void add_warning(const label_t& label, const std::string& msg) { add(label,     msg); total_warnings++; }
-    void add_unreachable(const label_t& label, const std::string& msg) { add(label, msg); total_unreachable++; }
+    void add_warning(const label_t& label, const std::string& msg) {
+        std::lock_guard<std::mutex> lock(checks_db_mutex);
+        add(label, msg);
+        total_warnings++;
+        warnings_at[label]++;
+    }
+    void add_unreachable(const label_t& label, const std::string& msg) {
+        std::lock_guard<std::mutex> lock(checks_db_mutex);
+        add(label, msg);
+        total_unreachable++;
+    }
+
+    // Record for label what other recorded for it.
+    void copy_block(const checks_db& other, const label_t& label) {
+        auto it = other.m_db.find(label);
+        if (it == other.m_db.end())
+            return;
+        auto w = other.warnings_at.find(label);
+        const int warnings = w == other.warnings_at.end() ? 0 : w->second;
+        m_db[label] = it->second;
+        if (warnings)
+            warnings_at[label] = warnings;
+        total_warnings += warnings;
+        total_unreachable += (int)it->second.size() - warnings;
+    }
+
+    // Add the records of other, which has none for the labels recorded here.
+    void merge(checks_db&& other) {
+        m_db.merge(other.m_db);
+        warnings_at.merge(other.warnings_at);
+        total_warnings += other.total_warnings;
+        total_unreachable += other.total_unreachable;
+    }
 
     checks_db() = default;
 };
 
 inline int first_num(const label_t& s) {
-    try {
-        return boost::lexical_cast<int>(s.substr(0, s.find_first_of(":+")));
-    } catch (...) {
+    const char* end = s.data() + std::min(s.find_first_of(":+"), s.size());
+    int res{};
+    auto [ptr, ec] = std::from_chars(s.data(), end, res);
+    if (ec != std::errc{} || ptr != end) {
         std::cout << "bad label:" << s << "\n";
-        throw;
+        throw std::invalid_argument("bad label: " + s);
     }
+    return res;
 }
 
-static std::vector<label_t> sorted_labels(cfg_t& cfg) {
-    std::vector<label_t> labels = cfg.labels();
+// Order blocks by the instruction they start at, so that output follows the program text.
+static std::vector<crab::block_id_t> sorted_nodes(const cfg_t& cfg) {
+    // Parse each label once rather than on every comparison.
+    std::vector<std::tuple<int, const label_t*, crab::block_id_t>> keys;
+    for (const basic_block_t& bb : cfg) {
+        keys.emplace_back(first_num(bb.label()), &bb.label(), bb.id());
+    }
 
-    std::sort(labels.begin(), labels.end(), [](const string& a, const string& b) {
-        if (first_num(a) < first_num(b))
-            return true;
-        if (first_num(a) > first_num(b))
-            return false;
-        return a < b;
+    std::sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+        if (std::get<0>(a) != std::get<0>(b))
+            return std::get<0>(a) < std::get<0>(b);
+        return *std::get<1>(a) < *std::get<1>(b);
     });
-    return labels;
-}
 
-static checks_db analyze(cfg_t& cfg) {
-    crab::domains::clear_global_state();
+    std::vector<crab::block_id_t> nodes;
+    nodes.reserve(keys.size());
+    for (const auto& key : keys) {
+        nodes.push_back(std::get<2>(key));
+    }
+    return nodes;
+}
 
-    auto [preconditions, postconditions] = crab::run_forward_analyzer(cfg);
+// Thrown by check_block to stop the analysis at the first assertion that may fail.
+struct assertion_failed {};
 
-    checks_db m_db;
-    for (const label_t& label : sorted_labels(cfg)) {
-        basic_block_t& bb = cfg.get_node(label);
+// Apply the statements of bb to inv, recording in m_db the assertions that may fail and the statements after
+// which inv becomes unreachable. Return the resulting post-state.
+// If stop_at_failure is set, throw assertion_failed once the first failure is recorded.
+static ebpf_domain_t check_block(checks_db& m_db, const basic_block_t& bb, ebpf_domain_t from_inv,
+                                 bool stop_at_failure = false) {
+    const label_t& label = bb.label();
+    crab::analysis_profile_t* profile = crab::analysis_context_t::current().profile;
+    auto apply = [&](const Instruction& statement) {
+        if (profile)
+            profile->apply(from_inv, statement, label);
+        else
+            std::visit(from_inv, statement);
+    };
+    if (std::none_of(bb.begin(), bb.end(), [](const auto& s) { return std::holds_alternative<Assert>(s); })) {
+        for (const auto& statement : bb)
+            apply(statement);
+        return from_inv;
+    }
+    auto check = [&m_db, &label, stop_at_failure](auto& inv, const linear_constraint_t& cst,
+                                                  const ebpf_domain_t::message_t& s) {
+        if (inv.is_bottom())
+            return;
+        if (cst.is_contradiction()) {
+            m_db.add_warning(label, std::string("Contradition: ") + s());
+        } else if (inv.entail(cst)) {
+            // add_redundant(s);
+            return;
+        } else if (inv.intersect(cst)) {
+            // TODO: add_error() if imply negation
+            m_db.add_warning(label, s());
+        } else {
+            m_db.add_warning(label, s());
+        }
+        if (stop_at_failure)
+            throw assertion_failed{};
+    };
+    from_inv.set_require_check(ebpf_domain_t::require_check_t(check));
 
-        if (global_options.print_invariants) {
-            std::cout << "\n" << preconditions.at(label) << "\n";
-            std::cout << bb;
-            std::cout << "\n" << postconditions.at(label) << "\n";
+    for (const auto& statement : bb) {
+        bool pre_bot = from_inv.is_bottom();
+        apply(statement);
+        if (!pre_bot && from_inv.is_bottom()) {
+            m_db.add_unreachable(label, "inv became bot after " + to_string(statement));
         }
+    }
+    // The post-state flows into other blocks, which must not report against this one.
+    from_inv.set_require_check({});
+    return from_inv;
+}
 
-        if (std::none_of(bb.begin(), bb.end(), [](const auto& s) { return std::holds_alternative<Assert>(s); }))
-            continue;
-        ebpf_domain_t from_inv(preconditions.at(label));
-        from_inv.set_require_check([&m_db, label](auto& inv, const linear_constraint_t& cst, const std::string& s) {
-            if (inv.is_bottom())
-                return;
-            if (cst.is_contradiction()) {
-                m_db.add_warning(label, std::string("Contradition: ") + s);
-                return;
-            }
+// The analysis was given up, so the program is not proven safe: count it as a warning at the block it stopped at.
+static void report_budget_exceeded(checks_db& m_db, const crab::budget_exceeded& e) {
+    std::cerr << "verification aborted: " << e.what() << "\n";
+    m_db.add_warning(e.label, std::string("Verification aborted: ") + e.what());
+}
 
-            if (inv.entail(cst)) {
-                // add_redundant(s);
-            } else if (inv.intersect(cst)) {
-                // TODO: add_error() if imply negation
-                m_db.add_warning(label, s);
-            } else {
-                m_db.add_warning(label, s);
-            }
-        });
+// Check every block of cfg against the invariants of a completed analysis, printing them along if asked to, and
+// writing them to global_options.invariants_file if set; that of the last analysis stays.
+// The blocks marked in reused have the same invariants as when previous was recorded, and its results.
+static void check_invariants(checks_db& m_db, cfg_t& cfg, const crab::invariant_table_t& preconditions,
+                             const crab::invariant_table_t& postconditions, const checks_db* previous = nullptr,
+                             const std::vector<bool>& reused = {}) {
+    CRAB_SCOPED_STOPWATCH("phase.check");
+    if (!global_options.invariants_file.empty())
+        crab::write_invariants(global_options.invariants_file, cfg, preconditions, postconditions);
+    const std::vector<crab::block_id_t> nodes = sorted_nodes(cfg);
+    auto check = [&](checks_db& db, crab::block_id_t node) {
+        const basic_block_t& bb = cfg.get_node(node);
+        if (previous && reused[node])
+            db.copy_block(*previous, bb.label());
+        else
+            check_block(db, bb, preconditions.at(node));
+    };
 
-        for (const auto& statement : bb) {
-            bool pre_bot = from_inv.is_bottom();
-            std::visit(from_inv, statement);
-            if (!pre_bot && from_inv.is_bottom()) {
-                m_db.add_unreachable(label, "inv became bot after " + to_string(statement));
+    crab::thread_pool_t& pool = crab::fixpoint_pool();
+    crab::analysis_context_t& context = crab::analysis_context_t::current();
+    // As in the fixpoint, neither the profile nor the phase stop watches can be kept from several threads.
+    if (global_options.print_invariants || pool.threads() == 1 || context.profile || global_options.print_phase_stats) {
+        for (crab::block_id_t node : nodes) {
+            if (global_options.print_invariants) {
+                basic_block_t& bb = cfg.get_node(node);
+                std::cout << "\n" << preconditions.at(node) << "\n";
+                print(cfg, bb, std::cout);
+                std::cout << "\n" << postconditions.at(node) << "\n";
             }
+            check(m_db, node);
         }
+        return;
+    }
+
+    /* With the invariants known, each block is checked from its own. The blocks are checked in runs of consecutive
+     * ones, each recorded into a checks_db of its own and from a copy of the array cells of the context, which
+     * checking may add to; the records are then merged in the order of the blocks and the cells of every run kept,
+     * so that the results do not depend on the threads. */
+    constexpr size_t run_blocks = 64;
+    const size_t runs = (nodes.size() + run_blocks - 1) / run_blocks;
+    std::vector<checks_db> shards(runs);
+    std::vector<crab::domains::array_map_t> cells(runs, context.array_map);
+    pool.run(runs, [&](size_t r) {
+        crab::analysis_context_t::scope_t scope(context, cells[r]);
+        for (size_t i = r * run_blocks; i < std::min(nodes.size(), (r + 1) * run_blocks); i++)
+            check(shards[r], nodes[i]);
+    });
+    for (size_t r = 0; r < runs; r++) {
+        m_db.merge(std::move(shards[r]));
+        context.array_map |= cells[r];
     }
-    return m_db;
 }
 
-std::tuple<bool, double> abs_validate(cfg_t& simple_cfg, program_info info) {
-    global_program_info = std::move(info);
-    cfg_t& cfg = simple_cfg;
+// The analysis saved in global_options.checkpoint_file if global_options.resume is set and there is one, and none
+// otherwise, or if the file cannot be read.
+static crab::checkpoint_t read_checkpoint_file() {
+    if (!global_options.resume)
+        return {};
+    std::ifstream in(global_options.checkpoint_file, std::ios::binary);
+    if (!in)
+        return {};
+    try {
+        return crab::read_checkpoint(in);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "ignoring checkpoint " << global_options.checkpoint_file << ": " << e.what() << "\n";
+        return {};
+    }
+}
+
+// The invariants of cfg, saving the analysis to global_options.checkpoint_file if set, and resuming it from there if
+// global_options.resume is set. A completed analysis removes its checkpoint; one given up keeps it.
+static std::pair<crab::invariant_table_t, crab::invariant_table_t> run_analysis(cfg_t& cfg,
+                                                                                crab::analysis_context_t& context) {
+    if (global_options.checkpoint_file.empty())
+        return crab::run_forward_analyzer(cfg, context);
+    auto res = crab::run_forward_analyzer(cfg, context, read_checkpoint_file(), global_options.checkpoint_file);
+    std::remove(global_options.checkpoint_file.c_str());
+    return res;
+}
+
+static checks_db analyze(cfg_t& cfg, crab::analysis_context_t& context) {
+    crab::analysis_context_t::scope_t scope(context);
+
+    checks_db m_db;
+    if (!global_options.print_invariants && global_options.invariants_file.empty() &&
+        global_options.checkpoint_file.empty()) {
+        // Check each block during the analysis, as soon as its pre-state is final.
+        CRAB_SCOPED_STOPWATCH("phase.fixpoint");
+        try {
+            crab::run_forward_analyzer(cfg, context, [&m_db](const basic_block_t& bb, ebpf_domain_t pre) {
+                if (!global_options.print_phase_stats)
+                    return check_block(m_db, bb, std::move(pre), global_options.fail_fast);
+                // Keep the time spent checking out of the fixpoint's.
+                crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+                CRAB_SCOPED_STOPWATCH("phase.check");
+                ebpf_domain_t post = check_block(m_db, bb, std::move(pre), global_options.fail_fast);
+                crab::CrabStats::resume(CRAB_STAT_ID("phase.fixpoint"));
+                return post;
+            });
+        } catch (const assertion_failed&) {
+            // The verdict is known; the rest of the program is not analyzed.
+        } catch (const crab::budget_exceeded& e) {
+            report_budget_exceeded(m_db, e);
+        }
+        return m_db;
+    }
 
-    using namespace std;
-    clock_t begin = clock();
+    crab::CrabStats::start(CRAB_STAT_ID("phase.fixpoint"));
+    crab::invariant_table_t preconditions, postconditions;
+    try {
+        std::tie(preconditions, postconditions) = run_analysis(cfg, context);
+    } catch (const crab::budget_exceeded& e) {
+        crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+        report_budget_exceeded(m_db, e);
+        return m_db;
+    }
+    crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
 
-    const checks_db db = analyze(cfg);
+    check_invariants(m_db, cfg, preconditions, postconditions);
+    return m_db;
+}
 
-    clock_t end = clock();
-    double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
+// Like analyze, with the fewer relations of context first. If assertions remain unproven, cfg is analyzed again with
+// zones, resuming from the first outermost WTO component with an unproven assertion, from the invariants of the
+// components before it; if that does not prove them either, with zones from scratch.
+static checks_db analyze_tiered(cfg_t& cfg, crab::analysis_context_t& context) {
+    crab::saved_invariants_t saved;
+    checks_db db;
+    {
+        crab::analysis_context_t::scope_t scope(context);
+        crab::CrabStats::start(CRAB_STAT_ID("phase.fixpoint"));
+        try {
+            auto [preconditions, postconditions] = crab::run_forward_analyzer(cfg, context);
+            crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+            check_invariants(db, cfg, preconditions, postconditions);
+            if (db.total_warnings == 0)
+                return db;
+            saved = crab::save_invariants(cfg, std::move(preconditions), std::move(postconditions));
+        } catch (const crab::budget_exceeded& e) {
+            crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+            report_budget_exceeded(db, e);
+            return db;
+        }
+    }
 
-    int nwarn = db.total_warnings;
+    // The components from the first block with a warning on are analyzed again.
+    for (const auto& [label, warnings] : db.warnings_at)
+        saved.erase(label);
+    context.relations = relations_t::differences;
+    checks_db zones_db;
+    std::vector<crab::block_id_t> reused;
+    {
+        crab::analysis_context_t::scope_t scope(context);
+        crab::CrabStats::start(CRAB_STAT_ID("phase.fixpoint"));
+        try {
+            auto [preconditions, postconditions] = crab::run_forward_analyzer(cfg, context, saved, reused);
+            crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+            std::vector<bool> is_reused(cfg.num_ids());
+            for (crab::block_id_t node : reused)
+                is_reused[node] = true;
+            check_invariants(zones_db, cfg, preconditions, postconditions, &db, is_reused);
+        } catch (const crab::budget_exceeded& e) {
+            crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+            report_budget_exceeded(zones_db, e);
+            return zones_db;
+        }
+    }
+    if (zones_db.total_warnings == 0 || reused.empty())
+        return zones_db;
+    // The relations lost at the boundary with the reused components may be what the assertions need.
+    crab::analysis_context_t zones_context(context.info, relations_t::differences);
+    zones_context.profile = context.profile;
+    return analyze(cfg, zones_context);
+}
 
+// What was recorded in db, and the time since elapsed started.
+static verification_result_t make_result(checks_db db, const crab::elapsed_time_t& elapsed) {
+    verification_result_t res;
+    res.verified = db.total_warnings == 0;
+    res.warnings = db.total_warnings;
+    res.unreachable = db.total_unreachable;
+    res.messages = std::move(db.m_db);
+    res.cpu_seconds = elapsed.cpu_seconds();
+    res.wall_seconds = elapsed.wall_seconds();
+    return res;
+}
+
+// Print the failures in result, if asked to, and return its verdict and times.
+static std::tuple<bool, double, double> report(const verification_result_t& result) {
     if (global_options.print_failures) {
         std::cout << "\n";
-        for (auto [label, messages] : db.m_db) {
+        for (const auto& [label, messages] : result.messages) {
             std::cout << label << ":\n";
             for (const auto& msg : messages)
                 std::cout << "  " << msg << "\n";
         }
         std::cout << "\n";
-        std::cout << db.total_warnings << " warnings\n";
+        std::cout << result.warnings << " warnings\n";
+    }
+    return {result.verified, result.cpu_seconds, result.wall_seconds};
+}
+
+verification_result_t verify_cfg(cfg_t& cfg, const program_info& info, crab::analysis_profile_t* profile,
+                                 relations_t relations) {
+    const crab::elapsed_time_t elapsed;
+
+    crab::analysis_context_t context(info, relations);
+    context.profile = profile;
+    const bool tiered = global_options.fallback_to_zones && context.relations != relations_t::differences;
+    return make_result(tiered ? analyze_tiered(cfg, context) : analyze(cfg, context), elapsed);
+}
+
+std::tuple<bool, double, double> abs_validate(cfg_t& cfg, const program_info& info,
+                                              crab::analysis_profile_t* profile, relations_t relations) {
+    return report(verify_cfg(cfg, info, profile, relations));
+}
+
+struct incremental_verifier_t::state_t {
+    crab::analysis_context_t context;
+    crab::saved_invariants_t saved;
+    // The results of checking the last version.
+    checks_db db;
+
+    explicit state_t(const program_info& info) : context(info) {}
+};
+
+incremental_verifier_t::incremental_verifier_t() = default;
+incremental_verifier_t::~incremental_verifier_t() = default;
+
+// Whether invariants computed for a program with info a hold for one with info b.
+static bool same_program_info(const program_info& a, const program_info& b) {
+    if (a.program_type != b.program_type || a.descriptor.size != b.descriptor.size ||
+        a.descriptor.data != b.descriptor.data || a.descriptor.end != b.descriptor.end ||
+        a.descriptor.meta != b.descriptor.meta || a.map_defs->size() != b.map_defs->size())
+        return false;
+    for (size_t i = 0; i < a.map_defs->size(); i++) {
+        const map_def& x = (*a.map_defs)[i];
+        const map_def& y = (*b.map_defs)[i];
+        if (x.original_fd != y.original_fd || x.type != y.type || x.key_size != y.key_size ||
+            x.value_size != y.value_size || x.inner_map_fd != y.inner_map_fd)
+            return false;
     }
-    return {nwarn == 0, elapsed_secs};
+    return true;
+}
+
+verification_result_t incremental_verifier_t::verify(cfg_t& cfg, const program_info& info,
+                                                     crab::analysis_control_t* control) {
+    const crab::elapsed_time_t elapsed;
+
+    if (!_state || !same_program_info(_state->context.info, info)) {
+        _state = std::make_unique<state_t>(info);
+    }
+    _state->context.control = control;
+    crab::analysis_context_t::scope_t scope(_state->context);
+
+    checks_db db;
+    _total_blocks = cfg.size();
+    crab::CrabStats::start(CRAB_STAT_ID("phase.fixpoint"));
+    try {
+        std::vector<crab::block_id_t> reused;
+        auto [preconditions, postconditions] = crab::run_forward_analyzer(cfg, _state->context, _state->saved, reused);
+        crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+        _reused_blocks = reused.size();
+        std::vector<bool> is_reused(cfg.num_ids());
+        for (crab::block_id_t node : reused)
+            is_reused[node] = true;
+        check_invariants(db, cfg, preconditions, postconditions, &_state->db, is_reused);
+        _state->saved = crab::save_invariants(cfg, std::move(preconditions), std::move(postconditions));
+        _state->db = db;
+    } catch (const crab::budget_exceeded& e) {
+        crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+        report_budget_exceeded(db, e);
+        _reused_blocks = 0;
+        _state->saved.clear();
+        _state->db = checks_db();
+    } catch (...) {
+        // The analysis could not complete, and its context may be halfway through a change.
+        crab::CrabStats::stop(CRAB_STAT_ID("phase.fixpoint"));
+        _reused_blocks = 0;
+        _state.reset();
+        throw;
+    }
+    return make_result(std::move(db), elapsed);
+}
+
+std::tuple<bool, double, double> incremental_verifier_t::validate(cfg_t& cfg, const program_info& info) {
+    return report(verify(cfg, info));
 }
@@ -1,10 +1,70 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <string>
 #include <tuple>
+#include <vector>
 
+#include "config.hpp"
 #include "crab/cfg.hpp"
 #include "spec_type_descriptors.hpp"
 
-std::tuple<bool, double> abs_validate(cfg_t& cfg, program_info info);
+namespace crab {
+class analysis_control_t;
+class analysis_profile_t;
+}
+
+// The outcome of verifying a program.
+struct verification_result_t {
+    // Whether every assertion holds.
+    bool verified{};
+    // The number of assertions that may fail, and of the places where the program was found to become unreachable.
+    int warnings{};
+    int unreachable{};
+    // The messages for both, by the label of their block.
+    std::map<label_t, std::vector<std::string>> messages;
+    double cpu_seconds{};
+    double wall_seconds{};
+};
+
+// Analyze cfg and check its assertions. If profile is set, it records where the analysis spends its time. The numeric
+// domain keeps the given relations; if they fail and global_options.fallback_to_zones is set, the analysis is repeated
+// with zones, from the first part of the program with an unproven assertion where possible.
+verification_result_t verify_cfg(cfg_t& cfg, const program_info& info, crab::analysis_profile_t* profile = nullptr,
+                                 relations_t relations = global_options.relations);
+
+// Like verify_cfg, printing the failures if global_options.print_failures is set, and returning whether all
+// assertions hold, and the CPU and wall time it took in seconds.
+std::tuple<bool, double, double> abs_validate(cfg_t& cfg, const program_info& info,
+                                              crab::analysis_profile_t* profile = nullptr,
+                                              relations_t relations = global_options.relations);
+
+/** Verifies successive versions of a program, such as the builds of a program being edited.
+ *
+ *  The invariants of each version are kept, and the analysis of the next one reuses those of the leading components
+ *  of its WTO that the edit left unchanged, recomputing the rest. Invariants are only reused between versions with
+ *  the same program type and maps.
+ */
+class incremental_verifier_t final {
+    struct state_t;
+    std::unique_ptr<state_t> _state;
+    size_t _reused_blocks{}, _total_blocks{};
+
+  public:
+    incremental_verifier_t();
+    ~incremental_verifier_t();
+
+    // Like verify_cfg, for the next version of the program. If the analysis throws, the invariants kept are dropped.
+    // If control is set, it follows the analysis and may stop it, which then throws crab::analysis_cancelled.
+    verification_result_t verify(cfg_t& cfg, const program_info& info, crab::analysis_control_t* control = nullptr);
+
+    // Like abs_validate, for the next version of the program.
+    std::tuple<bool, double, double> validate(cfg_t& cfg, const program_info& info);
+
+    // The number of blocks whose invariants the last validate() reused, and the number of blocks.
+    size_t reused_blocks() const { return _reused_blocks; }
+    size_t total_blocks() const { return _total_blocks; }
+};
 
 int create_map_crab(uint32_t map_type, uint32_t key_size, uint32_t value_size, uint32_t max_entries);
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <variant>
+
+#include "asm_syntax.hpp"
+#include "asm_unmarshal.hpp"
+#include "config.hpp"
+#include "crab/cfg.hpp"
+#include "ebpf_verifier.hpp"
+
+raw_program with_analysis_map_fds(raw_program raw_prog) {
+    auto analysis_fd = [&maps = *raw_prog.info.map_defs](int fd) -> int {
+        auto it = std::find_if(maps.begin(), maps.end(), [fd](const map_def& def) { return def.original_fd == fd; });
+        if (it == maps.end())
+            throw std::runtime_error("load of unknown map fd " + std::to_string(fd));
+        return create_map_crab((uint32_t)it->type, it->key_size, it->value_size, 0);
+    };
+    for (ebpf_inst& inst : raw_prog.prog) {
+        if (inst.opcode == EBPF_OP_LDDW_IMM && inst.src == 1)
+            inst.imm = analysis_fd(inst.imm);
+    }
+    auto defs = std::make_shared<std::vector<map_def>>(*raw_prog.info.map_defs);
+    for (map_def& def : *defs) {
+        if (def.type == MapType::ARRAY_OF_MAPS || def.type == MapType::HASH_OF_MAPS)
+            def.inner_map_fd = analysis_fd((int)def.inner_map_fd);
+        def.original_fd = analysis_fd(def.original_fd);
+    }
+    raw_prog.info.map_defs = std::move(defs);
+    return raw_prog;
+}
+
+verifier_session_t::result_t verifier_session_t::verify(const ebpf_inst* insts, size_t count, BpfProgType type,
+                                                        const std::vector<map_def>& maps,
+                                                        crab::analysis_control_t* control) {
+    result_t res;
+    try {
+        raw_program raw_prog{"", "", std::vector<ebpf_inst>(insts, insts + count),
+                             program_info{type, std::make_shared<const std::vector<map_def>>(maps),
+                                          get_descriptor(type)}};
+        raw_prog = with_analysis_map_fds(std::move(raw_prog));
+        auto prog_or_error = unmarshal(raw_prog);
+        if (std::holds_alternative<std::string>(prog_or_error)) {
+            res.error = std::get<std::string>(prog_or_error);
+            return res;
+        }
+        cfg_t det_cfg = instruction_seq_to_cfg(std::get<InstructionSeq>(prog_or_error));
+        explicate_assertions(det_cfg, raw_prog.info);
+        cfg_t cfg = to_nondet(det_cfg);
+        if (global_options.simplify)
+            cfg.simplify();
+        if (global_options.fold_constants)
+            fold_constants(cfg);
+        if (global_options.slice)
+            slice_to_assertions(cfg);
+        static_cast<verification_result_t&>(res) = _verifier.verify(cfg, raw_prog.info, control);
+    } catch (const std::exception& e) {
+        res = result_t{};
+        res.error = e.what();
+    }
+    return res;
+}
+
+verifier_session_t::handle_t& verifier_session_t::handle_t::operator=(handle_t&& other) {
+    if (this != &other) {
+        if (_thread.joinable()) {
+            cancel();
+            _thread.join();
+        }
+        _state = std::move(other._state);
+        _thread = std::move(other._thread);
+    }
+    return *this;
+}
+
+verifier_session_t::handle_t::~handle_t() {
+    if (!_thread.joinable())
+        return;
+    cancel();
+    _thread.join();
+}
+
+const verifier_session_t::result_t& verifier_session_t::handle_t::wait() {
+    if (_thread.joinable())
+        _thread.join();
+    return _state->result;
+}
+
+verifier_session_t::handle_t verifier_session_t::verify_async(const ebpf_inst* insts, size_t count, BpfProgType type,
+                                                              const std::vector<map_def>& maps,
+                                                              std::function<void(const result_t&)> on_result) {
+    handle_t handle;
+    handle._state = std::make_unique<handle_t::state_t>();
+    handle._thread = std::thread([this, state = handle._state.get(), prog = std::vector<ebpf_inst>(insts, insts + count),
+                                  type, maps, on_result = std::move(on_result)] {
+        state->result = verify(prog.data(), prog.size(), type, maps, &state->control);
+        if (on_result)
+            on_result(state->result);
+        state->done.store(true, std::memory_order_release);
+    });
+    return handle;
+}
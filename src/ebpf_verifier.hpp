@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crab/fwd_analyzer.hpp"
+#include "crab_verifier.hpp"
+#include "linux_ebpf.hpp"
+#include "spec_type_descriptors.hpp"
+
+/** Verifies programs from within another process, such as the loader that is about to load them.
+ *
+ *  Programs are given as instructions rather than files, and the outcome is returned: a session does not print unless
+ *  global_options asks for it, nor exit the process. Between calls, it keeps the analysis state of the last program, as
+ *  incremental_verifier_t: the variables and stack cells the analysis made, and the invariants, which the next program
+ *  of the same type and maps reuses for the code they share. Programs are analyzed with the options in global_options.
+ *
+ *  A session is used by one thread at a time; sessions on different threads are independent. verify_async() runs a
+ *  verification on a thread of its own, which may be followed and cancelled while it runs.
+ */
+class verifier_session_t final {
+    incremental_verifier_t _verifier;
+
+  public:
+    // The outcome of verify(): the analysis result, or why the program could not be analyzed.
+    struct result_t : verification_result_t {
+        // Set if the program could not be analyzed, such as for an invalid instruction or an internal limit of the
+        // analysis; it is then not verified, and there are no messages.
+        std::string error;
+    };
+
+    /** Verify the count instructions at insts, as a program of the given type.
+     *
+     *  maps describes the maps the program may load, by the file descriptor that the immediate of its map loads
+     *  (LDDW with src 1) holds, in original_fd, and for maps of maps, by that of the inner map, in inner_map_fd.
+     */
+    result_t verify(const ebpf_inst* insts, size_t count, BpfProgType type, const std::vector<map_def>& maps,
+                    crab::analysis_control_t* control = nullptr);
+
+    /** A verification started by verify_async().
+     *
+     *  Destroying the handle cancels the verification and waits for it to stop, so that the session may be used again.
+     */
+    class handle_t final {
+        struct state_t {
+            crab::analysis_control_t control;
+            std::atomic<bool> done{};
+            result_t result;
+        };
+        std::unique_ptr<state_t> _state;
+        std::thread _thread;
+
+        friend class verifier_session_t;
+
+      public:
+        handle_t() = default;
+        handle_t(handle_t&&) = default;
+        handle_t& operator=(handle_t&& other);
+        ~handle_t();
+
+        // How far the analysis went. Its components and iterations are those of the analysis of the part of the
+        // program that changed since the last one of the session.
+        crab::analysis_progress_t progress() const { return _state->control.progress(); }
+        // Ask the analysis to stop at its next boundary of component or iteration, as crab::analysis_control_t
+        // describes; the result then has the error "analysis cancelled", unless it was known first.
+        void cancel() { _state->control.cancel(); }
+        // Whether the result is known, and the callback of verify_async() returned.
+        bool done() const { return _state->done.load(std::memory_order_acquire); }
+        // The result, once it is known.
+        const result_t& wait();
+    };
+
+    /** Like verify, on a thread of its own; the instructions and maps are copied.
+     *
+     *  on_result, if set, is called from that thread with the result as soon as it is known. The session verifies
+     *  nothing else until then: it must not be used, nor destroyed, before wait() returns or the handle is destroyed.
+     */
+    handle_t verify_async(const ebpf_inst* insts, size_t count, BpfProgType type, const std::vector<map_def>& maps,
+                          std::function<void(const result_t&)> on_result = {});
+};
+
+// raw_prog with the map file descriptors in its map loads and map definitions, such as those of real maps, replaced by
+// those the analysis understands, which encode the sizes of the map, as create_map_crab() makes them. Throws
+// std::runtime_error for a load of a map that is not in the map definitions.
+raw_program with_analysis_map_fds(raw_program raw_prog);
@@ -6,9 +6,16 @@
 #include <ctime>
 
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
 
 #include "asm_syntax.hpp"
 #include "config.hpp"
+#include "crab/stats.hpp"
 
 #include "spec_type_descriptors.hpp"
 
@@ -42,43 +49,73 @@ static bpf_prog_type to_linuxtype(BpfProgType t) {
 
 static int do_bpf(bpf_cmd cmd, union bpf_attr& attr) { return syscall(321, cmd, &attr, sizeof(attr)); }
 
-/** Try to allocate a Linux map.
+/** The kernel maps that create_map_linux() makes, one for each kind of map, shared by every program that uses a map of
+ *  that kind and closed when the process exits.
  *
- *  This function requires admin privileges.
+ *  The verifier only looks at the type and sizes of a map, never at its contents, so programs loaded one after the
+ *  other, or at once on several threads, may all refer to the same map.
  */
-int create_map_linux(uint32_t map_type, uint32_t key_size, uint32_t value_size, uint32_t max_entries) {
-    union bpf_attr attr{};
-    memset(&attr, '\0', sizeof(attr));
-    attr.map_type = map_type;
-    attr.key_size = key_size;
-    attr.value_size = value_size;
-    attr.max_entries = 20;
-    attr.map_flags = map_type == BPF_MAP_TYPE_HASH ? BPF_F_NO_PREALLOC : 0;
-    int map_fd = do_bpf(BPF_MAP_CREATE, attr);
-    if (map_fd < 0) {
-        if (global_options.print_failures) {
-            std::cerr << "Failed to create map, " << strerror(errno) << "\n";
-            std::cerr << "Map: \n"
-                      << " map_type = " << attr.map_type << "\n"
-                      << " key_size = " << attr.key_size << "\n"
-                      << " value_size = " << attr.value_size << "\n"
-                      << " max_entries = " << attr.max_entries << "\n"
-                      << " map_flags = " << attr.map_flags << "\n";
+class linux_map_pool_t final {
+    // The map type, key size, value size and flags of each map.
+    using key_t = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>;
+
+    std::mutex _mutex;
+    std::map<key_t, int> _fds;
+
+  public:
+    ~linux_map_pool_t() {
+        for (const auto& [key, fd] : _fds)
+            close(fd);
+    }
+
+    int get(uint32_t map_type, uint32_t key_size, uint32_t value_size) {
+        union bpf_attr attr{};
+        memset(&attr, '\0', sizeof(attr));
+        attr.map_type = map_type;
+        attr.key_size = key_size;
+        attr.value_size = value_size;
+        attr.max_entries = 20;
+        attr.map_flags = map_type == BPF_MAP_TYPE_HASH ? BPF_F_NO_PREALLOC : 0;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        const key_t key{attr.map_type, attr.key_size, attr.value_size, attr.map_flags};
+        if (auto it = _fds.find(key); it != _fds.end())
+            return it->second;
+        const int map_fd = do_bpf(BPF_MAP_CREATE, attr);
+        if (map_fd < 0) {
+            std::ostringstream msg;
+            msg << "Failed to create map, " << strerror(errno) << " (map_type = " << attr.map_type
+                << ", key_size = " << attr.key_size << ", value_size = " << attr.value_size
+                << ", max_entries = " << attr.max_entries << ", map_flags = " << attr.map_flags << ")";
+            throw std::runtime_error(msg.str());
         }
-        exit(2);
+        _fds.emplace(key, map_fd);
+        return map_fd;
     }
-    return map_fd;
+};
+
+/** Get a Linux map of the given type and sizes, from the maps made so far or else by allocating one.
+ *
+ *  Allocating a map requires admin privileges; if it fails, std::runtime_error is thrown.
+ */
+int create_map_linux(uint32_t map_type, uint32_t key_size, uint32_t value_size, uint32_t max_entries) {
+    static linux_map_pool_t pool;
+    return pool.get(map_type, key_size, value_size);
 }
 
 /** Run the built-in Linux verifier on a raw eBPF program.
  *
- *  \return A pair (passed, elapsec_secs)
+ *  \return A tuple (passed, cpu_secs, wall_secs); the CPU time is that of the calling thread, including the kernel's.
  */
 
-std::tuple<bool, double> bpf_verify_program(BpfProgType type, const std::vector<ebpf_inst>& raw_prog) {
-    std::vector<char> buf(global_options.print_failures ? 1000000 : 10);
-    buf[0] = 0;
-    memset(buf.data(), '\0', buf.size());
+std::tuple<bool, double, double> bpf_verify_program(BpfProgType type, const std::vector<ebpf_inst>& raw_prog) {
+    // The log of the kernel, allocated once per thread and reused by the programs it verifies. The kernel writes it
+    // from the start and terminates it, so only the first byte is cleared.
+    thread_local std::vector<char> buf;
+    if (global_options.print_failures) {
+        buf.resize(1000000);
+        buf[0] = 0;
+    }
 
     union bpf_attr attr{};
     memset(&attr, '\0', sizeof(attr));
@@ -94,20 +131,20 @@ std::tuple<bool, double> bpf_verify_program(BpfProgType type, const std::vector<
     attr.kern_version = 0x041800;
     attr.prog_flags = 0;
 
-    std::clock_t begin = std::clock();
+    const crab::elapsed_time_t elapsed;
 
     int res = do_bpf(BPF_PROG_LOAD, attr);
 
-    std::clock_t end = std::clock();
-    double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
+    const double cpu_secs = elapsed.cpu_seconds();
+    const double wall_secs = elapsed.wall_seconds();
     if (res < 0) {
         if (global_options.print_failures) {
             std::cerr << "Failed to verify program: " << strerror(errno) << " (" << errno << ")\n";
             std::cerr << "LOG: " << (char*)attr.log_buf;
         }
-        return {false, elapsed_secs};
+        return {false, cpu_secs, wall_secs};
     }
-    return {true, elapsed_secs};
+    return {true, cpu_secs, wall_secs};
 }
 
 #endif
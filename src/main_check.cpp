@@ -1,4 +1,18 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/functional/hash.hpp>
@@ -6,6 +20,8 @@
 #include "CLI11.hpp"
 
 #include "crab/debug.hpp"
+#include "crab/profile.hpp"
+#include "crab/stats.hpp"
 #include "asm_files.hpp"
 #include "asm_ostream.hpp"
 #include "asm_syntax.hpp"
@@ -13,9 +29,13 @@
 #include "config.hpp"
 #include "crab/cfg.hpp"
 #include "crab_verifier.hpp"
+#include "ebpf_verifier.hpp"
 #include "linux_ebpf.hpp"
 #include "memsize.hpp"
+#include "result_cache.hpp"
 #include "linux_verifier.hpp"
+#include "verifier_coordinator.hpp"
+#include "verifier_server.hpp"
 
 using std::string;
 using std::vector;
@@ -26,25 +46,642 @@ static size_t hash(const raw_program& raw_prog) {
     return boost::hash_range(start, end);
 }
 
-int main(int argc, char** argv) {
+// The domains of a --domain value, which may list several, separated by commas.
+static vector<string> split_domains(const string& domain) {
+    vector<string> res;
+    std::istringstream in(domain);
+    for (string name; std::getline(in, name, ',');)
+        res.push_back(name);
+    return res;
+}
+
+static bool has_domain(const string& domain, const string& name) {
+    const vector<string> domains = split_domains(domain);
+    return std::find(domains.begin(), domains.end(), name) != domains.end();
+}
+
+// The relations that the numeric domain keeps in the analysis of domain.
+static relations_t domain_relations(const string& domain) {
+    return domain == "intervals" ? relations_t::none
+           : domain == "equalities" ? relations_t::equalities
+                                    : relations_t::differences;
+}
+
+static void print_headers(std::ostream& out, const string& domain) {
+    if (domain.find(',') != string::npos) {
+        const vector<string> domains = split_domains(domain);
+        for (size_t i = 0; i < domains.size(); i++) {
+            if (i > 0)
+                out << ",";
+            print_headers(out, domains[i]);
+        }
+    } else if (domain == "stats") {
+        out << "hash";
+        out << ",instructions";
+        for (const string& h : stats_headers()) {
+            out << "," << h;
+        }
+    } else if (domain == "compare") {
+        out << "agree,linux?,linux_sec,linux_wall_sec,";
+        print_headers(out, "zoneCrab");
+    } else {
+        out << domain << "?,";
+        out << domain << "_sec,";
+        out << domain << "_kb,";
+        out << domain << "_wall_sec";
+        if (global_options.print_phase_stats) {
+            out << ",load_sec,unmarshal_sec,cfg_sec,explicate_sec,nondet_sec,simplify_sec,wto_sec,fixpoint_sec,check_sec";
+            out << ",joins,widenings,narrowings,closures,peak_kb";
+            for (size_t kind = 0; kind < crab::memory_kinds; kind++)
+                out << "," << crab::MemoryStats::name((crab::memory_kind_t)kind) << "_kb";
+            if (global_options.print_perf_counters) {
+                for (size_t event = 0; event < crab::hw_events; event++)
+                    out << "," << crab::perf_counters_t::name((crab::hw_event_t)event);
+            }
+        }
+    }
+}
+
+// The seconds of the phases that make the CFG of a program, from unmarshal to simplify, which every domain run on
+// that CFG shares.
+using prepare_seconds_t = std::array<double, 5>;
+
+static prepare_seconds_t prepare_seconds() {
+    prepare_seconds_t res;
+    size_t i = 0;
+    for (const char* phase : {"phase.unmarshal", "phase.cfg", "phase.explicate", "phase.nondet", "phase.simplify"})
+        res[i++] = crab::CrabStats::seconds(crab::CrabStats::id(phase));
+    return res;
+}
+
+// Print the columns added by --phase-stats, from the seconds of the phases that made the CFG, and the stop watches and
+// counters of the last verification.
+static void print_phase_stats(std::ostream& out, double load_seconds, const prepare_seconds_t& prepare) {
+    using crab::CrabStats;
+    // The WTO is built within the fixpoint's stop watch.
+    const double wto = CrabStats::seconds(CrabStats::id("phase.wto"));
+    out << "," << load_seconds;
+    for (double seconds : prepare)
+        out << "," << seconds;
+    out << "," << wto << "," << std::max(0.0, CrabStats::seconds(CrabStats::id("phase.fixpoint")) - wto)
+        << "," << CrabStats::seconds(CrabStats::id("phase.check"));
+    for (const char* counter : {"SplitDBM.count.join", "SplitDBM.count.widening", "SplitDBM.count.narrowing",
+                                "SplitDBM.count.closure"})
+        out << "," << CrabStats::get(CrabStats::id(counter));
+    out << "," << peak_resident_set_size_kb();
+    for (size_t kind = 0; kind < crab::memory_kinds; kind++)
+        out << "," << crab::MemoryStats::peak_kb((crab::memory_kind_t)kind);
+    if (global_options.print_perf_counters) {
+        // Empty where the event could not be counted.
+        for (const std::optional<uint64_t>& count : CrabStats::hardware_events()) {
+            out << ",";
+            if (count)
+                out << *count;
+        }
+    }
+}
+
+static bool compare_section(std::ostream& out, const raw_program& raw_prog, const string& asmfile,
+                            const string& dotfile, double load_seconds, crab::analysis_profile_t* profile);
+
+/** Verify a single program and print its result columns (without a trailing newline).
+ *
+ *  domain may list several domains, separated by commas. The program is then unmarshalled and made into a CFG once,
+ *  and each domain in turn verifies it and prints its columns, with its own timings and counters. If the linux domain
+ *  is one of them, the map loads of raw_prog hold the file descriptors of real maps, and the other domains analyze a
+ *  copy with those of create_map_crab(), as compare_section() does.
+ *
+ *  load_seconds is the time it took to load the program's file, reported with --phase-stats.
+ *  If profile is set, the analysis records in it where it spends its time. If incremental is set, it verifies the
+ *  program, as the next version of the one it verified last.
+ *
+ *  \return true if the program passed verification in every domain (for the stats pseudo-domain, if it could be
+ *  unmarshalled, and for compare, if the verdicts agree)
+ */
+static bool verify_section(std::ostream& out, const raw_program& raw_prog, const string& domain,
+                           const string& asmfile, const string& dotfile, double load_seconds,
+                           crab::analysis_profile_t* profile = nullptr,
+                           incremental_verifier_t* incremental = nullptr) {
+    if (domain == "compare")
+        return compare_section(out, raw_prog, asmfile, dotfile, load_seconds, profile);
+    const vector<string> domains = split_domains(domain);
+    std::optional<raw_program> analysis_copy;
+    if (domains.size() > 1 && has_domain(domain, "linux"))
+        analysis_copy = with_analysis_map_fds(raw_prog);
+    const raw_program& analyzed = analysis_copy ? *analysis_copy : raw_prog;
+
+    crab::CrabStats::reset();
+    crab::CrabStats::start(CRAB_STAT_ID("phase.unmarshal"));
+    auto prog_or_error = unmarshal(analyzed);
+    crab::CrabStats::stop(CRAB_STAT_ID("phase.unmarshal"));
+    if (std::holds_alternative<string>(prog_or_error)) {
+        out << "trivial verification failure: " << std::get<string>(prog_or_error);
+        return false;
+    }
+
+    auto& prog = std::get<InstructionSeq>(prog_or_error);
+    if (!asmfile.empty())
+        print(prog, asmfile);
+
+    int instruction_count = prog.size();
+
+    crab::CrabStats::start(CRAB_STAT_ID("phase.cfg"));
+    cfg_t det_cfg = instruction_seq_to_cfg(prog);
+    crab::CrabStats::stop(CRAB_STAT_ID("phase.cfg"));
+    crab::CrabStats::start(CRAB_STAT_ID("phase.explicate"));
+    explicate_assertions(det_cfg, analyzed.info);
+    crab::CrabStats::stop(CRAB_STAT_ID("phase.explicate"));
+    crab::CrabStats::start(CRAB_STAT_ID("phase.nondet"));
+    cfg_t cfg = to_nondet(det_cfg);
+    crab::CrabStats::stop(CRAB_STAT_ID("phase.nondet"));
+
+    if (global_options.simplify || global_options.fold_constants || global_options.slice) {
+        crab::CrabStats::start(CRAB_STAT_ID("phase.simplify"));
+        if (global_options.simplify)
+            cfg.simplify();
+        if (global_options.fold_constants)
+            fold_constants(cfg);
+        if (global_options.slice)
+            slice_to_assertions(cfg);
+        crab::CrabStats::stop(CRAB_STAT_ID("phase.simplify"));
+    }
+
+    if (!dotfile.empty()) {
+        print_dot(cfg, dotfile);
+    }
+
+    const prepare_seconds_t prepare = prepare_seconds();
+    bool all_passed = true;
+    for (size_t i = 0; i < domains.size(); i++) {
+        const string& name = domains[i];
+        if (i > 0) {
+            out << ",";
+            crab::CrabStats::reset();
+        }
+        if (name == "stats") {
+            auto stats = collect_stats(cfg);
+            out << std::hex << hash(analyzed) << std::dec << "," << instruction_count;
+            for (const string& h : stats_headers()) {
+                out << "," << stats.at(h);
+            }
+            continue;
+        }
+        const auto [res, seconds, wall_seconds] =
+            (name == "linux") ? bpf_verify_program(raw_prog.info.program_type, raw_prog.prog)
+            : incremental     ? incremental->validate(cfg, analyzed.info)
+                              : abs_validate(cfg, analyzed.info, profile, domain_relations(name));
+        out << res << "," << seconds << "," << resident_set_size_kb() << "," << wall_seconds;
+        if (global_options.print_phase_stats)
+            print_phase_stats(out, load_seconds, prepare);
+        all_passed &= res;
+    }
+    return all_passed;
+}
+
+/** Verify a program with both the Linux verifier and zoneCrab, at the same time on two threads, and print whether
+ *  their verdicts agree, the verdict and times of the Linux verifier and the result columns of zoneCrab (without a
+ *  trailing newline).
+ *
+ *  The map loads of raw_prog hold the file descriptors of real maps, as create_map_linux() makes them; zoneCrab
+ *  verifies a copy with those of create_map_crab().
+ *
+ *  \return true if the verdicts agree
+ */
+static bool compare_section(std::ostream& out, const raw_program& raw_prog, const string& asmfile,
+                            const string& dotfile, double load_seconds, crab::analysis_profile_t* profile) {
+    auto linux_result = std::async(std::launch::async, bpf_verify_program, raw_prog.info.program_type,
+                                   std::cref(raw_prog.prog));
+    std::ostringstream crab_out;
+    bool crab_res = false;
+    try {
+        crab_res = verify_section(crab_out, with_analysis_map_fds(raw_prog), "zoneCrab", asmfile, dotfile,
+                                  load_seconds, profile);
+    } catch (...) {
+        linux_result.wait();
+        throw;
+    }
+    const auto [linux_res, linux_seconds, linux_wall_seconds] = linux_result.get();
+    out << (linux_res == crab_res) << "," << linux_res << "," << linux_seconds << "," << linux_wall_seconds << ","
+        << crab_out.str();
+    return linux_res == crab_res;
+}
+
+/** Like verify_section, but reuse the result columns stored in cache_dir for the same program and options.
+ *
+ *  The cache is bypassed when cache_dir is empty, whenever the run has other output than the result columns, such as
+ *  a profile, and with a time or memory budget, as the result then depends on the machine.
+ */
+static bool verify_section_cached(std::ostream& out, const raw_program& raw_prog, const string& domain,
+                                  const string& asmfile, const string& dotfile, double load_seconds,
+                                  const string& cache_dir, crab::analysis_profile_t* profile = nullptr) {
+    if (cache_dir.empty() || has_domain(domain, "stats") || domain == "compare" || !asmfile.empty() ||
+        !dotfile.empty() || profile || global_options.print_invariants || !global_options.invariants_file.empty() ||
+        global_options.print_failures || global_options.print_phase_stats || global_options.timeout_seconds > 0 ||
+        global_options.max_rss_mb > 0)
+        return verify_section(out, raw_prog, domain, asmfile, dotfile, load_seconds, profile);
+
+    const string key = result_cache_key(raw_prog, domain);
+    if (auto result = result_cache_lookup(cache_dir, key)) {
+        out << *result;
+        return result->front() == '1';
+    }
+    std::ostringstream result;
+    bool res = verify_section(result, raw_prog, domain, asmfile, dotfile, load_seconds);
+    result_cache_store(cache_dir, key, result.str());
+    out << result.str();
+    return res;
+}
+
+// Like read_elf, but exit with status 2 if the file cannot be read.
+static vector<raw_program> read_elf_or_exit(const string& path, const string& section, MapFd* create_map) {
+    try {
+        return read_elf(path, section, create_map);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        exit(2);
+    }
+}
+
+/** The result columns of one section of a batch (without a trailing newline), and whether it passed. */
+struct batch_entry_t {
+    string columns;
+    bool passed{};
+};
+
+static batch_entry_t verify_batch_entry(const raw_program& raw_prog, const string& domain, double load_seconds,
+                                        const string& cache_dir) {
+    std::ostringstream columns;
+    bool passed = false;
+    try {
+        passed = verify_section_cached(columns, raw_prog, domain, {}, {}, load_seconds, cache_dir);
+    } catch (const std::exception& e) {
+        columns << "error: " << e.what();
+    }
+    return {columns.str(), passed};
+}
+
+// The result columns of a section verified by a server, under remote_headers.
+static constexpr const char* remote_headers = "zoneCrab?,zoneCrab_warnings,zoneCrab_wall_sec";
+static batch_entry_t remote_batch_entry(const remote_result_t& res) {
+    std::ostringstream columns;
+    if (res.status > 1)
+        columns << "error: " << res.text;
+    else
+        columns << (res.status == 0) << "," << res.warnings << "," << res.wall_seconds;
+    return {columns.str(), res.status == 0};
+}
+
+static vector<string> split_columns(const string& row) {
+    vector<string> res;
+    std::istringstream in(row);
+    for (string column; std::getline(in, column, ',');)
+        res.push_back(column);
+    return res;
+}
+
+static string json_string(const string& s) {
+    std::ostringstream res;
+    res << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            res << '\\' << c;
+        else if (c == '\n')
+            res << "\\n";
+        else if ((unsigned char)c < 0x20)
+            res << "\\u00" << "0123456789abcdef"[c >> 4] << "0123456789abcdef"[c & 15];
+        else
+            res << c;
+    }
+    res << '"';
+    return res.str();
+}
+
+// A column as a JSON value: a number as it is, anything else, such as a hash in hex, as a string.
+static string json_value(const string& column) {
+    static const std::regex number(R"(-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][-+]?[0-9]+)?)");
+    return std::regex_match(column, number) ? column : json_string(column);
+}
+
+/** Print the record of one section of a batch, with a trailing newline.
+ *
+ *  As CSV, it is the file and section followed by the result columns. As NDJSON, it is an object with the file,
+ *  section and hash of the program, and each result column under the name of its header; a section whose columns do
+ *  not match the headers, being an error message, has it under "error" instead.
+ */
+static void print_batch_entry(std::ostream& out, const raw_program& raw_prog, const batch_entry_t& entry,
+                              const vector<string>& headers, bool ndjson) {
+    if (!ndjson) {
+        out << raw_prog.filename << "," << raw_prog.section << "," << entry.columns << std::endl;
+        return;
+    }
+    out << "{\"file\": " << json_string(raw_prog.filename) << ", \"section\": " << json_string(raw_prog.section);
+    // The stats domain has a hash column of its own.
+    if (std::find(headers.begin(), headers.end(), "hash") == headers.end()) {
+        std::ostringstream hex;
+        hex << std::hex << hash(raw_prog);
+        out << ", \"hash\": " << json_string(hex.str());
+    }
+    const vector<string> columns = split_columns(entry.columns);
+    if (columns.size() == headers.size()) {
+        for (size_t i = 0; i < columns.size(); i++)
+            out << ", " << json_string(headers[i]) << ": " << json_value(columns[i]);
+    } else {
+        out << ", \"passed\": " << (entry.passed ? "true" : "false") << ", \"error\": " << json_string(entry.columns);
+    }
+    out << "}" << std::endl;
+}
+
+// A section of a batch, from the loading of its file to the printing of its record.
+struct batch_section_t {
+    raw_program raw_prog;
+    // The time it took to load its file.
+    double load_seconds{};
+    std::optional<batch_entry_t> entry;
+    // The entry of the program of the section, set once the first section of the batch with that program is verified.
+    std::optional<batch_entry_t>* program_entry{};
+    // Whether an earlier section of the batch has the same program; it is not verified again, and takes its entry.
+    bool duplicate{};
+};
+
+// What the verification of raw_prog depends on: its type, the maps of its file and its relocated instructions. Sections
+// with the same identity are the same program, whatever file they come from.
+static string program_identity(const raw_program& raw_prog) {
+    string res;
+    auto append = [&res](const auto& v) { res.append((const char*)&v, sizeof v); };
+    append(raw_prog.info.program_type);
+    append(raw_prog.info.map_defs->size());
+    for (const map_def& def : *raw_prog.info.map_defs) {
+        append(def.original_fd);
+        append(def.type);
+        append(def.key_size);
+        append(def.value_size);
+        append(def.inner_map_fd);
+    }
+    res.append((const char*)raw_prog.prog.data(), raw_prog.prog.size() * sizeof(ebpf_inst));
+    return res;
+}
+
+/** Verify the sections of filenames on the servers at the sockets of servers, printing their records in order.
+ *
+ *  The files are loaded first, so that the largest sections can be sent first (see verifier_coordinator.hpp).
+ */
+static int verify_all_sections_on_servers(const vector<string>& filenames, MapFd* create_map, unsigned jobs,
+                                          bool ndjson, const vector<string>& servers) {
+    const vector<string> headers = split_columns(remote_headers);
+    if (!ndjson)
+        std::cout << "file,section," << remote_headers << "\n";
+    vector<raw_program> raw_progs;
+    for (const string& filename : filenames) {
+        for (raw_program& raw_prog : read_elf_or_exit(filename, string(), create_map))
+            raw_progs.push_back(std::move(raw_prog));
+    }
+    vector<std::promise<batch_entry_t>> results(raw_progs.size());
+    std::thread coordinator([&] {
+        verify_on_servers(raw_progs, servers, jobs, [&](size_t i, const remote_result_t& res) {
+            results[i].set_value(remote_batch_entry(res));
+        });
+    });
+    bool all_passed = true;
+    for (size_t i = 0; i < results.size(); i++) {
+        const batch_entry_t entry = results[i].get_future().get();
+        print_batch_entry(std::cout, raw_progs[i], entry, headers, ndjson);
+        all_passed &= entry.passed;
+    }
+    coordinator.join();
+    return all_passed ? 0 : 1;
+}
+
+/** Verify every section of every file, printing one CSV row, or NDJSON record, per section.
+ *
+ *  Each file is loaded once; a failure in one section does not stop the batch. The batch is a pipeline: a thread loads
+ *  the files in order, jobs worker threads verify their sections as they come, each running whole analyses (the
+ *  analysis state is thread-local), and the calling thread prints the records in file and section order, each as soon
+ *  as those before it are. Loading stays at most a few sections per worker ahead of the printed ones, so that the
+ *  reading of a file overlaps the analysis of the ones before it without holding the whole batch in memory; the
+ *  workers never wait on the output, and a section is dropped once printed.
+ *
+ *  A section with the same program_identity() as one before it, such as a program compiled into several files, is
+ *  not verified again: its record has the columns of the first one, and the number of such sections is reported on
+ *  stderr at the end.
+ *
+ *  With servers, the sections are verified instead by the verifier servers at those sockets, on jobs connections to
+ *  each (see verify_all_sections_on_servers), and their records have the columns of remote_headers.
+ *
+ *  \return the process exit code: 0 if all sections passed, 1 otherwise, or 2 if a file could not be read, after the
+ *  records of the files before it
+ */
+static int verify_all_sections(const vector<string>& filenames, const string& domain, MapFd* create_map,
+                               unsigned jobs, const string& cache_dir, bool ndjson, const vector<string>& servers) {
+    if (!servers.empty())
+        return verify_all_sections_on_servers(filenames, create_map, jobs, ndjson, servers);
+    std::ostringstream header_row;
+    print_headers(header_row, domain);
+    const vector<string> headers = split_columns(header_row.str());
+    if (!ndjson)
+        std::cout << "file,section," << header_row.str() << "\n";
+
+    const size_t max_ahead = 16 * (size_t)std::max(1u, jobs);
+    std::mutex mutex;
+    std::condition_variable changed;
+    // The sections loaded and not yet printed, the first of them being the section at index printed.
+    std::deque<batch_section_t> sections;
+    size_t printed = 0;
+    size_t loaded = 0;
+    // The next section for a worker to verify.
+    size_t next = 0;
+    bool loading_done = false;
+    string load_error;
+    // The entry of each distinct program of the batch, by program_identity(), once verified.
+    std::unordered_map<string, std::optional<batch_entry_t>> programs;
+    size_t duplicates = 0;
+
+    std::thread loader([&] {
+        for (const string& filename : filenames) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return loaded - printed < max_ahead; });
+            }
+            crab::Stopwatch load;
+            vector<raw_program> file_progs;
+            try {
+                file_progs = read_elf(filename, string(), create_map);
+            } catch (const std::runtime_error& e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                load_error = e.what();
+                break;
+            }
+            load.stop();
+            vector<string> identities;
+            for (const raw_program& raw_prog : file_progs)
+                identities.push_back(program_identity(raw_prog));
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < file_progs.size(); i++) {
+                // Elements of an unordered_map stay in place as it grows.
+                auto [it, inserted] = programs.try_emplace(std::move(identities[i]));
+                sections.push_back(batch_section_t{std::move(file_progs[i]), load.toSeconds(), {}, &it->second,
+                                                   !inserted});
+                duplicates += !inserted;
+            }
+            loaded += file_progs.size();
+            changed.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        loading_done = true;
+        changed.notify_all();
+    });
+
+    vector<std::thread> workers;
+    for (unsigned j = 0; j < std::max(1u, jobs); j++) {
+        workers.emplace_back([&] {
+            while (true) {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] {
+                    // Duplicates are left to the printing thread, which may print them before a worker gets to them.
+                    while (next < loaded && (next < printed || sections[next - printed].duplicate))
+                        next++;
+                    return next < loaded || loading_done;
+                });
+                if (next == loaded)
+                    return;
+                // Sections are only dropped once verified, and a deque keeps its elements in place as it grows.
+                batch_section_t& section = sections[next++ - printed];
+                lock.unlock();
+                batch_entry_t entry =
+                    verify_batch_entry(section.raw_prog, domain, section.load_seconds, cache_dir);
+                lock.lock();
+                *section.program_entry = entry;
+                section.entry = std::move(entry);
+                changed.notify_all();
+            }
+        });
+    }
+
+    bool all_passed = true;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // The first section with the program of a duplicate comes before it, and so was verified.
+        changed.wait(lock, [&] {
+            return (!sections.empty() && (sections.front().entry || sections.front().duplicate)) ||
+                   (loading_done && printed == loaded);
+        });
+        if (sections.empty())
+            break;
+        batch_section_t section = std::move(sections.front());
+        sections.pop_front();
+        printed++;
+        if (section.duplicate)
+            section.entry = *section.program_entry;
+        changed.notify_all();
+        lock.unlock();
+        print_batch_entry(std::cout, section.raw_prog, *section.entry, headers, ndjson);
+        all_passed &= section.entry->passed;
+    }
+    loader.join();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (duplicates > 0) {
+        std::cerr << duplicates << " of " << loaded << " sections had the program of an earlier section, and were "
+                  << "not verified again\n";
+    }
+    if (!load_error.empty()) {
+        std::cerr << load_error << "\n";
+        return 2;
+    }
+    return all_passed ? 0 : 1;
+}
+
+/** Verify section of filename, then again each time the file changes, reusing the invariants of the code that did
+ *  not change. Runs until interrupted.
+ */
+static int watch_section(const string& filename, const string& section, const string& asmfile,
+                         const string& dotfile) {
+    incremental_verifier_t verifier;
+    std::error_code ec;
+    auto last = std::filesystem::last_write_time(filename, ec);
+    while (true) {
+        crab::Stopwatch load;
+        vector<raw_program> raw_progs;
+        try {
+            raw_progs = read_elf(filename, section, create_map_crab);
+        } catch (const std::runtime_error& e) {
+            // The file may be in the middle of being rebuilt; wait for the next version.
+            std::cerr << e.what() << "\n";
+        }
+        load.stop();
+        if (raw_progs.size() == 1) {
+            verify_section(std::cout, raw_progs.back(), "zoneCrab", asmfile, dotfile, load.toSeconds(), nullptr,
+                           &verifier);
+            std::cout << std::endl;
+            std::cerr << "reused the invariants of " << verifier.reused_blocks() << " of " << verifier.total_blocks()
+                      << " blocks\n";
+        } else {
+            std::cerr << "no section " << section << " in " << filename << "\n";
+        }
+
+        // Wait for the file to change, and then to stay unchanged for a poll, as a build may write it in steps.
+        for (auto seen = last;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            const auto current = std::filesystem::last_write_time(filename, ec);
+            if (ec)
+                continue;
+            if (current == seen && current != last) {
+                last = current;
+                break;
+            }
+            seen = current;
+        }
+    }
+}
+
+static int run(int argc, char** argv) {
     // Parse command line arguments:
 
     crab::CrabEnableWarningMsg(false);
 
     CLI::App app{"A new eBPF verifier"};
 
-    std::string filename;
-    app.add_option("path", filename, "Elf file to analyze")->required()->type_name("FILE");
+    vector<string> positionals;
+    app.add_option("path", positionals, "Elf file to analyze and optional section (files only, with --all-sections)")
+        ->type_name("FILE [SECTION]");
 
-    std::string desired_section;
-
-    app.add_option("section", desired_section, "Section to analyze")->type_name("SECTION");
     bool list = false;
     app.add_flag("-l", list, "List sections");
 
+    bool all_sections = false;
+    app.add_flag("--all-sections", all_sections, "Verify every section of every FILE, one CSV row per section");
+
+    unsigned jobs = 1;
+    app.add_option("-j,--jobs", jobs, "With --all-sections, verify N sections concurrently; with --serve, serve N connections (0: one per core)")
+        ->type_name("N");
+
+    string format = "csv";
+    app.add_set("--format", format, {"csv", "ndjson"},
+                "With --all-sections, print a CSV row per section, or a JSON object per line (default: csv)")
+        ->type_name("FORMAT");
+
     std::string domain = "zoneCrab";
-    std::set<string> doms{"stats", "linux", "zoneCrab"};
-    app.add_set("-d,--dom,--domain", domain, doms, "Abstract domain")->type_name("DOMAIN");
+    std::set<string> doms{"stats", "linux", "compare", "zoneCrab", "intervals", "equalities"};
+    CLI::Option* domain_option =
+        app.add_option("-d,--dom,--domain", domain,
+                       "Abstract domain: compare, equalities, intervals, linux, stats or zoneCrab (intervals and "
+                       "equalities: zoneCrab keeping fewer relations, faster, less precise; compare: both linux and "
+                       "zoneCrab); several, separated by commas, run each on the same CFG")
+            ->check([&doms](const string& value) -> string {
+                const vector<string> domains = split_domains(value);
+                if (domains.empty())
+                    return "no domain";
+                for (size_t i = 0; i < domains.size(); i++) {
+                    if (!doms.count(domains[i]))
+                        return domains[i] + " is not a domain";
+                    if (domains[i] == "compare" && domains.size() > 1)
+                        return "compare cannot be listed with other domains";
+                    if (std::find(domains.begin(), domains.begin() + i, domains[i]) != domains.begin() + i)
+                        return domains[i] + " is listed twice";
+                }
+                return {};
+            })
+            ->type_name("DOMAIN[,DOMAIN...]");
 
     bool verbose = false;
     app.add_flag("-i", global_options.print_invariants, "Print invariants");
@@ -53,6 +690,106 @@ int main(int argc, char** argv) {
 
     bool no_simplify{false};
     app.add_flag("--no-simplify", no_simplify, "Do not simplify");
+    app.add_flag("--fold-constants", global_options.fold_constants,
+                 "Fold the constant operations and copies of each block before the analysis");
+    app.add_flag("--slice", global_options.slice, "Leave out the statements that no assertion depends on");
+
+    app.add_option("--widening-delay", global_options.widening_delay,
+                   "Number of loop iterations to join before widening (default: 1)")
+        ->type_name("N");
+    app.add_option("--widening-thresholds", global_options.widening_thresholds,
+                   "Widen to at most N constants compared against in each loop (default: 0, plain widening)")
+        ->type_name("N");
+    app.add_option("--max-narrowing", global_options.max_narrowing_iterations,
+                   "Stop narrowing each loop after N iterations (default: until stable)")
+        ->type_name("N");
+    app.add_flag("--warm-start-loops", global_options.warm_start_loops,
+                 "Start a nested loop entered again with a larger state from its previous fixpoint");
+    app.add_flag("--pack-variables", global_options.pack_variables,
+                 "Keep unrelated variables in separate zones (faster, less precise)");
+    app.add_flag("--fallback-to-zones", global_options.fallback_to_zones,
+                 "With the intervals or equalities domain, verify again with zoneCrab the sections that fail, from "
+                 "their first failing part where possible");
+    app.add_option("--max-relational", global_options.max_relational_variables,
+                   "Keep the relations of at most N variables per state, and only the bounds of the others (default: "
+                   "0, no limit)")
+        ->type_name("N");
+    bool tiered = false;
+    app.add_flag("--tiered", tiered, "Same as --domain intervals --fallback-to-zones")->excludes(domain_option);
+    bool keep_dead_variables{false};
+    app.add_flag("--keep-dead-variables", keep_dead_variables,
+                 "Keep the state of registers and stack cells that are never read again (slower, same results)");
+    bool no_known_bits{false};
+    app.add_flag("--no-known-bits", no_known_bits,
+                 "Do not keep the bits known of each register through bitwise operations (less precise)");
+    app.add_flag("--summarize-blocks", global_options.summarize_blocks,
+                 "Iterate over the blocks of loops through summaries of their statements compiled once (same results)");
+    app.add_flag("--fail-fast", global_options.fail_fast,
+                 "Stop at the first assertion that cannot be proven (no effect with -i)");
+    app.add_flag("--phase-stats", global_options.print_phase_stats,
+                 "Add the time of each phase, analysis counters and peak memory to the CSV output");
+    app.add_flag("--perf-counters", global_options.print_perf_counters,
+                 "With --phase-stats, add the cycles, instructions, LLC misses and branch misses of the fixpoint, "
+                 "from the hardware counters (Linux)");
+
+    app.add_option("--timeout", global_options.timeout_seconds,
+                   "Give up on the analysis of a section after SEC seconds and reject it (default: 0, no limit)")
+        ->type_name("SEC");
+    app.add_option("--max-rss", global_options.max_rss_mb,
+                   "Give up on the analysis once the process uses more than MB megabytes and reject the section "
+                   "(default: 0, no limit)")
+        ->type_name("MB");
+    app.add_option("--closure-jobs", global_options.closure_threads,
+                   "Close each large zone on N threads (default: 1; 0: one per core)")
+        ->type_name("N");
+    app.add_option("--fixpoint-jobs", global_options.fixpoint_threads,
+                   "Analyze the parts of the program that do not depend on each other on N threads (default: 1; 0: "
+                   "one per core)")
+        ->type_name("N");
+    app.add_flag("--huge-pages", global_options.huge_pages,
+                 "Back the memory of the zones with transparent huge pages where available (Linux), for fewer TLB "
+                 "misses on large programs");
+
+    bool watch = false;
+    app.add_flag("--watch", watch,
+                 "Verify the section again each time FILE changes, reusing the invariants of unchanged code "
+                 "(zoneCrab only)");
+
+    std::string serve_socket;
+    app.add_option("--serve", serve_socket,
+                   "Verify the programs sent to a Unix socket created at SOCKET, on -j threads, until interrupted "
+                   "(zoneCrab only; see src/verifier_server.hpp)")
+        ->type_name("SOCKET");
+
+    string servers_list;
+    app.add_option("--servers", servers_list,
+                   "With --all-sections, verify the sections on the servers of --serve at these sockets, on -j "
+                   "connections to each, rather than in this process (see src/verifier_coordinator.hpp)")
+        ->type_name("SOCKET,...");
+
+    std::string profile_file;
+    app.add_option("--profile", profile_file,
+                   "Write where the analysis spends its time to FILE, as folded stacks, or as JSON if FILE ends with "
+                   ".json (zoneCrab, single section only)")
+        ->type_name("FILE");
+
+    app.add_option("--invariants", global_options.invariants_file,
+                   "Write the invariants of each block to FILE in a compact binary format, or as JSON if FILE ends "
+                   "with .json (single section only)")
+        ->type_name("FILE");
+    app.add_option("--checkpoint", global_options.checkpoint_file,
+                   "Save the analysis to FILE as it goes, so that --resume may continue it if it is stopped; FILE is "
+                   "removed once the analysis completes (single section only)")
+        ->type_name("FILE");
+    app.add_option("--checkpoint-interval", global_options.checkpoint_seconds,
+                   "Save the analysis at most once per SEC seconds (default: 60)")
+        ->type_name("SEC");
+    app.add_flag("--resume", global_options.resume,
+                 "Continue the analysis saved in the file of --checkpoint, if there is one");
+
+    std::string cache_dir;
+    app.add_option("--cache", cache_dir, "Reuse verification results stored in DIR, and store new ones there")
+        ->type_name("DIR");
 
     std::string asmfile;
     app.add_option("--asm", asmfile, "Print disassembly to FILE")->type_name("FILE");
@@ -60,29 +797,103 @@ int main(int argc, char** argv) {
     app.add_option("--dot", dotfile, "Export cfg to dot FILE")->type_name("FILE");
 
     CLI11_PARSE(app, argc, argv);
+    if (tiered) {
+        domain = "intervals";
+        global_options.fallback_to_zones = true;
+    }
     if (verbose)
         global_options.print_invariants = global_options.print_failures = true;
 
     global_options.simplify = !no_simplify;
+    global_options.relations = domain_relations(domain);
+    global_options.forget_dead_variables = !keep_dead_variables;
+    global_options.known_bits = !no_known_bits;
+    if (global_options.print_perf_counters) {
+        if (!global_options.print_phase_stats) {
+            std::cerr << "--perf-counters applies with --phase-stats\n";
+            return 64;
+        }
+        crab::CrabStats::count_hardware_events(crab::CrabStats::id("phase.fixpoint"));
+    }
     // Main program
 
-    if (filename == "@headers") {
-        if (domain == "stats") {
-            std::cout << "hash";
-            std::cout << ",instructions";
-            for (const string& h : stats_headers()) {
-                std::cout << "," << h;
-            }
-        } else {
-            std::cout << domain << "?,";
-            std::cout << domain << "_sec,";
-            std::cout << domain << "_kb";
+    if (!serve_socket.empty()) {
+        if (!positionals.empty() || all_sections || watch || domain != "zoneCrab") {
+            std::cerr << "--serve takes no FILE, and applies to the zoneCrab domain\n";
+            return 64;
         }
+        if (jobs == 0)
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        return serve_verifier(serve_socket, jobs);
+    }
+    vector<string> servers;
+    std::istringstream servers_in(servers_list);
+    for (string server; std::getline(servers_in, server, ',');) {
+        if (!server.empty())
+            servers.push_back(server);
+    }
+    if (!servers.empty() && (!all_sections || domain != "zoneCrab" || global_options.print_phase_stats)) {
+        std::cerr << "--servers applies to --all-sections, with the zoneCrab domain and without --phase-stats\n";
+        return 64;
+    }
+    if (positionals.empty()) {
+        std::cerr << "path is required\n";
+        return 64;
+    }
+    if (!all_sections && positionals.size() > 2) {
+        std::cerr << "too many positional arguments; use --all-sections to verify multiple files\n";
+        return 64;
+    }
+    if (watch && (all_sections || domain != "zoneCrab" || positionals.size() != 2)) {
+        std::cerr << "--watch applies to a single section, given by name, with the zoneCrab domain\n";
+        return 64;
+    }
+    if (!profile_file.empty() && (all_sections || domain.find(',') != string::npos)) {
+        std::cerr << "--profile applies to a single section and domain\n";
+        return 64;
+    }
+    if (format == "ndjson" && global_options.print_phase_stats && domain.find(',') != string::npos) {
+        std::cerr << "--format ndjson with --phase-stats applies to a single domain, as the domains share the names "
+                     "of those columns\n";
+        return 64;
+    }
+    if (all_sections && !global_options.invariants_file.empty()) {
+        std::cerr << "--invariants applies to a single section\n";
+        return 64;
+    }
+    if (global_options.resume && global_options.checkpoint_file.empty()) {
+        std::cerr << "--resume requires --checkpoint\n";
+        return 64;
+    }
+    if (!global_options.checkpoint_file.empty() &&
+        (all_sections || watch || global_options.fallback_to_zones || domain == "linux" || domain == "stats" ||
+         domain.find(',') != string::npos)) {
+        std::cerr << "--checkpoint applies to the analysis of a single section by a single domain, without --watch or "
+                     "--fallback-to-zones\n";
+        return 64;
+    }
+    const string& filename = positionals.front();
+    const string desired_section = (!all_sections && positionals.size() == 2) ? positionals.back() : string();
+
+    if (filename == "@headers") {
+        print_headers(std::cout, domain);
         return 0;
     }
 
-    auto create_map = domain == "linux" ? create_map_linux : create_map_crab;
-    auto raw_progs = read_elf(filename, desired_section, create_map);
+    if (watch)
+        return watch_section(filename, desired_section, asmfile, dotfile);
+
+    auto create_map = (has_domain(domain, "linux") || domain == "compare") ? create_map_linux : create_map_crab;
+
+    if (all_sections) {
+        if (jobs == 0)
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        return verify_all_sections(positionals, domain, create_map, jobs, cache_dir, format == "ndjson", servers);
+    }
+
+    crab::Stopwatch load;
+    auto raw_progs = read_elf_or_exit(filename, desired_section, create_map);
+    load.stop();
 
     if (list || raw_progs.size() != 1) {
         if (!list) {
@@ -95,45 +906,35 @@ int main(int argc, char** argv) {
         std::cout << "\n";
         return list ? 0 : 64;
     }
-    raw_program raw_prog = raw_progs.back();
+    const raw_program& raw_prog = raw_progs.back();
 
-    auto prog_or_error = unmarshal(raw_prog);
-    if (std::holds_alternative<string>(prog_or_error)) {
-        std::cout << "trivial verification failure: " << std::get<string>(prog_or_error) << "\n";
-        return 1;
-    }
-
-    auto& prog = std::get<InstructionSeq>(prog_or_error);
-    if (!asmfile.empty())
-        print(prog, asmfile);
-
-    int instruction_count = prog.size();
-
-    cfg_t det_cfg = instruction_seq_to_cfg(prog);
-    explicate_assertions(det_cfg, raw_prog.info);
-    cfg_t cfg = to_nondet(det_cfg);
-
-    if (global_options.simplify) {
-        cfg.simplify();
-    }
-
-    if (!dotfile.empty()) {
-        print_dot(cfg, dotfile);
+    if (!profile_file.empty()) {
+        crab::analysis_profile_t profile;
+        bool res =
+            verify_section_cached(std::cout, raw_prog, domain, asmfile, dotfile, load.toSeconds(), cache_dir, &profile);
+        std::cout << "\n";
+        std::ofstream out(profile_file);
+        if (profile_file.size() >= 5 && profile_file.compare(profile_file.size() - 5, 5, ".json") == 0)
+            profile.write_json(out);
+        else
+            profile.write_folded(out);
+        if (!out) {
+            std::cerr << "cannot write " << profile_file << "\n";
+            return 2;
+        }
+        return !res;
     }
 
-    auto stats = collect_stats(cfg);
+    bool res = verify_section_cached(std::cout, raw_prog, domain, asmfile, dotfile, load.toSeconds(), cache_dir);
+    std::cout << "\n";
+    return !res;
+}
 
-    if (domain == "stats") {
-        std::cout << std::hex << hash(raw_prog) << std::dec << "," << instruction_count;
-        for (const string& h : stats_headers()) {
-            std::cout << "," << stats.at(h);
-        }
-        std::cout << "\n";
-    } else {
-        const auto [res, seconds] = (domain == "linux") ? bpf_verify_program(raw_prog.info.program_type, raw_prog.prog)
-                                                        : abs_validate(cfg, raw_prog.info);
-        std::cout << res << "," << seconds << "," << resident_set_size_kb() << "\n";
-        return !res;
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
+    } catch (const crab::crab_error& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
     }
-    return 0;
 }
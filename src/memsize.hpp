@@ -5,6 +5,7 @@
 #include <ios>
 #include <iostream>
 #include <string>
+#include <sys/resource.h>
 #include <unistd.h>
 
 inline long resident_set_size_kb() {
@@ -20,3 +21,10 @@ inline long resident_set_size_kb() {
     long page_size_kb = sysconf(_SC_PAGE_SIZE) / 1024; // in case x86-64 is configured to use 2MB pages
     return rss * page_size_kb;
 }
+
+// The largest resident set size of the process so far.
+inline long peak_resident_set_size_kb() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
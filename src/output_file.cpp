@@ -0,0 +1,96 @@
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#if EBPF_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "output_file.hpp"
+
+static constexpr std::size_t buffer_size = 1 << 20;
+
+static bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool output_has_suffix(const std::string& path, const std::string& suffix) {
+    return ends_with(ends_with(path, ".gz") ? path.substr(0, path.size() - 3) : path, suffix);
+}
+
+namespace {
+
+class buffered_file_t final : public std::ofstream {
+    // Set as the buffer of the file before it is opened, so it must outlive it: see the destructor.
+    std::vector<char> _buffer = std::vector<char>(buffer_size);
+
+  public:
+    explicit buffered_file_t(const std::string& path) {
+        rdbuf()->pubsetbuf(_buffer.data(), (std::streamsize)_buffer.size());
+        open(path, std::ios::binary);
+    }
+
+    ~buffered_file_t() override { close(); }
+};
+
+#if EBPF_WITH_ZLIB
+class gzip_buf_t final : public std::streambuf {
+    gzFile _file;
+    std::vector<char> _buffer = std::vector<char>(buffer_size);
+
+    bool write_buffer() {
+        const int n = (int)(pptr() - pbase());
+        setp(_buffer.data(), _buffer.data() + _buffer.size());
+        return n == 0 || gzwrite(_file, _buffer.data(), (unsigned)n) == n;
+    }
+
+  protected:
+    int_type overflow(int_type c) override {
+        if (!write_buffer())
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+            sputc(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+    // Hand the buffer to zlib, without ending a compressed block, which would cost compression at every flush.
+    int sync() override { return write_buffer() ? 0 : -1; }
+
+  public:
+    explicit gzip_buf_t(gzFile file) : _file{file} {
+        gzbuffer(_file, (unsigned)buffer_size);
+        setp(_buffer.data(), _buffer.data() + _buffer.size());
+    }
+
+    ~gzip_buf_t() override {
+        write_buffer();
+        gzclose(_file);
+    }
+};
+
+class gzip_file_t final : public std::ostream {
+    gzip_buf_t _buf;
+
+  public:
+    explicit gzip_file_t(gzFile file) : std::ostream(nullptr), _buf{file} { rdbuf(&_buf); }
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<std::ostream> open_output(const std::string& path) {
+    if (ends_with(path, ".gz")) {
+#if EBPF_WITH_ZLIB
+        gzFile file = gzopen(path.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("Could not open file " + path);
+        return std::make_unique<gzip_file_t>(file);
+#else
+        throw std::runtime_error("Cannot write " + path + ": built without zlib");
+#endif
+    }
+    auto res = std::make_unique<buffered_file_t>(path);
+    if (res->fail())
+        throw std::runtime_error("Could not open file " + path);
+    return res;
+}
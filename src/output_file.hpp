@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+/** Output files for the large dumps of the verifier: disassembly, CFGs and invariants.
+ *
+ *  They are written through a large buffer, so that the many small writes of the printers reach the file in few
+ *  system calls, and compressed with gzip as they are written when the path ends with ".gz", so that the dump of a
+ *  large program is never held in memory, nor on disk uncompressed.
+ */
+
+// Whether path ends with suffix, before a ".gz" if it has one.
+bool output_has_suffix(const std::string& path, const std::string& suffix);
+
+// Open path for writing. Throws std::runtime_error if it cannot be opened, or if it ends with ".gz" and the verifier
+// was built without zlib. Write errors show in the state of the stream; the file is complete once it is destroyed.
+std::unique_ptr<std::ostream> open_output(const std::string& path);
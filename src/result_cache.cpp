@@ -0,0 +1,117 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include <boost/functional/hash.hpp>
+
+#include "asm_syntax.hpp"
+#include "config.hpp"
+#include "result_cache.hpp"
+
+namespace fs = std::filesystem;
+
+// Identifies the verifier build, so that results of a changed analysis are not reused.
+static size_t verifier_hash() {
+    static const size_t h = [] {
+        std::ifstream exe("/proc/self/exe", std::ios::binary);
+        std::string bytes{std::istreambuf_iterator<char>(exe), std::istreambuf_iterator<char>()};
+        return boost::hash_range(bytes.begin(), bytes.end());
+    }();
+    return h;
+}
+
+// Append the bytes of value to the key.
+template <typename T>
+static void append(std::string& key, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void append(std::string& key, const std::string& value) {
+    append(key, value.size());
+    key += value;
+}
+
+std::string result_cache_key(const raw_program& raw_prog, const std::string& domain) {
+    std::string key;
+    append(key, raw_prog.prog.size());
+    key.append((const char*)raw_prog.prog.data(), raw_prog.prog.size() * sizeof(ebpf_inst));
+
+    const program_info& info = raw_prog.info;
+    append(key, (int)info.program_type);
+    append(key, info.descriptor.size);
+    append(key, info.descriptor.data);
+    append(key, info.descriptor.end);
+    append(key, info.descriptor.meta);
+    append(key, info.map_defs->size());
+    for (const map_def& def : *info.map_defs) {
+        append(key, def.original_fd);
+        append(key, (unsigned int)def.type);
+        append(key, def.key_size);
+        append(key, def.value_size);
+        append(key, def.inner_map_fd);
+    }
+
+    append(key, domain);
+    append(key, global_options.simplify);
+    append(key, global_options.fold_constants);
+    append(key, global_options.slice);
+    append(key, global_options.check_semantic_reachability);
+    append(key, global_options.widening_delay);
+    append(key, global_options.widening_thresholds);
+    append(key, global_options.max_narrowing_iterations);
+    append(key, global_options.warm_start_loops);
+    append(key, global_options.pack_variables);
+    append(key, (int)global_options.relations);
+    append(key, global_options.fallback_to_zones);
+    append(key, global_options.max_relational_variables);
+    // The parallel fixpoint keeps the array cells of each part apart, which may change the results.
+    append(key, global_options.fixpoint_threads != 1);
+    append(key, global_options.forget_dead_variables);
+    append(key, global_options.known_bits);
+    append(key, global_options.summarize_blocks);
+    append(key, verifier_hash());
+    return key;
+}
+
+// The file of the entry for key in its cache directory, named by a hash of the key.
+static fs::path entry_path(const std::string& dir, const std::string& key) {
+    std::ostringstream name;
+    name << std::hex << boost::hash_range(key.begin(), key.end());
+    return fs::path(dir) / name.str();
+}
+
+std::optional<std::string> result_cache_lookup(const std::string& dir, const std::string& key) {
+    std::ifstream entry(entry_path(dir, key), std::ios::binary);
+    std::string result;
+    if (!std::getline(entry, result) || result.empty())
+        return {};
+    // Keys whose hashes collide share a file, which holds the key of the last result stored.
+    const std::string stored_key{std::istreambuf_iterator<char>(entry), std::istreambuf_iterator<char>()};
+    if (stored_key != key)
+        return {};
+    return result;
+}
+
+void result_cache_store(const std::string& dir, const std::string& key, const std::string& result) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    const fs::path path = entry_path(dir, key);
+    std::ostringstream tmp_name;
+    tmp_name << path.filename().string() << ".tmp." << getpid() << "." << std::this_thread::get_id();
+    const fs::path tmp = fs::path(dir) / tmp_name.str();
+    {
+        std::ofstream entry(tmp, std::ios::binary);
+        entry << result << "\n" << key;
+        if (!entry)
+            return;
+    }
+    fs::rename(tmp, path, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "spec_type_descriptors.hpp"
+
+/** A persistent cache of verification results, kept as one small file per key in a directory.
+ *
+ *  The key covers everything the result depends on: the instruction bytes, the program type and its context
+ *  descriptor, the map definitions, the domain, the global analysis options and the verifier binary itself.
+ *  Entries are never invalidated in place; a changed input simply yields a different key. The key is the whole of
+ *  those inputs rather than a digest of them: an entry is named by a hash of its key but holds the key itself, which
+ *  a lookup compares, so that a collision of the hashes cannot return the result of another program.
+ */
+
+// The cache key of verifying raw_prog with domain, under the current global options, as bytes.
+std::string result_cache_key(const raw_program& raw_prog, const std::string& domain);
+
+// The result stored for key in the cache directory dir, if any.
+std::optional<std::string> result_cache_lookup(const std::string& dir, const std::string& key);
+
+// Store the result for key in the cache directory dir, creating it if needed. Concurrent writers of the same key
+// are safe: the entry is written aside and renamed into place. Failures to write are ignored.
+void result_cache_store(const std::string& dir, const std::string& key, const std::string& result);
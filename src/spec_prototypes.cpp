@@ -1,3 +1,7 @@
+#include <array>
+#include <cassert>
+#include <optional>
+
 #include "spec_prototypes.hpp"
 
 static const struct bpf_func_proto bpf_unspec_proto = {
@@ -1835,3 +1839,124 @@ bpf_func_proto get_prototype(unsigned int n) {
 }
 
 bool is_valid_prototype(unsigned int n) { return n < sizeof(prototypes) / sizeof(prototypes[0]) && n > 0; }
+
+static ArgSingle::Kind to_arg_single_kind(Arg t) {
+    switch (t) {
+    case Arg::ANYTHING: return ArgSingle::Kind::ANYTHING;
+    case Arg::CONST_SHARED_PTR: return ArgSingle::Kind::MAP_FD;
+    case Arg::PTR_TO_MAP_KEY: return ArgSingle::Kind::PTR_TO_MAP_KEY;
+    case Arg::PTR_TO_MAP_VALUE: return ArgSingle::Kind::PTR_TO_MAP_VALUE;
+    case Arg::PTR_TO_CTX: return ArgSingle::Kind::PTR_TO_CTX;
+    default: break;
+    }
+    return {};
+}
+
+static ArgPair::Kind to_arg_pair_kind(Arg t) {
+    switch (t) {
+    case Arg::PTR_TO_MEM_OR_NULL: return ArgPair::Kind::PTR_TO_MEM_OR_NULL;
+    case Arg::PTR_TO_MEM: return ArgPair::Kind::PTR_TO_MEM;
+    case Arg::PTR_TO_UNINIT_MEM: return ArgPair::Kind::PTR_TO_UNINIT_MEM;
+    default: break;
+    }
+    return {};
+}
+
+static Call make_call(int32_t n, const bpf_func_proto& proto) {
+    Call res;
+    res.func = n;
+    res.name = proto.name;
+    res.pkt_access = proto.pkt_access;
+    res.returns_map = proto.ret_type == Ret::PTR_TO_MAP_VALUE_OR_NULL;
+    std::array<Arg, 7> args = {{Arg::DONTCARE, proto.arg1_type, proto.arg2_type, proto.arg3_type, proto.arg4_type,
+                                proto.arg5_type, Arg::DONTCARE}};
+    for (size_t i = 1; i < args.size() - 1; i++) {
+        switch (args[i]) {
+        case Arg::DONTCARE: return res;
+        case Arg::ANYTHING:
+        case Arg::CONST_SHARED_PTR:
+        case Arg::PTR_TO_MAP_KEY:
+        case Arg::PTR_TO_MAP_VALUE:
+        case Arg::PTR_TO_CTX: res.singles.push_back({to_arg_single_kind(args[i]), Reg{(uint8_t)i}}); break;
+        case Arg::CONST_SIZE: assert(false); continue;
+        case Arg::CONST_SIZE_OR_ZERO: assert(false); continue;
+        case Arg::PTR_TO_MEM_OR_NULL:
+        case Arg::PTR_TO_MEM:
+        case Arg::PTR_TO_UNINIT_MEM:
+            bool can_be_zero = (args[i + 1] == Arg::CONST_SIZE_OR_ZERO);
+            res.pairs.push_back({to_arg_pair_kind(args[i]), Reg{(uint8_t)i}, Reg{(uint8_t)(i + 1)}, can_be_zero});
+            i++;
+            break;
+        }
+    }
+    return res;
+}
+
+static Assert type_of(Reg r, TypeGroup t) { return Assert{TypeConstraint{r, t}}; }
+
+static std::vector<Assert> call_preconditions(const Call& call, bool is_privileged) {
+    std::vector<Assert> res;
+    std::optional<Reg> map_fd_reg;
+    for (ArgSingle arg : call.singles) {
+        switch (arg.kind) {
+        case ArgSingle::Kind::ANYTHING:
+            // avoid pointer leakage:
+            if (!is_privileged)
+                res.push_back(type_of(arg.reg, TypeGroup::num));
+            break;
+        case ArgSingle::Kind::MAP_FD:
+            res.push_back(type_of(arg.reg, TypeGroup::map_fd));
+            map_fd_reg = arg.reg;
+            break;
+        case ArgSingle::Kind::PTR_TO_MAP_KEY:
+        case ArgSingle::Kind::PTR_TO_MAP_VALUE:
+            res.push_back(type_of(arg.reg, TypeGroup::stack_or_packet));
+            res.push_back(Assert{ValidMapKeyValue{arg.reg, *map_fd_reg, arg.kind == ArgSingle::Kind::PTR_TO_MAP_KEY}});
+            break;
+        case ArgSingle::Kind::PTR_TO_CTX:
+            res.push_back(type_of(arg.reg, TypeGroup::ctx));
+            // TODO: the kernel has some other conditions here -
+            // maybe offset == 0
+            break;
+        }
+    }
+    for (ArgPair arg : call.pairs) {
+        bool or_null = false;
+        switch (arg.kind) {
+        case ArgPair::Kind::PTR_TO_MEM_OR_NULL:
+            res.push_back(type_of(arg.mem, TypeGroup::mem_or_num));
+            // res.push_back(Assert{OnlyZeroIfNum{arg.mem}});
+            or_null = true;
+            break;
+        case ArgPair::Kind::PTR_TO_MEM:
+            /* LINUX: pointer to valid memory (stack, packet, map value) */
+            // TODO: check initialization
+            res.push_back(type_of(arg.mem, TypeGroup::mem));
+            break;
+        case ArgPair::Kind::PTR_TO_UNINIT_MEM:
+            // memory may be uninitialized, i.e. write only
+            res.push_back(type_of(arg.mem, TypeGroup::mem));
+            break;
+        }
+        // TODO: reg is constant (or maybe it's not important)
+        res.push_back(type_of(arg.size, TypeGroup::num));
+        res.push_back(Assert{ValidSize{arg.size, arg.can_be_zero}});
+        res.push_back(Assert{ValidAccess{arg.mem, 0, arg.size, or_null}});
+    }
+    return res;
+}
+
+const helper_summary_t& get_helper_summary(int32_t n) {
+    constexpr size_t count = sizeof(prototypes) / sizeof(prototypes[0]);
+    // Built on first use, for every helper at once, so that any thread may read it.
+    static const std::array<helper_summary_t, count> summaries = [] {
+        std::array<helper_summary_t, count> res;
+        for (size_t i = 0; i < count; i++) {
+            res[i].call = make_call((int32_t)i, prototypes[i]);
+            res[i].preconditions = call_preconditions(res[i].call, false);
+            res[i].privileged_preconditions = call_preconditions(res[i].call, true);
+        }
+        return res;
+    }();
+    return summaries[n >= 0 && (size_t)n < count ? n : 0];
+}
@@ -1,6 +1,10 @@
 #pragma once
 // Taken from the linux kernel
 
+#include <vector>
+
+#include "asm_syntax.hpp"
+
 enum class Ret { INTEGER, VOID, PTR_TO_MAP_VALUE_OR_NULL };
 
 enum class Arg {
@@ -62,3 +66,14 @@ struct bpf_func_proto {
 
 bpf_func_proto get_prototype(unsigned int n);
 bool is_valid_prototype(unsigned int n);
+
+// A helper as the analysis sees it, decoded from its prototype once for all of its call sites.
+struct helper_summary_t {
+    // A call to the helper, with its arguments grouped as they are checked.
+    Call call;
+    // The assertions that must hold before a call, in unprivileged programs and in privileged ones.
+    std::vector<Assert> preconditions, privileged_preconditions;
+};
+
+// The summary of helper n, or that of bpf_unspec (helper 0) if n is no known helper.
+const helper_summary_t& get_helper_summary(int32_t n);
@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -94,11 +95,15 @@ struct map_def {
 
 struct program_info {
     BpfProgType program_type;
-    std::vector<map_def> map_defs;
+    // The maps of the ELF file, shared by the programs of all its sections rather than copied into each.
+    std::shared_ptr<const std::vector<map_def>> map_defs = no_map_defs();
     ptype_descr descriptor;
-};
 
-extern program_info global_program_info;
+    static const std::shared_ptr<const std::vector<map_def>>& no_map_defs() {
+        static const auto empty = std::make_shared<const std::vector<map_def>>();
+        return empty;
+    }
+};
 
 struct raw_program {
     std::string filename;
@@ -107,24 +112,25 @@ struct raw_program {
     program_info info;
 };
 
-constexpr ptype_descr sk_buff = {sk_skb_regions, 19 * 4, 20 * 4, 35 * 4};
-constexpr ptype_descr xdp_md = {xdp_regions, 0, 1 * 4, 2 * 4};
-constexpr ptype_descr sk_msg_md = {17 * 4, 0, 1 * 8, -1}; // TODO: verify
-constexpr ptype_descr unspec_descr = {0};
-constexpr ptype_descr cgroup_dev_descr = {cgroup_dev_regions};
-constexpr ptype_descr kprobe_descr = {kprobe_regions};
-constexpr ptype_descr tracepoint_descr = {tracepoint_regions};
-constexpr ptype_descr perf_event_descr = {perf_event_regions};
-constexpr ptype_descr socket_filter_descr = sk_buff;
-constexpr ptype_descr sched_descr = sk_buff;
-constexpr ptype_descr xdp_descr = xdp_md;
-constexpr ptype_descr lwt_xmit_descr = sk_buff;
-constexpr ptype_descr lwt_inout_descr = sk_buff;
-constexpr ptype_descr cgroup_sock_descr = {cgroup_sock_regions};
-constexpr ptype_descr sock_ops_descr = {sock_ops_regions};
-constexpr ptype_descr sk_skb_descr = sk_buff;
+inline constexpr ptype_descr sk_buff = {sk_skb_regions, 19 * 4, 20 * 4, 35 * 4};
+inline constexpr ptype_descr xdp_md = {xdp_regions, 0, 1 * 4, 2 * 4};
+inline constexpr ptype_descr sk_msg_md = {17 * 4, 0, 1 * 8, -1}; // TODO: verify
+inline constexpr ptype_descr unspec_descr = {0};
+inline constexpr ptype_descr cgroup_dev_descr = {cgroup_dev_regions};
+inline constexpr ptype_descr kprobe_descr = {kprobe_regions};
+inline constexpr ptype_descr tracepoint_descr = {tracepoint_regions};
+inline constexpr ptype_descr perf_event_descr = {perf_event_regions};
+inline constexpr ptype_descr socket_filter_descr = sk_buff;
+inline constexpr ptype_descr sched_descr = sk_buff;
+inline constexpr ptype_descr xdp_descr = xdp_md;
+inline constexpr ptype_descr lwt_xmit_descr = sk_buff;
+inline constexpr ptype_descr lwt_inout_descr = sk_buff;
+inline constexpr ptype_descr cgroup_sock_descr = {cgroup_sock_regions};
+inline constexpr ptype_descr sock_ops_descr = {sock_ops_regions};
+inline constexpr ptype_descr sk_skb_descr = sk_buff;
 
-inline ptype_descr get_descriptor(BpfProgType t) {
+// The descriptor of a program type, from a table of constants: it is never copied.
+inline const ptype_descr& get_descriptor(BpfProgType t) {
     switch (t) {
     case BpfProgType::UNSPEC: return unspec_descr;
     case BpfProgType::CGROUP_DEVICE: return cgroup_dev_descr;
@@ -150,5 +156,5 @@ inline ptype_descr get_descriptor(BpfProgType t) {
     case BpfProgType::LIRC_MODE2: return sk_msg_md;
     }
     assert(false);
-    return {};
+    return unspec_descr;
 }
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "verifier_coordinator.hpp"
+
+using std::string;
+using std::vector;
+
+// Connection failures in a row after which a connection is given up.
+constexpr unsigned max_failures = 3;
+// The copies of a program that may run at once, on different connections.
+constexpr unsigned max_copies = 2;
+// Larger replies are taken for a broken server.
+constexpr uint32_t max_reply_size = 64u << 20;
+
+static bool read_exactly(int fd, char* buf, size_t size) {
+    while (size > 0) {
+        const ssize_t n = read(fd, buf, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_exactly(int fd, const char* buf, size_t size) {
+    while (size > 0) {
+        const ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void append_u32(string& out, uint32_t v) { out.append((const char*)&v, sizeof v); }
+
+// The request of raw_prog, as verifier_server.hpp describes it, without its length.
+static string make_request(const raw_program& raw_prog) {
+    string request;
+    append_u32(request, (uint32_t)raw_prog.info.program_type);
+    append_u32(request, (uint32_t)raw_prog.info.map_defs->size());
+    for (const map_def& def : *raw_prog.info.map_defs) {
+        append_u32(request, (uint32_t)def.original_fd);
+        append_u32(request, (uint32_t)def.type);
+        append_u32(request, def.key_size);
+        append_u32(request, def.value_size);
+        append_u32(request, def.inner_map_fd);
+    }
+    append_u32(request, (uint32_t)raw_prog.prog.size());
+    request.append((const char*)raw_prog.prog.data(), raw_prog.prog.size() * sizeof(ebpf_inst));
+    return request;
+}
+
+// Send request on fd and read its reply into res; false if the connection failed or the reply is malformed.
+static bool exchange(int fd, const string& request, remote_result_t& res) {
+    const uint32_t size = request.size();
+    if (!write_exactly(fd, (const char*)&size, sizeof size) || !write_exactly(fd, request.data(), request.size()))
+        return false;
+    uint32_t reply_size;
+    if (!read_exactly(fd, (char*)&reply_size, sizeof reply_size) || reply_size > max_reply_size ||
+        reply_size < 3 * sizeof(uint32_t))
+        return false;
+    string reply(reply_size, '\0');
+    if (!read_exactly(fd, reply.data(), reply_size))
+        return false;
+    uint32_t text_size;
+    std::memcpy(&res.status, reply.data(), sizeof(uint32_t));
+    std::memcpy(&res.warnings, reply.data() + sizeof(uint32_t), sizeof(uint32_t));
+    std::memcpy(&text_size, reply.data() + 2 * sizeof(uint32_t), sizeof(uint32_t));
+    if (res.status > 2 || text_size != reply_size - 3 * sizeof(uint32_t))
+        return false;
+    res.text = reply.substr(3 * sizeof(uint32_t));
+    return true;
+}
+
+static int connect_to(const string& socket_path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof addr.sun_path)
+        return -1;
+    std::strcpy(addr.sun_path, socket_path.c_str());
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (const sockaddr*)&addr, sizeof addr) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+namespace {
+
+// A distinct request, and the programs that make it.
+struct task_t {
+    string request;
+    vector<size_t> progs;
+    size_t instructions{};
+    // The connections running it.
+    unsigned running{};
+    bool done{};
+};
+
+/** The tasks of a batch, shared by the threads of the connections.
+ *
+ *  Each connection takes a task, runs it, and then completes it or gives it back. Those still running once every
+ *  task was taken are taken again by idle connections; when one of the copies completes, the connections running
+ *  the others are shut down, as their reply is no longer needed.
+ */
+class coordinator_t final {
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    vector<task_t> _tasks;
+    // The next task never taken.
+    size_t _next{};
+    size_t _done{};
+    // The connections that may still take tasks.
+    size_t _live;
+    // For each connection, the task it runs and its socket, while it runs one.
+    vector<std::optional<size_t>> _running_task;
+    vector<int> _running_fd;
+    const std::function<void(size_t, const remote_result_t&)>& _on_result;
+
+    // The task still running with the fewest copies, the first of the batch on a tie, if one may take another.
+    std::optional<size_t> straggler() const {
+        std::optional<size_t> res;
+        for (size_t t = 0; t < _next; t++) {
+            if (!_tasks[t].done && _tasks[t].running < max_copies &&
+                (!res || _tasks[t].running < _tasks[*res].running))
+                res = t;
+        }
+        return res;
+    }
+
+    // Called with the lock held; on_result is called after it is released, by the caller.
+    vector<size_t> finish(size_t t) {
+        task_t& task = _tasks[t];
+        task.done = true;
+        _done++;
+        for (size_t c = 0; c < _running_task.size(); c++) {
+            if (_running_task[c] == t && _running_fd[c] >= 0)
+                shutdown(_running_fd[c], SHUT_RDWR);
+        }
+        _changed.notify_all();
+        return task.progs;
+    }
+
+  public:
+    coordinator_t(const vector<raw_program>& progs, size_t connections,
+                  const std::function<void(size_t, const remote_result_t&)>& on_result)
+        : _live(connections), _running_task(connections), _running_fd(connections, -1), _on_result(on_result) {
+        std::unordered_map<string, size_t> index;
+        for (size_t i = 0; i < progs.size(); i++) {
+            string request = make_request(progs[i]);
+            auto [it, inserted] = index.emplace(request, _tasks.size());
+            if (inserted)
+                _tasks.push_back(task_t{std::move(request), {}, progs[i].prog.size()});
+            _tasks[it->second].progs.push_back(i);
+        }
+        std::stable_sort(_tasks.begin(), _tasks.end(),
+                         [](const task_t& a, const task_t& b) { return a.instructions > b.instructions; });
+    }
+
+    // The next task for connection c to run, waiting while there is none but some are still running; none once every
+    // task is done.
+    std::optional<size_t> take(size_t c) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            while (_next < _tasks.size() && _tasks[_next].done)
+                _next++;
+            std::optional<size_t> t;
+            if (_next < _tasks.size())
+                t = _next++;
+            else if (_done < _tasks.size())
+                t = straggler();
+            if (t) {
+                _tasks[*t].running++;
+                _running_task[c] = t;
+                return t;
+            }
+            if (_done == _tasks.size())
+                return {};
+            _changed.wait(lock);
+        }
+    }
+
+    const string& request(size_t t) const { return _tasks[t].request; }
+
+    // Connection c runs its task on fd, or no longer does with fd -1; the socket is shut down if the task is done.
+    void set_running_fd(size_t c, int fd) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running_fd[c] = fd;
+        if (fd >= 0 && _tasks[*_running_task[c]].done)
+            shutdown(fd, SHUT_RDWR);
+    }
+
+    void complete(size_t c, size_t t, const remote_result_t& res) {
+        vector<size_t> progs;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks[t].running--;
+            _running_task[c].reset();
+            if (_tasks[t].done)
+                return;
+            progs = finish(t);
+        }
+        for (size_t i : progs)
+            _on_result(i, res);
+    }
+
+    // Connection c failed to run task t, which is taken again; true if t was done elsewhere, as the connection is then
+    // shut down on purpose.
+    bool give_back(size_t c, size_t t) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks[t].running--;
+        _running_task[c].reset();
+        _changed.notify_all();
+        return _tasks[t].done;
+    }
+
+    // Connection c gives up. Once no connection is left, the tasks not done fail.
+    void leave() {
+        vector<size_t> progs;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_live > 0)
+                return;
+            for (size_t t = 0; t < _tasks.size(); t++) {
+                if (!_tasks[t].done) {
+                    const vector<size_t> task_progs = finish(t);
+                    progs.insert(progs.end(), task_progs.begin(), task_progs.end());
+                }
+            }
+        }
+        remote_result_t res;
+        res.text = "no verifier server answered";
+        for (size_t i : progs)
+            _on_result(i, res);
+    }
+};
+
+} // namespace
+
+// Run the tasks of coordinator on connection c to the server at socket_path until every task is done, or the
+// connection fails max_failures times in a row.
+static void run_connection(coordinator_t& coordinator, size_t c, const string& socket_path) {
+    int fd = -1;
+    unsigned failures = 0;
+    while (std::optional<size_t> t = coordinator.take(c)) {
+        if (fd < 0)
+            fd = connect_to(socket_path);
+        remote_result_t res;
+        const auto start = std::chrono::steady_clock::now();
+        bool ok = false;
+        if (fd >= 0) {
+            coordinator.set_running_fd(c, fd);
+            ok = exchange(fd, coordinator.request(*t), res);
+            coordinator.set_running_fd(c, -1);
+        }
+        if (ok) {
+            failures = 0;
+            res.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            coordinator.complete(c, *t, res);
+            continue;
+        }
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        if (coordinator.give_back(c, *t))
+            continue;
+        if (++failures == max_failures)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100 * failures));
+    }
+    if (fd >= 0)
+        close(fd);
+    coordinator.leave();
+}
+
+void verify_on_servers(const vector<raw_program>& progs, const vector<string>& sockets,
+                       unsigned connections_per_server,
+                       const std::function<void(size_t, const remote_result_t&)>& on_result) {
+    if (sockets.empty())
+        throw std::invalid_argument("verify_on_servers: no servers");
+    if (progs.empty())
+        return;
+    const size_t connections = sockets.size() * std::max(1u, connections_per_server);
+    coordinator_t coordinator(progs, connections, on_result);
+    vector<std::thread> threads;
+    for (size_t c = 0; c < connections; c++)
+        threads.emplace_back(run_connection, std::ref(coordinator), c, std::cref(sockets[c % sockets.size()]));
+    for (std::thread& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "spec_type_descriptors.hpp"
+
+/** Verifies a batch of programs on verifier servers (see verifier_server.hpp) rather than in this process.
+ *
+ *  A server is reached through its Unix socket; one on another machine, through a local socket that forwards to it,
+ *  such as ssh -L makes. Each server is given several connections, which it serves on its own threads, and each
+ *  connection one program at a time. Programs that are the same request (instructions, type and maps) are sent once,
+ *  largest first, so that the longest analyses do not end the batch. A program is sent again, on another connection,
+ *  if its connection fails; and once nothing is left to send, the programs still running are sent to the idle
+ *  connections as well, the first reply being taken, so that a slow or stuck server does not hold the batch up.
+ *
+ *  Programs are analyzed with the options of the servers, not with those of this process.
+ */
+struct remote_result_t {
+    // As the server's reply: 0 if the program is verified, 1 if it is rejected, 2 if it could not be analyzed,
+    // including when no server answered.
+    uint32_t status{2};
+    uint32_t warnings{};
+    // Why the program could not be analyzed, or the messages of the analysis.
+    std::string text;
+    // From sending the request to the reply that was taken.
+    double wall_seconds{};
+};
+
+// Verify progs on the servers at sockets, with connections_per_server connections to each. on_result is called once
+// per program, with its index in progs, as soon as it is known, from any of the threads of the connections.
+void verify_on_servers(const std::vector<raw_program>& progs, const std::vector<std::string>& sockets,
+                       unsigned connections_per_server,
+                       const std::function<void(size_t, const remote_result_t&)>& on_result);
@@ -0,0 +1,258 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "ebpf_verifier.hpp"
+#include "verifier_server.hpp"
+
+// Larger messages are taken for a broken client, whose connection is closed.
+constexpr uint32_t max_message_size = 64u << 20;
+// The memory that the requests and replies kept for requests seen again may take.
+constexpr size_t cache_capacity = 256u << 20;
+// The time to wait before accepting again once the process is out of file descriptors.
+constexpr std::chrono::milliseconds accept_backoff{100};
+
+enum class status_t : uint32_t { verified, rejected, error };
+
+// Read exactly size bytes from fd into buf; false at the end of the connection or on an error.
+static bool read_exactly(int fd, char* buf, size_t size) {
+    while (size > 0) {
+        const ssize_t n = read(fd, buf, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_exactly(int fd, const char* buf, size_t size) {
+    while (size > 0) {
+        // Not SIGPIPE if the client went away.
+        const ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Decodes the fields of a request in order. Throws std::runtime_error past its end.
+class request_reader_t final {
+    const std::string& _bytes;
+    size_t _offset{};
+
+  public:
+    explicit request_reader_t(const std::string& bytes) : _bytes(bytes) {}
+
+    const char* take(size_t size) {
+        if (size > _bytes.size() - _offset)
+            throw std::runtime_error("malformed request: truncated");
+        const char* p = _bytes.data() + _offset;
+        _offset += size;
+        return p;
+    }
+
+    uint32_t u32() {
+        uint32_t v;
+        std::memcpy(&v, take(sizeof v), sizeof v);
+        return v;
+    }
+
+    bool done() const { return _offset == _bytes.size(); }
+};
+
+static void append_u32(std::string& out, uint32_t v) { out.append((const char*)&v, sizeof v); }
+
+static std::string make_reply(status_t status, uint32_t warnings, const std::string& text) {
+    std::string reply;
+    append_u32(reply, (uint32_t)status);
+    append_u32(reply, warnings);
+    append_u32(reply, (uint32_t)text.size());
+    reply += text;
+    return reply;
+}
+
+static std::string verify_request(verifier_session_t& session, const std::string& request) {
+    std::vector<ebpf_inst> insts;
+    std::vector<map_def> maps;
+    BpfProgType type;
+    try {
+        request_reader_t in(request);
+        const uint32_t prog_type = in.u32();
+        if (prog_type > (uint32_t)BpfProgType::LIRC_MODE2)
+            throw std::runtime_error("malformed request: unknown program type");
+        type = (BpfProgType)prog_type;
+        for (size_t i = 0, n = in.u32(); i < n; i++) {
+            map_def def{};
+            def.original_fd = (int)in.u32();
+            const uint32_t map_type = in.u32();
+            if (map_type > (uint32_t)MapType::STACK)
+                throw std::runtime_error("malformed request: unknown map type");
+            def.type = (MapType)map_type;
+            def.key_size = in.u32();
+            def.value_size = in.u32();
+            def.inner_map_fd = in.u32();
+            maps.push_back(def);
+        }
+        const uint32_t count = in.u32();
+        const char* bytes = in.take((size_t)count * sizeof(ebpf_inst));
+        insts.resize(count);
+        std::memcpy(insts.data(), bytes, (size_t)count * sizeof(ebpf_inst));
+        if (!in.done())
+            throw std::runtime_error("malformed request: trailing bytes");
+    } catch (const std::runtime_error& e) {
+        return make_reply(status_t::error, 0, e.what());
+    }
+
+    const verifier_session_t::result_t res = session.verify(insts.data(), insts.size(), type, maps);
+    if (!res.error.empty())
+        return make_reply(status_t::error, 0, res.error);
+    std::ostringstream text;
+    for (const auto& [label, messages] : res.messages) {
+        for (const std::string& msg : messages)
+            text << label << ": " << msg << "\n";
+    }
+    return make_reply(res.verified ? status_t::verified : status_t::rejected, res.warnings, text.str());
+}
+
+// The replies to the requests seen last, by request, shared by the threads of the server.
+class reply_cache_t final {
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::string> _replies;
+    // The requests in _replies, oldest first.
+    std::deque<std::string> _order;
+    // The memory that the entries take, by entry_bytes().
+    size_t _bytes{};
+
+    // A request is held twice, as a key of _replies and in _order.
+    static size_t entry_bytes(const std::string& request, const std::string& reply) {
+        return 2 * request.size() + reply.size();
+    }
+
+  public:
+    std::optional<std::string> lookup(const std::string& request) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _replies.find(request);
+        if (it == _replies.end())
+            return {};
+        return it->second;
+    }
+
+    void store(const std::string& request, const std::string& reply) {
+        const size_t bytes = entry_bytes(request, reply);
+        if (bytes > cache_capacity)
+            return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_replies.emplace(request, reply).second)
+            return;
+        _order.push_back(request);
+        _bytes += bytes;
+        while (_bytes > cache_capacity) {
+            auto oldest = _replies.find(_order.front());
+            _bytes -= entry_bytes(oldest->first, oldest->second);
+            _replies.erase(oldest);
+            _order.pop_front();
+        }
+    }
+};
+
+// Answer the requests of one connection until the client closes it.
+static void serve_connection(int fd, verifier_session_t& session, reply_cache_t* cache) {
+    std::string request;
+    while (true) {
+        uint32_t size;
+        if (!read_exactly(fd, (char*)&size, sizeof size) || size > max_message_size)
+            return;
+        request.resize(size);
+        if (!read_exactly(fd, request.data(), size))
+            return;
+
+        std::optional<std::string> reply = cache ? cache->lookup(request) : std::nullopt;
+        if (!reply) {
+            reply = verify_request(session, request);
+            if (cache)
+                cache->store(request, *reply);
+        }
+        const uint32_t reply_size = reply->size();
+        if (!write_exactly(fd, (const char*)&reply_size, sizeof reply_size) ||
+            !write_exactly(fd, reply->data(), reply->size()))
+            return;
+    }
+}
+
+int serve_verifier(const std::string& socket_path, unsigned threads) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof addr.sun_path) {
+        std::cerr << "socket path too long: " << socket_path << "\n";
+        return 64;
+    }
+    std::strcpy(addr.sun_path, socket_path.c_str());
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        std::cerr << "cannot create a socket: " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    // A socket left by a server that did not exit cleanly.
+    struct stat st;
+    if (lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path.c_str());
+    if (bind(listener, (const sockaddr*)&addr, sizeof addr) < 0 || listen(listener, SOMAXCONN) < 0) {
+        std::cerr << "cannot listen on " << socket_path << ": " << std::strerror(errno) << "\n";
+        close(listener);
+        return 2;
+    }
+
+    reply_cache_t cache;
+    reply_cache_t* const shared_cache =
+        (global_options.timeout_seconds > 0 || global_options.max_rss_mb > 0) ? nullptr : &cache;
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back([&] {
+            verifier_session_t session;
+            while (true) {
+                const int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    // Out of file descriptors until some connection is closed; accepting again at once would spin.
+                    if (errno == EMFILE || errno == ENFILE) {
+                        std::this_thread::sleep_for(accept_backoff);
+                        continue;
+                    }
+                    std::cerr << "accept: " << std::strerror(errno) << "\n";
+                    return;
+                }
+                serve_connection(fd, session, shared_cache);
+                close(fd);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    close(listener);
+    return 2;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+/** Serves verification requests on a Unix stream socket, from a process that stays up between them.
+ *
+ *  Each client sends any number of requests on its connection and reads the reply to each before the next is
+ *  answered. Messages are a 32-bit length, followed by that many bytes; every integer is 32 bits, in the byte order of
+ *  the host. A request holds:
+ *
+ *      program type
+ *      map count, then for each map: fd, type, key size, value size, inner map fd
+ *      instruction count, then the instructions, 8 bytes each
+ *
+ *  as verifier_session_t::verify() takes them, and its reply:
+ *
+ *      status: 0 if the program is verified, 1 if it is rejected, 2 if it could not be analyzed
+ *      warning count
+ *      text length, then the text: why the program could not be analyzed, or the messages of the analysis, one per
+ *      line as "label: message"
+ *
+ *  A request that cannot be decoded is answered with status 2, and the connection goes on with the next one.
+ *
+ *  Connections are served concurrently by a fixed set of threads, each with its own verifier_session_t, so that the
+ *  analysis state a thread makes, such as its variables, is reused from one request to the next. Replies are kept in
+ *  memory for the requests seen last, up to 256 MB with the requests, and a request seen again is answered from there,
+ *  unless global_options sets a time or memory budget, which make the result depend on the machine. When the process
+ *  runs out of file descriptors, new connections wait until some are closed.
+ */
+
+// Serve on a socket created at socket_path, replacing a stale socket there, with the given number of threads.
+// Runs until the process is interrupted; returns only if the socket cannot be created, with an exit code.
+int serve_verifier(const std::string& socket_path, unsigned threads);